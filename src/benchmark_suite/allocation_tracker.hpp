@@ -0,0 +1,339 @@
+// ----------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef CPP_STREAMS__ALLOCATION_TRACKER__INCLUDE_GUARD
+# define CPP_STREAMS__ALLOCATION_TRACKER__INCLUDE_GUARD
+// ----------------------------------------------------------------------------
+# include "../cpp_streams/cpp_streams_instrument.hpp"
+// ----------------------------------------------------------------------------
+# include <array>
+# include <atomic>
+# include <cstddef>
+# include <cstdint>
+# include <cstdlib>
+# include <cstring>
+# include <new>
+// ----------------------------------------------------------------------------
+// Allocation tracking
+//  The global allocation functions are replaced (once, see
+//  CPP_STREAMS__REPLACE_GLOBAL_NEW) with ones that prefix every block with
+//  its size so that deallocations can be counted as well. Counting is only
+//  done between start and stop, blocks allocated before start (or by an
+//  earlier start) don't affect the live bytes when released.
+//
+//  A reallocation is an allocation immediately followed by the release of a
+//  smaller block, which is how std::vector and std::string grow.
+//
+//  Built with CPP_STREAMS__INSTRUMENT the allocations made by the buffering
+//  operators (reverse, sort, to_map, to_set, to_vector) are also counted
+//  per operator, see cpp_streams::allocation_owner
+// ----------------------------------------------------------------------------
+namespace benchmark_suite
+{
+  // --------------------------------------------------------------------------
+
+  // More operators than this aren't attributed
+  constexpr std::size_t max_allocation_owners = 16;
+
+  struct owner_allocations
+  {
+    // nullptr for unused entries
+    char const *  name            = nullptr;
+    std::uint64_t allocations     = 0      ;
+    std::uint64_t allocated_bytes = 0      ;
+  };
+
+  struct allocation_statistics
+  {
+    // False when the global allocation functions aren't replaced
+    bool          tracked         = false;
+    std::uint64_t allocations     = 0    ;
+    std::uint64_t deallocations   = 0    ;
+    std::uint64_t reallocations   = 0    ;
+    std::uint64_t allocated_bytes = 0    ;
+    // The most bytes allocated since start and not yet released
+    std::uint64_t peak_bytes      = 0    ;
+    // Allocations by operator, empty unless built with CPP_STREAMS__INSTRUMENT
+    std::array<owner_allocations, max_allocation_owners> owners;
+  };
+
+  // --------------------------------------------------------------------------
+
+  class allocation_tracker
+  {
+    // Keeps the blocks returned aligned as operator new requires
+    static constexpr std::size_t header_size = alignof (std::max_align_t);
+
+    struct header
+    {
+      std::size_t   size        ;
+      // The start that counted the block, 0 when not counted
+      std::uint64_t generation  ;
+    };
+
+    static_assert (sizeof (header) <= header_size, "header must fit in header_size");
+
+    struct owner_state
+    {
+      std::atomic<char const *>   name            {nullptr};
+      std::atomic<std::uint64_t>  allocations     {0};
+      std::atomic<std::uint64_t>  allocated_bytes {0};
+    };
+
+    struct state
+    {
+      std::atomic<bool>           replaced        {false};
+      std::atomic<bool>           enabled         {false};
+      std::atomic<std::uint64_t>  generation      {0};
+      std::atomic<std::uint64_t>  allocations     {0};
+      std::atomic<std::uint64_t>  deallocations   {0};
+      std::atomic<std::uint64_t>  reallocations   {0};
+      std::atomic<std::uint64_t>  allocated_bytes {0};
+      std::atomic<std::int64_t>   live_bytes      {0};
+      std::atomic<std::int64_t>   peak_bytes      {0};
+      // Size of the latest allocation if nothing was released since
+      std::atomic<std::size_t>    last_allocation {0};
+      // Claimed in order of first allocation since start
+      owner_state                 owners[max_allocation_owners];
+    };
+
+    // Constant initialized so that allocations made before main are safe
+    static state & current () noexcept
+    {
+      static state s;
+      return s;
+    }
+
+    // Adds the allocation to the operator allocating on this thread, if any
+    static void count_owner (state & s, std::size_t size) noexcept
+    {
+      auto const owner = cpp_streams::allocation_owner ();
+      if (!owner)
+      {
+        return;
+      }
+
+      for (auto && o : s.owners)
+      {
+        auto name = o.name.load (std::memory_order_acquire);
+        if (!name && o.name.compare_exchange_strong (name, owner, std::memory_order_acq_rel))
+        {
+          name = owner;
+        }
+
+        if (name == owner || std::strcmp (name, owner) == 0)
+        {
+          o.allocations.fetch_add (1, std::memory_order_relaxed);
+          o.allocated_bytes.fetch_add (size, std::memory_order_relaxed);
+          return;
+        }
+      }
+    }
+
+  public:
+    // Returns nullptr when out of memory
+    static void * try_allocate (std::size_t size) noexcept
+    {
+      auto & s = current ();
+      s.replaced.store (true, std::memory_order_relaxed);
+
+      auto const block = static_cast<char *> (std::malloc (size + header_size));
+      if (!block)
+      {
+        return nullptr;
+      }
+
+      auto const tracked    = s.enabled.load (std::memory_order_relaxed);
+      auto const generation = tracked ? s.generation.load (std::memory_order_relaxed) : 0U;
+      ::new (block) header {size, generation};
+
+      if (tracked)
+      {
+        s.allocations.fetch_add (1, std::memory_order_relaxed);
+        s.allocated_bytes.fetch_add (size, std::memory_order_relaxed);
+        s.last_allocation.store (size, std::memory_order_relaxed);
+        count_owner (s, size);
+
+        auto const live = s.live_bytes.fetch_add (static_cast<std::int64_t> (size), std::memory_order_relaxed) + static_cast<std::int64_t> (size);
+        auto peak       = s.peak_bytes.load (std::memory_order_relaxed);
+        while (live > peak && !s.peak_bytes.compare_exchange_weak (peak, live, std::memory_order_relaxed))
+        {
+        }
+      }
+
+      return block + header_size;
+    }
+
+    static void * allocate (std::size_t size)
+    {
+      // operator new must return a unique pointer for 0 bytes as well
+      auto const result = try_allocate (size > 0 ? size : 1);
+      if (!result)
+      {
+        throw std::bad_alloc ();
+      }
+      return result;
+    }
+
+    static void deallocate (void * ptr) noexcept
+    {
+      if (!ptr)
+      {
+        return;
+      }
+
+      auto & s          = current ();
+      auto const block  = static_cast<char *> (ptr) - header_size;
+      auto const h      = *reinterpret_cast<header const *> (block);
+
+      if (s.enabled.load (std::memory_order_relaxed))
+      {
+        s.deallocations.fetch_add (1, std::memory_order_relaxed);
+
+        auto const last = s.last_allocation.exchange (0, std::memory_order_relaxed);
+        if (h.size < last)
+        {
+          s.reallocations.fetch_add (1, std::memory_order_relaxed);
+        }
+
+        if (h.generation == s.generation.load (std::memory_order_relaxed))
+        {
+          s.live_bytes.fetch_sub (static_cast<std::int64_t> (h.size), std::memory_order_relaxed);
+        }
+      }
+
+      std::free (block);
+    }
+
+    // Resets the counts and starts counting allocations
+    static void start () noexcept
+    {
+      auto & s = current ();
+      s.allocations.store (0, std::memory_order_relaxed);
+      s.deallocations.store (0, std::memory_order_relaxed);
+      s.reallocations.store (0, std::memory_order_relaxed);
+      s.allocated_bytes.store (0, std::memory_order_relaxed);
+      s.live_bytes.store (0, std::memory_order_relaxed);
+      s.peak_bytes.store (0, std::memory_order_relaxed);
+      s.last_allocation.store (0, std::memory_order_relaxed);
+      for (auto && o : s.owners)
+      {
+        o.name.store (nullptr, std::memory_order_relaxed);
+        o.allocations.store (0, std::memory_order_relaxed);
+        o.allocated_bytes.store (0, std::memory_order_relaxed);
+      }
+      s.generation.fetch_add (1, std::memory_order_relaxed);
+      s.enabled.store (true, std::memory_order_seq_cst);
+    }
+
+    // Stops counting allocations and returns the counts since start
+    static allocation_statistics stop () noexcept
+    {
+      auto & s = current ();
+      s.enabled.store (false, std::memory_order_seq_cst);
+
+      allocation_statistics result;
+      result.tracked          = s.replaced.load (std::memory_order_relaxed);
+      result.allocations      = s.allocations.load (std::memory_order_relaxed);
+      result.deallocations    = s.deallocations.load (std::memory_order_relaxed);
+      result.reallocations    = s.reallocations.load (std::memory_order_relaxed);
+      result.allocated_bytes  = s.allocated_bytes.load (std::memory_order_relaxed);
+      result.peak_bytes       = static_cast<std::uint64_t> (s.peak_bytes.load (std::memory_order_relaxed));
+      for (auto iter = 0U; iter < max_allocation_owners; ++iter)
+      {
+        auto & o                  = result.owners[iter];
+        o.name                    = s.owners[iter].name.load (std::memory_order_acquire);
+        o.allocations             = s.owners[iter].allocations.load (std::memory_order_relaxed);
+        o.allocated_bytes         = s.owners[iter].allocated_bytes.load (std::memory_order_relaxed);
+      }
+      return result;
+    }
+  };
+
+  // --------------------------------------------------------------------------
+
+  // Counts the allocations of a single run (), including those released when
+  //  the value it returns is destroyed
+  template<typename TRun>
+  allocation_statistics track_allocations (TRun && run)
+  {
+    allocation_tracker::start ();
+    {
+      auto const result = run ();
+      (void)result;
+    }
+    return allocation_tracker::stop ();
+  }
+
+  // --------------------------------------------------------------------------
+
+}
+// ----------------------------------------------------------------------------
+// Defined in exactly one translation unit to replace the global allocation
+//  functions with the tracking ones
+# ifdef CPP_STREAMS__REPLACE_GLOBAL_NEW
+void * operator new (std::size_t size)
+{
+  return benchmark_suite::allocation_tracker::allocate (size);
+}
+
+void * operator new[] (std::size_t size)
+{
+  return benchmark_suite::allocation_tracker::allocate (size);
+}
+
+void * operator new (std::size_t size, std::nothrow_t const &) noexcept
+{
+  return benchmark_suite::allocation_tracker::try_allocate (size > 0 ? size : 1);
+}
+
+void * operator new[] (std::size_t size, std::nothrow_t const &) noexcept
+{
+  return benchmark_suite::allocation_tracker::try_allocate (size > 0 ? size : 1);
+}
+
+void operator delete (void * ptr) noexcept
+{
+  benchmark_suite::allocation_tracker::deallocate (ptr);
+}
+
+void operator delete[] (void * ptr) noexcept
+{
+  benchmark_suite::allocation_tracker::deallocate (ptr);
+}
+
+void operator delete (void * ptr, std::size_t) noexcept
+{
+  benchmark_suite::allocation_tracker::deallocate (ptr);
+}
+
+void operator delete[] (void * ptr, std::size_t) noexcept
+{
+  benchmark_suite::allocation_tracker::deallocate (ptr);
+}
+
+void operator delete (void * ptr, std::nothrow_t const &) noexcept
+{
+  benchmark_suite::allocation_tracker::deallocate (ptr);
+}
+
+void operator delete[] (void * ptr, std::nothrow_t const &) noexcept
+{
+  benchmark_suite::allocation_tracker::deallocate (ptr);
+}
+# endif
+// ----------------------------------------------------------------------------
+#endif // CPP_STREAMS__ALLOCATION_TRACKER__INCLUDE_GUARD
+// ----------------------------------------------------------------------------
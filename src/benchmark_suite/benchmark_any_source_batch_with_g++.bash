@@ -0,0 +1,9 @@
+# Runs the any_source benchmarks with batches of different sizes, the size
+#  used by default is CPP_STREAMS__ANY_SOURCE_BATCH_BYTES in cpp_streams_any.hpp
+FLAGS="-g -O2 -DNDEBUG -Wall -pedantic --std=c++1y -pthread"
+for BYTES in 256 1024 4096 16384 65536
+do
+  BATCH_FLAGS="$FLAGS -DCPP_STREAMS__ANY_SOURCE_BATCH_BYTES=$BYTES"
+  echo "CPP_STREAMS__ANY_SOURCE_BATCH_BYTES=$BYTES"
+  g++ $BATCH_FLAGS -DCPP_STREAMS__BENCHMARK_FLAGS="\"$BATCH_FLAGS\"" benchmark_suite.cpp -o benchmark_suite_any_batch_g++.out && ./benchmark_suite_any_batch_g++.out --filter any_source "$@" || exit 1
+done
@@ -0,0 +1,541 @@
+// ----------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef CPP_STREAMS__BENCHMARK_HARNESS__INCLUDE_GUARD
+# define CPP_STREAMS__BENCHMARK_HARNESS__INCLUDE_GUARD
+// ----------------------------------------------------------------------------
+# include <algorithm>
+# include <chrono>
+# include <cmath>
+# include <cstdint>
+# include <iomanip>
+# include <iostream>
+# include <memory>
+# include <string>
+# include <utility>
+# include <vector>
+# ifdef _MSC_VER
+#   include <intrin.h>
+# endif
+
+# include "allocation_tracker.hpp"
+# include "data_generators.hpp"
+# include "performance_counters.hpp"
+// ----------------------------------------------------------------------------
+// Benchmark strategy:
+//  Each benchmark is a pair of a hand-written loop and the equivalent
+//  pipeline, both returning a checksum that must match. A benchmark is run
+//  once to calibrate how many runs fill a sample, then warmed up and sampled
+//  repeatedly. Timings are reported per run and per element as median and
+//  p99 so that a few preempted samples don't skew the result
+// ----------------------------------------------------------------------------
+namespace benchmark_suite
+{
+  // --------------------------------------------------------------------------
+
+  using clock_type = std::chrono::steady_clock;
+
+  // --------------------------------------------------------------------------
+
+  // Forces v to be computed and assumes all memory might have changed so
+  //  that benchmark runs aren't hoisted out of the sample loop
+  template<typename T>
+  inline void do_not_optimize (T const & v)
+  {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile ("" : : "r,m" (v) : "memory");
+#else
+    auto volatile sink = *reinterpret_cast<char const volatile *> (&v);
+    (void)sink;
+    _ReadWriteBarrier ();
+#endif
+  }
+
+  // --------------------------------------------------------------------------
+
+  struct benchmark_options
+  {
+    std::size_t               warmup_samples    = 2             ;
+    std::size_t               min_samples       = 5             ;
+    std::size_t               max_samples       = 31            ;
+    // A sample repeats the benchmark until it takes at least this long
+    double                    min_sample_ns     = 2e6           ;
+    // Fewer samples (but at least min_samples) are taken of slow benchmarks
+    double                    max_benchmark_ns  = 5e8           ;
+    // The largest data set, in bytes, per element type
+    std::size_t               max_bytes         = 64U << 20     ;
+    // Every data set is created with each distribution from the same seed
+    std::vector<distribution> distributions     {distribution::uniform};
+    std::uint64_t             seed              = 19740531      ;
+    // Only benchmarks whose name/type/elements contains filter are run
+    std::string               filter            ;
+    // Collects performance counters during the samples
+    bool                      counters          = false         ;
+    // Counts the allocations of an extra, untimed, run
+    bool                      allocations       = false         ;
+  };
+
+  // --------------------------------------------------------------------------
+
+  // Statistics of the time of a single run of a benchmark in nanoseconds
+  struct benchmark_statistics
+  {
+    std::size_t samples         = 0;
+    std::size_t runs_per_sample = 0;
+    double      min_ns          = 0;
+    double      median_ns       = 0;
+    double      mean_ns         = 0;
+    double      p99_ns          = 0;
+    double      stddev_ns       = 0;
+    // Median absolute deviation, a spread that tolerates outliers
+    double      mad_ns          = 0;
+  };
+
+  inline benchmark_statistics compute_statistics (std::vector<double> sample_ns, std::size_t runs_per_sample)
+  {
+    benchmark_statistics result;
+
+    auto const count = sample_ns.size ();
+    if (count == 0)
+    {
+      return result;
+    }
+
+    for (auto && v : sample_ns)
+    {
+      v /= static_cast<double> (runs_per_sample);
+    }
+
+    std::sort (sample_ns.begin (), sample_ns.end ());
+
+    auto sum = 0.0;
+    for (auto v : sample_ns)
+    {
+      sum += v;
+    }
+
+    auto const mean = sum / static_cast<double> (count);
+
+    auto squares = 0.0;
+    for (auto v : sample_ns)
+    {
+      squares += (v - mean) * (v - mean);
+    }
+
+    // Nearest rank percentile
+    auto const p99_rank = static_cast<std::size_t> (std::ceil (0.99 * static_cast<double> (count)));
+
+    result.samples          = count;
+    result.runs_per_sample  = runs_per_sample;
+    result.min_ns           = sample_ns.front ();
+    result.median_ns        = count % 2 == 1
+      ? sample_ns[count / 2]
+      : (sample_ns[count / 2 - 1] + sample_ns[count / 2]) / 2
+      ;
+    result.mean_ns          = mean;
+    result.p99_ns           = sample_ns[p99_rank > 0 ? p99_rank - 1 : 0];
+    result.stddev_ns        = count > 1 ? std::sqrt (squares / static_cast<double> (count - 1)) : 0.0;
+
+    for (auto && v : sample_ns)
+    {
+      v = std::abs (v - result.median_ns);
+    }
+
+    std::sort (sample_ns.begin (), sample_ns.end ());
+
+    result.mad_ns           = count % 2 == 1
+      ? sample_ns[count / 2]
+      : (sample_ns[count / 2 - 1] + sample_ns[count / 2]) / 2
+      ;
+
+    return result;
+  }
+
+  // --------------------------------------------------------------------------
+
+  struct benchmark_measurement
+  {
+    benchmark_statistics  statistics  ;
+    counter_values        counters    ;
+    allocation_statistics allocations ;
+  };
+
+  // --------------------------------------------------------------------------
+
+  struct benchmark_result
+  {
+    std::string           name          ;
+    std::string           variant       ;
+    std::string           element_type  ;
+    std::size_t           elements      = 0;
+    benchmark_statistics  statistics    ;
+    counter_values        counters      ;
+    allocation_statistics allocations   ;
+
+    double ns_per_element (double ns) const noexcept
+    {
+      return elements > 0 ? ns / static_cast<double> (elements) : ns;
+    }
+  };
+
+  // --------------------------------------------------------------------------
+
+  class benchmark_runner
+  {
+  public:
+    explicit benchmark_runner (benchmark_options options)
+      : opts    (std::move (options))
+      , errors  (0)
+    {
+      if (!opts.counters)
+      {
+        return;
+      }
+
+      counters = std::make_unique<performance_counters> ();
+
+      if (!counters->any ())
+      {
+        std::cout << "Performance counters unavailable: " << counters->unavailable_reason () << std::endl;
+        counters.reset ();
+      }
+      else if (!counters->has_hardware ())
+      {
+        std::cout << "Hardware performance counters unavailable: " << counters->unavailable_reason () << std::endl;
+      }
+    }
+
+    benchmark_options const & options () const noexcept
+    {
+      return opts;
+    }
+
+    std::vector<benchmark_result> const & results () const noexcept
+    {
+      return all_results;
+    }
+
+    std::size_t error_count () const noexcept
+    {
+      return errors;
+    }
+
+    bool is_selected (std::string const & id) const
+    {
+      return opts.filter.empty () || id.find (opts.filter) != std::string::npos;
+    }
+
+    // Times run () which should return the value to keep alive
+    template<typename TRun>
+    benchmark_measurement measure (TRun && run)
+    {
+      auto const runs     = calibrate (run);
+      auto const samples  = sample_count (runs.second);
+
+      std::vector<double>               sample_ns ;
+      performance_counters::accumulator counted   ;
+      sample_ns.reserve (samples);
+
+      for (auto iter = 0U; iter < samples; ++iter)
+      {
+        sample_ns.push_back (time_sample (run, runs.first, &counted));
+      }
+
+      return make_measurement (std::move (sample_ns), runs.first, counted);
+    }
+
+    // Times the samples of first and second alternately so that both are
+    //  equally affected by frequency scaling and other load on the machine
+    template<typename TFirst, typename TSecond>
+    std::pair<benchmark_measurement, benchmark_measurement> measure_interleaved (TFirst && first, TSecond && second)
+    {
+      auto const first_runs   = calibrate (first);
+      auto const second_runs  = calibrate (second);
+      auto const samples      = sample_count (first_runs.second + second_runs.second);
+
+      std::vector<double>               first_ns        ;
+      std::vector<double>               second_ns       ;
+      performance_counters::accumulator first_counted   ;
+      performance_counters::accumulator second_counted  ;
+      first_ns.reserve (samples);
+      second_ns.reserve (samples);
+
+      for (auto iter = 0U; iter < samples; ++iter)
+      {
+        first_ns.push_back (time_sample (first, first_runs.first, &first_counted));
+        second_ns.push_back (time_sample (second, second_runs.first, &second_counted));
+      }
+
+      return std::make_pair (
+          make_measurement (std::move (first_ns), first_runs.first, first_counted)
+        , make_measurement (std::move (second_ns), second_runs.first, second_counted)
+        );
+    }
+
+    // Benchmarks a hand-written loop against the equivalent pipeline,
+    //  both return a checksum which must be equal
+    template<typename TLoop, typename TPipeline>
+    void compare (char const * name, char const * element_type, std::size_t elements, TLoop && loop, TPipeline && pipeline)
+    {
+      auto const id = std::string (name) + "/" + element_type + "/" + std::to_string (elements);
+      if (!is_selected (id))
+      {
+        return;
+      }
+
+      auto const expected = loop ();
+      auto const actual   = pipeline ();
+      if (!(expected == actual))
+      {
+        ++errors;
+        std::cout
+          << "CHECKSUM MISMATCH: "
+          << id
+          << ", loop: "
+          << expected
+          << ", pipeline: "
+          << actual
+          << std::endl
+          ;
+      }
+
+      auto measurements = measure_interleaved (loop, pipeline);
+
+      if (opts.allocations)
+      {
+        measurements.first.allocations  = track_allocations (loop);
+        measurements.second.allocations = track_allocations (pipeline);
+      }
+
+      auto const loop_result      = add_result (name, "loop"        , element_type, elements, measurements.first);
+      auto const pipeline_result  = add_result (name, "cpp_streams" , element_type, elements, measurements.second);
+
+      print_row (loop_result, pipeline_result);
+    }
+
+    static void print_header ()
+    {
+      std::cout
+        << std::left
+        << std::setw (20) << "benchmark"
+        << std::setw (24) << "type"
+        << std::right
+        << std::setw (10) << "elements"
+        << std::setw (12) << "loop ns/el"
+        << std::setw (12) << "p99"
+        << std::setw (12) << "cs ns/el"
+        << std::setw (12) << "p99"
+        << std::setw (8)  << "ratio"
+        << std::endl
+        ;
+    }
+
+  private:
+    // Returns the runs per sample and the estimated time of a sample after
+    //  warming up
+    template<typename TRun>
+    std::pair<std::size_t, double> calibrate (TRun & run)
+    {
+      auto const first  = time_sample (run, 1);
+      auto const runs   = first >= opts.min_sample_ns
+        ? 1U
+        : static_cast<std::size_t> (opts.min_sample_ns / (first > 1.0 ? first : 1.0)) + 1U
+        ;
+
+      auto sample_ns = first * static_cast<double> (runs);
+      for (auto iter = 0U; iter < opts.warmup_samples; ++iter)
+      {
+        sample_ns = time_sample (run, runs);
+      }
+
+      return std::make_pair (runs, sample_ns);
+    }
+
+    std::size_t sample_count (double sample_ns) const noexcept
+    {
+      auto const budget = static_cast<std::size_t> (opts.max_benchmark_ns / (sample_ns > 1.0 ? sample_ns : 1.0));
+      return std::min (std::max (budget, opts.min_samples), opts.max_samples);
+    }
+
+    // Counts are only collected when counted isn't null
+    template<typename TRun>
+    double time_sample (TRun & run, std::size_t runs, performance_counters::accumulator * counted = nullptr)
+    {
+      auto const before = counted && counters ? counters->read () : performance_counters::snapshot ();
+      auto const then   = clock_type::now ();
+
+      for (auto iter = 0U; iter < runs; ++iter)
+      {
+        do_not_optimize (run ());
+      }
+
+      auto const now    = clock_type::now ();
+
+      if (counted && counters)
+      {
+        performance_counters::accumulate (before, counters->read (), runs, *counted);
+      }
+
+      return std::chrono::duration<double, std::nano> (now - then).count ();
+    }
+
+    benchmark_measurement make_measurement (std::vector<double> sample_ns, std::size_t runs_per_sample, performance_counters::accumulator const & counted) const
+    {
+      benchmark_measurement result;
+      result.statistics = compute_statistics (std::move (sample_ns), runs_per_sample);
+      if (counters)
+      {
+        result.counters = counted.per_run (*counters);
+      }
+      return result;
+    }
+
+    benchmark_result add_result (char const * name, char const * variant, char const * element_type, std::size_t elements, benchmark_measurement const & measurement)
+    {
+      benchmark_result result;
+      result.name         = name;
+      result.variant      = variant;
+      result.element_type = element_type;
+      result.elements     = elements;
+      result.statistics   = measurement.statistics;
+      result.counters     = measurement.counters;
+      result.allocations  = measurement.allocations;
+
+      all_results.push_back (result);
+
+      return result;
+    }
+
+    static void print_row (benchmark_result const & loop, benchmark_result const & pipeline)
+    {
+      auto const ratio = loop.statistics.median_ns > 0
+        ? pipeline.statistics.median_ns / loop.statistics.median_ns
+        : 0.0
+        ;
+
+      std::cout
+        << std::left
+        << std::setw (20) << loop.name
+        << std::setw (24) << loop.element_type
+        << std::right
+        << std::setw (10) << loop.elements
+        << std::fixed << std::setprecision (3)
+        << std::setw (12) << loop.ns_per_element (loop.statistics.median_ns)
+        << std::setw (12) << loop.ns_per_element (loop.statistics.p99_ns)
+        << std::setw (12) << pipeline.ns_per_element (pipeline.statistics.median_ns)
+        << std::setw (12) << pipeline.ns_per_element (pipeline.statistics.p99_ns)
+        << std::setprecision (2)
+        << std::setw (8)  << ratio
+        << std::defaultfloat
+        << std::endl
+        ;
+
+      print_counters (loop);
+      print_counters (pipeline);
+      print_allocations (loop);
+      print_allocations (pipeline);
+    }
+
+    // Hardware counts are per element, software counts per run
+    static void print_counters (benchmark_result const & v)
+    {
+      auto const & c = v.counters;
+      if (!c.any ())
+      {
+        return;
+      }
+
+      auto const per_element = [&v] (double count)
+      {
+        return v.elements > 0 ? count / static_cast<double> (v.elements) : count;
+      };
+
+      std::cout
+        << "  "
+        << std::left << std::setw (12) << v.variant << std::right
+        << std::fixed << std::setprecision (3)
+        ;
+
+      if (c.ipc () >= 0)
+      {
+        std::cout << " ipc " << c.ipc ();
+      }
+
+      static char const * const labels[] = {"cyc/el", "ins/el", "br/el", "br-miss/el", "l1d-miss/el", "llc-miss/el"};
+      for (auto iter = 0U; iter < first_software_counter; ++iter)
+      {
+        if (c.values[iter] >= 0)
+        {
+          std::cout << " " << labels[iter] << " " << per_element (c.values[iter]);
+        }
+      }
+
+      if (c.has (counter_kind::context_switches))
+      {
+        std::cout << " ctx-sw/run " << c[counter_kind::context_switches];
+      }
+
+      if (c.has (counter_kind::page_faults))
+      {
+        std::cout << " faults/run " << c[counter_kind::page_faults];
+      }
+
+      std::cout
+        << std::defaultfloat
+        << std::endl
+        ;
+    }
+
+    // Counts per run
+    static void print_allocations (benchmark_result const & v)
+    {
+      auto const & a = v.allocations;
+      if (!a.tracked)
+      {
+        return;
+      }
+
+      std::cout
+        << "  "
+        << std::left << std::setw (12) << v.variant << std::right
+        << " allocs "   << a.allocations
+        << " reallocs " << a.reallocations
+        << " bytes "    << a.allocated_bytes
+        << " peak "     << a.peak_bytes
+        ;
+
+      for (auto && o : a.owners)
+      {
+        if (o.name)
+        {
+          std::cout << " | " << o.name << " allocs " << o.allocations << " bytes " << o.allocated_bytes;
+        }
+      }
+
+      std::cout << std::endl;
+    }
+
+    benchmark_options                     opts        ;
+    std::size_t                           errors      ;
+    std::vector<benchmark_result>         all_results ;
+    std::unique_ptr<performance_counters> counters    ;
+  };
+
+  // --------------------------------------------------------------------------
+
+}
+// ----------------------------------------------------------------------------
+#endif // CPP_STREAMS__BENCHMARK_HARNESS__INCLUDE_GUARD
+// ----------------------------------------------------------------------------
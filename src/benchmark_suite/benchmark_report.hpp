@@ -0,0 +1,613 @@
+// ----------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef CPP_STREAMS__BENCHMARK_REPORT__INCLUDE_GUARD
+# define CPP_STREAMS__BENCHMARK_REPORT__INCLUDE_GUARD
+// ----------------------------------------------------------------------------
+# include "../cpp_streams/cpp_streams.hpp"
+# include "../cpp_streams/cpp_streams_io.hpp"
+# include "benchmark_harness.hpp"
+
+# include <algorithm>
+# include <cmath>
+# include <cstring>
+# include <ctime>
+# include <iomanip>
+# include <iostream>
+# include <map>
+# include <string>
+# include <tuple>
+# include <vector>
+# ifdef _MSC_VER
+#   include <intrin.h>
+# endif
+// ----------------------------------------------------------------------------
+// Benchmark reports
+//  Results are written as CSV (one row per benchmark and variant, the
+//  environment repeated on each row so rows can be concatenated) or as JSON
+//  (the environment once followed by the results). A CSV report serves as
+//  the baseline a later run is compared against
+// ----------------------------------------------------------------------------
+// Set by the build scripts, otherwise a few predefined macros are listed
+# ifndef CPP_STREAMS__BENCHMARK_FLAGS
+#   define CPP_STREAMS__BENCHMARK_FLAGS ""
+# endif
+// ----------------------------------------------------------------------------
+namespace benchmark_suite
+{
+  // --------------------------------------------------------------------------
+
+  struct benchmark_environment
+  {
+    std::string compiler  ;
+    std::string flags     ;
+    std::string cpu       ;
+    // UTC, ISO 8601
+    std::string timestamp ;
+  };
+
+  inline std::string compiler_description ()
+  {
+#if defined(__clang__)
+    return std::string ("clang++ ") + __clang_version__;
+#elif defined(__GNUC__)
+    return std::string ("g++ ") + __VERSION__;
+#elif defined(_MSC_VER)
+    return "msvc " + std::to_string (_MSC_FULL_VER);
+#else
+    return "unknown";
+#endif
+  }
+
+  inline std::string flags_description ()
+  {
+    std::string result = CPP_STREAMS__BENCHMARK_FLAGS;
+    if (!result.empty ())
+    {
+      return result;
+    }
+
+#ifdef __OPTIMIZE__
+    result += " __OPTIMIZE__";
+#endif
+#ifdef NDEBUG
+    result += " NDEBUG";
+#endif
+#ifdef __AVX2__
+    result += " __AVX2__";
+#endif
+#ifdef _M_X64
+    result += " _M_X64";
+#endif
+
+    return result.empty () ? result : result.substr (1);
+  }
+
+  inline std::string cpu_description ()
+  {
+#if defined(_MSC_VER)
+    int info[4] = {};
+    __cpuid (info, 0x80000000);
+    if (static_cast<unsigned> (info[0]) < 0x80000004U)
+    {
+      return "unknown";
+    }
+
+    char brand[49] = {};
+    for (auto iter = 0; iter < 3; ++iter)
+    {
+      __cpuid (info, 0x80000002 + iter);
+      std::memcpy (brand + iter * 16, info, sizeof (info));
+    }
+    return brand;
+#elif defined(__linux__)
+    using namespace cpp_streams;
+
+    try
+    {
+      auto const prefixes = {text_view ("model name"), text_view ("Hardware"), text_view ("cpu model")};
+
+      auto const model =
+            from_lines ("/proc/cpuinfo")
+        >>  filter ([prefixes] (text_view line)
+            {
+              for (auto && prefix : prefixes)
+              {
+                if (line.size () > prefix.size () && text_view (line.data (), prefix.size ()) == prefix)
+                {
+                  return true;
+                }
+              }
+              return false;
+            })
+        >>  map ([] (text_view line)
+            {
+              auto const colon = std::find (line.begin (), line.end (), ':');
+              auto begin = colon == line.end () ? colon : colon + 1;
+              for (; begin != line.end () && *begin == ' '; ++begin)
+                ;
+              return std::string (begin, line.end ());
+            })
+        >>  to_first_or_default
+        ;
+
+      return model.empty () ? "unknown" : model;
+    }
+    catch (std::exception const &)
+    {
+      return "unknown";
+    }
+#else
+    return "unknown";
+#endif
+  }
+
+  inline std::string utc_timestamp ()
+  {
+    auto const now = std::time (nullptr);
+
+    std::tm utc {};
+#ifdef _MSC_VER
+    gmtime_s (&utc, &now);
+#else
+    gmtime_r (&now, &utc);
+#endif
+
+    char buffer[32] = {};
+    std::strftime (buffer, sizeof (buffer), "%Y-%m-%dT%H:%M:%SZ", &utc);
+    return buffer;
+  }
+
+  inline benchmark_environment current_environment ()
+  {
+    benchmark_environment result;
+    result.compiler   = compiler_description ();
+    result.flags      = flags_description ();
+    result.cpu        = cpu_description ();
+    result.timestamp  = utc_timestamp ();
+    return result;
+  }
+
+  // --------------------------------------------------------------------------
+
+  namespace detail
+  {
+    inline void write_csv_text (cpp_streams::output_buffer & out, std::string const & v)
+    {
+      out << '"';
+      for (auto c : v)
+      {
+        if (c == '"')
+        {
+          out << '"';
+        }
+        out << c;
+      }
+      out << '"';
+    }
+
+    inline void write_json_text (cpp_streams::output_buffer & out, std::string const & v)
+    {
+      static char const hex[] = "0123456789abcdef";
+
+      out << '"';
+      for (auto c : v)
+      {
+        auto const u = static_cast<unsigned char> (c);
+        if (c == '"' || c == '\\')
+        {
+          out << '\\' << c;
+        }
+        else if (u < 0x20)
+        {
+          out << "\\u00" << hex[u >> 4] << hex[u & 0xF];
+        }
+        else
+        {
+          out << c;
+        }
+      }
+      out << '"';
+    }
+
+    inline std::string result_id (benchmark_result const & v)
+    {
+      return v.name + "/" + v.variant + "/" + v.element_type + "/" + std::to_string (v.elements);
+    }
+  }
+
+  // --------------------------------------------------------------------------
+
+  inline void write_csv (std::ostream & stream, benchmark_environment const & environment, std::vector<benchmark_result> const & results)
+  {
+    using namespace cpp_streams;
+
+    stream
+      << "name,variant,type,elements,samples,runs_per_sample,min_ns,median_ns,mean_ns,p99_ns,stddev_ns,mad_ns,ns_per_element,compiler,flags,cpu,timestamp"
+      ;
+
+    // Counts per run, empty when not collected
+    for (auto iter = 0U; iter < counter_kind_count; ++iter)
+    {
+      stream << ',' << counter_name (iter);
+    }
+
+    stream << ",ipc";
+
+    // Counts per run, empty when not tracked
+    stream << ",allocations,deallocations,reallocations,allocated_bytes,peak_bytes\n";
+
+    from (results) >> to_ostream (stream, [&environment] (output_buffer & out, benchmark_result const & v)
+    {
+      auto const & s = v.statistics;
+
+      detail::write_csv_text (out, v.name)          ; out << ',';
+      detail::write_csv_text (out, v.variant)       ; out << ',';
+      detail::write_csv_text (out, v.element_type)  ; out << ',';
+      out
+        << v.elements                       << ','
+        << s.samples                        << ','
+        << s.runs_per_sample                << ','
+        << s.min_ns                         << ','
+        << s.median_ns                      << ','
+        << s.mean_ns                        << ','
+        << s.p99_ns                         << ','
+        << s.stddev_ns                      << ','
+        << s.mad_ns                         << ','
+        << v.ns_per_element (s.median_ns)   << ','
+        ;
+      detail::write_csv_text (out, environment.compiler)  ; out << ',';
+      detail::write_csv_text (out, environment.flags)     ; out << ',';
+      detail::write_csv_text (out, environment.cpu)       ; out << ',';
+      detail::write_csv_text (out, environment.timestamp) ;
+
+      for (auto count : v.counters.values)
+      {
+        out << ',';
+        if (count >= 0)
+        {
+          out << count;
+        }
+      }
+
+      out << ',';
+      if (v.counters.ipc () >= 0)
+      {
+        out << v.counters.ipc ();
+      }
+
+      auto const & a = v.allocations;
+      if (a.tracked)
+      {
+        out
+          << ',' << a.allocations
+          << ',' << a.deallocations
+          << ',' << a.reallocations
+          << ',' << a.allocated_bytes
+          << ',' << a.peak_bytes
+          ;
+      }
+      else
+      {
+        out << ",,,,,";
+      }
+
+      out << '\n';
+    });
+
+    stream.flush ();
+  }
+
+  inline void write_json (std::ostream & stream, benchmark_environment const & environment, std::vector<benchmark_result> const & results)
+  {
+    using namespace cpp_streams;
+
+    output_buffer header (256);
+    header << "{\n  \"compiler\": "  ; detail::write_json_text (header, environment.compiler);
+    header << ",\n  \"flags\": "     ; detail::write_json_text (header, environment.flags);
+    header << ",\n  \"cpu\": "       ; detail::write_json_text (header, environment.cpu);
+    header << ",\n  \"timestamp\": " ; detail::write_json_text (header, environment.timestamp);
+    header << ",\n  \"results\": [";
+    stream.write (header.data (), static_cast<std::streamsize> (header.size ()));
+
+    from (results) >> mapi ([] (std::size_t i, benchmark_result const & v) { return std::make_tuple (i, &v); }) >> to_ostream (stream, [] (output_buffer & out, auto && iv)
+    {
+      auto const & v = *std::get<1> (iv);
+      auto const & s = v.statistics;
+
+      out << (std::get<0> (iv) == 0 ? "\n    {" : ",\n    {");
+      out << "\"name\": "           ; detail::write_json_text (out, v.name);
+      out << ", \"variant\": "      ; detail::write_json_text (out, v.variant);
+      out << ", \"type\": "         ; detail::write_json_text (out, v.element_type);
+      out
+        << ", \"elements\": "         << v.elements
+        << ", \"samples\": "          << s.samples
+        << ", \"runs_per_sample\": "  << s.runs_per_sample
+        << ", \"min_ns\": "           << s.min_ns
+        << ", \"median_ns\": "        << s.median_ns
+        << ", \"mean_ns\": "          << s.mean_ns
+        << ", \"p99_ns\": "           << s.p99_ns
+        << ", \"stddev_ns\": "        << s.stddev_ns
+        << ", \"mad_ns\": "           << s.mad_ns
+        << ", \"ns_per_element\": "   << v.ns_per_element (s.median_ns)
+        ;
+
+      // Counts per run, only the collected ones
+      if (v.counters.any ())
+      {
+        out << ", \"counters\": {";
+        auto first = true;
+        for (auto iter = 0U; iter < counter_kind_count; ++iter)
+        {
+          if (v.counters.values[iter] >= 0)
+          {
+            out << (first ? "\"" : ", \"") << counter_name (iter) << "\": " << v.counters.values[iter];
+            first = false;
+          }
+        }
+        if (v.counters.ipc () >= 0)
+        {
+          out << ", \"ipc\": " << v.counters.ipc ();
+        }
+        out << "}";
+      }
+
+      auto const & a = v.allocations;
+      if (a.tracked)
+      {
+        out
+          << ", \"allocations\": {\"allocations\": " << a.allocations
+          << ", \"deallocations\": "                 << a.deallocations
+          << ", \"reallocations\": "                 << a.reallocations
+          << ", \"allocated_bytes\": "               << a.allocated_bytes
+          << ", \"peak_bytes\": "                    << a.peak_bytes
+          << ", \"owners\": {"
+          ;
+        auto first = true;
+        for (auto && o : a.owners)
+        {
+          if (o.name)
+          {
+            out << (first ? "" : ", ");
+            detail::write_json_text (out, o.name);
+            out
+              << ": {\"allocations\": " << o.allocations
+              << ", \"allocated_bytes\": " << o.allocated_bytes
+              << "}"
+              ;
+            first = false;
+          }
+        }
+        out << "}}";
+      }
+
+      out << "}";
+    });
+
+    stream << "\n  ]\n}\n";
+    stream.flush ();
+  }
+
+  // Reads the results of a CSV report, throws if the file can't be read
+  inline std::vector<benchmark_result> read_csv (std::string const & path)
+  {
+    using namespace cpp_streams;
+
+    csv_options options;
+    options.has_header = true;
+
+    return
+          from_csv<std::string, std::string, std::string, std::size_t, std::size_t, std::size_t, double, double, double, double, double, double> (path, options)
+      >>  map ([] (auto && row)
+          {
+            benchmark_result result;
+            result.name                       = std::get<0>  (row);
+            result.variant                    = std::get<1>  (row);
+            result.element_type               = std::get<2>  (row);
+            result.elements                   = std::get<3>  (row);
+            result.statistics.samples         = std::get<4>  (row);
+            result.statistics.runs_per_sample = std::get<5>  (row);
+            result.statistics.min_ns          = std::get<6>  (row);
+            result.statistics.median_ns       = std::get<7>  (row);
+            result.statistics.mean_ns         = std::get<8>  (row);
+            result.statistics.p99_ns          = std::get<9>  (row);
+            result.statistics.stddev_ns       = std::get<10> (row);
+            result.statistics.mad_ns          = std::get<11> (row);
+            return result;
+          })
+      >>  to_vector
+      ;
+  }
+
+  // --------------------------------------------------------------------------
+
+  struct comparison_options
+  {
+    // Changes smaller than this fraction are never reported
+    double min_threshold  = 0.05 ;
+    // Changes must exceed this many standard errors of the difference of
+    //  the medians to be reported
+    double noise_factor   = 3.0  ;
+    // Compares the pipeline/loop ratio of each run instead of the medians,
+    //  which cancels out the speed of the machine at the time of the run
+    bool   relative       = false;
+  };
+
+  namespace detail
+  {
+    // The standard error of the median estimated from the median absolute
+    //  deviation, which unlike stddev isn't inflated by a few slow samples
+    inline double relative_median_error (benchmark_statistics const & s)
+    {
+      return s.samples > 0 && s.median_ns > 0
+        ? 1.2533 * 1.4826 * s.mad_ns / std::sqrt (static_cast<double> (s.samples)) / s.median_ns
+        : 0.0
+        ;
+    }
+
+    struct compared_value
+    {
+      bool    valid           = false;
+      double  value           = 0    ;
+      double  relative_error  = 0    ;
+    };
+
+    using results_by_id = std::map<std::string, benchmark_result const *>;
+
+    inline results_by_id index_results (std::vector<benchmark_result> const & results)
+    {
+      results_by_id result;
+      for (auto && v : results)
+      {
+        result[result_id (v)] = &v;
+      }
+      return result;
+    }
+
+    inline compared_value compared_value_of (benchmark_result const & v, results_by_id const & same_run, bool relative)
+    {
+      compared_value result;
+
+      if (v.statistics.median_ns <= 0)
+      {
+        return result;
+      }
+
+      if (!relative)
+      {
+        result.valid          = true;
+        result.value          = v.statistics.median_ns;
+        result.relative_error = relative_median_error (v.statistics);
+        return result;
+      }
+
+      auto const loop = same_run.find (v.name + "/loop/" + v.element_type + "/" + std::to_string (v.elements));
+      if (v.variant == "loop" || loop == same_run.end () || loop->second->statistics.median_ns <= 0)
+      {
+        return result;
+      }
+
+      auto const pipeline_error = relative_median_error (v.statistics);
+      auto const loop_error     = relative_median_error (loop->second->statistics);
+
+      result.valid          = true;
+      result.value          = v.statistics.median_ns / loop->second->statistics.median_ns;
+      result.relative_error = std::sqrt (pipeline_error * pipeline_error + loop_error * loop_error);
+      return result;
+    }
+  }
+
+  // Compares current with baseline and prints the changes exceeding the
+  //  noise aware threshold. Returns the number of regressions
+  inline std::size_t compare_results (
+      std::vector<benchmark_result> const & baseline
+    , std::vector<benchmark_result> const & current
+    , comparison_options const &            options
+    , std::ostream &                        stream
+    )
+  {
+    auto const baseline_by_id = detail::index_results (baseline);
+    auto const current_by_id  = detail::index_results (current);
+
+    std::size_t regressions   = 0;
+    std::size_t improvements  = 0;
+    std::size_t unchanged     = 0;
+    std::size_t missing       = 0;
+
+    for (auto && c : current)
+    {
+      if (options.relative && c.variant == "loop")
+      {
+        continue;
+      }
+
+      auto const found = baseline_by_id.find (detail::result_id (c));
+      if (found == baseline_by_id.end ())
+      {
+        ++missing;
+        continue;
+      }
+
+      auto const b_value = detail::compared_value_of (*found->second, baseline_by_id, options.relative);
+      auto const c_value = detail::compared_value_of (c, current_by_id, options.relative);
+      if (!b_value.valid || !c_value.valid)
+      {
+        ++missing;
+        continue;
+      }
+
+      auto const change     = c_value.value / b_value.value - 1.0;
+      auto const noise      = options.noise_factor * std::sqrt (
+          b_value.relative_error * b_value.relative_error
+        + c_value.relative_error * c_value.relative_error
+        );
+      auto const threshold  = noise > options.min_threshold ? noise : options.min_threshold;
+
+      char const * verdict = nullptr;
+      if (change > threshold)
+      {
+        ++regressions;
+        verdict = "REGRESSION";
+      }
+      else if (change < -threshold)
+      {
+        ++improvements;
+        verdict = "improvement";
+      }
+      else
+      {
+        ++unchanged;
+      }
+
+      if (verdict)
+      {
+        stream
+          << std::left
+          << std::setw (12) << verdict
+          << std::setw (48) << detail::result_id (c)
+          << std::right
+          << std::fixed << std::setprecision (options.relative ? 3 : 1)
+          << std::setw (12) << b_value.value
+          << " -> "
+          << std::setw (12) << c_value.value
+          << (options.relative ? " x loop (" : " ns (")
+          << std::setprecision (1)
+          << std::showpos << change * 100 << std::noshowpos
+          << "%, threshold "
+          << threshold * 100
+          << "%)"
+          << std::defaultfloat
+          << std::endl
+          ;
+      }
+    }
+
+    stream
+      << regressions  << " regressions, "
+      << improvements << " improvements, "
+      << unchanged    << " unchanged, "
+      << missing      << " not in baseline"
+      << std::endl
+      ;
+
+    return regressions;
+  }
+
+  // --------------------------------------------------------------------------
+
+}
+// ----------------------------------------------------------------------------
+#endif // CPP_STREAMS__BENCHMARK_REPORT__INCLUDE_GUARD
+// ----------------------------------------------------------------------------
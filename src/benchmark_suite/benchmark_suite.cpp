@@ -0,0 +1,255 @@
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Counts allocations for --allocations
+#define CPP_STREAMS__REPLACE_GLOBAL_NEW
+
+#include "benchmark_report.hpp"
+#include "operator_benchmarks.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <iostream>
+#include <string>
+
+namespace
+{
+  void print_usage ()
+  {
+    std::cout
+      << "Usage: benchmark_suite [options]"                                           << std::endl
+      << "  --quick             Only L1/L2 sized data sets and fewer samples"         << std::endl
+      << "  --filter <text>     Only benchmarks whose name/type/elements contains text" << std::endl
+      << "  --max-bytes <n>     Largest data set in bytes (default 67108864)"         << std::endl
+      << "  --samples <n>       Maximum number of samples per benchmark"              << std::endl
+      << "  --distribution <d>  Data distribution, may be repeated (default uniform)" << std::endl
+      << "                      uniform, zipf, sorted, reverse_sorted, few_unique,"   << std::endl
+      << "                      heavy_duplicates or all"                              << std::endl
+      << "  --seed <n>          Seed of the benchmark data (default 19740531)"        << std::endl
+      << "  --counters          Collects performance counters (Linux perf events)"    << std::endl
+      << "  --allocations       Counts allocations, bytes and peak bytes per run"     << std::endl
+      << "  --csv <path>        Writes the results as CSV ('-' for stdout)"           << std::endl
+      << "  --json <path>       Writes the results as JSON ('-' for stdout)"          << std::endl
+      << "  --baseline <path>   Fails if a result regressed from a CSV baseline"      << std::endl
+      << "  --threshold <f>     Smallest relative change reported (default 0.05)"     << std::endl
+      << "  --relative          Compares pipeline/loop ratios instead of medians"     << std::endl
+      << "  --compare <baseline> <current>"                                           << std::endl
+      << "                      Compares two CSV reports without running benchmarks"  << std::endl
+      ;
+  }
+
+  template<typename TWriter>
+  bool write_report (std::string const & path, TWriter && writer)
+  {
+    if (path == "-")
+    {
+      writer (std::cout);
+      return true;
+    }
+
+    std::ofstream stream (path, std::ios::binary);
+    writer (stream);
+    stream.close ();
+
+    if (!stream)
+    {
+      std::cout << "Failed to write " << path << std::endl;
+      return false;
+    }
+
+    return true;
+  }
+}
+
+int main (int argc, char const * argv[])
+{
+  benchmark_suite::benchmark_options   options           ;
+  benchmark_suite::comparison_options  comparison        ;
+  std::string                          csv_path          ;
+  std::string                          json_path         ;
+  std::string                          baseline_path     ;
+  std::string                          compare_path      ;
+  auto                                 distributions_set = false;
+
+  for (auto iter = 1; iter < argc; ++iter)
+  {
+    auto const arg      = argv[iter];
+    auto const has_next = iter + 1 < argc;
+
+    if (std::strcmp (arg, "--quick") == 0)
+    {
+      options.max_bytes         = 256U << 10;
+      options.max_samples       = 11;
+      options.max_benchmark_ns  = 1e8;
+    }
+    else if (std::strcmp (arg, "--filter") == 0 && has_next)
+    {
+      options.filter = argv[++iter];
+    }
+    else if (std::strcmp (arg, "--max-bytes") == 0 && has_next)
+    {
+      options.max_bytes = static_cast<std::size_t> (std::strtoull (argv[++iter], nullptr, 10));
+    }
+    else if (std::strcmp (arg, "--samples") == 0 && has_next)
+    {
+      options.max_samples = static_cast<std::size_t> (std::strtoull (argv[++iter], nullptr, 10));
+      options.min_samples = options.min_samples < options.max_samples ? options.min_samples : options.max_samples;
+    }
+    else if (std::strcmp (arg, "--distribution") == 0 && has_next)
+    {
+      auto const name = argv[++iter];
+      if (!distributions_set)
+      {
+        options.distributions.clear ();
+        distributions_set = true;
+      }
+
+      benchmark_suite::distribution d;
+      if (std::strcmp (name, "all") == 0)
+      {
+        options.distributions.assign (std::begin (benchmark_suite::all_distributions), std::end (benchmark_suite::all_distributions));
+      }
+      else if (benchmark_suite::try_parse_distribution (name, d))
+      {
+        options.distributions.push_back (d);
+      }
+      else
+      {
+        std::cout << "Unknown distribution " << name << std::endl;
+        print_usage ();
+        return 2;
+      }
+    }
+    else if (std::strcmp (arg, "--seed") == 0 && has_next)
+    {
+      options.seed = std::strtoull (argv[++iter], nullptr, 10);
+    }
+    else if (std::strcmp (arg, "--counters") == 0)
+    {
+      options.counters = true;
+    }
+    else if (std::strcmp (arg, "--allocations") == 0)
+    {
+      options.allocations = true;
+    }
+    else if (std::strcmp (arg, "--csv") == 0 && has_next)
+    {
+      csv_path = argv[++iter];
+    }
+    else if (std::strcmp (arg, "--json") == 0 && has_next)
+    {
+      json_path = argv[++iter];
+    }
+    else if (std::strcmp (arg, "--baseline") == 0 && has_next)
+    {
+      baseline_path = argv[++iter];
+    }
+    else if (std::strcmp (arg, "--threshold") == 0 && has_next)
+    {
+      comparison.min_threshold = std::strtod (argv[++iter], nullptr);
+    }
+    else if (std::strcmp (arg, "--relative") == 0)
+    {
+      comparison.relative = true;
+    }
+    else if (std::strcmp (arg, "--compare") == 0 && iter + 2 < argc)
+    {
+      baseline_path = argv[++iter];
+      compare_path  = argv[++iter];
+    }
+    else
+    {
+      print_usage ();
+      return 2;
+    }
+  }
+
+  if (!compare_path.empty ())
+  {
+    try
+    {
+      auto const regressions = benchmark_suite::compare_results (
+          benchmark_suite::read_csv (baseline_path)
+        , benchmark_suite::read_csv (compare_path)
+        , comparison
+        , std::cout
+        );
+      return regressions > 0 ? 1 : 0;
+    }
+    catch (std::exception const & e)
+    {
+      std::cout << "Failed to compare reports: " << e.what () << std::endl;
+      return 2;
+    }
+  }
+
+  // Read before running so a bad path doesn't waste a benchmark run
+  std::vector<benchmark_suite::benchmark_result> baseline;
+  if (!baseline_path.empty ())
+  {
+    try
+    {
+      baseline = benchmark_suite::read_csv (baseline_path);
+    }
+    catch (std::exception const & e)
+    {
+      std::cout << "Failed to read baseline " << baseline_path << ": " << e.what () << std::endl;
+      return 2;
+    }
+  }
+
+#ifndef NDEBUG
+  std::cout << "WARNING: benchmarks are built without NDEBUG" << std::endl;
+#endif
+
+  benchmark_suite::benchmark_runner runner (options);
+
+  benchmark_suite::benchmark_runner::print_header ();
+
+  benchmark_suite::run_operator_benchmarks (runner);
+
+  auto const environment  = benchmark_suite::current_environment ();
+  auto       failed       = false;
+
+  if (!csv_path.empty ())
+  {
+    failed |= !write_report (csv_path, [&] (std::ostream & stream) { benchmark_suite::write_csv (stream, environment, runner.results ()); });
+  }
+
+  if (!json_path.empty ())
+  {
+    failed |= !write_report (json_path, [&] (std::ostream & stream) { benchmark_suite::write_json (stream, environment, runner.results ()); });
+  }
+
+  if (!baseline_path.empty ())
+  {
+    std::cout << "Comparing with " << baseline_path << std::endl;
+    failed |= benchmark_suite::compare_results (baseline, runner.results (), comparison, std::cout) > 0;
+  }
+
+  if (runner.error_count () > 0)
+  {
+    std::cout
+      << "Detected "
+      << runner.error_count ()
+      << " checksum mismatches"
+      << std::endl
+      ;
+    return 1;
+  }
+
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,2 @@
+FLAGS="-g -O2 -DNDEBUG -DCPP_STREAMS__INSTRUMENT -Wall -pedantic --std=c++1y -pthread"
+g++ $FLAGS -DCPP_STREAMS__BENCHMARK_FLAGS="\"$FLAGS\"" benchmark_suite.cpp -o benchmark_suite_instrumented_g++.out && ./benchmark_suite_instrumented_g++.out "$@"
@@ -0,0 +1,2 @@
+FLAGS="-g -O2 -DNDEBUG -Wall -pedantic --std=c++1y -pthread"
+clang++ $FLAGS -DCPP_STREAMS__BENCHMARK_FLAGS="\"$FLAGS\"" benchmark_suite.cpp -o benchmark_suite_clang++.out && ./benchmark_suite_clang++.out "$@"
@@ -0,0 +1,401 @@
+// ----------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef CPP_STREAMS__DATA_GENERATORS__INCLUDE_GUARD
+# define CPP_STREAMS__DATA_GENERATORS__INCLUDE_GUARD
+// ----------------------------------------------------------------------------
+# include <algorithm>
+# include <cmath>
+# include <cstdint>
+# include <cstdio>
+# include <cstring>
+# include <functional>
+# include <limits>
+# include <string>
+# include <vector>
+// ----------------------------------------------------------------------------
+// Data generation strategy:
+//  An element is created from a rank, its position in the order of the
+//  element type (smaller rank, smaller element), and a random source for
+//  the parts that don't affect the order. A distribution decides which
+//  ranks a data set has and in what order so that every element type can
+//  be created sorted, skewed or full of duplicates. Everything is derived
+//  from a seed so data sets are the same from run to run
+// ----------------------------------------------------------------------------
+namespace benchmark_suite
+{
+  // --------------------------------------------------------------------------
+
+  struct user
+  {
+    std::uint64_t     id              ;
+    std::string       first_name      ;
+    std::string       last_name       ;
+    std::vector<int>  lottery_numbers ;
+
+    bool operator < (user const & o) const
+    {
+      return id < o.id;
+    }
+  };
+
+  // --------------------------------------------------------------------------
+
+  // splitmix64, small and good enough to create benchmark data
+  class random_source
+  {
+  public:
+    explicit random_source (std::uint64_t seed) noexcept
+      : state (seed)
+    {
+    }
+
+    std::uint64_t next () noexcept
+    {
+      auto z = (state += 0x9E3779B97F4A7C15ULL);
+      z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+      z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+      return z ^ (z >> 31);
+    }
+
+    // Uniform in [0, 1)
+    double next_unit () noexcept
+    {
+      return static_cast<double> (next () >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+  private:
+    std::uint64_t state;
+  };
+
+  // --------------------------------------------------------------------------
+
+  enum class distribution
+  {
+    // Ranks drawn uniformly from all ranks of the element type
+    uniform           ,
+    // A few ranks are very common, the frequency of the k:th most common
+    //  rank is proportional to 1/k (like words in a text or customers in
+    //  an order table)
+    zipf              ,
+    // Uniform ranks in ascending order
+    sorted            ,
+    // Uniform ranks in descending order
+    reverse_sorted    ,
+    // Only few_unique_ranks different ranks
+    few_unique        ,
+    // Every rank repeated heavy_duplicates_repeats times on average
+    heavy_duplicates  ,
+  };
+
+  constexpr distribution all_distributions[] =
+  {
+    distribution::uniform           ,
+    distribution::zipf              ,
+    distribution::sorted            ,
+    distribution::reverse_sorted    ,
+    distribution::few_unique        ,
+    distribution::heavy_duplicates  ,
+  };
+
+  constexpr double        zipf_exponent             = 1.0     ;
+  // Zipf ranks are picked among at most this many ranks
+  constexpr std::size_t   zipf_max_ranks            = 1U << 16;
+  constexpr std::size_t   few_unique_ranks          = 8       ;
+  constexpr std::size_t   heavy_duplicates_repeats  = 16      ;
+
+  inline char const * distribution_name (distribution d) noexcept
+  {
+    switch (d)
+    {
+    case distribution::uniform          : return "uniform"          ;
+    case distribution::zipf             : return "zipf"             ;
+    case distribution::sorted           : return "sorted"           ;
+    case distribution::reverse_sorted   : return "reverse_sorted"   ;
+    case distribution::few_unique       : return "few_unique"       ;
+    case distribution::heavy_duplicates : return "heavy_duplicates" ;
+    }
+    return "unknown";
+  }
+
+  inline bool try_parse_distribution (char const * name, distribution & result) noexcept
+  {
+    for (auto d : all_distributions)
+    {
+      if (std::strcmp (name, distribution_name (d)) == 0)
+      {
+        result = d;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // --------------------------------------------------------------------------
+
+  namespace detail
+  {
+    // Zipf ranks by inverting the cumulative distribution, the most common
+    //  ranks are scattered over all ranks rather than being the smallest
+    inline void create_zipf_ranks (std::vector<std::uint64_t> & result, std::size_t count, std::uint64_t ranks, random_source & random)
+    {
+      auto const support = static_cast<std::size_t> (std::min<std::uint64_t> (ranks, zipf_max_ranks));
+      auto const spacing = ranks / support;
+
+      std::vector<double> cumulative (support);
+      auto sum = 0.0;
+      for (auto iter = 0U; iter < support; ++iter)
+      {
+        sum += 1.0 / std::pow (static_cast<double> (iter + 1), zipf_exponent);
+        cumulative[iter] = sum;
+      }
+
+      std::vector<std::uint64_t> scattered (support);
+      for (auto iter = 0U; iter < support; ++iter)
+      {
+        scattered[iter] = iter * spacing;
+      }
+      for (auto iter = support; iter > 1; --iter)
+      {
+        std::swap (scattered[iter - 1], scattered[random.next () % iter]);
+      }
+
+      for (auto iter = 0U; iter < count; ++iter)
+      {
+        auto const found = std::lower_bound (cumulative.begin (), cumulative.end (), random.next_unit () * sum);
+        auto const index = std::min (static_cast<std::size_t> (found - cumulative.begin ()), support - 1);
+        result.push_back (scattered[index]);
+      }
+    }
+
+    // Ranks picked uniformly from a pool of uniform ranks
+    inline void create_pooled_ranks (std::vector<std::uint64_t> & result, std::size_t count, std::uint64_t ranks, std::size_t pool_size, random_source & random)
+    {
+      std::vector<std::uint64_t> pool;
+      pool.reserve (pool_size);
+      for (auto iter = 0U; iter < pool_size; ++iter)
+      {
+        pool.push_back (random.next () % ranks);
+      }
+
+      for (auto iter = 0U; iter < count; ++iter)
+      {
+        result.push_back (pool[random.next () % pool_size]);
+      }
+    }
+  }
+
+  // count ranks in [0, ranks) following the distribution
+  inline std::vector<std::uint64_t> create_ranks (distribution d, std::size_t count, std::uint64_t ranks, random_source & random)
+  {
+    std::vector<std::uint64_t> result;
+    result.reserve (count);
+
+    switch (d)
+    {
+    case distribution::uniform          :
+    case distribution::sorted           :
+    case distribution::reverse_sorted   :
+      for (auto iter = 0U; iter < count; ++iter)
+      {
+        result.push_back (random.next () % ranks);
+      }
+      break;
+    case distribution::zipf             :
+      detail::create_zipf_ranks (result, count, ranks, random);
+      break;
+    case distribution::few_unique       :
+      detail::create_pooled_ranks (result, count, ranks, few_unique_ranks, random);
+      break;
+    case distribution::heavy_duplicates :
+      detail::create_pooled_ranks (result, count, ranks, std::max<std::size_t> (count / heavy_duplicates_repeats, 1), random);
+      break;
+    }
+
+    if (d == distribution::sorted)
+    {
+      std::sort (result.begin (), result.end ());
+    }
+    else if (d == distribution::reverse_sorted)
+    {
+      std::sort (result.begin (), result.end (), std::greater<std::uint64_t> ());
+    }
+
+    return result;
+  }
+
+  // --------------------------------------------------------------------------
+
+  template<typename T>
+  struct element_traits;
+
+  template<>
+  struct element_traits<int>
+  {
+    static char const * name () noexcept
+    {
+      return "int";
+    }
+
+    static std::size_t footprint () noexcept
+    {
+      return sizeof (int);
+    }
+
+    // Small values keep sums of RAM-sized data sets from overflowing
+    static std::uint64_t ranks () noexcept
+    {
+      return 2001;
+    }
+
+    static int create (std::uint64_t rank, random_source &)
+    {
+      return static_cast<int> (rank) - 1000;
+    }
+
+    static int largest ()
+    {
+      return std::numeric_limits<int>::max ();
+    }
+  };
+
+  template<>
+  struct element_traits<double>
+  {
+    static char const * name () noexcept
+    {
+      return "double";
+    }
+
+    static std::size_t footprint () noexcept
+    {
+      return sizeof (double);
+    }
+
+    static std::uint64_t ranks () noexcept
+    {
+      return 2001;
+    }
+
+    static double create (std::uint64_t rank, random_source &)
+    {
+      return (static_cast<int> (rank) - 1000) * 0.5;
+    }
+
+    static double largest ()
+    {
+      return std::numeric_limits<double>::max ();
+    }
+  };
+
+  template<>
+  struct element_traits<std::string>
+  {
+    static char const * name () noexcept
+    {
+      return "string";
+    }
+
+    static std::size_t footprint () noexcept
+    {
+      return sizeof (std::string);
+    }
+
+    static std::uint64_t ranks () noexcept
+    {
+      return 100000;
+    }
+
+    // Zero padded so strings order like their ranks, short enough for the
+    //  small string optimization
+    static std::string create (std::uint64_t rank, random_source &)
+    {
+      char buffer[16];
+      std::snprintf (buffer, sizeof buffer, "value_%05u", static_cast<unsigned> (rank));
+      return buffer;
+    }
+
+    static std::string largest ()
+    {
+      return "~";
+    }
+  };
+
+  template<>
+  struct element_traits<user>
+  {
+    static char const * name () noexcept
+    {
+      return "user";
+    }
+
+    static std::size_t footprint () noexcept
+    {
+      return sizeof (user) + 7 * sizeof (int);
+    }
+
+    static std::uint64_t ranks () noexcept
+    {
+      return 1000000000;
+    }
+
+    static user create (std::uint64_t rank, random_source & random)
+    {
+      static char const * const first_names[] = {"Bill", "Melinda", "Steve", "Ada", "Grace", "Alan", "Donald", "Barbara"};
+      static char const * const last_names [] = {"Gates", "Jobs", "Lovelace", "Hopper", "Turing", "Knuth", "Liskov"};
+
+      user result;
+      result.id         = rank;
+      result.first_name = first_names[random.next () % 8];
+      result.last_name  = last_names[random.next () % 7];
+      for (auto iter = 0; iter < 7; ++iter)
+      {
+        result.lottery_numbers.push_back (static_cast<int> (random.next () % 40) + 1);
+      }
+      return result;
+    }
+
+    static user largest ()
+    {
+      user result;
+      result.id = std::numeric_limits<std::uint64_t>::max ();
+      return result;
+    }
+  };
+
+  template<typename T>
+  std::vector<T> create_elements (std::size_t count, std::uint64_t seed, distribution d = distribution::uniform)
+  {
+    random_source random (seed);
+
+    auto const ranks = create_ranks (d, count, element_traits<T>::ranks (), random);
+
+    std::vector<T> result;
+    result.reserve (count);
+
+    for (auto rank : ranks)
+    {
+      result.push_back (element_traits<T>::create (rank, random));
+    }
+
+    return result;
+  }
+
+  // --------------------------------------------------------------------------
+
+}
+// ----------------------------------------------------------------------------
+#endif // CPP_STREAMS__DATA_GENERATORS__INCLUDE_GUARD
+// ----------------------------------------------------------------------------
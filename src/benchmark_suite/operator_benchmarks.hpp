@@ -0,0 +1,870 @@
+// ----------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef CPP_STREAMS__OPERATOR_BENCHMARKS__INCLUDE_GUARD
+# define CPP_STREAMS__OPERATOR_BENCHMARKS__INCLUDE_GUARD
+// ----------------------------------------------------------------------------
+# include "../cpp_streams/cpp_streams.hpp"
+# include "../cpp_streams/cpp_streams_any.hpp"
+# include "benchmark_harness.hpp"
+# include "data_generators.hpp"
+
+# include <cstdint>
+# include <limits>
+# include <map>
+# include <memory>
+# include <set>
+# include <string>
+# include <type_traits>
+# include <vector>
+// ----------------------------------------------------------------------------
+// Operator benchmark strategy:
+//  Every source, pipe and sink is benchmarked against the loop a programmer
+//  would write instead, for int, double, std::string and user elements and
+//  for data sets sized to fit L1, L2, LLC and RAM created with each of the
+//  selected distributions (data_generators.hpp). Pipes and sources are
+//  terminated with a cheap checksum fold, sinks are fed by from
+// ----------------------------------------------------------------------------
+namespace benchmark_suite
+{
+  // --------------------------------------------------------------------------
+
+  // The key of an element is folded into checksums and used by predicates
+  inline std::uint64_t key (int v) noexcept
+  {
+    return static_cast<std::uint64_t> (v);
+  }
+
+  inline std::uint64_t key (double v) noexcept
+  {
+    return static_cast<std::uint64_t> (static_cast<std::int64_t> (v));
+  }
+
+  inline std::uint64_t key (std::uint64_t v) noexcept
+  {
+    return v;
+  }
+
+  inline std::uint64_t key (std::string const & v) noexcept
+  {
+    return v.empty () ? 0 : static_cast<unsigned char> (v.back ());
+  }
+
+  inline std::uint64_t key (user const & v) noexcept
+  {
+    return v.id;
+  }
+
+  // --------------------------------------------------------------------------
+
+  // Data set sizes in bytes, chosen to be resident in L1, L2, LLC and RAM
+  constexpr std::size_t data_set_bytes[] =
+  {
+    4U    << 10 ,
+    256U  << 10 ,
+    8U    << 20 ,
+    64U   << 20 ,
+  };
+
+  constexpr std::size_t fixed_size_elements = 1024;
+
+  // No element has this key, negative ints map to keys near the max
+  constexpr std::uint64_t sentinel_key = 1ULL << 62;
+
+  // --------------------------------------------------------------------------
+
+  template<typename T>
+  void run_sum_benchmarks (benchmark_runner & runner, char const * type, std::vector<T> const & vs, std::true_type)
+  {
+    using namespace cpp_streams;
+
+    runner.compare ("to_sum", type, vs.size ()
+      , [&vs]
+        {
+          auto sum = T ();
+          for (auto && v : vs)
+          {
+            sum += v;
+          }
+          return key (sum);
+        }
+      , [&vs]
+        {
+          return key (from (vs) >> to_sum);
+        }
+      );
+  }
+
+  template<typename T>
+  void run_sum_benchmarks (benchmark_runner &, char const *, std::vector<T> const &, std::false_type)
+  {
+  }
+
+  inline void run_range_benchmarks (benchmark_runner & runner, char const * type, std::vector<int> const & vs)
+  {
+    using namespace cpp_streams;
+
+    auto const count = static_cast<int> (vs.size ());
+
+    runner.compare ("from_range", type, vs.size ()
+      , [count]
+        {
+          std::uint64_t sum = 0;
+          for (auto iter = 0; iter < count; ++iter)
+          {
+            sum += key (iter);
+          }
+          return sum;
+        }
+      , [count]
+        {
+          return from_range (0, count) >> to_fold (std::uint64_t (0), [] (std::uint64_t s, auto && v) { return s + key (v); });
+        }
+      );
+  }
+
+  template<typename T>
+  void run_range_benchmarks (benchmark_runner &, char const *, std::vector<T> const &)
+  {
+  }
+
+  // --------------------------------------------------------------------------
+
+  template<typename T>
+  void run_operator_benchmarks (benchmark_runner & runner, char const * type, std::vector<T> const & vs)
+  {
+    using namespace cpp_streams;
+
+    auto const count    = vs.size ();
+    auto const half     = count / 2;
+    auto const middle   = vs.begin () + static_cast<std::ptrdiff_t> (half);
+
+    auto const checksum         = to_fold (std::uint64_t (0), [] (std::uint64_t s, auto && v) { return s + key (v); });
+    // Used where the order of the elements matters
+    auto const ordered_checksum = to_fold (std::uint64_t (0), [] (std::uint64_t s, auto && v) { return s * 31 + key (v); });
+    auto const is_even          = [] (auto && v) { return key (v) % 2 == 0; };
+    auto const is_not_sentinel  = [] (auto && v) { return key (v) != sentinel_key; };
+    auto const is_sentinel      = [] (auto && v) { return key (v) == sentinel_key; };
+    auto const less             = [] (auto && l, auto && r) { return l < r; };
+
+    // Sources
+
+    runner.compare ("from", type, count
+      , [&vs]
+        {
+          std::uint64_t sum = 0;
+          for (auto && v : vs)
+          {
+            sum += key (v);
+          }
+          return sum;
+        }
+      , [&vs, checksum]
+        {
+          return from (vs) >> checksum;
+        }
+      );
+
+    runner.compare ("from_iterators", type, count
+      , [&vs]
+        {
+          std::uint64_t sum = 0;
+          for (auto iter = vs.begin (); iter != vs.end (); ++iter)
+          {
+            sum += key (*iter);
+          }
+          return sum;
+        }
+      , [&vs, checksum]
+        {
+          return from_iterators (vs.begin (), vs.end ()) >> checksum;
+        }
+      );
+
+    run_range_benchmarks (runner, type, vs);
+
+    runner.compare ("from_repeat", type, count
+      , [&vs, count]
+        {
+          std::uint64_t sum = 0;
+          for (auto iter = 0U; iter < count; ++iter)
+          {
+            sum += key (vs.front ());
+          }
+          return sum;
+        }
+      , [&vs, count, checksum]
+        {
+          return from_repeat (vs.front (), count) >> checksum;
+        }
+      );
+
+    // Pipes
+
+    runner.compare ("append", type, count
+      , [&vs, middle]
+        {
+          std::uint64_t sum = 0;
+          for (auto iter = vs.begin (); iter != middle; ++iter)
+          {
+            sum += key (*iter);
+          }
+          for (auto iter = middle; iter != vs.end (); ++iter)
+          {
+            sum += key (*iter);
+          }
+          return sum;
+        }
+      , [&vs, half, checksum]
+        {
+          auto const offset = static_cast<std::ptrdiff_t> (half);
+          return from_iterators (vs.begin (), vs.begin () + offset) >> append (from_iterators (vs.begin () + offset, vs.end ())) >> checksum;
+        }
+      );
+
+    runner.compare ("collect", type, count
+      , [&vs]
+        {
+          std::uint64_t sum = 0;
+          for (auto && v : vs)
+          {
+            for (auto iter = 0; iter < 2; ++iter)
+            {
+              sum += key (v);
+            }
+          }
+          return sum;
+        }
+      , [&vs, checksum]
+        {
+          return from (vs) >> collect ([] (auto && v) { return from_repeat (key (v), 2); }) >> checksum;
+        }
+      );
+
+    runner.compare ("filter", type, count
+      , [&vs, is_even]
+        {
+          std::uint64_t sum = 0;
+          for (auto && v : vs)
+          {
+            if (is_even (v))
+            {
+              sum += key (v);
+            }
+          }
+          return sum;
+        }
+      , [&vs, is_even, checksum]
+        {
+          return from (vs) >> filter (is_even) >> checksum;
+        }
+      );
+
+    runner.compare ("map", type, count
+      , [&vs]
+        {
+          std::uint64_t sum = 0;
+          for (auto && v : vs)
+          {
+            sum += key (v) + 1;
+          }
+          return sum;
+        }
+      , [&vs, checksum]
+        {
+          return from (vs) >> map ([] (auto && v) { return key (v) + 1; }) >> checksum;
+        }
+      );
+
+    runner.compare ("mapi", type, count
+      , [&vs]
+        {
+          std::uint64_t sum   = 0;
+          std::size_t   index = 0;
+          for (auto && v : vs)
+          {
+            sum += index++ + key (v);
+          }
+          return sum;
+        }
+      , [&vs, checksum]
+        {
+          return from (vs) >> mapi ([] (std::size_t i, auto && v) { return i + key (v); }) >> checksum;
+        }
+      );
+
+    runner.compare ("reverse", type, count
+      , [&vs]
+        {
+          std::uint64_t sum = 0;
+          for (auto iter = vs.rbegin (); iter != vs.rend (); ++iter)
+          {
+            sum = sum * 31 + key (*iter);
+          }
+          return sum;
+        }
+      , [&vs, ordered_checksum]
+        {
+          return from (vs) >> reverse >> ordered_checksum;
+        }
+      );
+
+    runner.compare ("skip", type, count
+      , [&vs, half]
+        {
+          std::uint64_t sum = 0;
+          for (auto iter = half; iter < vs.size (); ++iter)
+          {
+            sum += key (vs[iter]);
+          }
+          return sum;
+        }
+      , [&vs, half, checksum]
+        {
+          return from (vs) >> skip (half) >> checksum;
+        }
+      );
+
+    auto const is_skipped = [] (auto && v) { return key (v) % 64 != 0; };
+
+    runner.compare ("skip_while", type, count
+      , [&vs, is_skipped]
+        {
+          std::uint64_t sum     = 0;
+          auto          do_skip = true;
+          for (auto && v : vs)
+          {
+            if (do_skip && is_skipped (v))
+            {
+              continue;
+            }
+            do_skip = false;
+            sum += key (v);
+          }
+          return sum;
+        }
+      , [&vs, is_skipped, checksum]
+        {
+          return from (vs) >> skip_while (is_skipped) >> checksum;
+        }
+      );
+
+    runner.compare ("sort", type, count
+      , [&vs, less]
+        {
+          auto sorted = vs;
+          std::sort (sorted.begin (), sorted.end (), less);
+          std::uint64_t sum = 0;
+          for (auto && v : sorted)
+          {
+            sum = sum * 31 + key (v);
+          }
+          return sum;
+        }
+      , [&vs, less, ordered_checksum]
+        {
+          return from (vs) >> sort (less) >> ordered_checksum;
+        }
+      );
+
+    // The pipeline is built once and run repeatedly like a request handler
+    //  would, the loop reuses its buffer the same way
+    auto const prepared_sort  = from (vs) >> sort (less);
+    auto       sort_buffer    = std::vector<T> ();
+
+    runner.compare ("sort_prepared", type, count
+      , [&vs, &sort_buffer, less]
+        {
+          sort_buffer.assign (vs.begin (), vs.end ());
+          std::sort (sort_buffer.begin (), sort_buffer.end (), less);
+          std::uint64_t sum = 0;
+          for (auto && v : sort_buffer)
+          {
+            sum = sum * 31 + key (v);
+          }
+          return sum;
+        }
+      , [&prepared_sort, ordered_checksum]
+        {
+          return prepared_sort >> ordered_checksum;
+        }
+      );
+
+    runner.compare ("sort_by", type, count
+      , [&vs]
+        {
+          auto sorted = vs;
+          std::sort (sorted.begin (), sorted.end (), [] (auto && l, auto && r) { return key (l) < key (r); });
+          std::uint64_t sum = 0;
+          for (auto && v : sorted)
+          {
+            sum = sum * 31 + key (v);
+          }
+          return sum;
+        }
+      , [&vs, ordered_checksum]
+        {
+          return from (vs) >> sort_by ([] (auto && v) { return key (v); }) >> ordered_checksum;
+        }
+      );
+
+    runner.compare ("take", type, count
+      , [&vs, half]
+        {
+          std::uint64_t sum = 0;
+          for (auto iter = 0U; iter < half; ++iter)
+          {
+            sum += key (vs[iter]);
+          }
+          return sum;
+        }
+      , [&vs, half, checksum]
+        {
+          return from (vs) >> take (half) >> checksum;
+        }
+      );
+
+    runner.compare ("take_while", type, count
+      , [&vs, is_not_sentinel]
+        {
+          std::uint64_t sum = 0;
+          for (auto && v : vs)
+          {
+            if (!is_not_sentinel (v))
+            {
+              break;
+            }
+            sum += key (v);
+          }
+          return sum;
+        }
+      , [&vs, is_not_sentinel, checksum]
+        {
+          return from (vs) >> take_while (is_not_sentinel) >> checksum;
+        }
+      );
+
+    // Sinks
+
+    runner.compare ("to_all", type, count
+      , [&vs, is_not_sentinel]
+        {
+          auto result = false;
+          for (auto && v : vs)
+          {
+            if (!(result = is_not_sentinel (v)))
+            {
+              break;
+            }
+          }
+          return result;
+        }
+      , [&vs, is_not_sentinel]
+        {
+          return from (vs) >> to_all (is_not_sentinel);
+        }
+      );
+
+    runner.compare ("to_any", type, count
+      , [&vs, is_sentinel]
+        {
+          for (auto && v : vs)
+          {
+            if (is_sentinel (v))
+            {
+              return true;
+            }
+          }
+          return false;
+        }
+      , [&vs, is_sentinel]
+        {
+          return from (vs) >> to_any (is_sentinel);
+        }
+      );
+
+    runner.compare ("to_iter", type, count
+      , [&vs]
+        {
+          std::uint64_t sum = 0;
+          for (auto && v : vs)
+          {
+            sum += key (v);
+          }
+          return sum;
+        }
+      , [&vs]
+        {
+          std::uint64_t sum = 0;
+          from (vs) >> to_iter ([&sum] (auto && v) { sum += key (v); return true; });
+          return sum;
+        }
+      );
+
+    runner.compare ("to_fold", type, count
+      , [&vs]
+        {
+          std::uint64_t sum = 0;
+          for (auto && v : vs)
+          {
+            sum += key (v);
+          }
+          return sum;
+        }
+      , [&vs, checksum]
+        {
+          return from (vs) >> checksum;
+        }
+      );
+
+    runner.compare ("to_last_or_default", type, count
+      , [&vs]
+        {
+          T const * last = nullptr;
+          for (auto && v : vs)
+          {
+            last = &v;
+          }
+          return last ? key (*last) : key (T ());
+        }
+      , [&vs]
+        {
+          return key (from (vs) >> to_last_or_default);
+        }
+      );
+
+    runner.compare ("to_length", type, count
+      , [&vs]
+        {
+          std::size_t length = 0;
+          for (auto && v : vs)
+          {
+            (void)v;
+            ++length;
+          }
+          return length;
+        }
+      , [&vs]
+        {
+          return from (vs) >> to_length;
+        }
+      );
+
+    runner.compare ("to_map", type, count
+      , [&vs]
+        {
+          std::map<std::uint64_t, T> result;
+          for (auto && v : vs)
+          {
+            result.insert (std::make_pair (key (v), v));
+          }
+          return result.size ();
+        }
+      , [&vs]
+        {
+          return (from (vs) >> to_map ([] (auto && v) { return key (v); })).size ();
+        }
+      );
+
+    runner.compare ("to_max", type, count
+      , [&vs]
+        {
+          auto result = T ();
+          for (auto && v : vs)
+          {
+            if (result < v)
+            {
+              result = v;
+            }
+          }
+          return key (result);
+        }
+      , [&vs]
+        {
+          return key (from (vs) >> to_max (T ()));
+        }
+      );
+
+    runner.compare ("to_min", type, count
+      , [&vs]
+        {
+          auto result = element_traits<T>::largest ();
+          for (auto && v : vs)
+          {
+            if (v < result)
+            {
+              result = v;
+            }
+          }
+          return key (result);
+        }
+      , [&vs]
+        {
+          return key (from (vs) >> to_min (element_traits<T>::largest ()));
+        }
+      );
+
+    runner.compare ("to_set", type, count
+      , [&vs]
+        {
+          std::set<T> result;
+          for (auto && v : vs)
+          {
+            result.insert (v);
+          }
+          return result.size ();
+        }
+      , [&vs]
+        {
+          return (from (vs) >> to_set).size ();
+        }
+      );
+
+    run_sum_benchmarks (runner, type, vs, std::is_arithmetic<T> ());
+
+    runner.compare ("to_vector", type, count
+      , [&vs]
+        {
+          std::vector<T> result;
+          for (auto && v : vs)
+          {
+            result.push_back (v);
+          }
+          return result.size ();
+        }
+      , [&vs]
+        {
+          return (from (vs) >> to_vector).size ();
+        }
+      );
+
+    auto loop_vector      = std::vector<T> ();
+    auto pipeline_vector  = std::vector<T> ();
+
+    runner.compare ("to_vector_into", type, count
+      , [&vs, &loop_vector]
+        {
+          loop_vector.clear ();
+          for (auto && v : vs)
+          {
+            loop_vector.push_back (v);
+          }
+          return loop_vector.size ();
+        }
+      , [&vs, &pipeline_vector]
+        {
+          return (from (vs) >> to_vector_into (pipeline_vector)).size ();
+        }
+      );
+
+    // The pipeline from the README
+
+    runner.compare ("filter_map_sum", type, count
+      , [&vs, is_even]
+        {
+          std::uint64_t sum = 0;
+          for (auto && v : vs)
+          {
+            if (is_even (v))
+            {
+              sum += key (v) + 1;
+            }
+          }
+          return sum;
+        }
+      , [&vs, is_even]
+        {
+          return
+                from (vs)
+            >>  filter (is_even)
+            >>  map ([] (auto && v) { return key (v) + 1; })
+            >>  to_sum
+            ;
+        }
+      );
+
+    // The README pipeline with the source type erased, compared with the
+    //  pipeline rather than a loop to show the cost of the erasure. The
+    //  filter before the erased boundary can't be made branch free like the
+    //  filter of the pipeline so this includes the mispredicted branches,
+    //  any_source_keys erases before the filter to show the batching alone
+
+    auto erased = any_source<std::uint64_t> (from (vs) >> filter (is_even) >> map ([] (auto && v) { return key (v); }));
+
+    runner.compare ("any_source", type, count
+      , [&vs, is_even]
+        {
+          return
+                from (vs)
+            >>  filter (is_even)
+            >>  map ([] (auto && v) { return key (v) + 1; })
+            >>  to_sum
+            ;
+        }
+      , [&erased]
+        {
+          return
+                erased
+            >>  map ([] (auto && v) { return v + 1; })
+            >>  to_sum
+            ;
+        }
+      );
+
+    auto erased_keys = any_source<std::uint64_t> (from (vs) >> map ([] (auto && v) { return key (v); }));
+
+    runner.compare ("any_source_keys", type, count
+      , [&vs]
+        {
+          return
+                from (vs)
+            >>  map ([] (auto && v) { return key (v); })
+            >>  filter ([] (std::uint64_t v) { return v % 2 == 0; })
+            >>  map ([] (std::uint64_t v) { return v + 1; })
+            >>  to_sum
+            ;
+        }
+      , [&erased_keys]
+        {
+          return
+                erased_keys
+            >>  filter ([] (std::uint64_t v) { return v % 2 == 0; })
+            >>  map ([] (std::uint64_t v) { return v + 1; })
+            >>  to_sum
+            ;
+        }
+      );
+  }
+
+  // --------------------------------------------------------------------------
+
+  // Benchmarks of operators that don't scale with the data set size
+  template<typename T>
+  void run_fixed_size_benchmarks (benchmark_runner & runner, char const * type, std::vector<T> const & vs)
+  {
+    using namespace cpp_streams;
+
+    auto const checksum = to_fold (std::uint64_t (0), [] (std::uint64_t s, auto && v) { return s + key (v); });
+
+    struct array_holder
+    {
+      T values[fixed_size_elements];
+    };
+
+    auto const holder = std::make_unique<array_holder> ();
+    std::copy (vs.begin (), vs.begin () + fixed_size_elements, holder->values);
+
+    auto & values = holder->values;
+
+    runner.compare ("from_array", type, fixed_size_elements
+      , [&values]
+        {
+          std::uint64_t sum = 0;
+          for (auto && v : values)
+          {
+            sum += key (v);
+          }
+          return sum;
+        }
+      , [&values, checksum]
+        {
+          return from_array (values) >> checksum;
+        }
+      );
+
+    runner.compare ("from_singleton", type, 1
+      , [&vs]
+        {
+          return key (vs.front ());
+        }
+      , [&vs, checksum]
+        {
+          return from_singleton (vs.front ()) >> checksum;
+        }
+      );
+
+    runner.compare ("from_empty", type, 0
+      , []
+        {
+          return std::uint64_t (0);
+        }
+      , [checksum]
+        {
+          return from_empty<T> () >> checksum;
+        }
+      );
+
+    runner.compare ("to_first_or_default", type, 1
+      , [&vs]
+        {
+          return vs.empty () ? key (T ()) : key (vs.front ());
+        }
+      , [&vs]
+        {
+          return key (from (vs) >> to_first_or_default);
+        }
+      );
+  }
+
+  // --------------------------------------------------------------------------
+
+  template<typename T>
+  void run_element_benchmarks (benchmark_runner & runner)
+  {
+    auto const & options = runner.options ();
+
+    for (auto d : options.distributions)
+    {
+      // Uniform data keeps the plain type name so results compare with
+      //  reports from before distributions were added
+      auto const type = d == distribution::uniform
+        ? std::string (element_traits<T>::name ())
+        : std::string (element_traits<T>::name ()) + ":" + distribution_name (d)
+        ;
+
+      for (auto bytes : data_set_bytes)
+      {
+        if (bytes > options.max_bytes)
+        {
+          continue;
+        }
+
+        auto const count  = std::max (bytes / element_traits<T>::footprint (), fixed_size_elements);
+        auto const vs     = create_elements<T> (count, options.seed, d);
+
+        if (bytes == data_set_bytes[0])
+        {
+          run_fixed_size_benchmarks (runner, type.c_str (), vs);
+        }
+
+        run_operator_benchmarks (runner, type.c_str (), vs);
+      }
+    }
+  }
+
+  inline void run_operator_benchmarks (benchmark_runner & runner)
+  {
+    run_element_benchmarks<int>         (runner);
+    run_element_benchmarks<double>      (runner);
+    run_element_benchmarks<std::string> (runner);
+    run_element_benchmarks<user>        (runner);
+  }
+
+  // --------------------------------------------------------------------------
+
+}
+// ----------------------------------------------------------------------------
+#endif // CPP_STREAMS__OPERATOR_BENCHMARKS__INCLUDE_GUARD
+// ----------------------------------------------------------------------------
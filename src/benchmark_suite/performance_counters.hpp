@@ -0,0 +1,304 @@
+// ----------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef CPP_STREAMS__PERFORMANCE_COUNTERS__INCLUDE_GUARD
+# define CPP_STREAMS__PERFORMANCE_COUNTERS__INCLUDE_GUARD
+// ----------------------------------------------------------------------------
+# include <array>
+# include <cerrno>
+# include <cstdint>
+# include <cstring>
+# include <string>
+# ifdef __linux__
+#   include <linux/perf_event.h>
+#   include <sys/ioctl.h>
+#   include <sys/syscall.h>
+#   include <unistd.h>
+#   define CPP_STREAMS__PERF_EVENTS
+# endif
+// ----------------------------------------------------------------------------
+// Performance counters
+//  On Linux the counters are read with perf_event_open for the calling
+//  thread in user space only. Each counter is opened on its own so that the
+//  available ones are used when some aren't (virtual machines commonly lack
+//  hardware counters, perf_event_paranoid may deny them). Counts are scaled
+//  by enabled/running time when the kernel multiplexes counters
+// ----------------------------------------------------------------------------
+namespace benchmark_suite
+{
+  // --------------------------------------------------------------------------
+
+  enum class counter_kind : std::size_t
+  {
+    cycles            ,
+    instructions      ,
+    branches          ,
+    branch_misses     ,
+    l1d_misses        ,
+    llc_misses        ,
+    context_switches  ,
+    page_faults       ,
+  };
+
+  constexpr std::size_t counter_kind_count = 8;
+
+  // The first software counter, the ones before are hardware counters
+  constexpr std::size_t first_software_counter = static_cast<std::size_t> (counter_kind::context_switches);
+
+  inline char const * counter_name (std::size_t kind) noexcept
+  {
+    static char const * const names[counter_kind_count] =
+    {
+      "cycles"            ,
+      "instructions"      ,
+      "branches"          ,
+      "branch_misses"     ,
+      "l1d_misses"        ,
+      "llc_misses"        ,
+      "context_switches"  ,
+      "page_faults"       ,
+    };
+    return kind < counter_kind_count ? names[kind] : "unknown";
+  }
+
+  // --------------------------------------------------------------------------
+
+  // Counts per run of a benchmark, negative when not available
+  struct counter_values
+  {
+    counter_values () noexcept
+    {
+      values.fill (-1.0);
+    }
+
+    bool has (counter_kind kind) const noexcept
+    {
+      return values[static_cast<std::size_t> (kind)] >= 0;
+    }
+
+    double operator[] (counter_kind kind) const noexcept
+    {
+      return values[static_cast<std::size_t> (kind)];
+    }
+
+    bool any () const noexcept
+    {
+      for (auto v : values)
+      {
+        if (v >= 0)
+        {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // Instructions per cycle, negative when not available
+    double ipc () const noexcept
+    {
+      return has (counter_kind::cycles) && has (counter_kind::instructions) && (*this)[counter_kind::cycles] > 0
+        ? (*this)[counter_kind::instructions] / (*this)[counter_kind::cycles]
+        : -1.0
+        ;
+    }
+
+    std::array<double, counter_kind_count> values;
+  };
+
+  // --------------------------------------------------------------------------
+
+  class performance_counters
+  {
+  public:
+    // A snapshot of the raw counter values
+    struct snapshot
+    {
+      std::array<std::uint64_t, counter_kind_count> value   {};
+      std::array<std::uint64_t, counter_kind_count> enabled {};
+      std::array<std::uint64_t, counter_kind_count> running {};
+    };
+
+    // Sums of counter deltas between snapshots
+    struct accumulator
+    {
+      std::array<double, counter_kind_count>  totals  {};
+      std::size_t                             runs    = 0;
+
+      // The counts per run, only the counters that are open
+      counter_values per_run (performance_counters const & counters) const noexcept
+      {
+        counter_values result;
+        for (auto iter = 0U; iter < counter_kind_count; ++iter)
+        {
+          if (counters.is_open (iter) && runs > 0)
+          {
+            result.values[iter] = totals[iter] / static_cast<double> (runs);
+          }
+        }
+        return result;
+      }
+    };
+
+    performance_counters ()
+    {
+      fds.fill (-1);
+
+#ifdef CPP_STREAMS__PERF_EVENTS
+      open (counter_kind::cycles           , PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+      open (counter_kind::instructions     , PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+      open (counter_kind::branches         , PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS);
+      open (counter_kind::branch_misses    , PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+      open (counter_kind::l1d_misses       , PERF_TYPE_HW_CACHE,
+          PERF_COUNT_HW_CACHE_L1D
+        | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+        | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+        );
+      open (counter_kind::llc_misses       , PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+      open (counter_kind::context_switches , PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES);
+      open (counter_kind::page_faults      , PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS);
+
+      for (auto fd : fds)
+      {
+        if (fd >= 0)
+        {
+          ::ioctl (fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+      }
+#else
+      reason = "performance counters are only supported on Linux";
+#endif
+    }
+
+    performance_counters (performance_counters const &)             = delete;
+    performance_counters & operator= (performance_counters const &) = delete;
+
+    ~performance_counters () noexcept
+    {
+#ifdef CPP_STREAMS__PERF_EVENTS
+      for (auto fd : fds)
+      {
+        if (fd >= 0)
+        {
+          ::close (fd);
+        }
+      }
+#endif
+    }
+
+    bool is_open (std::size_t kind) const noexcept
+    {
+      return fds[kind] >= 0;
+    }
+
+    bool has_hardware () const noexcept
+    {
+      for (auto iter = 0U; iter < first_software_counter; ++iter)
+      {
+        if (is_open (iter))
+        {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    bool any () const noexcept
+    {
+      for (auto iter = 0U; iter < counter_kind_count; ++iter)
+      {
+        if (is_open (iter))
+        {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // Why the first counter that failed couldn't be opened
+    std::string const & unavailable_reason () const noexcept
+    {
+      return reason;
+    }
+
+    snapshot read () const noexcept
+    {
+      snapshot result;
+#ifdef CPP_STREAMS__PERF_EVENTS
+      for (auto iter = 0U; iter < counter_kind_count; ++iter)
+      {
+        std::uint64_t values[3] = {};
+        if (fds[iter] >= 0 && ::read (fds[iter], values, sizeof (values)) == static_cast<ssize_t> (sizeof (values)))
+        {
+          result.value[iter]    = values[0];
+          result.enabled[iter]  = values[1];
+          result.running[iter]  = values[2];
+        }
+      }
+#endif
+      return result;
+    }
+
+    // Adds the counts between before and after to accumulator
+    static void accumulate (snapshot const & before, snapshot const & after, std::size_t runs, accumulator & result) noexcept
+    {
+      for (auto iter = 0U; iter < counter_kind_count; ++iter)
+      {
+        auto const value    = static_cast<double> (after.value[iter]   - before.value[iter]);
+        auto const enabled  = static_cast<double> (after.enabled[iter] - before.enabled[iter]);
+        auto const running  = static_cast<double> (after.running[iter] - before.running[iter]);
+
+        result.totals[iter] += running > 0 ? value * enabled / running : value;
+      }
+      result.runs += runs;
+    }
+
+  private:
+#ifdef CPP_STREAMS__PERF_EVENTS
+    void open (counter_kind kind, std::uint32_t type, std::uint64_t config)
+    {
+      perf_event_attr attr;
+      std::memset (&attr, 0, sizeof (attr));
+      attr.size           = sizeof (attr);
+      attr.type           = type;
+      attr.config         = config;
+      attr.disabled       = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv     = 1;
+      attr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+      auto const fd = static_cast<int> (::syscall (SYS_perf_event_open, &attr, 0, -1, -1, 0));
+      if (fd < 0 && reason.empty ())
+      {
+        reason = std::string (counter_name (static_cast<std::size_t> (kind))) + ": " + std::strerror (errno);
+        if (errno == EACCES || errno == EPERM)
+        {
+          reason += " (see /proc/sys/kernel/perf_event_paranoid)";
+        }
+      }
+
+      fds[static_cast<std::size_t> (kind)] = fd;
+    }
+#endif
+
+    std::array<int, counter_kind_count> fds   ;
+    std::string                         reason;
+  };
+
+  // --------------------------------------------------------------------------
+
+}
+// ----------------------------------------------------------------------------
+#endif // CPP_STREAMS__PERFORMANCE_COUNTERS__INCLUDE_GUARD
+// ----------------------------------------------------------------------------
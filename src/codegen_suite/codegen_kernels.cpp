@@ -0,0 +1,302 @@
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Kernels for verify_codegen.bash, only compiled to an object file
+//  Each kernel__<name>__cpp_streams is a pipeline and kernel__<name>__loop
+//  the loop it should compile into. extern "C" keeps the symbol names
+//  unmangled so that the disassembly of each kernel is easy to find
+
+#include "../cpp_streams/cpp_streams.hpp"
+
+#include <climits>
+#include <cstddef>
+
+using namespace cpp_streams;
+
+extern "C"
+{
+  // --------------------------------------------------------------------------
+
+  int kernel__sum__loop (int const * begin, int const * end)
+  {
+    auto sum = 0;
+    for (auto iter = begin; iter != end; ++iter)
+    {
+      sum += *iter;
+    }
+    return sum;
+  }
+
+  int kernel__sum__cpp_streams (int const * begin, int const * end)
+  {
+    return from_iterators (begin, end) >> to_sum;
+  }
+
+  // --------------------------------------------------------------------------
+
+  int kernel__filter_map_sum__loop (int const * begin, int const * end)
+  {
+    auto sum = 0;
+    for (auto iter = begin; iter != end; ++iter)
+    {
+      if (*iter % 2 == 0)
+      {
+        sum += *iter + 1;
+      }
+    }
+    return sum;
+  }
+
+  int kernel__filter_map_sum__cpp_streams (int const * begin, int const * end)
+  {
+    return
+          from_iterators (begin, end)
+      >>  filter ([] (auto && v) {return v % 2 == 0;})
+      >>  map ([] (auto && v) {return v + 1;})
+      >>  to_sum
+      ;
+  }
+
+  // --------------------------------------------------------------------------
+
+  double kernel__map_sum_double__loop (double const * begin, double const * end)
+  {
+    auto sum = 0.0;
+    for (auto iter = begin; iter != end; ++iter)
+    {
+      sum += *iter * 2;
+    }
+    return sum;
+  }
+
+  double kernel__map_sum_double__cpp_streams (double const * begin, double const * end)
+  {
+    return from_iterators (begin, end) >> map ([] (auto && v) {return v * 2;}) >> to_sum;
+  }
+
+  // --------------------------------------------------------------------------
+
+  std::size_t kernel__filter_length__loop (int const * begin, int const * end)
+  {
+    std::size_t length = 0;
+    for (auto iter = begin; iter != end; ++iter)
+    {
+      if (*iter > 0)
+      {
+        ++length;
+      }
+    }
+    return length;
+  }
+
+  std::size_t kernel__filter_length__cpp_streams (int const * begin, int const * end)
+  {
+    return from_iterators (begin, end) >> filter ([] (auto && v) {return v > 0;}) >> to_length;
+  }
+
+  // --------------------------------------------------------------------------
+
+  int kernel__skip_take_sum__loop (int const * begin, int const * end)
+  {
+    auto sum       = 0;
+    auto remaining = 100;
+    for (auto iter = begin + (end - begin < 3 ? end - begin : 3); iter != end && remaining > 0; ++iter, --remaining)
+    {
+      sum += *iter;
+    }
+    return sum;
+  }
+
+  int kernel__skip_take_sum__cpp_streams (int const * begin, int const * end)
+  {
+    return from_iterators (begin, end) >> skip (3) >> take (100) >> to_sum;
+  }
+
+  // --------------------------------------------------------------------------
+
+  int kernel__take_while_sum__loop (int const * begin, int const * end)
+  {
+    auto sum = 0;
+    for (auto iter = begin; iter != end && *iter >= 0; ++iter)
+    {
+      sum += *iter;
+    }
+    return sum;
+  }
+
+  int kernel__take_while_sum__cpp_streams (int const * begin, int const * end)
+  {
+    return from_iterators (begin, end) >> take_while ([] (auto && v) {return v >= 0;}) >> to_sum;
+  }
+
+  // --------------------------------------------------------------------------
+
+  // Probes must compile to nothing unless built with CPP_STREAMS__INSTRUMENT
+  int kernel__probe_filter_sum__loop (int const * begin, int const * end)
+  {
+    auto sum = 0;
+    for (auto iter = begin; iter != end; ++iter)
+    {
+      if (*iter > 0)
+      {
+        sum += *iter;
+      }
+    }
+    return sum;
+  }
+
+  int kernel__probe_filter_sum__cpp_streams (int const * begin, int const * end)
+  {
+    return
+          from_iterators (begin, end)
+      >>  probe ("source")
+      >>  filter ([] (auto && v) {return v > 0;})
+      >>  probe ("filtered")
+      >>  to_sum
+      ;
+  }
+
+  // --------------------------------------------------------------------------
+
+  bool kernel__any__loop (int const * begin, int const * end)
+  {
+    for (auto iter = begin; iter != end; ++iter)
+    {
+      if (*iter < 0)
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool kernel__any__cpp_streams (int const * begin, int const * end)
+  {
+    return from_iterators (begin, end) >> to_any ([] (auto && v) {return v < 0;});
+  }
+
+  // --------------------------------------------------------------------------
+
+  int kernel__max__loop (int const * begin, int const * end)
+  {
+    auto result = INT_MIN;
+    for (auto iter = begin; iter != end; ++iter)
+    {
+      if (result < *iter)
+      {
+        result = *iter;
+      }
+    }
+    return result;
+  }
+
+  int kernel__max__cpp_streams (int const * begin, int const * end)
+  {
+    return from_iterators (begin, end) >> to_max (INT_MIN);
+  }
+
+  // --------------------------------------------------------------------------
+
+  std::size_t kernel__mapi_sum__loop (int const * begin, int const * end)
+  {
+    std::size_t sum = 0;
+    std::size_t i   = 0;
+    for (auto iter = begin; iter != end; ++iter, ++i)
+    {
+      sum += i * static_cast<std::size_t> (*iter);
+    }
+    return sum;
+  }
+
+  std::size_t kernel__mapi_sum__cpp_streams (int const * begin, int const * end)
+  {
+    return
+          from_iterators (begin, end)
+      >>  mapi ([] (std::size_t i, auto && v) {return i * static_cast<std::size_t> (v);})
+      >>  to_sum
+      ;
+  }
+
+  // --------------------------------------------------------------------------
+
+  unsigned kernel__fold_xor__loop (unsigned const * begin, unsigned const * end)
+  {
+    auto state = 0U;
+    for (auto iter = begin; iter != end; ++iter)
+    {
+      state ^= *iter;
+    }
+    return state;
+  }
+
+  unsigned kernel__fold_xor__cpp_streams (unsigned const * begin, unsigned const * end)
+  {
+    return from_iterators (begin, end) >> to_fold (0U, [] (unsigned s, auto && v) {return s ^ v;});
+  }
+
+  // --------------------------------------------------------------------------
+
+  int kernel__append_sum__loop (int const * first_begin, int const * first_end, int const * second_begin, int const * second_end)
+  {
+    auto sum = 0;
+    for (auto iter = first_begin; iter != first_end; ++iter)
+    {
+      sum += *iter;
+    }
+    for (auto iter = second_begin; iter != second_end; ++iter)
+    {
+      sum += *iter;
+    }
+    return sum;
+  }
+
+  int kernel__append_sum__cpp_streams (int const * first_begin, int const * first_end, int const * second_begin, int const * second_end)
+  {
+    return from_iterators (first_begin, first_end) >> append (from_iterators (second_begin, second_end)) >> to_sum;
+  }
+
+  // --------------------------------------------------------------------------
+
+  void kernel__iter_store__loop (int const * begin, int const * end, int * output)
+  {
+    for (auto iter = begin; iter != end; ++iter)
+    {
+      *output++ = *iter * 2;
+    }
+  }
+
+  void kernel__iter_store__cpp_streams (int const * begin, int const * end, int * output)
+  {
+    from_iterators (begin, end) >> map ([] (auto && v) {return v * 2;}) >> to_iter ([&output] (auto && v) {*output++ = v; return true;});
+  }
+
+  // --------------------------------------------------------------------------
+
+  int kernel__range_sum__loop (int count)
+  {
+    auto sum = 0;
+    for (auto iter = 0; iter < count; ++iter)
+    {
+      sum += iter;
+    }
+    return sum;
+  }
+
+  int kernel__range_sum__cpp_streams (int count)
+  {
+    return from_range (0, count) >> to_sum;
+  }
+
+  // --------------------------------------------------------------------------
+}
@@ -0,0 +1,187 @@
+#!/bin/bash
+# Compiles codegen_kernels.cpp with the available compilers at -O2 and -O3,
+#  disassembles the object files and compares every pipeline kernel with the
+#  hand-written loop it should be equivalent to.
+#
+#  For each kernel the instructions, calls, packed SIMD instructions and
+#  loops (backward jumps) are reported. A pipeline that calls out where the
+#  loop doesn't is a lambda or operator that stopped being inlined and fails
+#  the run. Losing vectorization the loop got is reported as a warning.
+#
+#  Usage: verify_codegen.bash [--save <path>] [--baseline <path>]
+#    --save <path>      Writes the pipeline kernel summaries to path
+#    --baseline <path>  Fails if a pipeline kernel gained calls or lost
+#                       vectorization compared to a saved summary
+#
+#  Extra compiler flags (-march=native for example) are taken from CXXFLAGS.
+#  The SIMD heuristics assume x86-64 and objdump (AT&T syntax)
+
+SAVE_PATH=
+BASELINE_PATH=
+
+while [ $# -gt 0 ]; do
+  case "$1" in
+    --save)     SAVE_PATH="$2";     shift 2 ;;
+    --baseline) BASELINE_PATH="$2"; shift 2 ;;
+    *)          sed -n '2,17s/^# \?//p' "$0"; exit 2 ;;
+  esac
+done
+
+if [ -n "$BASELINE_PATH" ] && [ ! -f "$BASELINE_PATH" ]; then
+  echo "Failed to read baseline $BASELINE_PATH"
+  exit 2
+fi
+
+if ! command -v objdump > /dev/null; then
+  echo "objdump is required"
+  exit 2
+fi
+
+DIR="$(cd "$(dirname "$0")" && pwd)"
+WORK="$(mktemp -d)"
+trap 'rm -rf "$WORK"' EXIT
+
+FLAGS="-DNDEBUG -Wall -Wextra -pedantic --std=c++1y $CXXFLAGS"
+
+# Prints "<function> <instructions> <calls> <vector> <loops>" per kernel
+summarize () {
+  objdump -dr --no-show-raw-insn "$1" | awk '
+    # Portable, mawk lacks strtonum
+    function hex(text,    result, iter) {
+      result = 0
+      for (iter = 1; iter <= length(text); ++iter)
+        result = result * 16 + index("0123456789abcdef", substr(text, iter, 1)) - 1
+      return result
+    }
+    function flush() {
+      if (name != "") print name, insns, calls, vector, loops
+    }
+    /^[0-9a-f]+ <kernel__.*>:$/ {
+      flush()
+      name = $2; gsub(/[<>:]/, "", name)
+      insns = calls = vector = loops = 0; last = ""
+      next
+    }
+    /^[0-9a-f]+ <.*>:$/ { flush(); name = ""; next }
+    name == "" { next }
+    # Tail calls are jmp with a relocation against another symbol
+    /R_X86_64_(PLT32|PC32)/ { if (last ~ /^jmp/) ++calls; next }
+    /^ *[0-9a-f]+:\t/ {
+      split($0, parts, "\t")
+      gsub(/ /, "", parts[1]); address = hex(substr(parts[1], 1, length(parts[1]) - 1))
+      split(parts[2], operands, " ")
+      mnemonic = operands[1]
+      last     = mnemonic
+      if (mnemonic ~ /^(nop|xchg|data16|cs|int3)/) next
+      ++insns
+      if (mnemonic ~ /^call/) ++calls
+      if (mnemonic ~ /^v?p(add|sub|mul|max|min|cmp|shuf|blend|sll|srl|sra|unpck|movmsk|sad|madd|hadd)/ \
+       || mnemonic ~ /^v?(add|sub|mul|div|max|min|hadd)p[sd]$/ \
+       || parts[2] ~ /%ymm|%zmm/) ++vector
+      if (mnemonic ~ /^j/ && match(parts[2], /[ \t][0-9a-f]+ </)) {
+        target = hex(substr(parts[2], RSTART + 1, RLENGTH - 3))
+        if (target < address) ++loops
+      }
+    }
+    END { flush() }
+  '
+}
+
+failures=0
+warnings=0
+compilers=0
+: > "$WORK/summary"
+
+for CXX in g++ clang++; do
+  if ! command -v "$CXX" > /dev/null; then
+    echo "Skipping $CXX (not found)"
+    continue
+  fi
+  compilers=$((compilers + 1))
+
+  for OPT in -O2 -O3; do
+    OBJECT="$WORK/kernels_${CXX}${OPT}.o"
+    if ! "$CXX" $OPT $FLAGS -c "$DIR/codegen_kernels.cpp" -o "$OBJECT"; then
+      echo "Failed to compile with $CXX $OPT"
+      failures=$((failures + 1))
+      continue
+    fi
+
+    summarize "$OBJECT" > "$WORK/current"
+
+    if ! grep -q "__loop " "$WORK/current"; then
+      echo "Found no kernels in the disassembly of $CXX $OPT"
+      failures=$((failures + 1))
+      continue
+    fi
+
+    echo
+    echo "== $CXX $OPT"
+    printf "%-20s %28s   %28s   %s\n" "" "loop" "cpp_streams" ""
+    printf "%-20s %6s %6s %6s %6s   %6s %6s %6s %6s   %s\n" \
+      kernel insns calls vector loops insns calls vector loops verdict
+
+    for KERNEL in $(sed -n 's/^kernel__\(.*\)__loop .*/\1/p' "$WORK/current"); do
+      read -r _ LI LC LV LL <<< "$(grep "^kernel__${KERNEL}__loop " "$WORK/current")"
+      read -r _ PI PC PV PL <<< "$(grep "^kernel__${KERNEL}__cpp_streams " "$WORK/current")"
+
+      if [ -z "$PI" ]; then
+        echo "$KERNEL: missing kernel__${KERNEL}__cpp_streams"
+        failures=$((failures + 1))
+        continue
+      fi
+
+      echo "$CXX $OPT $KERNEL $PI $PC $PV $PL" >> "$WORK/summary"
+
+      VERDICT="ok"
+      if [ "$PC" -gt "$LC" ]; then
+        VERDICT="NOT INLINED"
+        failures=$((failures + 1))
+      elif [ "$LV" -gt 0 ] && [ "$PV" -eq 0 ]; then
+        VERDICT="not vectorized"
+        warnings=$((warnings + 1))
+      elif [ "$PI" -gt $((LI + LI / 4 + 4)) ]; then
+        VERDICT="+$(( (PI - LI) * 100 / LI ))% instructions"
+      fi
+
+      printf "%-20s %6d %6d %6d %6d   %6d %6d %6d %6d   %s\n" \
+        "$KERNEL" "$LI" "$LC" "$LV" "$LL" "$PI" "$PC" "$PV" "$PL" "$VERDICT"
+    done
+  done
+done
+
+if [ "$compilers" -eq 0 ]; then
+  echo "No compiler found"
+  exit 2
+fi
+
+if [ -n "$BASELINE_PATH" ]; then
+  echo
+  echo "Comparing with $BASELINE_PATH"
+  while read -r CXX OPT KERNEL PI PC PV PL; do
+    read -r _ _ _ BI BC BV BL <<< "$(grep "^$CXX $OPT $KERNEL " "$BASELINE_PATH")"
+    if [ -z "$BI" ]; then
+      continue
+    fi
+    if [ "$PC" -gt "$BC" ]; then
+      echo "REGRESSION: $CXX $OPT $KERNEL calls $BC -> $PC (stopped inlining)"
+      failures=$((failures + 1))
+    fi
+    if [ "$BV" -gt 0 ] && [ "$PV" -eq 0 ]; then
+      echo "REGRESSION: $CXX $OPT $KERNEL no longer vectorized"
+      failures=$((failures + 1))
+    fi
+  done < "$WORK/summary"
+fi
+
+if [ -n "$SAVE_PATH" ]; then
+  cp "$WORK/summary" "$SAVE_PATH"
+fi
+
+echo
+if [ "$failures" -gt 0 ]; then
+  echo "Detected $failures code generation regressions"
+  exit 1
+fi
+
+echo "No code generation regressions detected ($warnings warnings)"
@@ -0,0 +1,219 @@
+#!/bin/bash
+# Generates pipelines of increasing depth and operator mix and measures what
+#  they cost to build with the available compilers (g++, clang++).
+#
+#  For each compiler, variant and depth the pipeline is compiled at -O2 and
+#  the best wall time of the runs, peak compiler memory (resident set of
+#  the compiler and its children), object size and text size are reported.
+#  It's compiled once more at -O0 where every instantiated function is
+#  emitted, the defined functions of that object count the instantiations.
+#
+#  Variants
+#    ints     map, filter, take_while and skip over int
+#    records  filter, map, skip_while, take and mapi over a struct
+#    mixed    records with sort_by, reverse and append in the mix
+#
+#  Usage: compile_time_benchmarks.bash [options]
+#    --quick               Depths 1, 4 and 16 with a single run each
+#    --csv <path>          Writes the results as CSV
+#    --baseline <path>     Fails if a result regressed from a CSV baseline
+#    --threshold <f>       Largest change of memory, sizes and instantiations
+#                          (default 0.05)
+#    --time-threshold <f>  Largest change of compile time (default 0.25)
+#
+#  Extra compiler flags are taken from CXXFLAGS. Requires Linux (getrusage)
+#  and binutils (nm, size)
+
+DEPTHS="1 2 4 8 16 32"
+RUNS=3
+CSV_PATH=
+BASELINE_PATH=
+THRESHOLD=0.05
+TIME_THRESHOLD=0.25
+
+while [ $# -gt 0 ]; do
+  case "$1" in
+    --quick)          DEPTHS="1 4 16"; RUNS=1;  shift   ;;
+    --csv)            CSV_PATH="$2";            shift 2 ;;
+    --baseline)       BASELINE_PATH="$2";       shift 2 ;;
+    --threshold)      THRESHOLD="$2";           shift 2 ;;
+    --time-threshold) TIME_THRESHOLD="$2";      shift 2 ;;
+    *)                sed -n '2,26s/^# \?//p' "$0"; exit 2 ;;
+  esac
+done
+
+if [ -n "$BASELINE_PATH" ] && [ ! -f "$BASELINE_PATH" ]; then
+  echo "Failed to read baseline $BASELINE_PATH"
+  exit 2
+fi
+
+DIR="$(cd "$(dirname "$0")" && pwd)"
+WORK="$(mktemp -d)"
+trap 'rm -rf "$WORK"' EXIT
+
+FLAGS="-DNDEBUG -w --std=c++1y -I$DIR/../cpp_streams $CXXFLAGS"
+
+COMPILERS=
+for CXX in g++ clang++; do
+  if command -v "$CXX" > /dev/null; then
+    COMPILERS="$COMPILERS $CXX"
+  else
+    echo "Skipping $CXX (not found)"
+  fi
+done
+
+if [ -z "$COMPILERS" ]; then
+  echo "No compiler found"
+  exit 2
+fi
+
+MEASURE="$WORK/measure_command"
+HELPER_CXX="$(echo $COMPILERS | cut -d' ' -f1)"
+if ! "$HELPER_CXX" -O2 --std=c++1y "$DIR/measure_command.cpp" -o "$MEASURE"; then
+  echo "Failed to build measure_command"
+  exit 2
+fi
+
+# Stages are picked in order (wrapping) until the pipeline is deep enough
+INTS_STAGES=(
+  'map ([] (int v) {return v + 1;})'
+  'filter ([] (int v) {return v % 3 != 0;})'
+  'map ([] (int v) {return v * 2;})'
+  'take_while ([] (int v) {return v < 1000000000;})'
+  'skip (1)'
+)
+
+RECORDS_STAGES=(
+  'filter ([] (record const & v) {return v.id % 3 != 0;})'
+  'map ([] (record const & v) {record r = v; r.score *= 1.5; return r;})'
+  'skip_while ([] (record const & v) {return v.id < 2;})'
+  'take (1000000)'
+  'mapi ([] (std::size_t i, record const & v) {record r = v; r.id += i; return r;})'
+  'filter ([] (record const & v) {return !v.name.empty ();})'
+)
+
+MIXED_STAGES=(
+  'filter ([] (record const & v) {return v.id % 3 != 0;})'
+  'append (from (vs))'
+  'sort_by ([] (record const & v) {return v.score;})'
+  'take (1000000)'
+  'reverse'
+  'map ([] (record const & v) {record r = v; r.score *= 1.5; return r;})'
+)
+
+# generate <variant> <depth>
+generate () {
+  local -n stages="$(echo "$1" | tr a-z A-Z)_STAGES"
+
+  echo '#include "cpp_streams.hpp"'
+  echo '#include <string>'
+  echo '#include <vector>'
+  echo 'using namespace cpp_streams;'
+
+  if [ "$1" = "ints" ]; then
+    echo 'int pipeline (std::vector<int> const & vs)'
+    echo '{'
+    echo '  return from (vs)'
+  else
+    echo 'struct record'
+    echo '{'
+    echo '  std::uint64_t     id    ;'
+    echo '  double            score ;'
+    echo '  std::string       name  ;'
+    echo '  std::vector<int>  tags  ;'
+    echo '};'
+    echo 'double pipeline (std::vector<record> const & vs)'
+    echo '{'
+    echo '  return from (vs)'
+  fi
+
+  for ((iter = 0; iter < $2; ++iter)); do
+    echo "    >> ${stages[iter % ${#stages[@]}]}"
+  done
+
+  if [ "$1" = "ints" ]; then
+    echo '    >> to_sum;'
+  else
+    echo '    >> map ([] (record const & v) {return v.score;})'
+    echo '    >> to_sum;'
+  fi
+  echo '}'
+}
+
+HEADER="compiler,variant,depth,compile_ms,max_rss_kb,instantiated_functions,object_bytes,text_bytes"
+echo "$HEADER" > "$WORK/results.csv"
+
+printf "%-10s %-8s %6s %12s %12s %10s %12s %12s\n" \
+  compiler variant depth compile_ms max_rss_kb functions object_bytes text_bytes
+
+failures=0
+
+for CXX in $COMPILERS; do
+  for VARIANT in ints records mixed; do
+    for DEPTH in $DEPTHS; do
+      SOURCE="$WORK/${VARIANT}_${DEPTH}.cpp"
+      OBJECT="$WORK/${VARIANT}_${DEPTH}.o"
+      generate "$VARIANT" "$DEPTH" > "$SOURCE"
+
+      BEST_MS=
+      MAX_RSS=0
+      for ((run = 0; run < RUNS; ++run)); do
+        if ! MEASURED="$("$MEASURE" "$CXX" -O2 $FLAGS -c "$SOURCE" -o "$OBJECT")"; then
+          echo "Failed to compile $VARIANT/$DEPTH with $CXX"
+          failures=$((failures + 1))
+          continue 2
+        fi
+        read -r MS RSS <<< "$MEASURED"
+        if [ -z "$BEST_MS" ] || awk "BEGIN {exit !($MS < $BEST_MS)}"; then
+          BEST_MS="$MS"
+        fi
+        if [ "$RSS" -gt "$MAX_RSS" ]; then
+          MAX_RSS="$RSS"
+        fi
+      done
+
+      OBJECT_BYTES="$(wc -c < "$OBJECT")"
+      TEXT_BYTES="$(size "$OBJECT" | awk 'NR == 2 {print $1}')"
+
+      "$CXX" -O0 $FLAGS -c "$SOURCE" -o "$OBJECT"
+      FUNCTIONS="$(nm --defined-only "$OBJECT" | grep -c ' [TtWw] ')"
+
+      printf "%-10s %-8s %6d %12.1f %12d %10d %12d %12d\n" \
+        "$CXX" "$VARIANT" "$DEPTH" "$BEST_MS" "$MAX_RSS" "$FUNCTIONS" "$OBJECT_BYTES" "$TEXT_BYTES"
+      echo "$CXX,$VARIANT,$DEPTH,$BEST_MS,$MAX_RSS,$FUNCTIONS,$OBJECT_BYTES,$TEXT_BYTES" >> "$WORK/results.csv"
+    done
+  done
+done
+
+if [ -n "$CSV_PATH" ]; then
+  cp "$WORK/results.csv" "$CSV_PATH"
+fi
+
+if [ -n "$BASELINE_PATH" ]; then
+  echo
+  echo "Comparing with $BASELINE_PATH"
+  if ! awk -F, -v threshold="$THRESHOLD" -v time_threshold="$TIME_THRESHOLD" '
+    FNR == 1 { next }
+    NR == FNR { baseline[$1 "/" $2 "/" $3] = $0; next }
+    {
+      id = $1 "/" $2 "/" $3
+      if (!(id in baseline)) { next }
+      split(baseline[id], b, ",")
+      for (column = 4; column <= 8; ++column) {
+        limit = column == 4 ? time_threshold : threshold
+        if (b[column] > 0 && ($column - b[column]) / b[column] > limit) {
+          printf "REGRESSION: %-24s %-24s %12s -> %12s (%+.1f%%)\n", id, names[column], b[column], $column, ($column - b[column]) * 100 / b[column]
+          ++regressions
+        }
+      }
+    }
+    BEGIN { split("compiler,variant,depth,compile_ms,max_rss_kb,instantiated_functions,object_bytes,text_bytes", names, ",") }
+    END { print regressions + 0 " regressions"; exit regressions > 0 }
+  ' "$BASELINE_PATH" "$WORK/results.csv"; then
+    failures=$((failures + 1))
+  fi
+fi
+
+if [ "$failures" -gt 0 ]; then
+  exit 1
+fi
@@ -0,0 +1,70 @@
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Runs a command and prints "<wall ms> <peak rss kB>" of it and all its
+//  descendants (the compiler driver runs cc1plus as a child), used by
+//  compile_time_benchmarks.bash as /usr/bin/time isn't always installed
+//  Exits with the exit code of the command
+
+#include <chrono>
+#include <cstdio>
+
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+int main (int argc, char * argv[])
+{
+  if (argc < 2)
+  {
+    std::fprintf (stderr, "Usage: measure_command <command> [arguments]\n");
+    return 2;
+  }
+
+  auto const then = std::chrono::steady_clock::now ();
+
+  auto const pid = ::fork ();
+  if (pid < 0)
+  {
+    std::perror ("fork");
+    return 2;
+  }
+
+  if (pid == 0)
+  {
+    ::execvp (argv[1], argv + 1);
+    std::perror ("execvp");
+    _exit (127);
+  }
+
+  int status = 0;
+  while (::waitpid (pid, &status, 0) < 0)
+  {
+  }
+
+  auto const now = std::chrono::steady_clock::now ();
+
+  // The largest resident set of any waited for descendant
+  rusage usage;
+  ::getrusage (RUSAGE_CHILDREN, &usage);
+
+  std::printf (
+      "%.1f %ld\n"
+    , std::chrono::duration<double, std::milli> (now - then).count ()
+    , static_cast<long> (usage.ru_maxrss)
+    );
+
+  return WIFEXITED (status) ? WEXITSTATUS (status) : 1;
+}
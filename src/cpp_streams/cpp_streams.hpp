@@ -28,12 +28,35 @@
   type (type &&)                  = default;\
   type& operator= (type const &)  = default;\
   type& operator= (type &&)       = default
+# define CPP_STREAMS__STEP(step, name, buffers, stops_early, size)  \
+  struct step                                                       \
+  {                                                                 \
+    static constexpr step_description describe () noexcept          \
+    {                                                               \
+      return step_description                                       \
+      {                                                             \
+        name, buffers, stops_early, size_effect::size, "sequential" \
+      };                                                            \
+    }                                                               \
+  }
 // ----------------------------------------------------------------------------
 # include <algorithm>
+# include <atomic>
+# include <iterator>
 # include <map>
+# include <memory>
+# include <new>
 # include <type_traits>
 # include <set>
+# include <stdexcept>
 # include <vector>
+# ifdef CPP_STREAMS__INSTRUMENT
+#   include <string>
+#   include "cpp_streams_instrument.hpp"
+# endif
+# ifdef CPP_STREAMS__TRACE
+#   include "cpp_streams_trace.hpp"
+# endif
 // ----------------------------------------------------------------------------
 // Three kind of objects
 //  1. Sources
@@ -75,11 +98,91 @@ namespace cpp_streams
     using strip_type_t = typename strip_type<TValueType>::type;
 
     // ------------------------------------------------------------------------
+    // Plans
+    //  Every source carries the operators it was built from as a plan type,
+    //  for instance plan<from_step, filter_step, sort_step>. A step describes
+    //  its operator at compile time, explain (see cpp_streams_explain.hpp)
+    //  prints the descriptions of a plan. Sources built without a plan have
+    //  plan<>
+    // ------------------------------------------------------------------------
+
+    // How an operator changes what's known about the number of elements
+    enum class size_effect
+    {
+      exact   , // The number of elements is known before running
+      unknown , // The number of elements isn't known before running
+      keeps   , // As many elements as the upstream source
+      at_most , // At most as many elements as the upstream source
+      limits  , // At most n elements (take)
+    };
+
+    struct step_description
+    {
+      char const *  name        ;
+      bool          buffers     ; // Buffers all elements before passing any on
+      bool          stops_early ; // Stops the upstream source before it's done
+      size_effect   size        ;
+      char const *  strategy    ; // How the operator executes
+    };
+
+    template<typename... TSteps>
+    struct plan
+    {
+    };
+
+    CPP_STREAMS__STEP (from_step            , "from"            , false , false , exact   );
+    CPP_STREAMS__STEP (from_array_step      , "from_array"      , false , false , exact   );
+    CPP_STREAMS__STEP (from_empty_step      , "from_empty"      , false , false , exact   );
+    CPP_STREAMS__STEP (from_iterators_step  , "from_iterators"  , false , false , exact   );
+    CPP_STREAMS__STEP (from_range_step      , "from_range"      , false , false , exact   );
+    CPP_STREAMS__STEP (from_repeat_step     , "from_repeat"     , false , false , exact   );
+    CPP_STREAMS__STEP (from_unfold_step     , "from_unfold"     , false , false , unknown );
+    CPP_STREAMS__STEP (append_step          , "append"          , false , false , unknown );
+    CPP_STREAMS__STEP (collect_step         , "collect"         , false , false , unknown );
+    CPP_STREAMS__STEP (filter_step          , "filter"          , false , false , at_most );
+    CPP_STREAMS__STEP (fused_filter_step    , "filter (fused)"  , false , false , at_most );
+    CPP_STREAMS__STEP (map_step             , "map"             , false , false , keeps   );
+    CPP_STREAMS__STEP (fused_map_step       , "map (fused)"     , false , false , keeps   );
+    CPP_STREAMS__STEP (mapi_step            , "mapi"            , false , false , keeps   );
+    CPP_STREAMS__STEP (probe_step           , "probe"           , false , false , keeps   );
+    CPP_STREAMS__STEP (reverse_step         , "reverse"         , true  , false , keeps   );
+    CPP_STREAMS__STEP (skip_step            , "skip"            , false , false , at_most );
+    CPP_STREAMS__STEP (skip_while_step      , "skip_while"      , false , false , at_most );
+    CPP_STREAMS__STEP (sort_step            , "sort"            , true  , false , keeps   );
+    CPP_STREAMS__STEP (take_step            , "take"            , false , true  , limits  );
+    CPP_STREAMS__STEP (take_while_step      , "take_while"      , false , true  , at_most );
+
+    template<typename TPlan, typename TStep>
+    struct append_plan_step;
+
+    template<typename... TSteps, typename TStep>
+    struct append_plan_step<plan<TSteps...>, TStep>
+    {
+      using type = plan<TSteps..., TStep>;
+    };
+
+    template<typename TPlan>
+    struct last_plan_step;
 
-    template<typename TValueType, typename TSourceFunction>
+    template<typename TStep>
+    struct last_plan_step<plan<TStep>>
+    {
+      using type = TStep;
+    };
+
+    template<typename TFirst, typename TSecond, typename... TSteps>
+    struct last_plan_step<plan<TFirst, TSecond, TSteps...>>
+    {
+      using type = typename last_plan_step<plan<TSecond, TSteps...>>::type;
+    };
+
+    // ------------------------------------------------------------------------
+
+    template<typename TValueType, typename TSourceFunction, typename TPlan = plan<>>
     struct source
     {
-      using value_type = TValueType;
+      using value_type = TValueType ;
+      using plan_type  = TPlan      ;
 
       TSourceFunction source_function;
 
@@ -95,18 +198,65 @@ namespace cpp_streams
       {
       }
 
+      // decltype (auto) as sinks such as to_vector_into return references
       template<typename TSink>
-      CPP_STREAMS__PRELUDE auto operator >> (TSink && sink) const
+      CPP_STREAMS__PRELUDE decltype (auto) operator >> (TSink && sink) const &
       {
-        return sink (*this);
+        return std::forward<TSink> (sink) (*this);
+      }
+
+      // A temporary source is moved into the pipe or sink rather than copied
+      template<typename TSink>
+      CPP_STREAMS__PRELUDE decltype (auto) operator >> (TSink && sink) &&
+      {
+        return std::forward<TSink> (sink) (std::move (*this));
       }
     };
 
     // Adapts a source function into a Source
-    template<typename TValueType, typename TSourceFunction>
+    template<typename TValueType, typename TPlan = plan<>, typename TSourceFunction>
     CPP_STREAMS__PRELUDE auto adapt_source_function (TSourceFunction && source_function)
     {
-      return source<TValueType, TSourceFunction> (std::forward<TSourceFunction> (source_function));
+      return source<TValueType, TSourceFunction, TPlan> (std::forward<TSourceFunction> (source_function));
+    }
+
+    // A pipe holding the functor (or other source) it was created with.
+    //  Applying the pipe calls build (source, functor) which captures the
+    //  functor in the new source. A temporary pipe (from (vs) >> filter (f))
+    //  moves its functor into the source, otherwise it's copied so the pipe
+    //  can be applied again
+    template<typename TFunctor, typename TBuild>
+    struct pipe
+    {
+      TFunctor  functor ;
+      TBuild    build   ;
+
+      CPP_STREAMS__BODY (pipe);
+
+      template<typename TArgument>
+      CPP_STREAMS__PRELUDE pipe (TArgument && functor, TBuild const & build)
+        : functor (std::forward<TArgument> (functor))
+        , build   (build)
+      {
+      }
+
+      template<typename TSource>
+      CPP_STREAMS__PRELUDE auto operator () (TSource && source) const &
+      {
+        return build (std::forward<TSource> (source), TFunctor (functor));
+      }
+
+      template<typename TSource>
+      CPP_STREAMS__PRELUDE auto operator () (TSource && source) &&
+      {
+        return build (std::forward<TSource> (source), std::move (functor));
+      }
+    };
+
+    template<typename TFunctor, typename TBuild>
+    CPP_STREAMS__PRELUDE auto adapt_pipe (TFunctor && functor, TBuild const & build)
+    {
+      return pipe<std::decay_t<TFunctor>, TBuild> (std::forward<TFunctor> (functor), build);
     }
 
     template<typename T>
@@ -118,8 +268,8 @@ namespace cpp_streams
       };
     };
 
-    template<typename TValueType, typename TSource>
-    struct is_source_impl<source<TValueType, TSource>>
+    template<typename TValueType, typename TSource, typename TPlan>
+    struct is_source_impl<source<TValueType, TSource, TPlan>>
     {
       enum
       {
@@ -139,8 +289,8 @@ namespace cpp_streams
     template<typename T>
     struct get_source_value_type_impl;
 
-    template<typename TValueType, typename TSource>
-    struct get_source_value_type_impl<source<TValueType, TSource>>
+    template<typename TValueType, typename TSource, typename TPlan>
+    struct get_source_value_type_impl<source<TValueType, TSource, TPlan>>
     {
       using type = TValueType;
     };
@@ -164,6 +314,733 @@ namespace cpp_streams
     template<typename T>
     using get_stripped_source_value_type_t = typename get_stripped_source_value_type<T>::type;
 
+    // The plan of TSource followed by TStep
+    template<typename TSource, typename TStep>
+    using next_plan_t = typename append_plan_step<typename strip_type_t<TSource>::plan_type, TStep>::type;
+
+    // The last step of the plan of TSource
+    template<typename TSource>
+    using last_step_t = typename last_plan_step<typename strip_type_t<TSource>::plan_type>::type;
+
+    // ------------------------------------------------------------------------
+
+#ifndef CPP_STREAMS__INSTRUMENT
+    template<typename TStep, typename TSource>
+    struct stage_tag
+    {
+    };
+
+    // Counts the elements in and out of a pipe run when built with
+    //  CPP_STREAMS__INSTRUMENT (see cpp_streams_instrument.hpp), otherwise
+    //  compiles to nothing
+    struct stage_counter
+    {
+      template<typename TStep, typename TSource>
+      CPP_STREAMS__PRELUDE stage_counter (stage_tag<TStep, TSource>, char const *) noexcept
+      {
+      }
+
+      CPP_STREAMS__PRELUDE void in () const noexcept
+      {
+      }
+
+      CPP_STREAMS__PRELUDE void out () const noexcept
+      {
+      }
+
+      CPP_STREAMS__PRELUDE bool passed (bool result) const noexcept
+      {
+        return result;
+      }
+    };
+
+    // Attributes the allocations made in its scope to an operator when built
+    //  with CPP_STREAMS__INSTRUMENT (see cpp_streams_instrument.hpp),
+    //  otherwise compiles to nothing
+    struct allocation_scope
+    {
+      explicit CPP_STREAMS__PRELUDE allocation_scope (char const *) noexcept
+      {
+      }
+    };
+#endif
+
+    // Elements buffered by a pipe (reverse, sort) during a run. The buffer
+    //  lives in the source built by the pipe so running that source again
+    //  reuses the capacity of the previous run, which avoids allocating in
+    //  steady state. Copies of a source start with empty buffers and a run
+    //  that finds the buffer busy (a concurrent or nested run of the same
+    //  source) uses a buffer of its own
+    template<typename TValueType, typename TAllocator = std::allocator<TValueType>>
+    class scratch_buffer
+    {
+    public:
+      using buffer_type = std::vector<TValueType, TAllocator>;
+
+      explicit scratch_buffer (TAllocator const & allocator = TAllocator ())
+        : allocator (allocator)
+        , values    (allocator)
+        , busy      (false)
+      {
+      }
+
+      scratch_buffer (scratch_buffer const & o)
+        : allocator (std::allocator_traits<TAllocator>::select_on_container_copy_construction (o.allocator))
+        , values    (allocator)
+        , busy      (false)
+      {
+      }
+
+      scratch_buffer (scratch_buffer && o) noexcept
+        : allocator (o.allocator)
+        , values    (std::move (o.values))
+        , busy      (false)
+      {
+      }
+
+      scratch_buffer & operator= (scratch_buffer const &) = delete;
+      scratch_buffer & operator= (scratch_buffer &&)      = delete;
+
+      // Calls run with an empty buffer, cleared but not freed afterwards.
+      //  Allocating the buffer is attributed to owner
+      template<typename TRun>
+      void use (char const * owner, TRun && run) const
+      {
+        if (busy.exchange (true, std::memory_order_acquire))
+        {
+          auto local = buffer_type (allocator);
+          {
+            allocation_scope scope (owner);
+            local.reserve (default_vector_reserve);
+          }
+          run (local);
+          return;
+        }
+
+        struct release
+        {
+          scratch_buffer const & owner;
+
+          ~release () noexcept
+          {
+            owner.values.clear ();
+            owner.busy.store (false, std::memory_order_release);
+          }
+        } on_exit {*this};
+
+        {
+          allocation_scope scope (owner);
+          values.reserve (default_vector_reserve);
+        }
+        run (values);
+      }
+
+    private:
+      TAllocator const          allocator ;
+      mutable buffer_type       values    ;
+      mutable std::atomic<bool> busy      ;
+    };
+
+    // A value constructed from the first element given rather than default
+    //  constructed and assigned
+    template<typename TValueType>
+    class lazy_value
+    {
+    public:
+      lazy_value () noexcept
+        : storage   {}
+        , has_value (false)
+      {
+      }
+
+      lazy_value (lazy_value const &)             = delete;
+      lazy_value & operator= (lazy_value const &) = delete;
+
+      ~lazy_value () noexcept
+      {
+        if (has_value)
+        {
+          value.~TValueType ();
+        }
+      }
+
+      // Only the first value is kept
+      template<typename TValue>
+      void emplace (TValue && v)
+      {
+        if (!has_value)
+        {
+          new (&value) TValueType (std::forward<TValue> (v));
+          has_value = true;
+        }
+      }
+
+      // Destroys the value kept, if any, and constructs it from v
+      template<typename TValue>
+      void replace (TValue && v)
+      {
+        if (has_value)
+        {
+          has_value = false;
+          value.~TValueType ();
+        }
+
+        new (&value) TValueType (std::forward<TValue> (v));
+        has_value = true;
+      }
+
+      // The value kept or nullptr
+      TValueType const * get () const noexcept
+      {
+        return has_value ? &value : nullptr;
+      }
+
+      // Moves the value out, or a default constructed value if never assigned.
+      //  Types without a default constructor throw std::out_of_range instead
+      TValueType take_or_default ()
+      {
+        if (has_value)
+        {
+          return std::move (value);
+        }
+        else
+        {
+          return make_default (std::is_default_constructible<TValueType> ());
+        }
+      }
+
+    private:
+      static TValueType make_default (std::true_type)
+      {
+        // WORKAROUND: return TValueType {} doesn't work in VS2015 RC
+        return TValueType ();
+      }
+
+      static TValueType make_default (std::false_type)
+      {
+        throw std::out_of_range ("cpp_streams: no value and the value type has no default constructor");
+      }
+
+      // value is only constructed when has_value is true, the storage is
+      //  zeroed so GCC doesn't warn about reads it can't prove are guarded
+      //  by has_value
+      union
+      {
+        unsigned char storage[sizeof (TValueType)];
+        TValueType    value                       ;
+      };
+      bool          has_value ;
+    };
+
+    // ------------------------------------------------------------------------
+
+    // from over an lvalue container, the container must outlive the source
+    template<typename TContainer>
+    CPP_STREAMS__PRELUDE auto from_container (TContainer & container, std::false_type)
+    {
+      using iterator_type = decltype (container.begin ());
+      using value_type    = decltype (*container.begin ());
+
+      return adapt_source_function<value_type, plan<from_step>> (
+        [begin = iterator_type (container.begin ()), end = iterator_type (container.end ())] (auto && sink)
+        {
+          for (auto iter = begin; iter != end && sink (*iter); ++iter)
+            ;
+        });
+    }
+
+    // The container owned by a source built from an rvalue container
+    template<typename TContainer>
+    struct owned_container
+    {
+      explicit owned_container (TContainer && container)
+        : container (std::move (container))
+        , consumed  (false)
+      {
+      }
+
+      TContainer  container ;
+      bool        consumed  ;
+    };
+
+    // A run moving the elements out consumes them, later runs throw rather
+    //  than pass on moved from elements
+    template<typename TContainer>
+    void consume (owned_container<TContainer> & owned, bool move)
+    {
+      if (owned.consumed)
+      {
+        throw std::logic_error ("cpp_streams: the elements owned by the source were moved out by an earlier run");
+      }
+
+      owned.consumed = move;
+    }
+
+    // from over an rvalue container of copyable elements, the container is
+    //  moved into the source and shared by its copies so nothing dangles. A
+    //  source that is the only owner moves the elements out, otherwise they
+    //  are passed on as copies so every run of the copies sees all of them
+    template<typename TContainer>
+    auto from_owned_container (TContainer && container, std::true_type)
+    {
+      using container_type  = strip_type_t<TContainer>                                  ;
+      using element_type    = std::decay_t<decltype (*container.begin ())>              ;
+      using value_type      = decltype (*std::make_move_iterator (container.begin ()))  ;
+
+      auto owned = std::make_shared<owned_container<container_type>> (std::move (container));
+
+      return adapt_source_function<value_type, plan<from_step>> (
+        [owned = std::move (owned)] (auto && sink)
+        {
+          auto & c = owned->container;
+
+          if (owned.use_count () == 1)
+          {
+            consume (*owned, true);
+
+            auto end = std::make_move_iterator (c.end ());
+            for (auto iter = std::make_move_iterator (c.begin ()); iter != end && sink (*iter); ++iter)
+              ;
+          }
+          else
+          {
+            consume (*owned, false);
+
+            auto end = c.end ();
+            for (auto iter = c.begin (); iter != end && sink (element_type (*iter)); ++iter)
+              ;
+          }
+        });
+    }
+
+    // from over an rvalue container of move-only elements, the source owns
+    //  the container and can only be moved. Its run moves the elements out
+    template<typename TContainer>
+    auto from_owned_container (TContainer && container, std::false_type)
+    {
+      using container_type  = strip_type_t<TContainer>                                    ;
+      using value_type      = decltype (*std::make_move_iterator (container.begin ()))  ;
+
+      auto owned = std::make_unique<owned_container<container_type>> (std::move (container));
+
+      return adapt_source_function<value_type, plan<from_step>> (
+        [owned = std::move (owned)] (auto && sink)
+        {
+          consume (*owned, true);
+
+          auto & c  = owned->container;
+          auto end  = std::make_move_iterator (c.end ());
+          for (auto iter = std::make_move_iterator (c.begin ()); iter != end && sink (*iter); ++iter)
+            ;
+        });
+    }
+
+    template<typename TContainer>
+    auto from_container (TContainer && container, std::true_type)
+    {
+      using element_type = std::decay_t<decltype (*container.begin ())>;
+
+      return from_owned_container (std::move (container), std::is_copy_constructible<element_type> ());
+    }
+
+    // ------------------------------------------------------------------------
+
+    // step (state) returns bool, the state is passed on
+    template<typename TState, typename TStep>
+    CPP_STREAMS__PRELUDE auto unfold_source (TState && state, TStep && step, std::true_type)
+    {
+      using state_type = strip_type_t<TState>;
+
+      return adapt_source_function<state_type const &, plan<from_unfold_step>> (
+        [initial = std::forward<TState> (state), step = std::forward<TStep> (step)] (auto && sink)
+        {
+          auto current = initial;
+          while (step (current) && sink (static_cast<state_type const &> (current)))
+            ;
+        });
+    }
+
+    // step (state) returns the value, the value is moved out of the result
+    template<typename TState, typename TStep>
+    CPP_STREAMS__PRELUDE auto unfold_source (TState && state, TStep && step, std::false_type)
+    {
+      using state_type  = strip_type_t<TState>                              ;
+      using result_type = decltype (step (std::declval<state_type &> ()))   ;
+      using value_type  = decltype (*std::declval<result_type> ())          ;
+
+      return adapt_source_function<value_type, plan<from_unfold_step>> (
+        [initial = std::forward<TState> (state), step = std::forward<TStep> (step)] (auto && sink)
+        {
+          auto current = initial;
+          for (;;)
+          {
+            auto next = step (current);
+            if (!next || !sink (*std::move (next)))
+            {
+              break;
+            }
+          }
+        });
+    }
+
+    // ------------------------------------------------------------------------
+
+    // The allocator type of TAllocator rebound to TValueType
+    template<typename TAllocator, typename TValueType>
+    using rebind_allocator_t = typename std::allocator_traits<strip_type_t<TAllocator>>::template rebind_alloc<TValueType>;
+
+    // ------------------------------------------------------------------------
+
+#ifndef CPP_STREAMS__TRACE
+    // Records the scope as a trace event when built with CPP_STREAMS__TRACE
+    //  (see cpp_streams_trace.hpp), otherwise compiles to nothing
+    struct trace_scope
+    {
+      explicit CPP_STREAMS__PRELUDE trace_scope (char const *) noexcept
+      {
+      }
+    };
+#endif
+
+    // ------------------------------------------------------------------------
+    // Fusion
+    //  filter, map, take and sort build sources with named source functions
+    //  so that the pipes and sinks applied to them can rewrite the pipeline
+    //  at compile time:
+    //    filter (a) >> filter (b)          => filter (a && b)
+    //    map (f) >> map (g)                => map (g (f))
+    //    map (f) >> take (n)               => take (n) >> map (f)
+    //    map (f) >> to_length              => to_length
+    //    sort (s) >> to_first_or_default   => smallest element by s
+    //  The rewrites assume testers, mappers and sorters have no side effects,
+    //  for instance map (f) >> to_length never calls f
+    // ------------------------------------------------------------------------
+
+    // True if TSource is a source built with the source function TFunction
+    template<typename TSource, template<typename...> class TFunction>
+    struct has_source_function_impl : std::false_type
+    {
+    };
+
+    template<typename TValueType, template<typename...> class TFunction, typename... TArguments, typename TPlan>
+    struct has_source_function_impl<source<TValueType, TFunction<TArguments...>, TPlan>, TFunction> : std::true_type
+    {
+    };
+
+    template<typename TSource, template<typename...> class TFunction>
+    using has_source_function = has_source_function_impl<strip_type_t<TSource>, TFunction>;
+
+    // ------------------------------------------------------------------------
+
+    template<typename TFirst, typename TSecond>
+    struct and_tester
+    {
+      TFirst  first   ;
+      TSecond second  ;
+
+      template<typename TValue>
+      CPP_STREAMS__PRELUDE bool operator () (TValue && v) const
+      {
+        return first (v) && second (v);
+      }
+    };
+
+    template<typename TFirst, typename TSecond>
+    struct composed_mapper
+    {
+      TFirst  first   ;
+      TSecond second  ;
+
+      template<typename TValue>
+      CPP_STREAMS__PRELUDE decltype (auto) operator () (TValue && v) const
+      {
+        return second (first (std::forward<TValue> (v)));
+      }
+    };
+
+    // ------------------------------------------------------------------------
+
+    template<typename TSource, typename TTester>
+    struct filter_function
+    {
+      TSource source  ;
+      TTester tester  ;
+
+      template<typename TSink>
+      CPP_STREAMS__PRELUDE void operator () (TSink && sink) const
+      {
+        auto & tester = this->tester;
+        stage_counter counter (stage_tag<filter_step, TSource> (), "filter");
+
+        source.source_function ([&tester, &sink, &counter] (auto && v)
+        {
+          counter.in ();
+          if (tester (v))
+          {
+            counter.out ();
+            return counter.passed (sink (std::forward<decltype (v)> (v)));
+          }
+          else
+          {
+            return true;
+          }
+        });
+      }
+    };
+
+    template<typename TStep = filter_step, typename TSource, typename TTester>
+    CPP_STREAMS__PRELUDE auto filter_source (TSource && source, TTester && tester, std::false_type)
+    {
+      using source_type = strip_type_t<TSource>                       ;
+      using tester_type = strip_type_t<TTester>                       ;
+      using value_type  = get_source_value_type_t<source_type>        ;
+      using function    = filter_function<source_type, tester_type>   ;
+
+      return adapt_source_function<value_type, next_plan_t<source_type, TStep>> (function {std::forward<TSource> (source), std::forward<TTester> (tester)});
+    }
+
+    // filter (a) >> filter (b) => filter (a && b)
+    template<typename TSource, typename TTester>
+    CPP_STREAMS__PRELUDE auto filter_source (TSource && source, TTester && tester, std::true_type)
+    {
+      using first_type  = decltype (source.source_function.tester)    ;
+      using second_type = strip_type_t<TTester>                       ;
+      using tester_type = and_tester<first_type, second_type>         ;
+
+      return filter_source<fused_filter_step> (
+          std::forward<TSource> (source).source_function.source
+        , tester_type {std::forward<TSource> (source).source_function.tester, std::forward<TTester> (tester)}
+        , std::false_type ()
+        );
+    }
+
+    // ------------------------------------------------------------------------
+
+    template<typename TSource, typename TMapper>
+    struct map_function
+    {
+      TSource source  ;
+      TMapper mapper  ;
+
+      template<typename TSink>
+      CPP_STREAMS__PRELUDE void operator () (TSink && sink) const
+      {
+        auto & mapper = this->mapper;
+
+        source.source_function ([&mapper, &sink] (auto && v)
+        {
+          return sink (mapper (std::forward<decltype (v)> (v)));
+        });
+      }
+    };
+
+    template<typename TStep = map_step, typename TSource, typename TMapper>
+    CPP_STREAMS__PRELUDE auto map_source (TSource && source, TMapper && mapper, std::false_type)
+    {
+      using source_type     = strip_type_t<TSource>                       ;
+      using mapper_type     = strip_type_t<TMapper>                       ;
+      using value_type      = get_source_value_type_t<source_type>        ;
+      using map_value_type  = std::result_of_t<mapper_type (value_type)>  ;
+      using function        = map_function<source_type, mapper_type>      ;
+
+      return adapt_source_function<map_value_type, next_plan_t<source_type, TStep>> (function {std::forward<TSource> (source), std::forward<TMapper> (mapper)});
+    }
+
+    // map (f) >> map (g) => map (g (f))
+    template<typename TSource, typename TMapper>
+    CPP_STREAMS__PRELUDE auto map_source (TSource && source, TMapper && mapper, std::true_type)
+    {
+      using first_type  = decltype (source.source_function.mapper)    ;
+      using second_type = strip_type_t<TMapper>                       ;
+      using mapper_type = composed_mapper<first_type, second_type>    ;
+
+      return map_source<fused_map_step> (
+          std::forward<TSource> (source).source_function.source
+        , mapper_type {std::forward<TSource> (source).source_function.mapper, std::forward<TMapper> (mapper)}
+        , std::false_type ()
+        );
+    }
+
+    // ------------------------------------------------------------------------
+
+    template<typename TSource>
+    struct take_function
+    {
+      TSource     source  ;
+      std::size_t count   ;
+
+      template<typename TSink>
+      CPP_STREAMS__PRELUDE void operator () (TSink && sink) const
+      {
+        auto remaining = count;
+        stage_counter counter (stage_tag<take_step, TSource> (), "take");
+
+        source.source_function ([&remaining, &sink, &counter] (auto && v)
+        {
+          counter.in ();
+          if (remaining > 0)
+          {
+            --remaining;
+            counter.out ();
+            return counter.passed (sink (std::forward<decltype (v)> (v)));
+          }
+          else
+          {
+            return false;
+          }
+        });
+      }
+    };
+
+    template<typename TSource>
+    CPP_STREAMS__PRELUDE auto take_source (TSource && source, std::size_t count, std::false_type)
+    {
+      using source_type = strip_type_t<TSource>                 ;
+      using value_type  = get_source_value_type_t<source_type>  ;
+      using function    = take_function<source_type>            ;
+
+      return adapt_source_function<value_type, next_plan_t<source_type, take_step>> (function {std::forward<TSource> (source), count});
+    }
+
+    // map (f) >> take (n) => take (n) >> map (f), take sees the element
+    //  after the last one taken so f is called one time less
+    template<typename TSource>
+    CPP_STREAMS__PRELUDE auto take_source (TSource && source, std::size_t count, std::true_type)
+    {
+      using inner_type  = decltype (source.source_function.source);
+
+      return map_source<last_step_t<TSource>> (
+          take_source (
+              std::forward<TSource> (source).source_function.source
+            , count
+            , has_source_function<inner_type, map_function> ()
+            )
+        , std::forward<TSource> (source).source_function.mapper
+        , std::false_type ()
+        );
+    }
+
+    // ------------------------------------------------------------------------
+
+#ifndef _MSC_VER
+    template<typename TSource, typename TSorter, typename TBuffer>
+    struct sort_function
+    {
+      TSource source  ;
+      TSorter sorter  ;
+      TBuffer buffer  ;
+
+      template<typename TSink>
+      void operator () (TSink && sink) const
+      {
+        auto & source = this->source;
+        auto & sorter = this->sorter;
+
+        buffer.use ("sort", [&sorter, &source, &sink] (auto & result)
+        {
+          {
+            trace_scope scope ("sort.buffer");
+
+            source.source_function ([&result] (auto && v)
+            {
+              allocation_scope owner ("sort");
+              result.push_back (std::forward<decltype (v)> (v));
+              return true;
+            });
+          }
+
+          {
+            trace_scope scope ("sort.sort");
+
+            std::sort (
+                result.begin ()
+              , result.end ()
+              , sorter
+              );
+          }
+
+          trace_scope scope ("sort.emit");
+
+          auto sz = result.size ();
+          for (auto iter = 0U; iter < sz && sink (std::move (result[iter])); ++iter)
+            ;
+        });
+      }
+    };
+#endif
+
+    // ------------------------------------------------------------------------
+
+    template<typename TSource>
+    auto first_or_default (TSource && source, std::false_type)
+    {
+      using source_type = decltype (source);
+      using value_type  = get_stripped_source_value_type_t<source_type>;
+
+      lazy_value<value_type> result;
+
+      source.source_function (
+        [&result] (auto && v)
+        {
+          result.emplace (std::forward<decltype (v)> (v));
+          return false;
+        });
+
+      return result.take_or_default ();
+    }
+
+#ifndef _MSC_VER
+    // sort (s) >> to_first_or_default => smallest element by s, as std::sort
+    //  isn't stable any of the smallest elements is a valid first element
+    template<typename TSource>
+    auto first_or_default (TSource && source, std::true_type)
+    {
+      using source_type = decltype (source);
+      using value_type  = get_stripped_source_value_type_t<source_type>;
+
+      auto & sorter = source.source_function.sorter;
+
+      lazy_value<value_type> result;
+
+      source.source_function.source.source_function (
+        [&result, &sorter] (auto && v)
+        {
+          auto smallest = result.get ();
+          if (!smallest || sorter (v, *smallest))
+          {
+            result.replace (std::forward<decltype (v)> (v));
+          }
+          return true;
+        });
+
+      return result.take_or_default ();
+    }
+#endif
+
+    // ------------------------------------------------------------------------
+
+    template<typename TSource>
+    CPP_STREAMS__PRELUDE std::size_t length (TSource && source, std::false_type)
+    {
+      std::size_t result = 0;
+
+      source.source_function (
+        [&result] (auto &&)
+        {
+          ++result;
+          return true;
+        });
+
+      return result;
+    }
+
+    // map (f) >> to_length => to_length
+    template<typename TSource>
+    CPP_STREAMS__PRELUDE std::size_t length (TSource && source, std::true_type)
+    {
+      return length (source.source_function.source, std::false_type ());
+    }
+
     // ------------------------------------------------------------------------
 
   }
@@ -178,7 +1055,7 @@ namespace cpp_streams
     using end_type    = decltype (end)        ;
     using value_type  = decltype (*(&begin))  ;
 
-    return detail::adapt_source_function<value_type> (
+    return detail::adapt_source_function<value_type, detail::plan<detail::from_range_step>> (
       [begin = std::forward<begin_type> (begin), end = std::forward<end_type> (end)] (auto && sink)
       {
         for (auto iter = begin; iter < end && sink (iter); ++iter)
@@ -196,7 +1073,7 @@ namespace cpp_streams
 
     static_assert (std::is_same<begin_type, end_type>::value, "begin and end should be of same type");
 
-    return detail::adapt_source_function<value_type> (
+    return detail::adapt_source_function<value_type, detail::plan<detail::from_iterators_step>> (
       [begin = std::forward<begin_type> (begin), end = std::forward<end_type> (end)] (auto && sink)
       {
         for (auto iter = begin; iter != end && sink (*iter); ++iter)
@@ -206,9 +1083,21 @@ namespace cpp_streams
 
   // --------------------------------------------------------------------------
 
+  // An rvalue container (from (load_rows ()) or from (std::move (vs))) is
+  //  owned by the source. When no copy of the source shares it the elements
+  //  are moved out by the run, running the source again throws
+  //  std::logic_error. While copies share it the elements are passed on as
+  //  copies. A source of move-only elements (std::unique_ptr) can only be
+  //  moved. An lvalue container isn't owned, it must outlive running the
+  //  source
   auto from = [] (auto && container)
   {
-    return from_iterators (container.begin (), container.end ());
+    using container_type = decltype (container);
+
+    return detail::from_container (
+        std::forward<container_type> (container)
+      , std::is_rvalue_reference<container_type> ()
+      );
   };
 
   // --------------------------------------------------------------------------
@@ -220,7 +1109,15 @@ namespace cpp_streams
     static_assert (std::is_array<array_type>::value, "arr must be a C-Style array");
 
     // arr + 0 makes the expression a pointer
-    return from_iterators (arr + 0, arr + std::extent<array_type, 0>::value);
+    auto begin  = arr + 0;
+    auto end    = begin + std::extent<array_type, 0>::value;
+
+    return detail::adapt_source_function<decltype (*begin), detail::plan<detail::from_array_step>> (
+      [begin, end] (auto && sink)
+      {
+        for (auto iter = begin; iter != end && sink (*iter); ++iter)
+          ;
+      });
   };
 
   // --------------------------------------------------------------------------
@@ -228,7 +1125,7 @@ namespace cpp_streams
   template<typename TValue>
   CPP_STREAMS__PRELUDE auto from_empty ()
   {
-    return detail::adapt_source_function<TValue> (
+    return detail::adapt_source_function<TValue, detail::plan<detail::from_empty_step>> (
       [] (auto &&)
       {
       });
@@ -240,7 +1137,7 @@ namespace cpp_streams
   {
     using value_type = decltype (value);
 
-    return detail::adapt_source_function<value_type> (
+    return detail::adapt_source_function<value_type, detail::plan<detail::from_repeat_step>> (
       [count, value = std::forward<value_type> (value)] (auto && sink)
       {
         for (auto iter = 0U; iter < count && sink (value); ++iter)
@@ -257,6 +1154,24 @@ namespace cpp_streams
     return from_repeat (std::forward<value_type> (value), 1);
   };
 
+  // --------------------------------------------------------------------------
+
+  // step (state) advances state and returns the next value as an optional
+  //  like type (std::optional, a pointer into state, ...) that is empty when
+  //  there are no more values, each run starts over from state which isn't
+  //  passed on itself:
+  //    from_unfold (0, [] (int & s) -> std::optional<int> { if (++s > 3) return {}; return s * 10; }) => 10, 20, 30
+  //  A step returning bool passes on the state it advanced to:
+  //    from_unfold (0, [] (int & s) { return ++s <= 3; }) => 1, 2, 3
+  auto from_unfold = [] (auto && state, auto && step)
+  {
+    using state_type  = detail::strip_type_t<decltype (state)>                        ;
+    using result_type = decltype (step (std::declval<state_type &> ()))               ;
+    using is_bool     = std::is_same<detail::strip_type_t<result_type>, bool>         ;
+
+    return detail::unfold_source (std::forward<decltype (state)> (state), std::forward<decltype (step)> (step), is_bool ());
+  };
+
   // --------------------------------------------------------------------------
   // Pipes
   // --------------------------------------------------------------------------
@@ -265,224 +1180,243 @@ namespace cpp_streams
   {
     CPP_STREAMS__CHECK_SOURCE (other_source);
 
-#ifndef _MSC_VER
-    // WORKAROUND: G++ gets confused with other_source_type declared inside lambda
-    using other_source_type = decltype (other_source)                           ;
-#endif
-
-    return
-      // WORKAROUND: perfect forwarding preferable
-      [other_source] (auto && source)
-      {
-        CPP_STREAMS__CHECK_SOURCE (source);
+    return detail::adapt_pipe (
+        std::forward<decltype (other_source)> (other_source)
+      , [] (auto && source, auto && other_source)
+        {
+          CPP_STREAMS__CHECK_SOURCE (source);
 
-        using source_type       = decltype (source)                                 ;
-#ifdef _MSC_VER
-        // WORKAROUND: VS2015 RC ICE:s if other_source_type is put in outer scope
-        using other_source_type = decltype (other_source)                           ;
-#endif
-        using value_type        = detail::get_source_value_type_t<source_type>      ;
-        using other_value_type  = detail::get_source_value_type_t<other_source_type>;
+          using source_type       = decltype (source)                                 ;
+          using other_source_type = decltype (other_source)                           ;
+          using value_type        = detail::get_source_value_type_t<source_type>      ;
+          using other_value_type  = detail::get_source_value_type_t<other_source_type>;
 
-        static_assert (std::is_convertible<other_value_type, value_type>::value, "TOtherSource values must be convertible into a TSource value");
+          static_assert (std::is_convertible<other_value_type, value_type>::value, "TOtherSource values must be convertible into a TSource value");
 
-        return detail::adapt_source_function<value_type> (
-          [other_source = other_source, source = std::forward<source_type> (source)] (auto && sink)
-          {
-            source.source_function ([&sink] (auto && v)
+          return detail::adapt_source_function<value_type, detail::next_plan_t<source_type, detail::append_step>> (
+            [other_source = std::forward<other_source_type> (other_source), source = std::forward<source_type> (source)] (auto && sink)
             {
-              return sink (std::forward<decltype (v)> (v));
-            });
+              source.source_function ([&sink] (auto && v)
+              {
+                return sink (std::forward<decltype (v)> (v));
+              });
 
-            other_source.source_function ([&sink] (auto && v)
-            {
-              return sink (std::forward<decltype (v)> (v));
+              other_source.source_function ([&sink] (auto && v)
+              {
+                return sink (std::forward<decltype (v)> (v));
+              });
             });
-          });
-      };
+        });
   };
 
   // --------------------------------------------------------------------------
 
   auto collect = [] (auto && collector)
   {
-#ifndef _MSC_VER
-    // WORKAROUND: G++ gets confused with collector_type declared inside lambda
-    using collector_type    = decltype (collector)                              ;
-#endif
-    return
-      // WORKAROUND: perfect forwarding preferable
-      [collector] (auto && source)
-      {
-        CPP_STREAMS__CHECK_SOURCE (source);
+    return detail::adapt_pipe (
+        std::forward<decltype (collector)> (collector)
+      , [] (auto && source, auto && collector)
+        {
+          CPP_STREAMS__CHECK_SOURCE (source);
 
-#ifdef _MSC_VER
-        // WORKAROUND: VS2015 RC ICE:s if collector_type is put in outer scope
-        using collector_type    = decltype (collector)                              ;
-#endif
-        using source_type       = decltype (source)                                 ;
-        using value_type        = detail::get_source_value_type_t<source_type>      ;
-        using inner_source_type = std::result_of_t<collector_type (value_type)>     ;
-        using inner_value_type  = detail::get_source_value_type_t<inner_source_type>;
+          using collector_type    = decltype (collector)                              ;
+          using source_type       = decltype (source)                                 ;
+          using value_type        = detail::get_source_value_type_t<source_type>      ;
+          using inner_source_type = std::result_of_t<collector_type (value_type)>     ;
+          using inner_value_type  = detail::get_source_value_type_t<inner_source_type>;
 
-        return detail::adapt_source_function<inner_value_type> (
-          [collector, source = std::forward<source_type> (source)] (auto && sink)
-          {
-            source.source_function ([&collector, &sink] (auto && v)
+          return detail::adapt_source_function<inner_value_type, detail::next_plan_t<source_type, detail::collect_step>> (
+            [collector = std::forward<collector_type> (collector), source = std::forward<source_type> (source)] (auto && sink)
             {
-              auto result = true;
+              source.source_function ([&collector, &sink] (auto && v)
+              {
+                auto result = true;
 
-              // Don't use std::forward<decltype (v)> (v) as this might cause v to destroy
-              //  If the inner_source is member field of v we do like v to live on
-              auto inner_source = collector (v);
+                // Don't use std::forward<decltype (v)> (v) as this might cause v to destroy
+                //  If the inner_source is member field of v we do like v to live on
+                auto inner_source = collector (v);
 
-              CPP_STREAMS__CHECK_SOURCE (inner_source);
+                CPP_STREAMS__CHECK_SOURCE (inner_source);
 
-              inner_source.source_function ([&result, &sink] (auto && iv)
-              {
-                return result = sink (std::forward<decltype (iv)> (iv));
-              });
+                inner_source.source_function ([&result, &sink] (auto && iv)
+                {
+                  return result = sink (std::forward<decltype (iv)> (iv));
+                });
 
-              return result;
+                return result;
+              });
             });
-          });
+        });
+  };
 
-      };
+  // --------------------------------------------------------------------------
+
+  auto filter = [] (auto && tester)
+  {
+    return detail::adapt_pipe (
+        std::forward<decltype (tester)> (tester)
+      , [] (auto && source, auto && tester)
+        {
+          CPP_STREAMS__CHECK_SOURCE (source);
 
+          using source_type = decltype (source);
+
+          return detail::filter_source (
+              std::forward<source_type> (source)
+            , std::forward<decltype (tester)> (tester)
+            , detail::has_source_function<source_type, detail::filter_function> ()
+            );
+        });
   };
 
   // --------------------------------------------------------------------------
 
-  auto filter = [] (auto && tester)
+  auto map = [] (auto && mapper)
   {
-    // using tester_type = decltype (tester);
+    return detail::adapt_pipe (
+        std::forward<decltype (mapper)> (mapper)
+      , [] (auto && source, auto && mapper)
+        {
+          CPP_STREAMS__CHECK_SOURCE (source);
 
-    return
-      // WORKAROUND: perfect forwarding preferable
-      [tester] (auto && source)
-      {
-        CPP_STREAMS__CHECK_SOURCE (source);
+          using source_type = decltype (source);
 
-        using source_type = decltype (source)                           ;
-        using value_type  = detail::get_source_value_type_t<source_type>;
+          return detail::map_source (
+              std::forward<source_type> (source)
+            , std::forward<decltype (mapper)> (mapper)
+            , detail::has_source_function<source_type, detail::map_function> ()
+            );
+        });
+  };
 
-        return detail::adapt_source_function<value_type> (
-          [tester, source = std::forward<source_type> (source)] (auto && sink)
-          {
-            source.source_function ([&tester, &sink] (auto && v)
+  // --------------------------------------------------------------------------
+
+  auto mapi = [] (auto && mapper)
+  {
+    return detail::adapt_pipe (
+        std::forward<decltype (mapper)> (mapper)
+      , [] (auto && source, auto && mapper)
+        {
+          CPP_STREAMS__CHECK_SOURCE (source);
+
+          using mapper_type     = decltype (mapper)                                       ;
+          using source_type     = decltype (source)                                       ;
+          using value_type      = detail::get_source_value_type_t<source_type>            ;
+          using map_value_type  = std::result_of_t<mapper_type (std::size_t, value_type)> ;
+
+          return detail::adapt_source_function<map_value_type, detail::next_plan_t<source_type, detail::mapi_step>> (
+            [mapper = std::forward<mapper_type> (mapper), source = std::forward<source_type> (source)] (auto && sink)
             {
-              if (tester (v))
-              {
-                return sink (std::forward<decltype (v)> (v));
-              }
-              else
-              {
-                return true;
-              }
+              std::size_t iter = 0U;
+
+              source.source_function ([&iter, &mapper, &sink] (auto && v)
+              {
+                return sink (mapper (iter++, std::forward<decltype (v)> (v)));
+              });
             });
-          });
-      };
+        });
   };
 
   // --------------------------------------------------------------------------
 
-  auto map = [] (auto && mapper)
+  // Counts the elements passing and samples the time spent downstream under
+  //  name when built with CPP_STREAMS__INSTRUMENT, otherwise passes the
+  //  source through
+  auto probe = [] (char const * name)
   {
-#ifndef _MSC_VER
-    // WORKAROUND: G++ gets confused with mapper_type declared inside lambda
-    using mapper_type     = decltype (mapper);
-#endif
-
+#ifdef CPP_STREAMS__INSTRUMENT
     return
-      // WORKAROUND: perfect forwarding preferable
-      [mapper] (auto && source)
+      [name = std::string (name)] (auto && source)
       {
         CPP_STREAMS__CHECK_SOURCE (source);
 
-#ifdef _MSC_VER
-        // WORKAROUND: VS2015 RC ICE:s if mapper_type is put in outer scope
-        using mapper_type     = decltype (mapper)                           ;
-#endif
-        using source_type     = decltype (source)                           ;
-        using value_type      = detail::get_source_value_type_t<source_type>;
-        using map_value_type  = std::result_of_t<mapper_type (value_type)>  ;
+        using source_type = decltype (source)                           ;
+        using value_type  = detail::get_source_value_type_t<source_type>;
 
-        return detail::adapt_source_function<map_value_type> (
-          [mapper, source = std::forward<source_type> (source)] (auto && sink)
+        // Looked up once per probe built, the runs only add to the slot
+        auto slot = &detail::stage_registry::instance ().slot (
+            detail::stage_key<detail::probe_step, detail::strip_type_t<source_type>> ()
+          , name
+          );
+
+        return detail::adapt_source_function<value_type, detail::next_plan_t<source_type, detail::probe_step>> (
+          [slot, source = std::forward<source_type> (source)] (auto && sink)
           {
-            source.source_function ([&mapper, &sink] (auto && v)
+            detail::stage_counter counter (*slot);
+
+            source.source_function ([&sink, &counter] (auto && v)
             {
-              return sink (mapper (std::forward<decltype (v)> (v)));
+              return counter.downstream ([&sink, &v] { return sink (std::forward<decltype (v)> (v)); });
             });
           });
       };
+#else
+    (void)name;
+
+    return
+      [] (auto && source)
+      {
+        CPP_STREAMS__CHECK_SOURCE (source);
+
+        return std::forward<decltype (source)> (source);
+      };
+#endif
   };
 
   // --------------------------------------------------------------------------
 
-  auto mapi = [] (auto && mapper)
-  {
 #ifndef _MSC_VER
-    // WORKAROUND: G++ gets confused with mapper_type declared inside lambda
-    using mapper_type     = decltype (mapper);
-#endif
+  // reverse buffering the elements in memory from allocator
+  auto reverse_using = [] (auto && allocator)
+  {
+    using allocator_type = decltype (allocator);
 
     return
-      // WORKAROUND: perfect forwarding preferable
-      [mapper] (auto && source)
+      [allocator = std::forward<allocator_type> (allocator)] (auto && source)
       {
         CPP_STREAMS__CHECK_SOURCE (source);
 
-#ifdef _MSC_VER
-        // WORKAROUND: VS2015 RC ICE:s if mapper_type is put in outer scope
-        using mapper_type     = decltype (mapper)                                       ;
-#endif
-        using source_type     = decltype (source)                                       ;
-        using value_type      = detail::get_source_value_type_t<source_type>            ;
-        using map_value_type  = std::result_of_t<mapper_type (std::size_t, value_type)> ;
-
-        return detail::adapt_source_function<map_value_type> (
-          [mapper, source = std::forward<source_type> (source)] (auto && sink)
+        using source_type         = decltype (source)                                                     ;
+        using stripped_value_type = detail::get_stripped_source_value_type_t<source_type>                 ;
+        // Added std::add_rvalue_reference_t to allow moving of vector copies
+        using value_type          = std::add_rvalue_reference_t<stripped_value_type>                      ;
+        using buffer_type         = detail::scratch_buffer<
+            stripped_value_type
+          , detail::rebind_allocator_t<allocator_type, stripped_value_type>
+          >;
+
+        return detail::adapt_source_function<value_type, detail::next_plan_t<source_type, detail::reverse_step>> (
+          [source = std::forward<source_type> (source), buffer = buffer_type (allocator)] (auto && sink)
           {
-            std::size_t iter = 0U;
-
-            source.source_function ([&iter, &mapper, &sink] (auto && v)
+            buffer.use ("reverse", [&source, &sink] (auto & result)
             {
-              return sink (mapper (iter++, std::forward<decltype (v)> (v)));
+              {
+                detail::trace_scope scope ("reverse.buffer");
+
+                source.source_function ([&result] (auto && v)
+                {
+                  detail::allocation_scope owner ("reverse");
+                  result.push_back (std::forward<decltype (v)> (v));
+                  return true;
+                });
+              }
+
+              detail::trace_scope scope ("reverse.emit");
+
+              auto iter = result.size ();
+              while (iter != 0 && sink (std::move (result[--iter])))
+                ;
             });
           });
       };
   };
 
-  // --------------------------------------------------------------------------
-
-#ifndef _MSC_VER
   auto reverse =
     [] (auto && source)
     {
       CPP_STREAMS__CHECK_SOURCE (source);
 
-      using source_type         = decltype (source)                                     ;
-      using stripped_value_type = detail::get_stripped_source_value_type_t<source_type> ;
-      // Added std::add_rvalue_reference_t to allow moving of vector copies
-      using value_type          = std::add_rvalue_reference_t<stripped_value_type>      ;
-
-      return detail::adapt_source_function<value_type> (
-        [source = std::forward<source_type> (source)] (auto && sink)
-        {
-          std::vector<stripped_value_type> result;
-          result.reserve (detail::default_vector_reserve);
-
-          source.source_function ([&result] (auto && v)
-          {
-            result.push_back (std::forward<decltype (v)> (v));
-            return true;
-          });
-
-          auto iter = result.size ();
-          while (iter != 0 && sink (std::move (result[--iter])))
-            ;
-        });
+      return reverse_using (std::allocator<char> ()) (std::forward<decltype (source)> (source));
     };
 #endif
 
@@ -498,16 +1432,19 @@ namespace cpp_streams
         using source_type = decltype (source)                           ;
         using value_type  = detail::get_source_value_type_t<source_type>;
 
-        return detail::adapt_source_function<value_type> (
+        return detail::adapt_source_function<value_type, detail::next_plan_t<source_type, detail::skip_step>> (
           [count, source = std::forward<source_type> (source)] (auto && sink)
           {
             auto remaining = count;
+            detail::stage_counter counter (detail::stage_tag<detail::skip_step, detail::strip_type_t<source_type>> (), "skip");
 
-            source.source_function ([&remaining, &sink] (auto && v)
+            source.source_function ([&remaining, &sink, &counter] (auto && v)
             {
+              counter.in ();
               if (remaining == 0)
               {
-                return sink (std::forward<decltype (v)> (v));
+                counter.out ();
+                return counter.passed (sink (std::forward<decltype (v)> (v)));
               }
               else
               {
@@ -523,92 +1460,107 @@ namespace cpp_streams
 
   auto skip_while = [] (auto && skipper)
   {
-    // using skipper_type = decltype ()
-
-    return
-      // WORKAROUND: perfect forwarding preferable
-      [skipper] (auto && source)
-      {
-        CPP_STREAMS__CHECK_SOURCE (source);
-
-        using source_type = decltype (source)                           ;
-        using value_type  = detail::get_source_value_type_t<source_type>;
+    return detail::adapt_pipe (
+        std::forward<decltype (skipper)> (skipper)
+      , [] (auto && source, auto && skipper)
+        {
+          CPP_STREAMS__CHECK_SOURCE (source);
 
-        return detail::adapt_source_function<value_type> (
-          [skipper, source = std::forward<source_type> (source)] (auto && sink)
-          {
-            auto do_skip = true;
+          using skipper_type  = decltype (skipper)                          ;
+          using source_type   = decltype (source)                           ;
+          using value_type    = detail::get_source_value_type_t<source_type>;
 
-            source.source_function ([&do_skip, &skipper, &sink] (auto && v)
+          return detail::adapt_source_function<value_type, detail::next_plan_t<source_type, detail::skip_while_step>> (
+            [skipper = std::forward<skipper_type> (skipper), source = std::forward<source_type> (source)] (auto && sink)
             {
-              if (!do_skip)
-              {
-                return sink (std::forward<decltype (v)> (v));
-              }
-              else if (skipper (v))
-              {
-                return true;
-              }
-              else
+              auto do_skip = true;
+              detail::stage_counter counter (detail::stage_tag<detail::skip_while_step, detail::strip_type_t<source_type>> (), "skip_while");
+
+              source.source_function ([&do_skip, &skipper, &sink, &counter] (auto && v)
               {
-                do_skip = false;
-                return sink (std::forward<decltype (v)> (v));
-              }
+                counter.in ();
+                if (!do_skip)
+                {
+                  counter.out ();
+                  return counter.passed (sink (std::forward<decltype (v)> (v)));
+                }
+                else if (skipper (v))
+                {
+                  return true;
+                }
+                else
+                {
+                  do_skip = false;
+                  counter.out ();
+                  return counter.passed (sink (std::forward<decltype (v)> (v)));
+                }
+              });
             });
-          });
-      };
+        });
   };
 
   // --------------------------------------------------------------------------
 
 #ifndef _MSC_VER
-  auto sort = [] (auto && sorter)
+  // sort buffering the elements in memory from allocator
+  auto sort_using = [] (auto && sorter, auto && allocator)
   {
-    return
-      // WORKAROUND: perfect forwarding preferable
-      [sorter] (auto && source)
-      {
-        CPP_STREAMS__CHECK_SOURCE (source);
-
-        using source_type         = decltype (source)                                     ;
-        using stripped_value_type = detail::get_stripped_source_value_type_t<source_type> ;
-        // Added std::add_rvalue_reference_t to allow moving of vector copies
-        using value_type          = std::add_rvalue_reference_t<stripped_value_type>      ;
-
-        return detail::adapt_source_function<value_type> (
-          [sorter, source = std::forward<source_type> (source)] (auto && sink)
-          {
-            std::vector<stripped_value_type> result;
-            result.reserve (detail::default_vector_reserve);
+    using allocator_type = decltype (allocator);
 
-            source.source_function ([&result] (auto && v)
+    return detail::adapt_pipe (
+        std::forward<decltype (sorter)> (sorter)
+      , [allocator = std::forward<allocator_type> (allocator)] (auto && source, auto && sorter)
+        {
+          CPP_STREAMS__CHECK_SOURCE (source);
+
+          using sorter_type         = decltype (sorter)                                                     ;
+          using source_type         = decltype (source)                                                     ;
+          using stripped_value_type = detail::get_stripped_source_value_type_t<source_type>                 ;
+          // Added std::add_rvalue_reference_t to allow moving of vector copies
+          using value_type          = std::add_rvalue_reference_t<stripped_value_type>                      ;
+          using buffer_type         = detail::scratch_buffer<
+              stripped_value_type
+            , detail::rebind_allocator_t<allocator_type, stripped_value_type>
+            >;
+          using function            = detail::sort_function<
+              detail::strip_type_t<source_type>
+            , detail::strip_type_t<sorter_type>
+            , buffer_type
+            >;
+
+          return detail::adapt_source_function<value_type, detail::next_plan_t<source_type, detail::sort_step>> (
+            function
             {
-              result.push_back (std::forward<decltype (v)> (v));
-              return true;
+                std::forward<source_type> (source)
+              , std::forward<sorter_type> (sorter)
+              , buffer_type (allocator)
             });
+        });
+  };
 
-            std::sort (
-                result.begin ()
-              , result.end ()
-              , sorter
-              );
-
-            auto sz = result.size ();
-            for (auto iter = 0U; iter < sz && sink (std::move (result[iter])); ++iter)
-              ;
-          });
-      };
+  auto sort = [] (auto && sorter)
+  {
+    return sort_using (std::forward<decltype (sorter)> (sorter), std::allocator<char> ());
   };
 
   // --------------------------------------------------------------------------
 
-  auto sort_by = [] (auto && selector)
+  auto sort_by_using = [] (auto && selector, auto && allocator)
   {
+    using selector_type = decltype (selector);
+
     return
-      sort ([selector] (auto && l, auto && r)
+      sort_using ([selector = std::forward<selector_type> (selector)] (auto && l, auto && r)
         {
           return selector (std::forward<decltype (l)> (l)) < selector (std::forward<decltype (r)> (r));
-        });
+        }
+      , std::forward<decltype (allocator)> (allocator)
+      );
+  };
+
+  auto sort_by = [] (auto && selector)
+  {
+    return sort_by_using (std::forward<decltype (selector)> (selector), std::allocator<char> ());
   };
 #endif
 
@@ -621,26 +1573,13 @@ namespace cpp_streams
       {
         CPP_STREAMS__CHECK_SOURCE (source);
 
-        using source_type = decltype (source)                           ;
-        using value_type  = detail::get_source_value_type_t<source_type>;
+        using source_type = decltype (source);
 
-        return detail::adapt_source_function<value_type> (
-          [count, source = std::forward<source_type> (source)] (auto && sink)
-          {
-            auto remaining = count;
-            source.source_function ([&remaining, &sink] (auto && v)
-            {
-              if (remaining > 0)
-              {
-                --remaining;
-                return sink (std::forward<decltype (v)> (v));
-              }
-              else
-              {
-                return false;
-              }
-            });
-          });
+        return detail::take_source (
+            std::forward<source_type> (source)
+          , count
+          , detail::has_source_function<source_type, detail::map_function> ()
+          );
       };
   };
 
@@ -648,31 +1587,36 @@ namespace cpp_streams
 
   auto take_while = [] (auto && taker)
   {
-    return
-      // WORKAROUND: perfect forwarding preferable
-      [taker] (auto && source)
-      {
-        CPP_STREAMS__CHECK_SOURCE (source);
+    return detail::adapt_pipe (
+        std::forward<decltype (taker)> (taker)
+      , [] (auto && source, auto && taker)
+        {
+          CPP_STREAMS__CHECK_SOURCE (source);
 
-        using source_type = decltype (source)                           ;
-        using value_type  = detail::get_source_value_type_t<source_type>;
+          using taker_type  = decltype (taker)                            ;
+          using source_type = decltype (source)                           ;
+          using value_type  = detail::get_source_value_type_t<source_type>;
 
-        return detail::adapt_source_function<value_type> (
-          [taker, source = std::forward<source_type> (source)] (auto && sink)
-          {
-            source.source_function ([&taker, &sink] (auto && v)
+          return detail::adapt_source_function<value_type, detail::next_plan_t<source_type, detail::take_while_step>> (
+            [taker = std::forward<taker_type> (taker), source = std::forward<source_type> (source)] (auto && sink)
             {
-              if (taker (v))
-              {
-                return sink (std::forward<decltype (v)> (v));
-              }
-              else
+              detail::stage_counter counter (detail::stage_tag<detail::take_while_step, detail::strip_type_t<source_type>> (), "take_while");
+
+              source.source_function ([&taker, &sink, &counter] (auto && v)
               {
-                return false;
-              }
+                counter.in ();
+                if (taker (v))
+                {
+                  counter.out ();
+                  return counter.passed (sink (std::forward<decltype (v)> (v)));
+                }
+                else
+                {
+                  return false;
+                }
+              });
             });
-          });
-      };
+        });
   };
 
   // --------------------------------------------------------------------------
@@ -681,14 +1625,15 @@ namespace cpp_streams
 
   auto to_all = [] (auto && tester)
   {
-    // using tester_type  = decltype (tester);
+    using tester_type  = decltype (tester);
 
     return
-      // WORKAROUND: perfect forwarding preferable
-      [tester] (auto && source)
+      [tester = std::forward<tester_type> (tester)] (auto && source)
       {
         CPP_STREAMS__CHECK_SOURCE (source);
 
+        detail::trace_scope scope ("to_all");
+
         auto result = false;
 
         source.source_function (
@@ -705,14 +1650,15 @@ namespace cpp_streams
 
   auto to_any = [] (auto && tester)
   {
-    // using tester_type  = decltype (tester);
+    using tester_type  = decltype (tester);
 
     return
-      // WORKAROUND: perfect forwarding preferable
-      [tester] (auto && source)
+      [tester = std::forward<tester_type> (tester)] (auto && source)
       {
         CPP_STREAMS__CHECK_SOURCE (source);
 
+        detail::trace_scope scope ("to_any");
+
         auto result = true;
 
         source.source_function (
@@ -732,38 +1678,36 @@ namespace cpp_streams
     {
       CPP_STREAMS__CHECK_SOURCE (source);
 
-      using source_type = decltype (source);
-      using value_type  = detail::get_stripped_source_value_type_t<source_type>;
+      detail::trace_scope scope ("to_first_or_default");
 
-      // WORKAROUND: value_type result {} doesn't work in VS2015 RC
-      auto result = value_type ();
+      using source_type = decltype (source);
 
-      source.source_function (
-        [&result] (auto && v)
-        {
-          result = std::forward<decltype (v)> (v);
-          return false;
-        });
+#ifndef _MSC_VER
+      using is_sorted   = detail::has_source_function<source_type, detail::sort_function>;
+#else
+      using is_sorted   = std::false_type;
+#endif
 
-      return result;
+      return detail::first_or_default (std::forward<source_type> (source), is_sorted ());
     };
 
   // --------------------------------------------------------------------------
 
   auto to_iter = [] (auto && iteration)
   {
-    // using iteration_type  = decltype (iteration);
+    using iteration_type  = decltype (iteration);
 
     return
-      // WORKAROUND: perfect forwarding preferable
-      [iteration] (auto && source)
+      [iteration = std::forward<iteration_type> (iteration)] (auto && source)
       {
         CPP_STREAMS__CHECK_SOURCE (source);
 
+        detail::trace_scope scope ("to_iter");
+
         source.source_function (
           [&iteration] (auto && v)
           {
-            return iteration (v);
+            return iteration (std::forward<decltype (v)> (v));
           });
       };
   };
@@ -772,15 +1716,16 @@ namespace cpp_streams
 
   auto to_fold = [] (auto && initial, auto && folder)
   {
-    // using state_type  = decltype (initial);
-    // using folder_type = decltype (folder);
+    using state_type  = decltype (initial);
+    using folder_type = decltype (folder);
 
     return
-      // WORKAROUND: perfect forwarding preferable
-      [initial, folder] (auto && source)
+      [initial = std::forward<state_type> (initial), folder = std::forward<folder_type> (folder)] (auto && source)
       {
         CPP_STREAMS__CHECK_SOURCE (source);
 
+        detail::trace_scope scope ("to_fold");
+
         auto state = initial;
 
         source.source_function (
@@ -801,6 +1746,8 @@ namespace cpp_streams
     {
       CPP_STREAMS__CHECK_SOURCE (source);
 
+      detail::trace_scope scope ("to_last_or_default");
+
       using source_type= decltype (source);
       using value_type = detail::get_stripped_source_value_type_t<source_type>;
 
@@ -824,46 +1771,52 @@ namespace cpp_streams
     {
       CPP_STREAMS__CHECK_SOURCE (source);
 
-      std::size_t result = 0;
+      detail::trace_scope scope ("to_length");
 
-      source.source_function (
-        [&result] (auto &&)
-        {
-          ++result;
-          return true;
-        });
+      using source_type = decltype (source);
 
-      return result;
+      return detail::length (
+          std::forward<source_type> (source)
+        , detail::has_source_function<source_type, detail::map_function> ()
+        );
     };
 
   // --------------------------------------------------------------------------
 
 #ifndef _MSC_VER
-  auto to_map = [] (auto && key_selector)
+  // to_map allocating the nodes of the map from allocator
+  auto to_map_using = [] (auto && key_selector, auto && allocator)
   {
-    using key_selector_type  = decltype (key_selector)                              ;
+    using key_selector_type = decltype (key_selector) ;
+    using allocator_type    = decltype (allocator)    ;
 
     return
-      // WORKAROUND: perfect forwarding preferable
-      [key_selector] (auto && source)
+      [key_selector = std::forward<key_selector_type> (key_selector), allocator = std::forward<allocator_type> (allocator)] (auto && source)
       {
         CPP_STREAMS__CHECK_SOURCE (source);
 
+        detail::trace_scope scope ("to_map");
 
-        using source_type       = decltype (source)                                     ;
-        using value_type        = detail::get_stripped_source_value_type_t<source_type> ;
-        using selected_key_type = std::result_of_t<key_selector_type (value_type)>      ;
-        using key_type          = detail::strip_type_t<selected_key_type>               ;
-        using map_type          = std::map<key_type, value_type>                        ;
-        using item_type         = typename map_type::value_type                         ;
+        using source_type       = decltype (source)                                                     ;
+        using value_type        = detail::get_stripped_source_value_type_t<source_type>                 ;
+        using selected_key_type = std::result_of_t<key_selector_type (value_type)>                      ;
+        using key_type          = detail::strip_type_t<selected_key_type>                               ;
+        using item_type         = std::pair<key_type const, value_type>                                 ;
+        using map_type          = std::map<
+            key_type
+          , value_type
+          , std::less<key_type>
+          , detail::rebind_allocator_t<allocator_type, item_type>
+          >;
 
-        // WORKAROUND: std::set<value_type> result; doesn't work in VS2015 RC
-        auto result = map_type ();
+        auto result = map_type (std::less<key_type> (), allocator);
 
         source.source_function (
           [&key_selector, &result] (auto && v)
           {
             auto key = key_selector (v);
+
+            detail::allocation_scope owner ("to_map");
             result.insert (item_type (std::move (key), std::forward<decltype (v)> (v)));
             return true;
           });
@@ -871,18 +1824,26 @@ namespace cpp_streams
         return result;
       };
   };
+
+  auto to_map = [] (auto && key_selector)
+  {
+    return to_map_using (std::forward<decltype (key_selector)> (key_selector), std::allocator<char> ());
+  };
 #endif
 
   // --------------------------------------------------------------------------
 
   auto to_max = [] (auto && initial)
   {
+    using initial_type = decltype (initial);
+
     return
-      // WORKAROUND: perfect forwarding preferable
-      [initial] (auto && source)
+      [initial = std::forward<initial_type> (initial)] (auto && source)
       {
         CPP_STREAMS__CHECK_SOURCE (source);
 
+        detail::trace_scope scope ("to_max");
+
         using source_type= decltype (source);
         using value_type = detail::get_stripped_source_value_type_t<source_type>;
 
@@ -908,12 +1869,15 @@ namespace cpp_streams
 
   auto to_min = [] (auto && initial)
   {
+    using initial_type = decltype (initial);
+
     return
-      // WORKAROUND: perfect forwarding preferable
-      [initial] (auto && source)
+      [initial = std::forward<initial_type> (initial)] (auto && source)
       {
         CPP_STREAMS__CHECK_SOURCE (source);
 
+        detail::trace_scope scope ("to_min");
+
         using source_type= decltype (source);
         using value_type = detail::get_stripped_source_value_type_t<source_type>;
 
@@ -937,25 +1901,46 @@ namespace cpp_streams
 
   // --------------------------------------------------------------------------
 
+  // to_set allocating the nodes of the set from allocator
+  auto to_set_using = [] (auto && allocator)
+  {
+    using allocator_type = decltype (allocator);
+
+    return
+      [allocator = std::forward<allocator_type> (allocator)] (auto && source)
+      {
+        CPP_STREAMS__CHECK_SOURCE (source);
+
+        detail::trace_scope scope ("to_set");
+
+        using source_type= decltype (source);
+        using value_type = detail::get_stripped_source_value_type_t<source_type>;
+        using set_type   = std::set<
+            value_type
+          , std::less<value_type>
+          , detail::rebind_allocator_t<allocator_type, value_type>
+          >;
+
+        auto result = set_type (std::less<value_type> (), allocator);
+
+        source.source_function (
+          [&result] (auto && v)
+          {
+            detail::allocation_scope owner ("to_set");
+            result.insert (std::forward<decltype (v)> (v));
+            return true;
+          });
+
+        return result;
+      };
+  };
+
   auto to_set =
     [] (auto && source)
     {
       CPP_STREAMS__CHECK_SOURCE (source);
 
-      using source_type= decltype (source);
-      using value_type = detail::get_stripped_source_value_type_t<source_type>;
-
-      // WORKAROUND: std::set<value_type> result; doesn't work in VS2015 RC
-      auto result = std::set<value_type> ();
-
-      source.source_function (
-        [&result] (auto && v)
-        {
-          result.insert (std::forward<decltype (v)> (v));
-          return true;
-        });
-
-      return result;
+      return to_set_using (std::allocator<char> ()) (std::forward<decltype (source)> (source));
     };
 
   // --------------------------------------------------------------------------
@@ -965,6 +1950,8 @@ namespace cpp_streams
     {
       CPP_STREAMS__CHECK_SOURCE (source);
 
+      detail::trace_scope scope ("to_sum");
+
       using source_type= decltype (source);
       using value_type = detail::get_stripped_source_value_type_t<source_type>;
 
@@ -983,27 +1970,75 @@ namespace cpp_streams
 
   // --------------------------------------------------------------------------
 
+  // to_vector allocating the vector from allocator
+  auto to_vector_using = [] (auto && allocator)
+  {
+    using allocator_type = decltype (allocator);
+
+    return
+      [allocator = std::forward<allocator_type> (allocator)] (auto && source)
+      {
+        CPP_STREAMS__CHECK_SOURCE (source);
+
+        detail::trace_scope scope ("to_vector");
+
+        using source_type= decltype (source);
+        using value_type = detail::get_stripped_source_value_type_t<source_type>;
+        using vector_type= std::vector<value_type, detail::rebind_allocator_t<allocator_type, value_type>>;
+
+        auto result = vector_type (allocator);
+        {
+          detail::allocation_scope owner ("to_vector");
+          result.reserve (detail::default_vector_reserve);
+        }
+
+        source.source_function (
+          [&result] (auto && v)
+          {
+            detail::allocation_scope owner ("to_vector");
+            result.push_back (std::forward<decltype (v)> (v));
+            return true;
+          });
+
+        return result;
+      };
+  };
+
   auto to_vector =
     [] (auto && source)
     {
       CPP_STREAMS__CHECK_SOURCE (source);
 
-      using source_type= decltype (source);
-      using value_type = detail::get_stripped_source_value_type_t<source_type>;
+      return to_vector_using (std::allocator<char> ()) (std::forward<decltype (source)> (source));
+    };
 
-      // WORKAROUND: std::vector<value_type> result {} doesn't work in VS2015 RC
-      auto result = std::vector<value_type> ();
-      result.reserve (detail::default_vector_reserve);
+  // --------------------------------------------------------------------------
 
-      source.source_function (
-        [&result] (auto && v)
-        {
-          result.push_back (std::forward<decltype (v)> (v));
-          return true;
-        });
+  // Clears result and fills it with the elements, the capacity of result is
+  //  kept so a reused vector doesn't allocate once it's large enough
+  template<typename TValueType, typename TAllocator>
+  CPP_STREAMS__PRELUDE auto to_vector_into (std::vector<TValueType, TAllocator> & result)
+  {
+    return
+      [&result] (auto && source) -> std::vector<TValueType, TAllocator> &
+      {
+        CPP_STREAMS__CHECK_SOURCE (source);
 
-      return result;
-    };
+        detail::trace_scope scope ("to_vector_into");
+
+        result.clear ();
+
+        source.source_function (
+          [&result] (auto && v)
+          {
+            detail::allocation_scope owner ("to_vector_into");
+            result.push_back (std::forward<decltype (v)> (v));
+            return true;
+          });
+
+        return result;
+      };
+  }
 
   // --------------------------------------------------------------------------
 
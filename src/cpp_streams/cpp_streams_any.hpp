@@ -0,0 +1,397 @@
+// ----------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef CPP_STREAMS_ANY__INCLUDE_GUARD
+# define CPP_STREAMS_ANY__INCLUDE_GUARD
+// ----------------------------------------------------------------------------
+# include "cpp_streams.hpp"
+// ----------------------------------------------------------------------------
+# include <cstddef>
+# include <new>
+# include <type_traits>
+# include <utility>
+// ----------------------------------------------------------------------------
+# ifndef CPP_STREAMS__ANY_SOURCE_BATCH_BYTES
+#   define CPP_STREAMS__ANY_SOURCE_BATCH_BYTES 4096
+# endif
+// ----------------------------------------------------------------------------
+// Type erased sources
+//  any_source<T> holds any source with values convertible to T so pipelines
+//  can be stored in containers, returned from non-template functions and
+//  passed between translation units:
+//
+//    any_source<int> even_ints (std::vector<int> const & vs)
+//    {
+//      return from (vs) >> filter ([] (int v) {return v % 2 == 0;});
+//    }
+//
+//  A std::function per stage would cost an indirect call per element.
+//  any_source instead buffers the values of the erased source in batches
+//  of CPP_STREAMS__ANY_SOURCE_BATCH_BYTES (default 4096) and makes one
+//  indirect call per batch, the downstream pipeline runs inline over the
+//  batch. Sources that fit in a small buffer are stored without allocating.
+//  The compiler can't vectorize or remove branches across the batch so
+//  pipelines relying on that run several times slower erased (see README)
+//
+//  The values are passed on as T && (moved out of the batch). As a batch is
+//  filled before it's passed on the erased source may produce up to a batch
+//  more values than the downstream pipeline consumes (take (n) stops the
+//  erased source at the end of the batch)
+// ----------------------------------------------------------------------------
+
+namespace cpp_streams
+{
+
+  // --------------------------------------------------------------------------
+
+  namespace detail
+  {
+    // Sources larger than this are allocated on the heap
+    constexpr std::size_t any_source_buffer_size  = 64;
+
+    // Bytes of values buffered before a batch is passed on
+    constexpr std::size_t any_source_batch_bytes  = CPP_STREAMS__ANY_SOURCE_BATCH_BYTES;
+
+    // ------------------------------------------------------------------------
+
+    // The plan of the erased source isn't known
+    struct any_source_step
+    {
+      static constexpr step_description describe () noexcept
+      {
+        return step_description
+        {
+          "any_source", false, false, size_effect::unknown, "batched type erasure"
+        };
+      }
+    };
+
+    // ------------------------------------------------------------------------
+
+    // Values are constructed in place as T might not be default constructible,
+    //  the count is kept by the filling loop so it stays in a register
+    template<typename TValueType>
+    class any_source_batch
+    {
+    public:
+      static constexpr std::size_t capacity =
+          sizeof (TValueType) < any_source_batch_bytes
+        ? any_source_batch_bytes / sizeof (TValueType)
+        : 1U
+        ;
+
+      any_source_batch () noexcept
+      {
+      }
+
+      any_source_batch (any_source_batch const &)             = delete;
+      any_source_batch & operator= (any_source_batch const &) = delete;
+
+      TValueType * values () noexcept
+      {
+        return reinterpret_cast<TValueType *> (&storage);
+      }
+
+      static void destroy (TValueType * values, std::size_t count) noexcept
+      {
+        for (auto iter = 0U; iter < count; ++iter)
+        {
+          values[iter].~TValueType ();
+        }
+      }
+
+    private:
+      std::aligned_storage_t<sizeof (TValueType) * capacity, alignof (TValueType)>  storage ;
+    };
+
+    // Destroys the values left in a batch if the erased source throws
+    template<typename TValueType>
+    struct any_source_batch_guard
+    {
+      TValueType *  values;
+      std::size_t & count ;
+
+      ~any_source_batch_guard () noexcept
+      {
+        any_source_batch<TValueType>::destroy (values, count);
+      }
+    };
+
+    // ------------------------------------------------------------------------
+
+    template<typename TValueType>
+    class any_source_function
+    {
+    public:
+      // Receives a batch of values, returns false when no more values are wanted
+      using batch_function = bool (*) (void * context, TValueType * values, std::size_t count);
+
+      template<typename TSource>
+      explicit any_source_function (TSource && source)
+        : table (&table_for<strip_type_t<TSource>> ())
+      {
+        using source_type = strip_type_t<TSource>                     ;
+        using value_type  = get_source_value_type_t<source_type>      ;
+
+        static_assert (std::is_convertible<value_type, TValueType>::value, "TSource values must be convertible into a TValueType value");
+
+        create (std::forward<TSource> (source), is_small_t<source_type> ());
+      }
+
+      any_source_function (any_source_function const & o)
+        : table (o.table)
+      {
+        table->copy (&o.storage, &storage);
+      }
+
+      any_source_function (any_source_function && o) noexcept
+        : table (o.table)
+      {
+        table->move (&o.storage, &storage);
+      }
+
+      any_source_function & operator= (any_source_function const & o)
+      {
+        if (this != &o)
+        {
+          auto copy = o;
+          *this = std::move (copy);
+        }
+        return *this;
+      }
+
+      any_source_function & operator= (any_source_function && o) noexcept
+      {
+        if (this != &o)
+        {
+          table->destroy (&storage);
+          table = o.table;
+          table->move (&o.storage, &storage);
+        }
+        return *this;
+      }
+
+      ~any_source_function () noexcept
+      {
+        table->destroy (&storage);
+      }
+
+      template<typename TSink>
+      void operator () (TSink && sink) const
+      {
+        using sink_type = std::remove_reference_t<TSink>;
+
+        // One indirect call per batch, the sink is called inline
+        batch_function batch = [] (void * context, TValueType * values, std::size_t count)
+        {
+          auto & sink = *static_cast<sink_type *> (context);
+          for (auto iter = 0U; iter < count; ++iter)
+          {
+            if (!sink (std::move (values[iter])))
+            {
+              return false;
+            }
+          }
+          return true;
+        };
+
+        table->run (&storage, batch, &sink);
+      }
+
+    private:
+      using storage_type = std::aligned_storage_t<any_source_buffer_size, alignof (std::max_align_t)>;
+
+      struct table_type
+      {
+        void (*run)     (void const * self, batch_function batch, void * context) ;
+        void (*copy)    (void const * from, void * to)                            ;
+        void (*move)    (void * from, void * to)                                  ;
+        void (*destroy) (void * self)                                             ;
+      };
+
+      template<typename TSource>
+      static constexpr bool is_small ()
+      {
+        return
+              sizeof (TSource) <= sizeof (storage_type)
+          &&  alignof (TSource) <= alignof (storage_type)
+          &&  std::is_nothrow_move_constructible<TSource>::value
+          ;
+      }
+
+      template<typename TSource>
+      using is_small_t = std::integral_constant<bool, is_small<TSource> ()>;
+
+      template<typename TSource>
+      void create (TSource && source, std::true_type)
+      {
+        new (&storage) strip_type_t<TSource> (std::forward<TSource> (source));
+      }
+
+      template<typename TSource>
+      void create (TSource && source, std::false_type)
+      {
+        *reinterpret_cast<strip_type_t<TSource> **> (&storage) = new strip_type_t<TSource> (std::forward<TSource> (source));
+      }
+
+      template<typename TSource>
+      static TSource const & get (void const * self, std::true_type) noexcept
+      {
+        return *static_cast<TSource const *> (self);
+      }
+
+      template<typename TSource>
+      static TSource const & get (void const * self, std::false_type) noexcept
+      {
+        return **static_cast<TSource * const *> (self);
+      }
+
+      template<typename TSource>
+      static void run (void const * self, batch_function batch, void * context)
+      {
+        using batch_type = any_source_batch<TValueType>;
+
+        batch_type  storage                 ;
+        auto        values  = storage.values ();
+        std::size_t count   = 0             ;
+        auto        result  = true          ;
+
+        any_source_batch_guard<TValueType> guard {values, count};
+
+        get<TSource> (self, is_small_t<TSource> ()).source_function ([batch, context, values, &count, &result] (auto && v)
+        {
+          new (values + count) TValueType (std::forward<decltype (v)> (v));
+          if (++count < batch_type::capacity)
+          {
+            return true;
+          }
+
+          result = batch (context, values, count);
+          batch_type::destroy (values, count);
+          count = 0;
+          return result;
+        });
+
+        if (result && count > 0)
+        {
+          batch (context, values, count);
+        }
+      }
+
+      template<typename TSource>
+      static table_type const & table_for () noexcept
+      {
+        static table_type const small_table =
+        {
+          &run<TSource>,
+          [] (void const * from, void * to)
+          {
+            new (to) TSource (*static_cast<TSource const *> (from));
+          },
+          [] (void * from, void * to)
+          {
+            new (to) TSource (std::move (*static_cast<TSource *> (from)));
+          },
+          [] (void * self)
+          {
+            static_cast<TSource *> (self)->~TSource ();
+          },
+        };
+
+        // The storage holds a pointer to the heap allocated source, a moved
+        //  from any_source keeps a null pointer and runs as an empty source
+        static table_type const large_table =
+        {
+          [] (void const * self, batch_function batch, void * context)
+          {
+            if (*static_cast<TSource * const *> (self))
+            {
+              run<TSource> (self, batch, context);
+            }
+          },
+          [] (void const * from, void * to)
+          {
+            auto p = *static_cast<TSource * const *> (from);
+            *static_cast<TSource **> (to) = p ? new TSource (*p) : nullptr;
+          },
+          [] (void * from, void * to)
+          {
+            auto & p = *static_cast<TSource **> (from);
+            *static_cast<TSource **> (to) = p;
+            p = nullptr;
+          },
+          [] (void * self)
+          {
+            delete *static_cast<TSource **> (self);
+          },
+        };
+
+        return is_small<TSource> () ? small_table : large_table;
+      }
+
+      table_type const *  table   ;
+      storage_type        storage ;
+    };
+  }
+
+  // --------------------------------------------------------------------------
+
+  template<typename TValueType>
+  class any_source
+    : public detail::source<TValueType &&, detail::any_source_function<TValueType>, detail::plan<detail::any_source_step>>
+  {
+    using base_type = detail::source<TValueType &&, detail::any_source_function<TValueType>, detail::plan<detail::any_source_step>>;
+
+  public:
+    // Implicit so pipelines can be returned as any_source
+    template<
+        typename TSource
+      , typename = std::enable_if_t<
+            detail::is_source<TSource>::value
+        &&  !std::is_same<detail::strip_type_t<TSource>, any_source>::value
+        >
+      >
+    any_source (TSource && source)
+      : base_type (detail::any_source_function<TValueType> (std::forward<TSource> (source)))
+    {
+    }
+  };
+
+  // --------------------------------------------------------------------------
+
+  namespace detail
+  {
+    template<typename TValueType>
+    struct is_source_impl<any_source<TValueType>>
+    {
+      enum
+      {
+        value = true,
+      };
+    };
+
+    template<typename TValueType>
+    struct get_source_value_type_impl<any_source<TValueType>>
+    {
+      using type = TValueType &&;
+    };
+  }
+
+  // --------------------------------------------------------------------------
+
+}
+// ----------------------------------------------------------------------------
+#endif // CPP_STREAMS_ANY__INCLUDE_GUARD
+// ----------------------------------------------------------------------------
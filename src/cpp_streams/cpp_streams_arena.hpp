@@ -0,0 +1,235 @@
+// ----------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef CPP_STREAMS_ARENA__INCLUDE_GUARD
+# define CPP_STREAMS_ARENA__INCLUDE_GUARD
+// ----------------------------------------------------------------------------
+# include <cstddef>
+# include <cstdint>
+# include <new>
+# include <type_traits>
+// ----------------------------------------------------------------------------
+// Arena allocation
+//  monotonic_arena hands out memory by bumping a pointer through blocks and
+//  never frees single allocations, everything is released at once by
+//  release () or the destructor. An arena is meant to be owned by a single
+//  request (or thread) so it takes no locks. An optional initial buffer,
+//  for instance on the stack, is used before any block is allocated.
+//
+//  arena_allocator<T> adapts an arena to the allocator requirements so it
+//  can be passed to the *_using operators:
+//
+//    monotonic_arena arena;
+//    auto result = from (vs) >> sort_using (less, arena_allocator<int> (arena)) >> to_vector_using (arena_allocator<int> (arena));
+//
+//  Containers from the arena must not outlive it. With C++17
+//  std::pmr::polymorphic_allocator works with the *_using operators too
+// ----------------------------------------------------------------------------
+
+namespace cpp_streams
+{
+
+  // --------------------------------------------------------------------------
+
+  namespace detail
+  {
+    // The size of the first allocated block, later blocks double in size
+    constexpr std::size_t default_arena_block_size = 4096;
+  }
+
+  // --------------------------------------------------------------------------
+
+  class monotonic_arena
+  {
+  public:
+    explicit monotonic_arena (std::size_t block_size = detail::default_arena_block_size) noexcept
+      : initial_begin     (nullptr)
+      , initial_end       (nullptr)
+      , current           (nullptr)
+      , end               (nullptr)
+      , blocks            (nullptr)
+      , first_block_size  (block_size > 0 ? block_size : detail::default_arena_block_size)
+      , next_block_size   (first_block_size)
+      , used              (0)
+    {
+    }
+
+    // Allocates from buffer until it's exhausted, buffer must outlive the arena
+    monotonic_arena (void * buffer, std::size_t size, std::size_t block_size = detail::default_arena_block_size) noexcept
+      : monotonic_arena (block_size)
+    {
+      initial_begin = static_cast<char *> (buffer);
+      initial_end   = initial_begin + size;
+      current       = initial_begin;
+      end           = initial_end;
+    }
+
+    monotonic_arena (monotonic_arena const &)             = delete;
+    monotonic_arena & operator= (monotonic_arena const &) = delete;
+
+    ~monotonic_arena () noexcept
+    {
+      release ();
+    }
+
+    void * allocate (std::size_t size, std::size_t alignment)
+    {
+      auto result = align (current, alignment);
+      if (result == nullptr || result > end || size > static_cast<std::size_t> (end - result))
+      {
+        add_block (size + alignment);
+        result = align (current, alignment);
+      }
+
+      current = result + size;
+      used    += size;
+
+      return result;
+    }
+
+    // Memory is only reclaimed by release
+    void deallocate (void *, std::size_t) noexcept
+    {
+    }
+
+    // Frees all blocks and starts over from the initial buffer
+    void release () noexcept
+    {
+      while (blocks != nullptr)
+      {
+        auto const next = blocks->next;
+        ::operator delete (blocks);
+        blocks = next;
+      }
+
+      current         = initial_begin;
+      end             = initial_end;
+      next_block_size = first_block_size;
+      used            = 0;
+    }
+
+    // Bytes handed out since construction or the last release
+    std::size_t allocated_bytes () const noexcept
+    {
+      return used;
+    }
+
+  private:
+    struct block
+    {
+      block * next;
+    };
+
+    static char * align (char * p, std::size_t alignment) noexcept
+    {
+      if (p == nullptr)
+      {
+        return nullptr;
+      }
+
+      auto const address = reinterpret_cast<std::uintptr_t> (p);
+      auto const aligned = (address + alignment - 1) & ~static_cast<std::uintptr_t> (alignment - 1);
+      return p + (aligned - address);
+    }
+
+    void add_block (std::size_t minimum_size)
+    {
+      while (next_block_size < minimum_size)
+      {
+        next_block_size *= 2;
+      }
+
+      auto const header = (sizeof (block) + alignof (std::max_align_t) - 1) & ~(alignof (std::max_align_t) - 1);
+      auto const b      = static_cast<block *> (::operator new (header + next_block_size));
+
+      b->next = blocks;
+      blocks  = b;
+      current = reinterpret_cast<char *> (b) + header;
+      end     = current + next_block_size;
+
+      next_block_size *= 2;
+    }
+
+    char *      initial_begin     ;
+    char *      initial_end       ;
+    char *      current           ;
+    char *      end               ;
+    block *     blocks            ;
+    std::size_t first_block_size  ;
+    std::size_t next_block_size   ;
+    std::size_t used              ;
+  };
+
+  // --------------------------------------------------------------------------
+
+  template<typename T>
+  class arena_allocator
+  {
+  public:
+    using value_type                              = T               ;
+    using propagate_on_container_copy_assignment  = std::true_type  ;
+    using propagate_on_container_move_assignment  = std::true_type  ;
+    using propagate_on_container_swap             = std::true_type  ;
+
+    explicit arena_allocator (monotonic_arena & arena) noexcept
+      : arena (&arena)
+    {
+    }
+
+    template<typename U>
+    arena_allocator (arena_allocator<U> const & o) noexcept
+      : arena (o.arena)
+    {
+    }
+
+    T * allocate (std::size_t count)
+    {
+      if (count > static_cast<std::size_t> (-1) / sizeof (T))
+      {
+        throw std::bad_alloc ();
+      }
+      return static_cast<T *> (arena->allocate (count * sizeof (T), alignof (T)));
+    }
+
+    void deallocate (T * p, std::size_t count) noexcept
+    {
+      arena->deallocate (p, count * sizeof (T));
+    }
+
+    template<typename U>
+    bool operator == (arena_allocator<U> const & o) const noexcept
+    {
+      return arena == o.arena;
+    }
+
+    template<typename U>
+    bool operator != (arena_allocator<U> const & o) const noexcept
+    {
+      return arena != o.arena;
+    }
+
+  private:
+    template<typename U>
+    friend class arena_allocator;
+
+    monotonic_arena * arena;
+  };
+
+  // --------------------------------------------------------------------------
+
+}
+// ----------------------------------------------------------------------------
+#endif // CPP_STREAMS_ARENA__INCLUDE_GUARD
+// ----------------------------------------------------------------------------
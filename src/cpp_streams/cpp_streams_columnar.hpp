@@ -0,0 +1,1241 @@
+// ----------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef CPP_STREAMS_COLUMNAR__INCLUDE_GUARD
+# define CPP_STREAMS_COLUMNAR__INCLUDE_GUARD
+// ----------------------------------------------------------------------------
+# include "cpp_streams_io.hpp"
+// ----------------------------------------------------------------------------
+# include <algorithm>
+# include <cstdint>
+# include <cstring>
+# include <limits>
+# include <map>
+# include <stdexcept>
+# include <string>
+# include <tuple>
+# include <utility>
+# include <vector>
+// ----------------------------------------------------------------------------
+// Columnar file format
+//  A file is a magic followed by row groups where each column of a row group
+//  is stored as a separately encoded chunk. A footer holds the column types
+//  and names and indexes the chunks, keeping min/max of numeric chunks so
+//  that readers only read the requested columns and skip row groups that
+//  can't match a column_range. The footer offset and an end magic close the
+//  file. Values are stored in native byte order
+//
+//  Encodings
+//    integer columns : frame of reference or zigzag delta, bit-packed
+//                      (whichever needs the fewest bits per value)
+//    float columns   : plain
+//    string columns  : dictionary with bit-packed indices when there are
+//                      few distinct values, plain otherwise
+// ----------------------------------------------------------------------------
+
+namespace cpp_streams
+{
+
+  // --------------------------------------------------------------------------
+
+  // unsigned_integer columns hold 64 bit unsigned values, stored as the bits
+  //  of std::int64_t with min/max kept in unsigned order
+  enum class column_type : std::uint8_t
+  {
+    integer           = 1,
+    real              = 2,
+    text              = 3,
+    unsigned_integer  = 4,
+  };
+
+  // --------------------------------------------------------------------------
+
+  namespace detail
+  {
+
+    // ------------------------------------------------------------------------
+
+    constexpr char          columnar_magic[]        = "CSCOL001";
+    constexpr char          columnar_end_magic[]    = "CSCOLEND";
+    constexpr std::size_t   columnar_magic_size     = 8U;
+    constexpr std::size_t   default_rows_per_group  = 1U << 16;
+
+    enum class column_encoding : std::uint8_t
+    {
+      frame_of_reference  = 1,
+      delta               = 2,
+      plain_real          = 3,
+      plain_text          = 4,
+      dictionary_text     = 5,
+    };
+
+    template<typename T, typename TEnable = void>
+    struct column_type_of;
+
+    template<typename T>
+    struct column_type_of<T, std::enable_if_t<std::is_integral<T>::value>>
+      : std::integral_constant<
+          column_type
+        , std::is_unsigned<T>::value && sizeof (T) == sizeof (std::uint64_t) ? column_type::unsigned_integer : column_type::integer
+        >
+    {
+    };
+
+    constexpr bool is_integer_column (column_type type) noexcept
+    {
+      return type == column_type::integer || type == column_type::unsigned_integer;
+    }
+
+    // Compares 64 bit integers that are either signed or unsigned (the bits
+    //  of an unsigned value held in std::int64_t)
+    inline bool integer_less (std::int64_t l, bool l_unsigned, std::int64_t r, bool r_unsigned) noexcept
+    {
+      if (l_unsigned == r_unsigned)
+      {
+        return l_unsigned ? static_cast<std::uint64_t> (l) < static_cast<std::uint64_t> (r) : l < r;
+      }
+      else if (l_unsigned)
+      {
+        return r >= 0 && static_cast<std::uint64_t> (l) < static_cast<std::uint64_t> (r);
+      }
+      else
+      {
+        return l < 0 || static_cast<std::uint64_t> (l) < static_cast<std::uint64_t> (r);
+      }
+    }
+
+    inline double integer_to_real (std::int64_t v, bool is_unsigned) noexcept
+    {
+      return is_unsigned ? static_cast<double> (static_cast<std::uint64_t> (v)) : static_cast<double> (v);
+    }
+
+    template<typename T>
+    struct column_type_of<T, std::enable_if_t<std::is_floating_point<T>::value>>
+      : std::integral_constant<column_type, column_type::real>
+    {
+    };
+
+    template<>
+    struct column_type_of<std::string>
+      : std::integral_constant<column_type, column_type::text>
+    {
+    };
+
+    template<>
+    struct column_type_of<text_view>
+      : std::integral_constant<column_type, column_type::text>
+    {
+    };
+
+    // ------------------------------------------------------------------------
+
+    inline unsigned bit_width (std::uint64_t v) noexcept
+    {
+      auto result = 0U;
+      for (; v != 0; v >>= 1)
+      {
+        ++result;
+      }
+      return result;
+    }
+
+    inline std::uint64_t zigzag_encode (std::uint64_t delta) noexcept
+    {
+      return (delta << 1) ^ (0ULL - (delta >> 63));
+    }
+
+    inline std::uint64_t zigzag_decode (std::uint64_t v) noexcept
+    {
+      return (v >> 1) ^ (0ULL - (v & 1));
+    }
+
+    inline std::size_t bit_packed_words (std::size_t count, unsigned width) noexcept
+    {
+      return (count * width + 63) / 64;
+    }
+
+    // Packs width bits of each value into consecutive 64 bit words
+    template<typename TValue>
+    void bit_pack (output_buffer & out, std::size_t count, unsigned width, TValue && value)
+    {
+      if (width == 0)
+      {
+        return;
+      }
+
+      std::uint64_t word  = 0;
+      auto          used  = 0U;
+
+      for (auto iter = 0U; iter < count; ++iter)
+      {
+        auto const v      = value (iter);
+        word              |= v << used;
+        auto const total  = used + width;
+
+        if (total >= 64)
+        {
+          out.write_bytes (word);
+          word  = used == 0 ? 0 : v >> (64 - used);
+          used  = total - 64;
+        }
+        else
+        {
+          used  = total;
+        }
+      }
+
+      if (used > 0)
+      {
+        out.write_bytes (word);
+      }
+    }
+
+    template<typename TValue>
+    void bit_unpack (char const * words, std::size_t count, unsigned width, TValue && value)
+    {
+      if (count == 0)
+      {
+        return;
+      }
+
+      if (width == 0)
+      {
+        for (auto iter = 0U; iter < count; ++iter)
+        {
+          value (iter, 0);
+        }
+        return;
+      }
+
+      auto const mask = width == 64 ? ~0ULL : (1ULL << width) - 1;
+
+      auto word = [words] (std::size_t idx)
+      {
+        std::uint64_t result;
+        std::memcpy (&result, words + idx * sizeof (result), sizeof (result));
+        return result;
+      };
+
+      std::size_t idx   = 0;
+      auto        used  = 0U;
+      auto        cur   = word (0);
+
+      for (auto iter = 0U; iter < count; ++iter)
+      {
+        auto v = cur >> used;
+        if (used + width > 64)
+        {
+          cur = word (++idx);
+          v   |= cur << (64 - used);
+          used = used + width - 64;
+        }
+        else if ((used += width) == 64 && iter + 1 < count)
+        {
+          cur   = word (++idx);
+          used  = 0;
+        }
+        value (iter, v & mask);
+      }
+    }
+
+    // ------------------------------------------------------------------------
+
+    // A cursor over a block of encoded bytes that throws on overrun
+    struct byte_reader
+    {
+      byte_reader (char const * begin, char const * end) noexcept
+        : iter  (begin)
+        , end   (end)
+      {
+      }
+
+      char const * take (std::size_t size)
+      {
+        if (static_cast<std::size_t> (end - iter) < size)
+        {
+          throw std::runtime_error ("cpp_streams: corrupt columnar file");
+        }
+        auto const result = iter;
+        iter += size;
+        return result;
+      }
+
+      template<typename T>
+      T read ()
+      {
+        T result;
+        std::memcpy (&result, take (sizeof (T)), sizeof (T));
+        return result;
+      }
+
+      text_view read_text ()
+      {
+        auto const size = read<std::uint32_t> ();
+        return text_view (take (size), size);
+      }
+
+      char const * iter ;
+      char const * end  ;
+    };
+
+    inline void write_text (output_buffer & out, text_view v)
+    {
+      out.write_bytes (static_cast<std::uint32_t> (v.size ()));
+      out.write (v.data (), v.size ());
+    }
+
+    // ------------------------------------------------------------------------
+
+    // The values of a column, for a row group being written or read
+    //  When read, texts refer into bytes which holds the encoded chunk
+    struct column_values
+    {
+      column_type                 type    ;
+      std::vector<std::int64_t>   integers;
+      std::vector<double>         reals   ;
+      std::vector<std::string>    strings ;
+      std::vector<text_view>      texts   ;
+      std::vector<char>           bytes   ;
+
+      void append (std::int64_t v)
+      {
+        integers.push_back (v);
+      }
+
+      void append (double v)
+      {
+        reals.push_back (v);
+      }
+
+      void append (text_view v)
+      {
+        strings.push_back (v.to_string ());
+      }
+
+      void append (std::string v)
+      {
+        strings.push_back (std::move (v));
+      }
+
+      void clear () noexcept
+      {
+        integers.clear ();
+        reals   .clear ();
+        strings .clear ();
+        texts   .clear ();
+      }
+    };
+
+    // Per chunk index entry, min/max are only meaningful for numeric columns
+    //  int_min/int_max of unsigned_integer columns hold unsigned values
+    struct chunk_info
+    {
+      std::uint64_t offset  = 0;
+      std::uint64_t size    = 0;
+      std::int64_t  int_min = 0;
+      std::int64_t  int_max = 0;
+      double        real_min= 0;
+      double        real_max= 0;
+    };
+
+    struct row_group_info
+    {
+      std::uint64_t           rows  = 0;
+      std::vector<chunk_info> chunks;
+    };
+
+    // ------------------------------------------------------------------------
+
+    // Replaces the min/max of encode_integers by the min/max in unsigned order
+    inline void unsigned_min_max (std::vector<std::int64_t> const & vs, chunk_info & info)
+    {
+      auto min = vs.empty () ? 0U : static_cast<std::uint64_t> (vs.front ());
+      auto max = min;
+
+      for (auto && v : vs)
+      {
+        auto const u = static_cast<std::uint64_t> (v);
+        min = u < min ? u : min;
+        max = u > max ? u : max;
+      }
+
+      info.int_min = static_cast<std::int64_t> (min);
+      info.int_max = static_cast<std::int64_t> (max);
+    }
+
+    inline void encode_integers (output_buffer & out, std::vector<std::int64_t> const & vs, chunk_info & info)
+    {
+      auto const count = vs.size ();
+
+      auto min = vs.empty () ? 0 : vs.front ();
+      auto max = min;
+      std::uint64_t max_zigzag = 0;
+
+      for (auto iter = 0U; iter < count; ++iter)
+      {
+        min = vs[iter] < min ? vs[iter] : min;
+        max = vs[iter] > max ? vs[iter] : max;
+        if (iter > 0)
+        {
+          auto const zigzag = zigzag_encode (static_cast<std::uint64_t> (vs[iter]) - static_cast<std::uint64_t> (vs[iter - 1]));
+          max_zigzag = zigzag > max_zigzag ? zigzag : max_zigzag;
+        }
+      }
+
+      info.int_min = min;
+      info.int_max = max;
+
+      auto const for_width    = bit_width (static_cast<std::uint64_t> (max) - static_cast<std::uint64_t> (min));
+      auto const delta_width  = bit_width (max_zigzag);
+
+      if (delta_width < for_width)
+      {
+        out.write_bytes (column_encoding::delta);
+        out.write_bytes (vs.empty () ? 0 : vs.front ());
+        out.write_bytes (static_cast<std::uint8_t> (delta_width));
+        bit_pack (out, count > 0 ? count - 1 : 0, delta_width, [&vs] (std::size_t idx)
+        {
+          return zigzag_encode (static_cast<std::uint64_t> (vs[idx + 1]) - static_cast<std::uint64_t> (vs[idx]));
+        });
+      }
+      else
+      {
+        out.write_bytes (column_encoding::frame_of_reference);
+        out.write_bytes (min);
+        out.write_bytes (static_cast<std::uint8_t> (for_width));
+        bit_pack (out, count, for_width, [&vs, min] (std::size_t idx)
+        {
+          return static_cast<std::uint64_t> (vs[idx]) - static_cast<std::uint64_t> (min);
+        });
+      }
+    }
+
+    inline void encode_reals (output_buffer & out, std::vector<double> const & vs, chunk_info & info)
+    {
+      auto min = std::numeric_limits<double>::infinity ();
+      auto max = -min;
+
+      for (auto v : vs)
+      {
+        min = v < min ? v : min;
+        max = v > max ? v : max;
+      }
+
+      info.real_min = min;
+      info.real_max = max;
+
+      out.write_bytes (column_encoding::plain_real);
+      out.write (reinterpret_cast<char const *> (vs.data ()), vs.size () * sizeof (double));
+    }
+
+    inline void encode_texts (output_buffer & out, std::vector<std::string> const & vs)
+    {
+      std::map<text_view, std::uint32_t> dictionary;
+      std::vector<std::uint32_t>         indices   ;
+      indices.reserve (vs.size ());
+
+      // Dictionary encoding pays off when values repeat
+      auto const max_dictionary = vs.size () / 2;
+
+      for (auto && v : vs)
+      {
+        auto const found = dictionary.insert (std::make_pair (text_view (v), static_cast<std::uint32_t> (dictionary.size ())));
+        if (dictionary.size () > max_dictionary)
+        {
+          break;
+        }
+        indices.push_back (found.first->second);
+      }
+
+      if (indices.size () == vs.size () && !vs.empty ())
+      {
+        std::vector<text_view> entries (dictionary.size ());
+        for (auto && kv : dictionary)
+        {
+          entries[kv.second] = kv.first;
+        }
+
+        auto const width = bit_width (entries.size () - 1);
+
+        out.write_bytes (column_encoding::dictionary_text);
+        out.write_bytes (static_cast<std::uint32_t> (entries.size ()));
+        for (auto && e : entries)
+        {
+          write_text (out, e);
+        }
+        out.write_bytes (static_cast<std::uint8_t> (width));
+        bit_pack (out, indices.size (), width, [&indices] (std::size_t idx)
+        {
+          return static_cast<std::uint64_t> (indices[idx]);
+        });
+      }
+      else
+      {
+        out.write_bytes (column_encoding::plain_text);
+        for (auto && v : vs)
+        {
+          write_text (out, v);
+        }
+      }
+    }
+
+    inline void decode_chunk (column_values & values, std::size_t rows)
+    {
+      values.clear ();
+
+      byte_reader reader (values.bytes.data (), values.bytes.data () + values.bytes.size ());
+
+      auto const encoding = reader.read<column_encoding> ();
+
+      switch (encoding)
+      {
+      case column_encoding::frame_of_reference:
+        {
+          auto const base   = static_cast<std::uint64_t> (reader.read<std::int64_t> ());
+          auto const width  = reader.read<std::uint8_t> ();
+          values.integers.resize (rows);
+          bit_unpack (reader.take (bit_packed_words (rows, width) * 8), rows, width, [&values, base] (std::size_t idx, std::uint64_t v)
+          {
+            values.integers[idx] = static_cast<std::int64_t> (base + v);
+          });
+        }
+        break;
+      case column_encoding::delta:
+        {
+          auto current      = static_cast<std::uint64_t> (reader.read<std::int64_t> ());
+          auto const width  = reader.read<std::uint8_t> ();
+          auto const deltas = rows > 0 ? rows - 1 : 0;
+          values.integers.resize (rows);
+          if (rows > 0)
+          {
+            values.integers[0] = static_cast<std::int64_t> (current);
+          }
+          bit_unpack (reader.take (bit_packed_words (deltas, width) * 8), deltas, width, [&values, &current] (std::size_t idx, std::uint64_t v)
+          {
+            current += zigzag_decode (v);
+            values.integers[idx + 1] = static_cast<std::int64_t> (current);
+          });
+        }
+        break;
+      case column_encoding::plain_real:
+        values.reals.resize (rows);
+        std::memcpy (values.reals.data (), reader.take (rows * sizeof (double)), rows * sizeof (double));
+        break;
+      case column_encoding::plain_text:
+        values.texts.reserve (rows);
+        for (auto iter = 0U; iter < rows; ++iter)
+        {
+          values.texts.push_back (reader.read_text ());
+        }
+        break;
+      case column_encoding::dictionary_text:
+        {
+          std::vector<text_view> entries (reader.read<std::uint32_t> ());
+          for (auto && e : entries)
+          {
+            e = reader.read_text ();
+          }
+          auto const width = reader.read<std::uint8_t> ();
+          values.texts.resize (rows);
+          bit_unpack (reader.take (bit_packed_words (rows, width) * 8), rows, width, [&values, &entries] (std::size_t idx, std::uint64_t v)
+          {
+            if (v >= entries.size ())
+            {
+              throw std::runtime_error ("cpp_streams: corrupt columnar file");
+            }
+            values.texts[idx] = entries[static_cast<std::size_t> (v)];
+          });
+        }
+        break;
+      default:
+        throw std::runtime_error ("cpp_streams: unknown columnar encoding");
+      }
+    }
+
+    // ------------------------------------------------------------------------
+
+    // Whether the values of a chunk can be read as T without truncating,
+    //  integer columns are stored as 64 bits so a narrower T must hold the
+    //  chunk min/max and real columns are only read as double or wider
+    template<typename T>
+    bool column_read_fits (chunk_info const & chunk, std::integral_constant<column_type, column_type::integer>) noexcept
+    {
+      return
+            chunk.int_min >= static_cast<std::int64_t> (std::numeric_limits<T>::min ())
+        &&  chunk.int_max <= static_cast<std::int64_t> (std::numeric_limits<T>::max ())
+        ;
+    }
+
+    template<typename T>
+    bool column_read_fits (chunk_info const &, std::integral_constant<column_type, column_type::real>) noexcept
+    {
+      return sizeof (T) >= sizeof (double);
+    }
+
+    template<typename T, column_type Type>
+    bool column_read_fits (chunk_info const &, std::integral_constant<column_type, Type>) noexcept
+    {
+      return true;
+    }
+
+    template<typename T>
+    bool column_read_fits (chunk_info const & chunk) noexcept
+    {
+      return column_read_fits<T> (chunk, column_type_of<T> ());
+    }
+
+    // ------------------------------------------------------------------------
+
+    template<typename T>
+    struct column_value
+    {
+      static T get (column_values const & values, std::size_t row)
+      {
+        return get (values, row, column_type_of<T> ());
+      }
+
+    private:
+      static T get (column_values const & values, std::size_t row, std::integral_constant<column_type, column_type::integer>)
+      {
+        return static_cast<T> (values.integers[row]);
+      }
+
+      static T get (column_values const & values, std::size_t row, std::integral_constant<column_type, column_type::unsigned_integer>)
+      {
+        return static_cast<T> (static_cast<std::uint64_t> (values.integers[row]));
+      }
+
+      static T get (column_values const & values, std::size_t row, std::integral_constant<column_type, column_type::real>)
+      {
+        return static_cast<T> (values.reals[row]);
+      }
+
+      static T get (column_values const & values, std::size_t row, std::integral_constant<column_type, column_type::text>)
+      {
+        return T (values.texts[row]);
+      }
+    };
+
+    template<>
+    struct column_value<std::string>
+    {
+      static std::string get (column_values const & values, std::size_t row)
+      {
+        return values.texts[row].to_string ();
+      }
+    };
+
+    template<typename TRow, typename... TColumns, std::size_t... Indices>
+    TRow make_columnar_row (column_values const * const * columns, std::size_t row, std::index_sequence<Indices...>)
+    {
+      return TRow {column_value<TColumns>::get (*columns[Indices], row)...};
+    }
+
+    template<typename TTuple, std::size_t... Indices>
+    void append_columnar_row (std::vector<column_values> & columns, TTuple && row, std::index_sequence<Indices...>)
+    {
+      using tuple_type = strip_type_t<TTuple>;
+
+      int ignore[] =
+      {
+        0,
+        (columns[Indices].append (
+          static_cast<std::conditional_t<
+              is_integer_column (column_type_of<strip_type_t<std::tuple_element_t<Indices, tuple_type>>>::value)
+            , std::int64_t
+            , std::conditional_t<
+                  column_type_of<strip_type_t<std::tuple_element_t<Indices, tuple_type>>>::value == column_type::real
+                , double
+                , strip_type_t<std::tuple_element_t<Indices, tuple_type>>
+                >
+            >> (std::get<Indices> (std::forward<TTuple> (row)))), 0)...
+      };
+      (void)ignore;
+    }
+
+    template<typename TTuple, std::size_t... Indices>
+    std::vector<column_type> get_column_types (std::index_sequence<Indices...>)
+    {
+      return std::vector<column_type> {column_type_of<strip_type_t<std::tuple_element_t<Indices, TTuple>>>::value...};
+    }
+
+    // ------------------------------------------------------------------------
+
+    struct columnar_metadata
+    {
+      std::vector<column_type>    types     ;
+      std::vector<std::string>    names     ;
+      std::vector<row_group_info> row_groups;
+
+      std::size_t find (std::string const & name) const
+      {
+        for (auto iter = 0U; iter < names.size (); ++iter)
+        {
+          if (names[iter] == name)
+          {
+            return iter;
+          }
+        }
+        throw std::invalid_argument ("cpp_streams: no column '" + name + "' in columnar file");
+      }
+    };
+
+    inline columnar_metadata read_columnar_metadata (input_file & file)
+    {
+      auto const size    = file.size ();
+      auto const trailer = sizeof (std::uint64_t) + columnar_magic_size;
+
+      char magic[columnar_magic_size];
+      char end  [sizeof (std::uint64_t) + columnar_magic_size];
+
+      if (size < columnar_magic_size + trailer)
+      {
+        throw std::runtime_error ("cpp_streams: not a columnar file");
+      }
+
+      file.read_at (magic, sizeof (magic), 0);
+      file.read_at (end, sizeof (end), size - trailer);
+
+      std::uint64_t footer_offset;
+      std::memcpy (&footer_offset, end, sizeof (footer_offset));
+
+      if (
+            std::memcmp (magic, columnar_magic, columnar_magic_size) != 0
+        ||  std::memcmp (end + sizeof (footer_offset), columnar_end_magic, columnar_magic_size) != 0
+        ||  footer_offset < columnar_magic_size
+        ||  footer_offset > size - trailer
+        )
+      {
+        throw std::runtime_error ("cpp_streams: not a columnar file");
+      }
+
+      std::vector<char> footer (static_cast<std::size_t> (size - trailer - footer_offset));
+      file.read_at (footer.data (), footer.size (), footer_offset);
+
+      columnar_metadata result;
+
+      byte_reader reader (footer.data (), footer.data () + footer.size ());
+
+      auto const columns = reader.read<std::uint32_t> ();
+      for (auto iter = 0U; iter < columns; ++iter)
+      {
+        result.types.push_back (reader.read<column_type> ());
+        result.names.push_back (reader.read_text ().to_string ());
+      }
+
+      auto const groups = reader.read<std::uint64_t> ();
+      for (auto iter = 0U; iter < groups; ++iter)
+      {
+        row_group_info group;
+        group.rows = reader.read<std::uint64_t> ();
+        for (auto column = 0U; column < columns; ++column)
+        {
+          chunk_info chunk;
+          chunk.offset    = reader.read<std::uint64_t> ();
+          chunk.size      = reader.read<std::uint64_t> ();
+          chunk.int_min   = reader.read<std::int64_t> ();
+          chunk.int_max   = reader.read<std::int64_t> ();
+          chunk.real_min  = reader.read<double> ();
+          chunk.real_max  = reader.read<double> ();
+          group.chunks.push_back (chunk);
+        }
+        result.row_groups.push_back (std::move (group));
+      }
+
+      return result;
+    }
+
+    // Encodes row groups of columns and writes them with the index on finish
+    class columnar_writer
+    {
+    public:
+      columnar_writer (std::string const & path, std::vector<column_type> const & types, std::vector<std::string> names, std::size_t rows_per_group)
+        : file            (path, false)
+        , names           (std::move (names))
+        , out             (default_write_buffer_size)
+        , rows_per_group  (rows_per_group > 0 ? rows_per_group : default_rows_per_group)
+        , offset          (0)
+        , rows            (0)
+        , total_rows      (0)
+      {
+        out.write (columnar_magic, columnar_magic_size);
+        for (auto && type : types)
+        {
+          columns.emplace_back ();
+          columns.back ().type = type;
+        }
+        flush ();
+      }
+
+      template<typename TTuple>
+      void append (TTuple && row)
+      {
+        append_columnar_row (columns, std::forward<TTuple> (row), std::make_index_sequence<std::tuple_size<strip_type_t<TTuple>>::value> ());
+        if (++rows == rows_per_group)
+        {
+          write_row_group ();
+        }
+      }
+
+      // Returns the number of rows written
+      std::size_t finish ()
+      {
+        write_row_group ();
+
+        auto const footer_offset = offset;
+
+        out.write_bytes (static_cast<std::uint32_t> (columns.size ()));
+        for (auto iter = 0U; iter < columns.size (); ++iter)
+        {
+          out.write_bytes (columns[iter].type);
+          write_text (out, names[iter]);
+        }
+
+        out.write_bytes (static_cast<std::uint64_t> (row_groups.size ()));
+        for (auto && group : row_groups)
+        {
+          out.write_bytes (group.rows);
+          for (auto && chunk : group.chunks)
+          {
+            out.write_bytes (chunk.offset);
+            out.write_bytes (chunk.size);
+            out.write_bytes (chunk.int_min);
+            out.write_bytes (chunk.int_max);
+            out.write_bytes (chunk.real_min);
+            out.write_bytes (chunk.real_max);
+          }
+        }
+        out.write_bytes (footer_offset);
+        out.write (columnar_end_magic, columnar_magic_size);
+        flush ();
+
+        return total_rows;
+      }
+
+    private:
+      void flush ()
+      {
+        file.write (out.data (), out.size ());
+        offset += out.size ();
+        out.consume (out.size ());
+      }
+
+      void write_row_group ()
+      {
+        if (rows == 0)
+        {
+          return;
+        }
+
+        trace_scope scope ("to_columnar_file.row_group");
+
+        row_group_info group;
+        group.rows = rows;
+
+        for (auto && column : columns)
+        {
+          chunk_info chunk;
+          chunk.offset = offset + out.size ();
+
+          switch (column.type)
+          {
+          case column_type::integer:
+            encode_integers (out, column.integers, chunk);
+            break;
+          case column_type::unsigned_integer:
+            encode_integers (out, column.integers, chunk);
+            unsigned_min_max (column.integers, chunk);
+            break;
+          case column_type::real:
+            encode_reals (out, column.reals, chunk);
+            break;
+          case column_type::text:
+            encode_texts (out, column.strings);
+            break;
+          }
+
+          chunk.size = offset + out.size () - chunk.offset;
+          group.chunks.push_back (chunk);
+          column.clear ();
+        }
+
+        row_groups.push_back (std::move (group));
+        total_rows  += rows;
+        rows        = 0;
+
+        flush ();
+      }
+
+      output_file                 file          ;
+      std::vector<std::string>    names         ;
+      output_buffer               out           ;
+      std::size_t                 rows_per_group;
+      std::uint64_t               offset        ;
+      std::size_t                 rows          ;
+      std::size_t                 total_rows    ;
+      std::vector<column_values>  columns       ;
+      std::vector<row_group_info> row_groups    ;
+    };
+
+    // ------------------------------------------------------------------------
+
+    struct from_columnar_file_step
+    {
+      static constexpr step_description describe () noexcept
+      {
+        return step_description
+        {
+          "from_columnar_file", false, false, size_effect::unknown, "column chunk reads, row groups pruned by where"
+        };
+      }
+    };
+
+    // ------------------------------------------------------------------------
+
+  }
+
+  // --------------------------------------------------------------------------
+
+  // The column types and names of a columnar file
+  class columnar_schema
+  {
+  public:
+    // Adds a column, integer types are stored as std::int64_t (std::uint64_t
+    //  as unsigned_integer), floating point types as double and std::string
+    //  or text_view as text
+    template<typename T>
+    columnar_schema & add (std::string name)
+    {
+      types.push_back (detail::column_type_of<T>::value);
+      names.push_back (std::move (name));
+      return *this;
+    }
+
+    std::vector<column_type>  types ;
+    std::vector<std::string>  names ;
+  };
+
+  // --------------------------------------------------------------------------
+
+  // An inclusive range of values a column must be within, row groups whose
+  //  min/max doesn't overlap the range are skipped without being read
+  //  int_min/int_max hold unsigned values when is_unsigned is true
+  struct column_range
+  {
+    std::string   column      ;
+    bool          integer     = true  ;
+    bool          is_unsigned = false ;
+    std::int64_t  int_min     = 0     ;
+    std::int64_t  int_max     = 0     ;
+    double        real_min    = 0     ;
+    double        real_max    = 0     ;
+
+    bool overlaps (column_type type, detail::chunk_info const & chunk) const noexcept
+    {
+      auto const chunk_unsigned = type == column_type::unsigned_integer;
+
+      if (detail::is_integer_column (type) && integer)
+      {
+        return
+              !detail::integer_less (chunk.int_max, chunk_unsigned, int_min, is_unsigned)
+          &&  !detail::integer_less (int_max, is_unsigned, chunk.int_min, chunk_unsigned)
+          ;
+      }
+      else if (detail::is_integer_column (type))
+      {
+        return
+              !(detail::integer_to_real (chunk.int_max, chunk_unsigned) < real_min)
+          &&  !(real_max < detail::integer_to_real (chunk.int_min, chunk_unsigned))
+          ;
+      }
+      else
+      {
+        return !(chunk.real_max < lower () || upper () < chunk.real_min);
+      }
+    }
+
+    bool contains (detail::column_values const & values, std::size_t row) const noexcept
+    {
+      auto const column_unsigned = values.type == column_type::unsigned_integer;
+
+      if (detail::is_integer_column (values.type) && integer)
+      {
+        auto const v = values.integers[row];
+        return
+              !detail::integer_less (v, column_unsigned, int_min, is_unsigned)
+          &&  !detail::integer_less (int_max, is_unsigned, v, column_unsigned)
+          ;
+      }
+      else if (detail::is_integer_column (values.type))
+      {
+        auto const v = detail::integer_to_real (values.integers[row], column_unsigned);
+        return real_min <= v && v <= real_max;
+      }
+      else
+      {
+        auto const v = values.reals[row];
+        return lower () <= v && v <= upper ();
+      }
+    }
+
+  private:
+    double lower () const noexcept
+    {
+      return integer ? detail::integer_to_real (int_min, is_unsigned) : real_min;
+    }
+
+    double upper () const noexcept
+    {
+      return integer ? detail::integer_to_real (int_max, is_unsigned) : real_max;
+    }
+  };
+
+  template<typename T>
+  std::enable_if_t<std::is_integral<T>::value, column_range> column_between (std::string column, T min, T max)
+  {
+    column_range result;
+    result.column       = std::move (column);
+    result.integer      = true;
+    result.is_unsigned  = std::is_unsigned<T>::value;
+    result.int_min      = static_cast<std::int64_t> (min);
+    result.int_max      = static_cast<std::int64_t> (max);
+    return result;
+  }
+
+  template<typename T>
+  std::enable_if_t<std::is_floating_point<T>::value, column_range> column_between (std::string column, T min, T max)
+  {
+    column_range result;
+    result.column   = std::move (column);
+    result.integer  = false;
+    result.real_min = static_cast<double> (min);
+    result.real_max = static_cast<double> (max);
+    return result;
+  }
+
+  // --------------------------------------------------------------------------
+
+  // What the runs of from_columnar_file read, every run adds to it
+  struct columnar_read_statistics
+  {
+    std::uint64_t row_groups          = 0;
+    // Row groups skipped as a where range doesn't overlap their min/max
+    std::uint64_t row_groups_skipped  = 0;
+    std::uint64_t chunks_read         = 0;
+    std::uint64_t chunk_bytes_read    = 0;
+  };
+
+  // --------------------------------------------------------------------------
+  // Sources
+  // --------------------------------------------------------------------------
+
+  // Creates a source of std::tuple<TColumns...> from the named columns of a
+  //  columnar file. Only the chunks of the named columns and the columns of
+  //  where are read, rows outside any of the where ranges are excluded
+  //  text_view columns refer into the read chunk and are valid until the
+  //  sink returns
+  //  Integer columns are only read as a narrower type than std::int64_t if
+  //  all the values fit and real columns only as double, otherwise it throws
+  //  std::invalid_argument
+  //  statistics (if not null) must outlive the source and is added to by its
+  //  runs without synchronization
+  template<typename... TColumns>
+  auto from_columnar_file (
+      std::string                 path
+    , std::vector<std::string>    columns
+    , std::vector<column_range>   where       = std::vector<column_range> ()
+    , columnar_read_statistics *  statistics  = nullptr
+    )
+  {
+    using row_type = std::tuple<TColumns...>;
+
+    constexpr auto column_count = sizeof... (TColumns);
+
+    if (columns.size () != column_count)
+    {
+      throw std::invalid_argument ("cpp_streams: from_columnar_file must name one column per requested column");
+    }
+
+    return detail::adapt_source_function<row_type, detail::plan<detail::from_columnar_file_step>> (
+      [path = std::move (path), columns = std::move (columns), where = std::move (where), statistics] (auto && sink)
+      {
+        detail::input_file  file      (detail::make_file_spec (path));
+        auto const          metadata  = detail::read_columnar_metadata (file);
+
+        auto const expected_types = std::vector<column_type> {detail::column_type_of<TColumns>::value...};
+
+        using fits_function = bool (*) (detail::chunk_info const &);
+        fits_function const fits[column_count > 0 ? column_count : 1] = {&detail::column_read_fits<TColumns>...};
+
+        // The file columns that are read, each column is read once even if
+        //  it's both requested and filtered on
+        std::vector<std::size_t> read;
+        auto add_read = [&read] (std::size_t column)
+        {
+          auto const found = std::find (read.begin (), read.end (), column);
+          if (found != read.end ())
+          {
+            return static_cast<std::size_t> (found - read.begin ());
+          }
+          read.push_back (column);
+          return read.size () - 1;
+        };
+
+        std::vector<std::size_t> requested;
+        for (auto iter = 0U; iter < column_count; ++iter)
+        {
+          auto const column = metadata.find (columns[iter]);
+          if (metadata.types[column] != expected_types[iter])
+          {
+            throw std::invalid_argument ("cpp_streams: column '" + columns[iter] + "' has a different type in columnar file");
+          }
+          for (auto && group : metadata.row_groups)
+          {
+            if (!fits[iter] (group.chunks[column]))
+            {
+              throw std::invalid_argument ("cpp_streams: column '" + columns[iter] + "' has values that don't fit the requested type");
+            }
+          }
+          requested.push_back (add_read (column));
+        }
+
+        std::vector<std::size_t> filtered;
+        for (auto && range : where)
+        {
+          auto const column = metadata.find (range.column);
+          if (metadata.types[column] == column_type::text)
+          {
+            throw std::invalid_argument ("cpp_streams: column_range on text column '" + range.column + "'");
+          }
+          filtered.push_back (add_read (column));
+        }
+
+        std::vector<detail::column_values> values (read.size ());
+        for (auto iter = 0U; iter < read.size (); ++iter)
+        {
+          values[iter].type = metadata.types[read[iter]];
+        }
+
+        detail::column_values const * row_columns[column_count > 0 ? column_count : 1];
+        for (auto iter = 0U; iter < column_count; ++iter)
+        {
+          row_columns[iter] = &values[requested[iter]];
+        }
+
+        for (auto && group : metadata.row_groups)
+        {
+          auto skip = false;
+          for (auto iter = 0U; iter < where.size () && !skip; ++iter)
+          {
+            auto const column = read[filtered[iter]];
+            skip = !where[iter].overlaps (metadata.types[column], group.chunks[column]);
+          }
+
+          if (statistics)
+          {
+            ++statistics->row_groups;
+            statistics->row_groups_skipped += skip ? 1U : 0U;
+          }
+
+          if (skip)
+          {
+            continue;
+          }
+
+          auto const rows = static_cast<std::size_t> (group.rows);
+
+          {
+            detail::trace_scope scope ("from_columnar_file.read");
+
+            for (auto iter = 0U; iter < read.size (); ++iter)
+            {
+              auto const & chunk  = group.chunks[read[iter]];
+              auto & v            = values[iter];
+              v.bytes.resize (static_cast<std::size_t> (chunk.size));
+              file.read_at (v.bytes.data (), v.bytes.size (), chunk.offset);
+              detail::decode_chunk (v, rows);
+
+              if (statistics)
+              {
+                ++statistics->chunks_read;
+                statistics->chunk_bytes_read += chunk.size;
+              }
+            }
+          }
+
+          detail::trace_scope scope ("from_columnar_file.rows");
+
+          for (auto row = 0U; row < rows; ++row)
+          {
+            auto include = true;
+            for (auto iter = 0U; iter < where.size () && include; ++iter)
+            {
+              include = where[iter].contains (values[filtered[iter]], row);
+            }
+
+            if (include && !sink (detail::make_columnar_row<row_type, TColumns...> (row_columns, row, std::index_sequence_for<TColumns...> ())))
+            {
+              return;
+            }
+          }
+        }
+      });
+  }
+
+  // --------------------------------------------------------------------------
+  // Sinks
+  // --------------------------------------------------------------------------
+
+  // Writes tuples to a columnar file with the given schema, the tuple
+  //  elements must match the schema column types
+  //  Returns the number of rows written
+  auto to_columnar_file = [] (auto && path, columnar_schema schema, std::size_t rows_per_group = detail::default_rows_per_group)
+  {
+    return
+      [path = std::string (path), schema = std::move (schema), rows_per_group] (auto && source)
+      {
+        CPP_STREAMS__CHECK_SOURCE (source);
+
+        detail::trace_scope scope ("to_columnar_file");
+
+        using source_type = decltype (source)                                     ;
+        using value_type  = detail::get_stripped_source_value_type_t<source_type> ;
+
+        auto const types = detail::get_column_types<value_type> (std::make_index_sequence<std::tuple_size<value_type>::value> ());
+        if (types != schema.types)
+        {
+          throw std::invalid_argument ("cpp_streams: the pipeline values don't match the columnar schema");
+        }
+
+        detail::columnar_writer writer (path, schema.types, schema.names, rows_per_group);
+
+        source.source_function (
+          [&writer] (auto && v)
+          {
+            writer.append (std::forward<decltype (v)> (v));
+            return true;
+          });
+
+        return writer.finish ();
+      };
+  };
+
+  // --------------------------------------------------------------------------
+
+}
+
+// ----------------------------------------------------------------------------
+#endif // CPP_STREAMS_COLUMNAR__INCLUDE_GUARD
+// ----------------------------------------------------------------------------
@@ -0,0 +1,165 @@
+// ----------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef CPP_STREAMS_EXPLAIN__INCLUDE_GUARD
+# define CPP_STREAMS_EXPLAIN__INCLUDE_GUARD
+// ----------------------------------------------------------------------------
+# include "cpp_streams.hpp"
+// ----------------------------------------------------------------------------
+# include <algorithm>
+# include <cstddef>
+# include <cstring>
+# include <string>
+# include <vector>
+// ----------------------------------------------------------------------------
+// Explaining pipelines
+//  explain (source) describes the plan of a source, the operators it was
+//  built from in the order they run, after the rewrites of the pipes (see
+//  Fusion in cpp_streams.hpp):
+//
+//    std::cout << explain (from (vs) >> filter (f) >> filter (g) >> sort (s) >> take (10));
+//
+//    #  operator        buffers  stops early  elements  strategy
+//    1  from            no       no           exact     sequential
+//    2  filter (fused)  no       no           bounded   sequential
+//    3  sort            yes      no           bounded   sequential
+//    4  take            no       yes          bounded   sequential
+//
+//  buffers means the operator holds all elements before passing any on,
+//  stops early that it stops the upstream operators before they're done.
+//  elements is what's known about the number of elements passed on before
+//  running: exact, bounded (by an exact count or take) or unknown.
+//  The sink isn't part of the plan
+// ----------------------------------------------------------------------------
+
+namespace cpp_streams
+{
+
+  // --------------------------------------------------------------------------
+
+  namespace detail
+  {
+    template<typename... TSteps>
+    std::vector<step_description> describe_plan (plan<TSteps...>)
+    {
+      return std::vector<step_description> {TSteps::describe ()...};
+    }
+
+    enum class element_count
+    {
+      exact   ,
+      bounded ,
+      unknown ,
+    };
+
+    inline element_count next_element_count (element_count upstream, size_effect effect) noexcept
+    {
+      switch (effect)
+      {
+      case size_effect::exact:
+        return element_count::exact;
+      case size_effect::keeps:
+        return upstream;
+      case size_effect::at_most:
+        return upstream == element_count::unknown ? element_count::unknown : element_count::bounded;
+      case size_effect::limits:
+        return element_count::bounded;
+      case size_effect::unknown:
+      default:
+        return element_count::unknown;
+      }
+    }
+
+    inline char const * element_count_name (element_count count) noexcept
+    {
+      switch (count)
+      {
+      case element_count::exact:
+        return "exact";
+      case element_count::bounded:
+        return "bounded";
+      case element_count::unknown:
+      default:
+        return "unknown";
+      }
+    }
+
+    inline void append_column (std::string & result, char const * text, std::size_t width)
+    {
+      auto const length = std::strlen (text);
+      result += text;
+      result.append (width > length ? width - length : 0U, ' ');
+    }
+  }
+
+  // --------------------------------------------------------------------------
+
+  // Returns the plan of source as a table with one line per operator
+  template<typename TSource>
+  std::string explain (TSource const & source)
+  {
+    CPP_STREAMS__CHECK_SOURCE (source);
+
+    using plan_type = typename detail::strip_type_t<TSource>::plan_type;
+
+    auto steps = detail::describe_plan (plan_type ());
+    if (steps.empty ())
+    {
+      // Sources built with adapt_source_function without a plan
+      steps.push_back (detail::step_description {"(not described)", false, false, detail::size_effect::unknown, "unknown"});
+    }
+
+    std::size_t name_width = std::strlen ("operator");
+    for (auto && step : steps)
+    {
+      name_width = std::max (name_width, std::strlen (step.name));
+    }
+    name_width += 2;
+
+    auto const index_width = std::to_string (steps.size ()).size () + 2;
+
+    std::string result;
+
+    detail::append_column (result, "#"          , index_width );
+    detail::append_column (result, "operator"   , name_width  );
+    detail::append_column (result, "buffers"    , 9           );
+    detail::append_column (result, "stops early", 13          );
+    detail::append_column (result, "elements"   , 10          );
+    result += "strategy\n";
+
+    auto count = detail::element_count::unknown;
+    auto index = 0U;
+    for (auto && step : steps)
+    {
+      count = detail::next_element_count (count, step.size);
+
+      detail::append_column (result, std::to_string (++index).c_str ()  , index_width );
+      detail::append_column (result, step.name                          , name_width  );
+      detail::append_column (result, step.buffers     ? "yes" : "no"    , 9           );
+      detail::append_column (result, step.stops_early ? "yes" : "no"    , 13          );
+      detail::append_column (result, detail::element_count_name (count) , 10          );
+      result += step.strategy;
+      result += '\n';
+    }
+
+    return result;
+  }
+
+  // --------------------------------------------------------------------------
+
+}
+// ----------------------------------------------------------------------------
+#endif // CPP_STREAMS_EXPLAIN__INCLUDE_GUARD
+// ----------------------------------------------------------------------------
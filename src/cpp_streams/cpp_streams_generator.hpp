@@ -0,0 +1,343 @@
+// ----------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef CPP_STREAMS_GENERATOR__INCLUDE_GUARD
+# define CPP_STREAMS_GENERATOR__INCLUDE_GUARD
+// ----------------------------------------------------------------------------
+# include "cpp_streams.hpp"
+// ----------------------------------------------------------------------------
+// Sources from C++20 coroutines
+//  generator<T> is the return type of coroutines that co_yield values of T,
+//  from_generator (g) creates a source pushing the values of g:
+//
+//    generator<page> pages (client & c)
+//    {
+//      for (auto p = c.first_page (); !p.empty (); p = c.next_page (p))
+//      {
+//        co_yield p;
+//      }
+//    }
+//
+//    auto items = from_generator (pages (c)) >> map (parse) >> to_vector;
+//
+//  The coroutine frame of a generator is allocated from an allocator passed
+//  as std::allocator_arg, allocator (for instance arena_allocator) ahead of
+//  the other parameters. Otherwise the most recently freed frame of the
+//  thread is reused so a generator created per sequence doesn't allocate
+//  once the frame cache is warm.
+//
+//  A generator runs once, copies of it (and of sources built from it) share
+//  its coroutine. Exceptions thrown by the coroutine are rethrown from the
+//  source. Only available when the compiler supports coroutines
+// ----------------------------------------------------------------------------
+# ifdef __cpp_impl_coroutine
+// ----------------------------------------------------------------------------
+#   include <coroutine>
+#   include <cstddef>
+#   include <exception>
+#   include <memory>
+#   include <new>
+#   include <utility>
+// ----------------------------------------------------------------------------
+
+namespace cpp_streams
+{
+
+  // --------------------------------------------------------------------------
+
+  namespace detail
+  {
+    struct from_generator_step
+    {
+      static constexpr step_description describe () noexcept
+      {
+        return step_description
+        {
+          "from_generator", false, false, size_effect::unknown, "coroutine"
+        };
+      }
+    };
+
+    // ------------------------------------------------------------------------
+
+    // Frames are followed by the function that frees them so frames from
+    //  allocators and from the frame cache can be told apart
+    using free_frame_function = void (*) (void * frame, std::size_t size);
+
+    constexpr std::size_t frame_alignment = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
+    constexpr std::size_t align_frame_size (std::size_t size) noexcept
+    {
+      return (size + frame_alignment - 1) & ~(frame_alignment - 1);
+    }
+
+    constexpr std::size_t frame_size_with_free (std::size_t size) noexcept
+    {
+      return align_frame_size (size) + align_frame_size (sizeof (free_frame_function));
+    }
+
+    inline free_frame_function & free_function_of (void * frame, std::size_t size) noexcept
+    {
+      return *reinterpret_cast<free_frame_function *> (static_cast<char *> (frame) + align_frame_size (size));
+    }
+
+    // Keeps the largest freed frame of the thread
+    struct frame_cache
+    {
+      void *      frame = nullptr ;
+      std::size_t size  = 0       ;
+
+      ~frame_cache () noexcept
+      {
+        ::operator delete (frame);
+      }
+    };
+
+    inline frame_cache & thread_frame_cache () noexcept
+    {
+      thread_local frame_cache cache;
+      return cache;
+    }
+
+    inline void free_cached_frame (void * frame, std::size_t size) noexcept
+    {
+      auto & cache      = thread_frame_cache ();
+      auto const total  = frame_size_with_free (size);
+
+      if (cache.size >= total)
+      {
+        ::operator delete (frame);
+        return;
+      }
+
+      ::operator delete (cache.frame);
+      cache.frame = frame;
+      cache.size  = total;
+    }
+
+    inline void * allocate_cached_frame (std::size_t size)
+    {
+      auto & cache      = thread_frame_cache ();
+      auto const total  = frame_size_with_free (size);
+
+      void * frame = nullptr;
+      if (cache.frame != nullptr && cache.size >= total)
+      {
+        frame       = cache.frame;
+        cache.frame = nullptr;
+        cache.size  = 0;
+      }
+      else
+      {
+        frame = ::operator new (total);
+      }
+
+      free_function_of (frame, size) = &free_cached_frame;
+      return frame;
+    }
+
+    // The allocator is stored after the free function
+    struct alignas (frame_alignment) frame_block
+    {
+      char bytes[frame_alignment];
+    };
+
+    template<typename TAllocator>
+    using frame_allocator_t = rebind_allocator_t<TAllocator, frame_block>;
+
+    template<typename TAllocator>
+    constexpr std::size_t frame_blocks (std::size_t size) noexcept
+    {
+      return (frame_size_with_free (size) + align_frame_size (sizeof (frame_allocator_t<TAllocator>))) / sizeof (frame_block);
+    }
+
+    template<typename TAllocator>
+    frame_allocator_t<TAllocator> * allocator_of (void * frame, std::size_t size) noexcept
+    {
+      return reinterpret_cast<frame_allocator_t<TAllocator> *> (static_cast<char *> (frame) + frame_size_with_free (size));
+    }
+
+    template<typename TAllocator>
+    void free_allocated_frame (void * frame, std::size_t size) noexcept
+    {
+      using allocator_type = frame_allocator_t<TAllocator>;
+
+      auto stored     = allocator_of<TAllocator> (frame, size);
+      auto allocator  = std::move (*stored);
+      stored->~allocator_type ();
+
+      allocator.deallocate (static_cast<frame_block *> (frame), frame_blocks<TAllocator> (size));
+    }
+
+    template<typename TAllocator>
+    void * allocate_frame (std::size_t size, TAllocator const & allocator)
+    {
+      using allocator_type = frame_allocator_t<TAllocator>;
+
+      static_assert (alignof (allocator_type) <= frame_alignment, "TAllocator is overaligned");
+
+      auto frame_allocator  = allocator_type (allocator);
+      void * frame          = frame_allocator.allocate (frame_blocks<TAllocator> (size));
+
+      free_function_of (frame, size) = &free_allocated_frame<TAllocator>;
+      new (allocator_of<TAllocator> (frame, size)) allocator_type (std::move (frame_allocator));
+      return frame;
+    }
+  }
+
+  // --------------------------------------------------------------------------
+
+  template<typename TValueType>
+  class generator
+  {
+  public:
+    class promise_type
+    {
+    public:
+      generator get_return_object () noexcept
+      {
+        return generator (std::coroutine_handle<promise_type>::from_promise (*this));
+      }
+
+      std::suspend_always initial_suspend () const noexcept
+      {
+        return {};
+      }
+
+      std::suspend_always final_suspend () const noexcept
+      {
+        return {};
+      }
+
+      // A yielded temporary lives until the coroutine is resumed
+      std::suspend_always yield_value (TValueType const & v) noexcept
+      {
+        value = std::addressof (v);
+        return {};
+      }
+
+      void return_void () const noexcept
+      {
+      }
+
+      void unhandled_exception () noexcept
+      {
+        error = std::current_exception ();
+      }
+
+      static void * operator new (std::size_t size)
+      {
+        return detail::allocate_cached_frame (size);
+      }
+
+      template<typename TAllocator, typename... TArguments>
+      static void * operator new (std::size_t size, std::allocator_arg_t, TAllocator const & allocator, TArguments const & ...)
+      {
+        return detail::allocate_frame (size, allocator);
+      }
+
+      static void operator delete (void * frame, std::size_t size) noexcept
+      {
+        detail::free_function_of (frame, size) (frame, size);
+      }
+
+    private:
+      friend class generator;
+
+      TValueType const *  value       = nullptr ;
+      std::exception_ptr  error                 ;
+      std::size_t         references  = 1       ;
+    };
+
+    generator (generator const & o) noexcept
+      : coroutine (o.coroutine)
+    {
+      if (coroutine)
+      {
+        ++coroutine.promise ().references;
+      }
+    }
+
+    generator (generator && o) noexcept
+      : coroutine (std::exchange (o.coroutine, nullptr))
+    {
+    }
+
+    generator & operator= (generator o) noexcept
+    {
+      std::swap (coroutine, o.coroutine);
+      return *this;
+    }
+
+    ~generator () noexcept
+    {
+      if (coroutine && --coroutine.promise ().references == 0)
+      {
+        coroutine.destroy ();
+      }
+    }
+
+    // Resumes the coroutine until it's done or sink returns false
+    template<typename TSink>
+    void operator () (TSink && sink) const
+    {
+      if (!coroutine)
+      {
+        return;
+      }
+
+      auto & promise = coroutine.promise ();
+
+      while (!coroutine.done ())
+      {
+        coroutine.resume ();
+
+        if (promise.error)
+        {
+          std::rethrow_exception (std::exchange (promise.error, nullptr));
+        }
+
+        if (coroutine.done () || !sink (*promise.value))
+        {
+          return;
+        }
+      }
+    }
+
+  private:
+    explicit generator (std::coroutine_handle<promise_type> coroutine) noexcept
+      : coroutine (coroutine)
+    {
+    }
+
+    std::coroutine_handle<promise_type> coroutine;
+  };
+
+  // --------------------------------------------------------------------------
+
+  template<typename TValueType>
+  auto from_generator (generator<TValueType> g)
+  {
+    return detail::adapt_source_function<TValueType const &, detail::plan<detail::from_generator_step>> (std::move (g));
+  }
+
+  // --------------------------------------------------------------------------
+
+}
+// ----------------------------------------------------------------------------
+# endif // __cpp_impl_coroutine
+// ----------------------------------------------------------------------------
+#endif // CPP_STREAMS_GENERATOR__INCLUDE_GUARD
+// ----------------------------------------------------------------------------
@@ -0,0 +1,483 @@
+// ----------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef CPP_STREAMS_INSTRUMENT__INCLUDE_GUARD
+# define CPP_STREAMS_INSTRUMENT__INCLUDE_GUARD
+// ----------------------------------------------------------------------------
+# include <algorithm>
+# include <atomic>
+# include <chrono>
+# include <cstdint>
+# include <map>
+# include <memory>
+# include <mutex>
+# include <ostream>
+# include <string>
+# include <utility>
+# include <vector>
+// ----------------------------------------------------------------------------
+// Pipeline instrumentation
+//  Built with CPP_STREAMS__INSTRUMENT defined (for all translation units)
+//  the selective pipes (filter, skip, skip_while, take, take_while) count
+//  the elements in and out of every run and probe ("name") pipes count
+//  the elements passing, how often downstream stopped the source and time
+//  every 64th downstream call to estimate the time spent after the probe.
+//  The time between two probes is the difference of their downstream times.
+//
+//  Every stage in a pipeline gets its own entry, identified by the stage
+//  kind and the type of the pipeline upstream of it, so two filters in one
+//  pipeline are told apart by their stage number while running the same
+//  pipeline again adds to the same entries. Counts are kept per run and
+//  added with atomics when the run ends, runs on different threads are fine
+//  and only reporting takes a lock.
+//  Without CPP_STREAMS__INSTRUMENT probe passes the source through, the
+//  pipes count nothing and the registry stays empty
+//
+//  The buffering operators (reverse, sort, to_map, to_set, to_vector,
+//  to_vector_into) also name themselves as the owner of the allocations
+//  they make while instrumented, allocation_owner () returns the owner on
+//  the calling thread so a replaced operator new can attribute allocations
+// ----------------------------------------------------------------------------
+
+namespace cpp_streams
+{
+
+  // --------------------------------------------------------------------------
+
+  struct stage_statistics
+  {
+    std::string   name                  ;
+    // Tells apart stages of the same name, numbered in the order first run
+    std::uint64_t stage                 = 0;
+    std::uint64_t runs                  = 0;
+    std::uint64_t elements_in           = 0;
+    std::uint64_t elements_out          = 0;
+    // Runs where downstream asked the stage to stop early
+    std::uint64_t stops                 = 0;
+    // Total time of the runs, including upstream and downstream
+    double        run_ns                = 0;
+    // Only collected by probes, time of the sampled downstream calls
+    std::uint64_t sampled_elements      = 0;
+    double        sampled_downstream_ns = 0;
+
+    // Fraction of elements passed on, 1 when no elements were received
+    double selectivity () const noexcept
+    {
+      return elements_in > 0
+        ? static_cast<double> (elements_out) / static_cast<double> (elements_in)
+        : 1.0
+        ;
+    }
+
+    // Estimated time spent downstream of a probe, negative if not sampled
+    double downstream_ns () const noexcept
+    {
+      return sampled_elements > 0
+        ? sampled_downstream_ns * static_cast<double> (elements_out) / static_cast<double> (sampled_elements)
+        : -1.0
+        ;
+    }
+  };
+
+  // --------------------------------------------------------------------------
+
+  namespace detail
+  {
+
+    // ------------------------------------------------------------------------
+
+    using instrument_clock = std::chrono::steady_clock;
+
+    // Every (sample_mask + 1):th element passing a probe is timed
+    constexpr std::uint64_t probe_sample_mask = 63U;
+
+    // The counts of a stage added up over all its runs
+    struct stage_slot
+    {
+      stage_slot (std::string name, std::uint64_t stage)
+        : name  (std::move (name))
+        , stage (stage)
+      {
+      }
+
+      std::string const           name                  ;
+      std::uint64_t const         stage                 ;
+      std::atomic<std::uint64_t>  runs                  {0};
+      std::atomic<std::uint64_t>  elements_in           {0};
+      std::atomic<std::uint64_t>  elements_out          {0};
+      std::atomic<std::uint64_t>  stops                 {0};
+      std::atomic<std::uint64_t>  run_ns                {0};
+      std::atomic<std::uint64_t>  sampled_elements      {0};
+      std::atomic<std::uint64_t>  sampled_downstream_ns {0};
+    };
+
+    class stage_registry
+    {
+    public:
+      static stage_registry & instance ()
+      {
+        static stage_registry registry;
+        return registry;
+      }
+
+      // The slot of the stage identified by key and name, created on first use
+      stage_slot & slot (void const * key, std::string const & name)
+      {
+        std::lock_guard<std::mutex> lock (mutex);
+
+        auto & s = slots[std::make_pair (key, name)];
+        if (!s)
+        {
+          s.reset (new stage_slot (name, slots.size ()));
+        }
+        return *s;
+      }
+
+      std::vector<stage_statistics> snapshot () const
+      {
+        std::lock_guard<std::mutex> lock (mutex);
+
+        std::vector<stage_statistics> result;
+        result.reserve (slots.size ());
+        for (auto && kv : slots)
+        {
+          auto const & s = *kv.second;
+
+          stage_statistics stats;
+          stats.runs = s.runs.load (std::memory_order_relaxed);
+          if (stats.runs == 0)
+          {
+            continue;
+          }
+
+          stats.name                  = s.name                                                                        ;
+          stats.stage                 = s.stage                                                                       ;
+          stats.elements_in           = s.elements_in.load (std::memory_order_relaxed)                                ;
+          stats.elements_out          = s.elements_out.load (std::memory_order_relaxed)                               ;
+          stats.stops                 = s.stops.load (std::memory_order_relaxed)                                      ;
+          stats.run_ns                = static_cast<double> (s.run_ns.load (std::memory_order_relaxed))               ;
+          stats.sampled_elements      = s.sampled_elements.load (std::memory_order_relaxed)                           ;
+          stats.sampled_downstream_ns = static_cast<double> (s.sampled_downstream_ns.load (std::memory_order_relaxed));
+          result.push_back (std::move (stats));
+        }
+
+        std::sort (
+            result.begin ()
+          , result.end ()
+          , [] (stage_statistics const & l, stage_statistics const & r)
+            {
+              return l.name < r.name || (l.name == r.name && l.stage < r.stage);
+            }
+          );
+
+        return result;
+      }
+
+      // Zeroes the counts, the slots stay as the stages keep referring to them
+      void reset ()
+      {
+        std::lock_guard<std::mutex> lock (mutex);
+
+        for (auto && kv : slots)
+        {
+          auto & s = *kv.second;
+          s.runs                  .store (0, std::memory_order_relaxed);
+          s.elements_in           .store (0, std::memory_order_relaxed);
+          s.elements_out          .store (0, std::memory_order_relaxed);
+          s.stops                 .store (0, std::memory_order_relaxed);
+          s.run_ns                .store (0, std::memory_order_relaxed);
+          s.sampled_elements      .store (0, std::memory_order_relaxed);
+          s.sampled_downstream_ns .store (0, std::memory_order_relaxed);
+        }
+      }
+
+    private:
+      using slot_key = std::pair<void const *, std::string>;
+
+      mutable std::mutex                                mutex ;
+      std::map<slot_key, std::unique_ptr<stage_slot>>   slots ;
+    };
+
+    // Unique to the stage of kind TStep following the pipeline TSource, the
+    //  upstream type differs for every pipeline built by different code
+    template<typename TStep, typename TSource>
+    void const * stage_key () noexcept
+    {
+      static char const key = 0;
+      return &key;
+    }
+
+    // The slot of a stage with a fixed name, only looked up the first time
+    template<typename TStep, typename TSource>
+    stage_slot & stage_slot_of (char const * name)
+    {
+      static stage_slot & slot = stage_registry::instance ().slot (stage_key<TStep, TSource> (), name);
+      return slot;
+    }
+
+    // ------------------------------------------------------------------------
+
+#ifdef CPP_STREAMS__INSTRUMENT
+    inline char const * & current_allocation_owner () noexcept
+    {
+      thread_local char const * owner = nullptr;
+      return owner;
+    }
+
+    // Names the operator owning the allocations made in its scope, the
+    //  innermost scope is the owner
+    class allocation_scope
+    {
+    public:
+      explicit allocation_scope (char const * owner) noexcept
+        : previous (current_allocation_owner ())
+      {
+        current_allocation_owner () = owner;
+      }
+
+      allocation_scope (allocation_scope const &)             = delete;
+      allocation_scope & operator= (allocation_scope const &) = delete;
+
+      ~allocation_scope () noexcept
+      {
+        current_allocation_owner () = previous;
+      }
+
+    private:
+      char const * previous;
+    };
+
+    // Names the stage of kind TStep following the pipeline TSource
+    template<typename TStep, typename TSource>
+    struct stage_tag
+    {
+    };
+
+    // Counts a single run of a pipe, added to the stage slot when the run ends
+    class stage_counter
+    {
+    public:
+      template<typename TStep, typename TSource>
+      stage_counter (stage_tag<TStep, TSource>, char const * name)
+        : stage_counter (stage_slot_of<TStep, TSource> (name))
+      {
+      }
+
+      explicit stage_counter (stage_slot & slot)
+        : slot (slot)
+        , then (instrument_clock::now ())
+      {
+      }
+
+      stage_counter (stage_counter const &)             = delete;
+      stage_counter & operator= (stage_counter const &) = delete;
+
+      ~stage_counter () noexcept
+      {
+        auto const elapsed = std::chrono::duration_cast<std::chrono::nanoseconds> (instrument_clock::now () - then).count ();
+
+        slot.runs                 .fetch_add (1                                   , std::memory_order_relaxed);
+        slot.elements_in          .fetch_add (elements_in                         , std::memory_order_relaxed);
+        slot.elements_out         .fetch_add (elements_out                        , std::memory_order_relaxed);
+        slot.stops                .fetch_add (stops                               , std::memory_order_relaxed);
+        slot.run_ns               .fetch_add (static_cast<std::uint64_t> (elapsed), std::memory_order_relaxed);
+        slot.sampled_elements     .fetch_add (sampled_elements                    , std::memory_order_relaxed);
+        slot.sampled_downstream_ns.fetch_add (sampled_downstream_ns               , std::memory_order_relaxed);
+      }
+
+      void in () noexcept
+      {
+        ++elements_in;
+      }
+
+      void out () noexcept
+      {
+        ++elements_out;
+      }
+
+      // Tracks downstream asking the pipe to stop, returns result
+      bool passed (bool result) noexcept
+      {
+        stops += result ? 0U : 1U;
+        return result;
+      }
+
+      // Passes an element downstream, timing every 64th call
+      template<typename TDownstream>
+      bool downstream (TDownstream && call)
+      {
+        in ();
+        out ();
+
+        if ((elements_out & probe_sample_mask) != 0)
+        {
+          return passed (call ());
+        }
+
+        auto const before = instrument_clock::now ();
+        auto const result = call ();
+        auto const after  = instrument_clock::now ();
+
+        sampled_downstream_ns += static_cast<std::uint64_t> (std::chrono::duration_cast<std::chrono::nanoseconds> (after - before).count ());
+        ++sampled_elements;
+
+        return passed (result);
+      }
+
+    private:
+      stage_slot &                  slot                      ;
+      instrument_clock::time_point  then                      ;
+      std::uint64_t                 elements_in           = 0 ;
+      std::uint64_t                 elements_out          = 0 ;
+      std::uint64_t                 stops                 = 0 ;
+      std::uint64_t                 sampled_elements      = 0 ;
+      std::uint64_t                 sampled_downstream_ns = 0 ;
+    };
+#endif
+
+    // ------------------------------------------------------------------------
+
+    template<typename TChar, typename TTraits>
+    void write_instrument_csv_text (std::basic_ostream<TChar, TTraits> & stream, std::string const & v)
+    {
+      stream << '"';
+      for (auto c : v)
+      {
+        if (c == '"')
+        {
+          stream << '"';
+        }
+        stream << c;
+      }
+      stream << '"';
+    }
+
+    template<typename TChar, typename TTraits>
+    void write_instrument_json_text (std::basic_ostream<TChar, TTraits> & stream, std::string const & v)
+    {
+      static char const hex[] = "0123456789abcdef";
+
+      stream << '"';
+      for (auto c : v)
+      {
+        auto const u = static_cast<unsigned char> (c);
+        if (c == '"' || c == '\\')
+        {
+          stream << '\\' << c;
+        }
+        else if (u < 0x20)
+        {
+          stream << "\\u00" << hex[u >> 4] << hex[u & 0xF];
+        }
+        else
+        {
+          stream << c;
+        }
+      }
+      stream << '"';
+    }
+
+    // ------------------------------------------------------------------------
+
+  }
+
+  // --------------------------------------------------------------------------
+
+  // The statistics of all instrumented stages that ran, ordered by name and
+  //  stage
+  inline std::vector<stage_statistics> instrumentation_snapshot ()
+  {
+    return detail::stage_registry::instance ().snapshot ();
+  }
+
+  inline void reset_instrumentation ()
+  {
+    detail::stage_registry::instance ().reset ();
+  }
+
+  // The operator allocating on the calling thread or nullptr (always when
+  //  not instrumented), safe to call from a replaced operator new as it
+  //  doesn't allocate
+  inline char const * allocation_owner () noexcept
+  {
+#ifdef CPP_STREAMS__INSTRUMENT
+    return detail::current_allocation_owner ();
+#else
+    return nullptr;
+#endif
+  }
+
+  // Writes the statistics of all stages as a JSON array
+  template<typename TChar, typename TTraits>
+  void write_instrumentation_json (std::basic_ostream<TChar, TTraits> & stream)
+  {
+    auto const stages = instrumentation_snapshot ();
+
+    stream << '[';
+    for (auto iter = 0U; iter < stages.size (); ++iter)
+    {
+      auto const & s = stages[iter];
+      stream << (iter == 0 ? "\n  {\"name\": " : ",\n  {\"name\": ");
+      detail::write_instrument_json_text (stream, s.name);
+      stream
+        << ", \"runs\": "         << s.runs
+        << ", \"elements_in\": "  << s.elements_in
+        << ", \"elements_out\": " << s.elements_out
+        << ", \"selectivity\": "  << s.selectivity ()
+        << ", \"stops\": "        << s.stops
+        << ", \"run_ns\": "       << s.run_ns
+        ;
+      if (s.sampled_elements > 0)
+      {
+        stream << ", \"downstream_ns\": " << s.downstream_ns ();
+      }
+      stream << ", \"stage\": " << s.stage << '}';
+    }
+    stream << "\n]\n";
+  }
+
+  // Writes the statistics of all stages as CSV with a header, downstream_ns
+  //  is empty when not sampled
+  template<typename TChar, typename TTraits>
+  void write_instrumentation_csv (std::basic_ostream<TChar, TTraits> & stream)
+  {
+    stream << "name,runs,elements_in,elements_out,selectivity,stops,run_ns,downstream_ns,stage\n";
+
+    for (auto && s : instrumentation_snapshot ())
+    {
+      detail::write_instrument_csv_text (stream, s.name);
+      stream
+        << ',' << s.runs
+        << ',' << s.elements_in
+        << ',' << s.elements_out
+        << ',' << s.selectivity ()
+        << ',' << s.stops
+        << ',' << s.run_ns
+        << ','
+        ;
+      if (s.sampled_elements > 0)
+      {
+        stream << s.downstream_ns ();
+      }
+      stream << ',' << s.stage << '\n';
+    }
+  }
+
+  // --------------------------------------------------------------------------
+
+}
+// ----------------------------------------------------------------------------
+#endif // CPP_STREAMS_INSTRUMENT__INCLUDE_GUARD
+// ----------------------------------------------------------------------------
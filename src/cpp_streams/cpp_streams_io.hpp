@@ -0,0 +1,2220 @@
+// ----------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef CPP_STREAMS_IO__INCLUDE_GUARD
+# define CPP_STREAMS_IO__INCLUDE_GUARD
+// ----------------------------------------------------------------------------
+# include "cpp_streams.hpp"
+// ----------------------------------------------------------------------------
+# if defined(__AVX2__)
+#   define CPP_STREAMS__AVX2 1
+# else
+#   define CPP_STREAMS__AVX2 0
+# endif
+# if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#   define CPP_STREAMS__SSE2 1
+# else
+#   define CPP_STREAMS__SSE2 0
+# endif
+// ----------------------------------------------------------------------------
+# include <cerrno>
+# include <cmath>
+# include <cstdint>
+# include <cstdio>
+# include <cstdlib>
+# include <cstring>
+# include <iosfwd>
+# include <limits>
+# include <memory>
+# include <stdexcept>
+# include <string>
+# include <system_error>
+# include <tuple>
+# include <utility>
+# include <vector>
+# if defined(__linux__) && defined(__has_include)
+#   if __has_include(<linux/io_uring.h>)
+#     define CPP_STREAMS__IO_URING 1
+#   endif
+# endif
+# ifndef CPP_STREAMS__IO_URING
+#   define CPP_STREAMS__IO_URING 0
+# endif
+// ----------------------------------------------------------------------------
+# include <atomic>
+# include <condition_variable>
+# include <exception>
+# include <mutex>
+# include <thread>
+# ifdef _MSC_VER
+#   include <fcntl.h>
+#   include <intrin.h>
+#   include <io.h>
+#   include <sys/stat.h>
+# else
+#   include <fcntl.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+# endif
+# if CPP_STREAMS__IO_URING
+#   include <linux/io_uring.h>
+#   include <sys/mman.h>
+#   include <sys/syscall.h>
+# endif
+# if CPP_STREAMS__AVX2
+#   include <immintrin.h>
+# elif CPP_STREAMS__SSE2
+#   include <emmintrin.h>
+# endif
+// ----------------------------------------------------------------------------
+// I/O sources and sinks
+//  These live in a separate header as they depend on the platform file API
+//  Text is pushed as text_view which refers into an internal read buffer
+//    A text_view is only valid until the sink it was pushed to returns
+//    Use map ([] (text_view v) { return v.to_string (); }) to keep values
+// ----------------------------------------------------------------------------
+
+namespace cpp_streams
+{
+
+  // --------------------------------------------------------------------------
+
+  // A non-owning view of a sequence of chars
+  struct text_view
+  {
+    using value_type      = char          ;
+    using const_iterator  = char const *  ;
+
+    CPP_STREAMS__BODY (text_view);
+
+    CPP_STREAMS__PRELUDE text_view () noexcept
+      : first   (nullptr)
+      , length  (0)
+    {
+    }
+
+    CPP_STREAMS__PRELUDE text_view (char const * first, std::size_t length) noexcept
+      : first   (first)
+      , length  (length)
+    {
+    }
+
+    text_view (char const * zero_terminated) noexcept
+      : first   (zero_terminated)
+      , length  (std::strlen (zero_terminated))
+    {
+    }
+
+    text_view (std::string const & s) noexcept
+      : first   (s.data ())
+      , length  (s.size ())
+    {
+    }
+
+    CPP_STREAMS__PRELUDE char const * data () const noexcept
+    {
+      return first;
+    }
+
+    CPP_STREAMS__PRELUDE std::size_t size () const noexcept
+    {
+      return length;
+    }
+
+    CPP_STREAMS__PRELUDE bool empty () const noexcept
+    {
+      return length == 0;
+    }
+
+    CPP_STREAMS__PRELUDE char const * begin () const noexcept
+    {
+      return first;
+    }
+
+    CPP_STREAMS__PRELUDE char const * end () const noexcept
+    {
+      return first + length;
+    }
+
+    CPP_STREAMS__PRELUDE char operator [] (std::size_t idx) const noexcept
+    {
+      return first[idx];
+    }
+
+    std::string to_string () const
+    {
+      return std::string (first, length);
+    }
+
+    bool operator == (text_view const & o) const noexcept
+    {
+      return length == o.length && (length == 0 || std::memcmp (first, o.first, length) == 0);
+    }
+
+    bool operator != (text_view const & o) const noexcept
+    {
+      return !(*this == o);
+    }
+
+    bool operator < (text_view const & o) const noexcept
+    {
+      auto const common = length < o.length ? length : o.length;
+      auto const result = common == 0 ? 0 : std::memcmp (first, o.first, common);
+      return result < 0 || (result == 0 && length < o.length);
+    }
+
+  private:
+    char const *  first ;
+    std::size_t   length;
+  };
+
+  template<typename TChar, typename TTraits>
+  std::basic_ostream<TChar, TTraits> & operator << (std::basic_ostream<TChar, TTraits> & s, text_view const & v)
+  {
+    return s.write (v.data (), static_cast<std::streamsize> (v.size ()));
+  }
+
+  // --------------------------------------------------------------------------
+
+  namespace detail
+  {
+
+    // ------------------------------------------------------------------------
+
+    constexpr std::size_t default_read_buffer_size  = 1U << 20;
+    constexpr std::size_t default_write_buffer_size = 1U << 20;
+    constexpr std::size_t buffer_alignment          = 64U     ;
+    constexpr std::size_t direct_io_alignment       = 4096U   ;
+
+    // ------------------------------------------------------------------------
+
+    inline int count_trailing_zeros (std::uint32_t mask) noexcept
+    {
+#ifdef _MSC_VER
+      unsigned long result;
+      _BitScanForward (&result, mask);
+      return static_cast<int> (result);
+#else
+      return __builtin_ctz (mask);
+#endif
+    }
+
+    // Calls visitor with a pointer to each char in [begin, end) that equals
+    //  n0, n1 or n2, in order. The comparisons are done a SIMD block at a
+    //  time and the matches of a block are visited from its bitmask so that
+    //  short records don't pay a function call + setup per match like
+    //  repeated std::memchr would
+    // Returns false if visitor returned false
+    template<typename TVisitor>
+    bool scan_bytes (char const * begin, char const * end, char n0, char n1, char n2, TVisitor && visitor)
+    {
+      auto iter = begin;
+
+#if CPP_STREAMS__AVX2
+      {
+        auto const v0 = _mm256_set1_epi8 (n0);
+        auto const v1 = _mm256_set1_epi8 (n1);
+        auto const v2 = _mm256_set1_epi8 (n2);
+
+        for (; end - iter >= 32; iter += 32)
+        {
+          auto const block  = _mm256_loadu_si256 (reinterpret_cast<__m256i const *> (iter));
+          auto const eq     = _mm256_or_si256 (
+              _mm256_or_si256 (_mm256_cmpeq_epi8 (block, v0), _mm256_cmpeq_epi8 (block, v1))
+            , _mm256_cmpeq_epi8 (block, v2)
+            );
+          auto mask         = static_cast<std::uint32_t> (_mm256_movemask_epi8 (eq));
+
+          for (; mask != 0; mask &= mask - 1)
+          {
+            if (!visitor (iter + count_trailing_zeros (mask)))
+            {
+              return false;
+            }
+          }
+        }
+      }
+#endif
+
+#if CPP_STREAMS__SSE2
+      {
+        auto const v0 = _mm_set1_epi8 (n0);
+        auto const v1 = _mm_set1_epi8 (n1);
+        auto const v2 = _mm_set1_epi8 (n2);
+
+        for (; end - iter >= 16; iter += 16)
+        {
+          auto const block  = _mm_loadu_si128 (reinterpret_cast<__m128i const *> (iter));
+          auto const eq     = _mm_or_si128 (
+              _mm_or_si128 (_mm_cmpeq_epi8 (block, v0), _mm_cmpeq_epi8 (block, v1))
+            , _mm_cmpeq_epi8 (block, v2)
+            );
+          auto mask         = static_cast<std::uint32_t> (_mm_movemask_epi8 (eq));
+
+          for (; mask != 0; mask &= mask - 1)
+          {
+            if (!visitor (iter + count_trailing_zeros (mask)))
+            {
+              return false;
+            }
+          }
+        }
+      }
+#else
+      if (n0 == n1 && n0 == n2)
+      {
+        // The C library memchr is vectorized on most platforms
+        while (iter != end)
+        {
+          auto found = static_cast<char const *> (std::memchr (iter, n0, static_cast<std::size_t> (end - iter)));
+          if (!found)
+          {
+            return true;
+          }
+          if (!visitor (found))
+          {
+            return false;
+          }
+          iter = found + 1;
+        }
+        return true;
+      }
+#endif
+
+      for (; iter != end; ++iter)
+      {
+        auto const c = *iter;
+        if ((c == n0 || c == n1 || c == n2) && !visitor (iter))
+        {
+          return false;
+        }
+      }
+
+      return true;
+    }
+
+    // ------------------------------------------------------------------------
+
+    // A heap buffer aligned to buffer_alignment that keeps its content when grown
+    struct aligned_buffer
+    {
+      explicit aligned_buffer (std::size_t size, std::size_t alignment = buffer_alignment)
+        : alignment (alignment)
+      {
+        resize (size);
+      }
+
+      aligned_buffer (aligned_buffer const &)             = delete;
+      aligned_buffer & operator= (aligned_buffer const &) = delete;
+
+      char * data () const noexcept
+      {
+        return aligned;
+      }
+
+      std::size_t size () const noexcept
+      {
+        return capacity;
+      }
+
+      // Grows the buffer to at least size bytes, the first keep bytes are preserved
+      void grow (std::size_t size, std::size_t keep)
+      {
+        if (size <= capacity)
+        {
+          return;
+        }
+
+        auto previous = std::move (storage);
+        auto from     = aligned;
+
+        resize (size);
+
+        if (keep > 0)
+        {
+          std::memcpy (aligned, from, keep);
+        }
+      }
+
+    private:
+      void resize (std::size_t size)
+      {
+        storage   .reset (new char[size + alignment]);
+        auto raw  = reinterpret_cast<std::uintptr_t> (storage.get ());
+        aligned   = reinterpret_cast<char *> ((raw + alignment - 1) & ~(static_cast<std::uintptr_t> (alignment) - 1));
+        capacity  = size;
+      }
+
+      std::size_t             alignment ;
+      std::unique_ptr<char[]> storage   ;
+      char *                  aligned   = nullptr;
+      std::size_t             capacity  = 0;
+    };
+
+    // ------------------------------------------------------------------------
+
+    // Identifies a file either by path or by an already open file descriptor
+    struct file_spec
+    {
+      std::string path;
+      int         fd    = -1;
+    };
+
+    inline file_spec make_file_spec (std::string path)
+    {
+      file_spec result;
+      result.path = std::move (path);
+      return result;
+    }
+
+    inline file_spec make_file_spec (int fd)
+    {
+      file_spec result;
+      result.fd = fd;
+      return result;
+    }
+
+    [[noreturn]] inline void throw_io_error (char const * what)
+    {
+      throw std::system_error (errno, std::generic_category (), what);
+    }
+
+    // Streams don't set errno, the error is reported as a generic I/O error
+    [[noreturn]] inline void throw_stream_error (char const * what)
+    {
+      throw std::system_error (std::make_error_code (std::errc::io_error), what);
+    }
+
+    // Opens (and closes) the file of a file_spec, a file_spec holding a
+    //  file descriptor is not closed as it's owned by the caller
+    struct input_file
+    {
+      explicit input_file (file_spec const & spec)
+        : fd    (spec.fd)
+        , owned (spec.fd < 0)
+      {
+        if (owned)
+        {
+#ifdef _MSC_VER
+          fd = _open (spec.path.c_str (), _O_RDONLY | _O_BINARY | _O_SEQUENTIAL);
+#else
+          fd = ::open (spec.path.c_str (), O_RDONLY | O_CLOEXEC);
+#endif
+          if (fd < 0)
+          {
+            throw_io_error ("cpp_streams: failed to open file for reading");
+          }
+#if defined(POSIX_FADV_SEQUENTIAL) && !defined(_MSC_VER)
+          ::posix_fadvise (fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+        }
+      }
+
+      input_file (input_file const &)             = delete;
+      input_file & operator= (input_file const &) = delete;
+
+      ~input_file () noexcept
+      {
+        if (owned)
+        {
+#ifdef _MSC_VER
+          _close (fd);
+#else
+          ::close (fd);
+#endif
+        }
+      }
+
+      // Returns the number of bytes read, 0 on end of file
+      std::size_t read (char * buffer, std::size_t size)
+      {
+        for (;;)
+        {
+#ifdef _MSC_VER
+          auto const result = _read (fd, buffer, static_cast<unsigned int> (size < 0x40000000U ? size : 0x40000000U));
+#else
+          auto const result = ::read (fd, buffer, size);
+#endif
+          if (result >= 0)
+          {
+            return static_cast<std::size_t> (result);
+          }
+          else if (errno != EINTR)
+          {
+            throw_io_error ("cpp_streams: failed to read file");
+          }
+        }
+      }
+
+      // Reads exactly size bytes at offset, throws if the file is shorter
+      void read_at (char * buffer, std::size_t size, std::uint64_t offset)
+      {
+#ifdef _MSC_VER
+        if (_lseeki64 (fd, static_cast<__int64> (offset), SEEK_SET) < 0)
+        {
+          throw_io_error ("cpp_streams: failed to seek file");
+        }
+#endif
+        while (size > 0)
+        {
+#ifdef _MSC_VER
+          auto const result = _read (fd, buffer, static_cast<unsigned int> (size < 0x40000000U ? size : 0x40000000U));
+#else
+          auto const result = ::pread (fd, buffer, size, static_cast<off_t> (offset));
+#endif
+          if (result > 0)
+          {
+            buffer  += result;
+            size    -= static_cast<std::size_t> (result);
+            offset  += static_cast<std::uint64_t> (result);
+          }
+          else if (result == 0)
+          {
+            errno = EIO;
+            throw_io_error ("cpp_streams: unexpected end of file");
+          }
+          else if (errno != EINTR)
+          {
+            throw_io_error ("cpp_streams: failed to read file");
+          }
+        }
+      }
+
+      std::uint64_t size () const
+      {
+#ifdef _MSC_VER
+        struct _stat64 status;
+        auto const result = _fstat64 (fd, &status);
+#else
+        struct stat status;
+        auto const result = ::fstat (fd, &status);
+#endif
+        if (result != 0)
+        {
+          throw_io_error ("cpp_streams: failed to get file size");
+        }
+        return static_cast<std::uint64_t> (status.st_size);
+      }
+
+      int   fd    ;
+      bool  owned ;
+    };
+
+    // Reads the file in large blocks and hands the buffered bytes to process
+    //  process (begin, end, eof, consumed) returns false to stop reading and
+    //  sets consumed to the number of bytes it's done with. Unconsumed bytes
+    //  (a partial record) are moved to the front of the buffer and handed
+    //  over again with the next block. The buffer is grown when a single
+    //  record doesn't fit. On eof process must consume everything
+    template<typename TProcess>
+    void read_blocks (file_spec const & spec, std::size_t buffer_size, TProcess && process)
+    {
+      input_file      file    (spec);
+      aligned_buffer  buffer  (buffer_size > 0 ? buffer_size : default_read_buffer_size);
+
+      std::size_t filled  = 0;
+      auto        eof     = false;
+
+      while (!eof)
+      {
+        if (filled == buffer.size ())
+        {
+          buffer.grow (buffer.size () * 2, filled);
+        }
+
+        auto const read = file.read (buffer.data () + filled, buffer.size () - filled);
+        eof             = read == 0;
+        filled          += read;
+
+        std::size_t consumed = 0;
+        if (!process (static_cast<char const *> (buffer.data ()), buffer.data () + filled, eof, consumed))
+        {
+          return;
+        }
+
+        filled -= consumed;
+        if (filled > 0 && consumed > 0)
+        {
+          std::memmove (buffer.data (), buffer.data () + consumed, filled);
+        }
+      }
+    }
+
+    // ------------------------------------------------------------------------
+
+    // Reads blocks on a separate thread keeping up to queue_depth blocks
+    //  ahead of the consumer. process (begin, end) returns false to stop
+    template<typename TProcess>
+    void read_ahead_blocks (file_spec const & spec, std::size_t block_size, std::size_t queue_depth, TProcess && process)
+    {
+      struct slot
+      {
+        explicit slot (std::size_t block_size)
+          : buffer  (block_size)
+          , size    (0)
+        {
+        }
+
+        aligned_buffer  buffer;
+        std::size_t     size  ;
+      };
+
+      input_file file (spec);
+
+      std::vector<std::unique_ptr<slot>> slots;
+      for (auto iter = 0U; iter < queue_depth; ++iter)
+      {
+        slots.push_back (std::make_unique<slot> (block_size));
+      }
+
+      std::mutex              lock      ;
+      std::condition_variable changed   ;
+      std::size_t             produced  = 0     ;
+      std::size_t             consumed  = 0     ;
+      auto                    done      = false ;
+      auto                    stop      = false ;
+      std::exception_ptr      error     ;
+
+      std::thread reader ([&] ()
+      {
+        try
+        {
+          for (auto block = 0U;; ++block)
+          {
+            {
+              std::unique_lock<std::mutex> guard (lock);
+              changed.wait (guard, [&] { return stop || produced - consumed < queue_depth; });
+              if (stop)
+              {
+                return;
+              }
+            }
+
+            // Only the reader touches a slot between consumption and production
+            auto & s = *slots[block % queue_depth];
+            s.size = 0;
+            {
+              trace_scope scope ("from_file_blocks.read");
+
+              for (std::size_t read = 1; read > 0 && s.size < block_size;)
+              {
+                read    = file.read (s.buffer.data () + s.size, block_size - s.size);
+                s.size  += read;
+              }
+            }
+
+            std::lock_guard<std::mutex> guard (lock);
+            if (s.size == 0)
+            {
+              done = true;
+              changed.notify_all ();
+              return;
+            }
+            ++produced;
+            changed.notify_all ();
+          }
+        }
+        catch (...)
+        {
+          std::lock_guard<std::mutex> guard (lock);
+          error = std::current_exception ();
+          done  = true;
+          changed.notify_all ();
+        }
+      });
+
+      auto finish = [&] ()
+      {
+        {
+          std::lock_guard<std::mutex> guard (lock);
+          stop = true;
+          changed.notify_all ();
+        }
+        reader.join ();
+      };
+
+      try
+      {
+        for (;;)
+        {
+          {
+            trace_scope scope ("from_file_blocks.wait");
+
+            std::unique_lock<std::mutex> guard (lock);
+            changed.wait (guard, [&] { return done || produced > consumed; });
+            if (produced == consumed)
+            {
+              break;
+            }
+          }
+
+          auto & s = *slots[consumed % queue_depth];
+          if (!process (static_cast<char const *> (s.buffer.data ()), s.buffer.data () + s.size))
+          {
+            break;
+          }
+
+          std::lock_guard<std::mutex> guard (lock);
+          ++consumed;
+          changed.notify_all ();
+        }
+      }
+      catch (...)
+      {
+        finish ();
+        throw;
+      }
+
+      finish ();
+
+      if (error)
+      {
+        std::rethrow_exception (error);
+      }
+    }
+
+    // ------------------------------------------------------------------------
+
+#if CPP_STREAMS__IO_URING
+    // A minimal io_uring submission/completion queue pair using the raw
+    //  system calls so that liburing isn't required
+    class io_uring_queue
+    {
+    public:
+      explicit io_uring_queue (unsigned entries) noexcept
+      {
+        io_uring_params params;
+        std::memset (&params, 0, sizeof (params));
+
+        fd = static_cast<int> (::syscall (__NR_io_uring_setup, entries, &params));
+        if (fd < 0)
+        {
+          return;
+        }
+
+        sq_ring_size  = params.sq_off.array + params.sq_entries * sizeof (unsigned);
+        cq_ring_size  = params.cq_off.cqes + params.cq_entries * sizeof (io_uring_cqe);
+        single_mmap   = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+
+        if (single_mmap)
+        {
+          sq_ring_size = cq_ring_size = sq_ring_size > cq_ring_size ? sq_ring_size : cq_ring_size;
+        }
+
+        sq_ring = ::mmap (nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        cq_ring = single_mmap
+          ? sq_ring
+          : ::mmap (nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING)
+          ;
+        sqes_size = params.sq_entries * sizeof (io_uring_sqe);
+        sqes      = ::mmap (nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+
+        if (sq_ring == MAP_FAILED || cq_ring == MAP_FAILED || sqes == MAP_FAILED)
+        {
+          release ();
+          return;
+        }
+
+        auto const sq = static_cast<char *> (sq_ring);
+        auto const cq = static_cast<char *> (cq_ring);
+
+        sq_tail   = reinterpret_cast<unsigned *> (sq + params.sq_off.tail);
+        sq_mask   = *reinterpret_cast<unsigned *> (sq + params.sq_off.ring_mask);
+        sq_array  = reinterpret_cast<unsigned *> (sq + params.sq_off.array);
+        cq_head   = reinterpret_cast<unsigned *> (cq + params.cq_off.head);
+        cq_tail   = reinterpret_cast<unsigned *> (cq + params.cq_off.tail);
+        cq_mask   = *reinterpret_cast<unsigned *> (cq + params.cq_off.ring_mask);
+        cqes      = reinterpret_cast<io_uring_cqe *> (cq + params.cq_off.cqes);
+      }
+
+      io_uring_queue (io_uring_queue const &)             = delete;
+      io_uring_queue & operator= (io_uring_queue const &) = delete;
+
+      ~io_uring_queue () noexcept
+      {
+        release ();
+      }
+
+      bool valid () const noexcept
+      {
+        return fd >= 0;
+      }
+
+      // Kernels before 5.6 set up the ring but fail IORING_OP_READ with
+      //  EINVAL, they also lack IORING_REGISTER_PROBE
+      bool supports (unsigned opcode) const noexcept
+      {
+        constexpr unsigned max_ops = IORING_OP_LAST;
+
+        alignas (io_uring_probe) char buffer[sizeof (io_uring_probe) + max_ops * sizeof (io_uring_probe_op)];
+        std::memset (buffer, 0, sizeof (buffer));
+
+        auto const probe  = reinterpret_cast<io_uring_probe *> (buffer);
+        auto const result = ::syscall (__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, max_ops);
+
+        return
+              result >= 0
+          &&  opcode <= probe->last_op
+          &&  opcode < max_ops
+          &&  (probe->ops[opcode].flags & IO_URING_OP_SUPPORTED) != 0
+          ;
+      }
+
+      // Queues a read, the caller never has more reads in flight than entries
+      void queue_read (int file, char * buffer, unsigned size, std::uint64_t offset, std::uint64_t user_data) noexcept
+      {
+        auto const tail = *sq_tail;
+        auto const idx  = tail & sq_mask;
+        auto & sqe      = static_cast<io_uring_sqe *> (sqes)[idx];
+
+        std::memset (&sqe, 0, sizeof (sqe));
+        sqe.opcode    = IORING_OP_READ;
+        sqe.fd        = file;
+        sqe.addr      = reinterpret_cast<std::uint64_t> (buffer);
+        sqe.len       = size;
+        sqe.off       = offset;
+        sqe.user_data = user_data;
+
+        sq_array[idx] = idx;
+        __atomic_store_n (sq_tail, tail + 1, __ATOMIC_RELEASE);
+        ++pending;
+      }
+
+      // Submits queued reads without waiting
+      void submit ()
+      {
+        if (pending > 0)
+        {
+          enter (0);
+        }
+      }
+
+      // Submits queued reads and waits for at least min_complete completions
+      void enter (unsigned min_complete)
+      {
+        for (;;)
+        {
+          auto const result = ::syscall (__NR_io_uring_enter, fd, pending, min_complete, min_complete > 0 ? IORING_ENTER_GETEVENTS : 0U, nullptr, 0);
+          if (result >= 0)
+          {
+            pending -= static_cast<unsigned> (result);
+            return;
+          }
+          else if (errno != EINTR)
+          {
+            throw_io_error ("cpp_streams: io_uring_enter failed");
+          }
+        }
+      }
+
+      // Calls completed (user_data, result) for each reaped completion
+      template<typename TCompleted>
+      void reap (TCompleted && completed)
+      {
+        auto head = *cq_head;
+        for (; head != __atomic_load_n (cq_tail, __ATOMIC_ACQUIRE); ++head)
+        {
+          auto const & cqe = cqes[head & cq_mask];
+          completed (cqe.user_data, cqe.res);
+        }
+        __atomic_store_n (cq_head, head, __ATOMIC_RELEASE);
+      }
+
+    private:
+      void release () noexcept
+      {
+        if (sqes != nullptr && sqes != MAP_FAILED)
+        {
+          ::munmap (sqes, sqes_size);
+        }
+        if (cq_ring != nullptr && cq_ring != MAP_FAILED && !single_mmap)
+        {
+          ::munmap (cq_ring, cq_ring_size);
+        }
+        if (sq_ring != nullptr && sq_ring != MAP_FAILED)
+        {
+          ::munmap (sq_ring, sq_ring_size);
+        }
+        if (fd >= 0)
+        {
+          ::close (fd);
+        }
+        fd = -1;
+      }
+
+      int             fd            = -1      ;
+      bool            single_mmap   = false   ;
+      void *          sq_ring       = nullptr ;
+      void *          cq_ring       = nullptr ;
+      void *          sqes          = nullptr ;
+      std::size_t     sq_ring_size  = 0       ;
+      std::size_t     cq_ring_size  = 0       ;
+      std::size_t     sqes_size     = 0       ;
+      unsigned *      sq_tail       = nullptr ;
+      unsigned        sq_mask       = 0       ;
+      unsigned *      sq_array      = nullptr ;
+      unsigned *      cq_head       = nullptr ;
+      unsigned *      cq_tail       = nullptr ;
+      unsigned        cq_mask       = 0       ;
+      io_uring_cqe *  cqes          = nullptr ;
+      unsigned        pending       = 0       ;
+    };
+
+    // Reads a regular file with up to queue_depth reads in flight, blocks are
+    //  handed to process in file order. Returns false if io_uring or its read
+    //  operation is unavailable (old kernel, seccomp) or the file isn't a
+    //  regular file
+    template<typename TProcess>
+    bool io_uring_read_blocks (file_spec const & spec, std::size_t block_size, std::size_t queue_depth, TProcess && process)
+    {
+      input_file file (spec);
+
+      struct stat status;
+      if (::fstat (file.fd, &status) != 0 || !S_ISREG (status.st_mode))
+      {
+        return false;
+      }
+
+      auto const start = spec.fd < 0 ? 0 : ::lseek (file.fd, 0, SEEK_CUR);
+      if (start < 0 || status.st_size <= start)
+      {
+        return start >= 0;
+      }
+
+      io_uring_queue queue (static_cast<unsigned> (queue_depth));
+      if (!queue.valid () || !queue.supports (IORING_OP_READ))
+      {
+        return false;
+      }
+
+      struct slot
+      {
+        explicit slot (std::size_t block_size)
+          : buffer  (block_size, direct_io_alignment)
+        {
+        }
+
+        aligned_buffer  buffer              ;
+        std::uint64_t   offset    = 0       ;
+        std::size_t     size      = 0       ;
+        std::size_t     read      = 0       ;
+        bool            in_flight = false   ;
+      };
+
+      auto const end    = static_cast<std::uint64_t> (status.st_size);
+      auto const blocks = (end - static_cast<std::uint64_t> (start) + block_size - 1) / block_size;
+
+      std::vector<std::unique_ptr<slot>> slots;
+      for (auto iter = 0U; iter < queue_depth; ++iter)
+      {
+        slots.push_back (std::make_unique<slot> (block_size));
+      }
+
+      std::uint64_t next_read = 0;
+      std::uint64_t next_push = 0;
+      unsigned      in_flight = 0;
+      auto          failure   = 0;
+
+      auto queue_remaining = [&] (std::size_t idx)
+      {
+        auto & s = *slots[idx];
+        queue.queue_read (
+            file.fd
+          , s.buffer.data () + s.read
+          , static_cast<unsigned> (s.size - s.read)
+          , s.offset + s.read
+          , idx
+          );
+        s.in_flight = true;
+        ++in_flight;
+      };
+
+      auto queue_next = [&] ()
+      {
+        for (; next_read < blocks && next_read < next_push + queue_depth; ++next_read)
+        {
+          auto const idx    = static_cast<std::size_t> (next_read % queue_depth);
+          auto & s          = *slots[idx];
+          s.offset          = static_cast<std::uint64_t> (start) + next_read * block_size;
+          s.size            = static_cast<std::size_t> (end - s.offset < block_size ? end - s.offset : block_size);
+          s.read            = 0;
+          queue_remaining (idx);
+        }
+      };
+
+      auto reap = [&] ()
+      {
+        queue.reap ([&] (std::uint64_t user_data, int result)
+        {
+          auto & s    = *slots[static_cast<std::size_t> (user_data)];
+          s.in_flight = false;
+          --in_flight;
+
+          if (result == -EINTR || result == -EAGAIN)
+          {
+            queue_remaining (static_cast<std::size_t> (user_data));
+          }
+          else if (result < 0)
+          {
+            failure = -result;
+          }
+          else if (result == 0)
+          {
+            // The file was truncated while read
+            s.size = s.read;
+          }
+          else if ((s.read += static_cast<std::size_t> (result)) < s.size)
+          {
+            queue_remaining (static_cast<std::size_t> (user_data));
+          }
+        });
+      };
+
+      // In flight reads must complete before their buffers are released
+      auto drain = [&] ()
+      {
+        while (in_flight > 0)
+        {
+          queue.enter (1);
+          queue.reap ([&] (std::uint64_t, int) { --in_flight; });
+        }
+      };
+
+      try
+      {
+        queue_next ();
+        queue.submit ();
+
+        while (next_push < blocks && failure == 0)
+        {
+          auto & s = *slots[static_cast<std::size_t> (next_push % queue_depth)];
+
+          if (s.in_flight)
+          {
+            trace_scope scope ("from_file_blocks.wait");
+
+            queue.enter (1);
+            reap ();
+            continue;
+          }
+
+          if (s.size > 0 && !process (static_cast<char const *> (s.buffer.data ()), s.buffer.data () + s.size))
+          {
+            break;
+          }
+
+          ++next_push;
+
+          // Refills start as soon as a slot is freed, not when the consumer
+          //  next waits
+          queue_next ();
+          queue.submit ();
+        }
+      }
+      catch (...)
+      {
+        drain ();
+        throw;
+      }
+
+      drain ();
+
+      if (failure != 0)
+      {
+        errno = failure;
+        throw_io_error ("cpp_streams: io_uring read failed");
+      }
+
+      return true;
+    }
+#endif
+
+    // ------------------------------------------------------------------------
+
+    // Creates (or truncates) a file for writing, direct is cleared if the
+    //  platform or file system doesn't support unbuffered (O_DIRECT) writes
+    struct output_file
+    {
+      output_file (std::string const & path, bool direct)
+        : direct (false)
+      {
+#ifdef _MSC_VER
+        (void)direct;
+        fd = _open (path.c_str (), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+        auto const flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+        fd = -1;
+# ifdef O_DIRECT
+        if (direct)
+        {
+          fd            = ::open (path.c_str (), flags | O_DIRECT, 0644);
+          this->direct  = fd >= 0;
+        }
+# endif
+        if (fd < 0)
+        {
+          fd = ::open (path.c_str (), flags, 0644);
+        }
+#endif
+        if (fd < 0)
+        {
+          throw_io_error ("cpp_streams: failed to open file for writing");
+        }
+      }
+
+      output_file (output_file const &)             = delete;
+      output_file & operator= (output_file const &) = delete;
+
+      ~output_file () noexcept
+      {
+#ifdef _MSC_VER
+        _close (fd);
+#else
+        ::close (fd);
+#endif
+      }
+
+      void write (char const * data, std::size_t size)
+      {
+        while (size > 0)
+        {
+#ifdef _MSC_VER
+          auto const result = _write (fd, data, static_cast<unsigned int> (size < 0x40000000U ? size : 0x40000000U));
+#else
+          auto const result = ::write (fd, data, size);
+#endif
+          if (result >= 0)
+          {
+            data += result;
+            size -= static_cast<std::size_t> (result);
+          }
+          else if (errno != EINTR)
+          {
+            throw_io_error ("cpp_streams: failed to write file");
+          }
+        }
+      }
+
+      // Unbuffered writes must be block sized, the tail is written buffered
+      void disable_direct ()
+      {
+#if !defined(_MSC_VER) && defined(O_DIRECT)
+        if (direct && ::fcntl (fd, F_SETFL, ::fcntl (fd, F_GETFL) & ~O_DIRECT) < 0)
+        {
+          throw_io_error ("cpp_streams: failed to disable O_DIRECT");
+        }
+#endif
+        direct = false;
+      }
+
+      void sync ()
+      {
+#if defined(_MSC_VER)
+        auto const result = _commit (fd);
+#elif defined(__linux__)
+        auto const result = ::fdatasync (fd);
+#else
+        auto const result = ::fsync (fd);
+#endif
+        if (result < 0)
+        {
+          throw_io_error ("cpp_streams: failed to sync file");
+        }
+      }
+
+      int   fd    ;
+      bool  direct;
+    };
+
+    // ------------------------------------------------------------------------
+
+    // A csv field with its surrounding quotes removed, escaped is true if the
+    //  text still contains doubled quotes
+    struct csv_field
+    {
+      text_view text    ;
+      char      quote   = '"'   ;
+      bool      escaped = false ;
+    };
+
+    inline csv_field make_csv_field (char const * begin, char const * end, char quote, bool quoted, std::size_t quotes)
+    {
+      csv_field result;
+      result.quote = quote;
+
+      if (quoted)
+      {
+        // The closing quote is the last quote, a field missing it runs to end
+        auto closing = end;
+        while (closing != begin + 1 && closing[-1] != quote)
+        {
+          --closing;
+        }
+        closing = closing == begin + 1 ? end : closing - 1;
+
+        result.text     = text_view (begin + 1, static_cast<std::size_t> (closing - begin - 1));
+        result.escaped  = quotes > 2;
+      }
+      else
+      {
+        result.text     = text_view (begin, static_cast<std::size_t> (end - begin));
+      }
+
+      return result;
+    }
+
+    [[noreturn]] inline void throw_invalid_field (char const * what, csv_field const & field)
+    {
+      throw std::invalid_argument (std::string (what) + ": '" + field.text.to_string () + "'");
+    }
+
+    template<typename T, typename TEnable = void>
+    struct field_parser;
+
+    // Integers are parsed without locale or allocation, empty fields are 0
+    template<typename T>
+    struct field_parser<T, std::enable_if_t<std::is_integral<T>::value>>
+    {
+      static T parse (csv_field const & field)
+      {
+        auto iter = field.text.begin ();
+        auto end  = field.text.end ();
+
+        if (iter == end)
+        {
+          return T ();
+        }
+
+        auto const negative = *iter == '-';
+        if (negative || *iter == '+')
+        {
+          ++iter;
+        }
+
+        if (iter == end)
+        {
+          throw_invalid_field ("cpp_streams: invalid integer in csv field", field);
+        }
+
+        constexpr auto max_value = std::numeric_limits<std::uint64_t>::max ();
+
+        std::uint64_t value = 0;
+        for (; iter != end; ++iter)
+        {
+          auto const digit = static_cast<std::uint64_t> (static_cast<unsigned char> (*iter)) - '0';
+          if (digit > 9)
+          {
+            throw_invalid_field ("cpp_streams: invalid integer in csv field", field);
+          }
+          if (value > (max_value - digit) / 10)
+          {
+            throw_invalid_field ("cpp_streams: integer out of range in csv field", field);
+          }
+          value = value * 10 + digit;
+        }
+
+        constexpr auto max_t = static_cast<std::uint64_t> (std::numeric_limits<T>::max ());
+
+        if (!negative)
+        {
+          if (value > max_t)
+          {
+            throw_invalid_field ("cpp_streams: integer out of range in csv field", field);
+          }
+          return static_cast<T> (value);
+        }
+        else if (value == 0)
+        {
+          return T ();
+        }
+        else if (!std::is_signed<T>::value || value > max_t + 1)
+        {
+          throw_invalid_field ("cpp_streams: integer out of range in csv field", field);
+        }
+        else
+        {
+          return static_cast<T> (-static_cast<std::int64_t> (value - 1) - 1);
+        }
+      }
+    };
+
+    // The limits of the fast path of field_parser for T: mantissas up to
+    //  max_mantissa and powers of 10 up to max_exponent are exact in T
+    template<typename T>
+    struct floating_limits;
+
+    template<>
+    struct floating_limits<float>
+    {
+      static constexpr std::uint64_t  max_mantissa = 1ULL << 24 ;
+      static constexpr int            max_exponent = 10         ;
+
+      static float parse (char const * text, char ** parsed_end) noexcept
+      {
+        return std::strtof (text, parsed_end);
+      }
+    };
+
+    template<>
+    struct floating_limits<double>
+    {
+      static constexpr std::uint64_t  max_mantissa = 1ULL << 53 ;
+      static constexpr int            max_exponent = 22         ;
+
+      static double parse (char const * text, char ** parsed_end) noexcept
+      {
+        return std::strtod (text, parsed_end);
+      }
+    };
+
+    // The limits of double are exact in long double too
+    template<>
+    struct floating_limits<long double>
+    {
+      static constexpr std::uint64_t  max_mantissa = 1ULL << 53 ;
+      static constexpr int            max_exponent = 22         ;
+
+      static long double parse (char const * text, char ** parsed_end) noexcept
+      {
+        return std::strtold (text, parsed_end);
+      }
+    };
+
+    // Decimal numbers with at most 19 significant digits whose mantissa and
+    //  power of 10 are exact in T (see floating_limits) are converted by a
+    //  single exactly rounded multiplication or division in T. Anything else
+    //  falls back on std::strtof, std::strtod or std::strtold (which use the
+    //  C locale decimal point)
+    template<typename T>
+    struct field_parser<T, std::enable_if_t<std::is_floating_point<T>::value>>
+    {
+      static T parse (csv_field const & field)
+      {
+        auto iter = field.text.begin ();
+        auto end  = field.text.end ();
+
+        if (iter == end)
+        {
+          return T ();
+        }
+
+        auto const negative = *iter == '-';
+        if (negative || *iter == '+')
+        {
+          ++iter;
+        }
+
+        std::uint64_t mantissa  = 0;
+        int           exponent  = 0;
+        int           digits    = 0;
+        auto          any       = false;
+
+        for (; iter != end && static_cast<unsigned> (*iter - '0') < 10; ++iter, any = true)
+        {
+          if (digits < 19)
+          {
+            mantissa = mantissa * 10 + static_cast<unsigned> (*iter - '0');
+            digits  += mantissa != 0;
+          }
+          else
+          {
+            ++exponent;
+            ++digits;
+          }
+        }
+
+        if (iter != end && *iter == '.')
+        {
+          for (++iter; iter != end && static_cast<unsigned> (*iter - '0') < 10; ++iter, any = true)
+          {
+            if (digits < 19)
+            {
+              mantissa = mantissa * 10 + static_cast<unsigned> (*iter - '0');
+              digits  += mantissa != 0;
+              --exponent;
+            }
+            else
+            {
+              ++digits;
+            }
+          }
+        }
+
+        if (any && iter != end && (*iter == 'e' || *iter == 'E'))
+        {
+          ++iter;
+          auto const negative_exponent = iter != end && *iter == '-';
+          if (iter != end && (*iter == '-' || *iter == '+'))
+          {
+            ++iter;
+          }
+          auto e = 0;
+          auto any_exponent = false;
+          for (; iter != end && static_cast<unsigned> (*iter - '0') < 10; ++iter, any_exponent = true)
+          {
+            e = e < 10000 ? e * 10 + (*iter - '0') : e;
+          }
+          any       = any_exponent;
+          exponent  += negative_exponent ? -e : e;
+        }
+
+        using limits = floating_limits<T>;
+
+        if (any && iter == end && digits <= 19 && mantissa <= limits::max_mantissa && exponent >= -limits::max_exponent && exponent <= limits::max_exponent)
+        {
+          static constexpr T powers_of_10[] =
+          {
+            1e0 , 1e1 , 1e2 , 1e3 , 1e4 , 1e5 , 1e6 , 1e7 , 1e8 , 1e9 , 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+          };
+
+          auto result = static_cast<T> (mantissa);
+          result = exponent < 0 ? result / powers_of_10[-exponent] : result * powers_of_10[exponent];
+          return negative ? -result : result;
+        }
+
+        return parse_slow (field);
+      }
+
+    private:
+      static T parse_slow (csv_field const & field)
+      {
+        char local[64];
+
+        auto const size = field.text.size ();
+        std::string heap;
+        char const * zero_terminated = local;
+
+        if (size < sizeof (local))
+        {
+          std::memcpy (local, field.text.data (), size);
+          local[size] = 0;
+        }
+        else
+        {
+          heap = field.text.to_string ();
+          zero_terminated = heap.c_str ();
+        }
+
+        char * parsed_end = nullptr;
+        auto const result = floating_limits<T>::parse (zero_terminated, &parsed_end);
+
+        if (parsed_end != zero_terminated + size)
+        {
+          throw_invalid_field ("cpp_streams: invalid number in csv field", field);
+        }
+
+        return result;
+      }
+    };
+
+    template<>
+    struct field_parser<std::string>
+    {
+      static std::string parse (csv_field const & field)
+      {
+        if (!field.escaped)
+        {
+          return field.text.to_string ();
+        }
+
+        std::string result;
+        result.reserve (field.text.size ());
+
+        for (auto iter = field.text.begin (), end = field.text.end (); iter != end; ++iter)
+        {
+          result.push_back (*iter);
+          if (*iter == field.quote && iter + 1 != end && iter[1] == field.quote)
+          {
+            ++iter;
+          }
+        }
+
+        return result;
+      }
+    };
+
+    // text_view fields refer into the read buffer, doubled quotes are kept
+    template<>
+    struct field_parser<text_view>
+    {
+      static text_view parse (csv_field const & field) noexcept
+      {
+        return field.text;
+      }
+    };
+
+    template<typename TRecord, typename... TColumns, std::size_t... Indices>
+    TRecord make_csv_record (csv_field const * fields, std::index_sequence<Indices...>)
+    {
+      return TRecord {field_parser<TColumns>::parse (fields[Indices])...};
+    }
+
+    // ------------------------------------------------------------------------
+
+    // How the sources scan their read buffer, see scan_bytes
+#if CPP_STREAMS__AVX2
+    constexpr char const * scan_strategy = "blocked reads, AVX2 scan";
+#elif CPP_STREAMS__SSE2
+    constexpr char const * scan_strategy = "blocked reads, SSE2 scan";
+#else
+    constexpr char const * scan_strategy = "blocked reads, byte scan";
+#endif
+
+#if CPP_STREAMS__IO_URING
+    constexpr char const * async_read_strategy = "io_uring reads (read-ahead thread fallback)";
+#else
+    constexpr char const * async_read_strategy = "read-ahead thread";
+#endif
+
+    struct from_lines_step
+    {
+      static constexpr step_description describe () noexcept
+      {
+        return step_description
+        {
+          "from_lines", false, false, size_effect::unknown, scan_strategy
+        };
+      }
+    };
+
+    struct from_csv_step
+    {
+      static constexpr step_description describe () noexcept
+      {
+        return step_description
+        {
+          "from_csv", false, false, size_effect::unknown, scan_strategy
+        };
+      }
+    };
+
+    struct from_file_blocks_step
+    {
+      static constexpr step_description describe () noexcept
+      {
+        return step_description
+        {
+          "from_file_blocks", false, false, size_effect::unknown, async_read_strategy
+        };
+      }
+    };
+
+    // ------------------------------------------------------------------------
+
+  }
+
+  // --------------------------------------------------------------------------
+
+  // A growable output buffer with locale independent formatting. The file
+  //  sinks pass it to serializers which append using operator <<, write and
+  //  write_bytes. Integers are formatted with a digit pair table. Floating
+  //  points that are exactly recovered from an integer scaled by 10^-k
+  //  (k <= digits10) are formatted in fixed notation with the fewest
+  //  decimals, others with the fewest of digits10 or max_digits10 digits
+  //  that reads back as the same value (using snprintf and the C locale)
+  class output_buffer
+  {
+  public:
+    explicit output_buffer (std::size_t capacity, std::size_t alignment = detail::buffer_alignment)
+      : buffer  (capacity > 64 ? capacity : 64, alignment)
+      , used    (0)
+    {
+    }
+
+    output_buffer (output_buffer const &)             = delete;
+    output_buffer & operator= (output_buffer const &) = delete;
+
+    char const * data () const noexcept
+    {
+      return buffer.data ();
+    }
+
+    std::size_t size () const noexcept
+    {
+      return used;
+    }
+
+    // Drops the first count bytes, the rest is moved to the front
+    void consume (std::size_t count) noexcept
+    {
+      used -= count;
+      if (used > 0)
+      {
+        std::memmove (buffer.data (), buffer.data () + count, used);
+      }
+    }
+
+    // Returns space for at least count bytes, use commit to keep them
+    char * reserve (std::size_t count)
+    {
+      if (used + count > buffer.size ())
+      {
+        auto const doubled = buffer.size () * 2;
+        buffer.grow (used + count > doubled ? used + count : doubled, used);
+      }
+      return buffer.data () + used;
+    }
+
+    void commit (std::size_t count) noexcept
+    {
+      used += count;
+    }
+
+    output_buffer & put (char c)
+    {
+      *reserve (1) = c;
+      commit (1);
+      return *this;
+    }
+
+    output_buffer & write (char const * data, std::size_t size)
+    {
+      if (size > 0)
+      {
+        std::memcpy (reserve (size), data, size);
+        commit (size);
+      }
+      return *this;
+    }
+
+    template<typename T>
+    output_buffer & write_bytes (T const & v)
+    {
+      static_assert (std::is_trivially_copyable<T>::value, "write_bytes requires a trivially copyable type");
+      return write (reinterpret_cast<char const *> (&v), sizeof (v));
+    }
+
+    output_buffer & operator << (char c)
+    {
+      return put (c);
+    }
+
+    output_buffer & operator << (bool v)
+    {
+      return put (v ? '1' : '0');
+    }
+
+    output_buffer & operator << (char const * v)
+    {
+      return write (v, std::strlen (v));
+    }
+
+    output_buffer & operator << (std::string const & v)
+    {
+      return write (v.data (), v.size ());
+    }
+
+    output_buffer & operator << (text_view v)
+    {
+      return write (v.data (), v.size ());
+    }
+
+    template<typename T>
+    std::enable_if_t<std::is_integral<T>::value, output_buffer &> operator << (T v)
+    {
+      constexpr char const pairs[] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899"
+        ;
+
+      auto const negative = is_negative (v, std::is_signed<T> ());
+      auto value          = negative
+        ? 0ULL - static_cast<unsigned long long> (static_cast<long long> (v))
+        : static_cast<unsigned long long> (v)
+        ;
+
+      char digits[24];
+      auto const end  = digits + sizeof (digits);
+      auto iter       = end;
+
+      while (value >= 100)
+      {
+        auto const idx = static_cast<std::size_t> (value % 100) * 2;
+        value /= 100;
+        iter -= 2;
+        iter[0] = pairs[idx];
+        iter[1] = pairs[idx + 1];
+      }
+
+      if (value >= 10)
+      {
+        auto const idx = static_cast<std::size_t> (value) * 2;
+        iter -= 2;
+        iter[0] = pairs[idx];
+        iter[1] = pairs[idx + 1];
+      }
+      else
+      {
+        *--iter = static_cast<char> ('0' + value);
+      }
+
+      if (negative)
+      {
+        *--iter = '-';
+      }
+
+      return write (iter, static_cast<std::size_t> (end - iter));
+    }
+
+    template<typename T>
+    std::enable_if_t<std::is_floating_point<T>::value, output_buffer &> operator << (T v)
+    {
+      using format_type = std::conditional_t<std::is_same<T, long double>::value, long double, double>;
+
+      if (format_fixed (v))
+      {
+        return *this;
+      }
+
+      constexpr auto capacity = 48U;
+      auto const p            = reserve (capacity);
+
+      auto n = format (p, capacity, std::numeric_limits<T>::digits10, static_cast<format_type> (v));
+      if (static_cast<T> (parse (p, format_type ())) != v)
+      {
+        n = format (p, capacity, std::numeric_limits<T>::max_digits10, static_cast<format_type> (v));
+      }
+
+      commit (static_cast<std::size_t> (n > 0 ? n : 0));
+      return *this;
+    }
+
+  private:
+    template<typename T>
+    static bool is_negative (T v, std::true_type) noexcept
+    {
+      return v < 0;
+    }
+
+    template<typename T>
+    static bool is_negative (T, std::false_type) noexcept
+    {
+      return false;
+    }
+
+    // If v == r / 10^k with r < 2^digits and k <= digits10 then both r and
+    //  10^k are exact so "r * 10^-k" parses back to the correctly rounded
+    //  quotient, that is v
+    template<typename T>
+    bool format_fixed (T v)
+    {
+      constexpr auto digits   = std::numeric_limits<T>::digits  ;
+      constexpr auto decimals = std::numeric_limits<T>::digits10;
+
+      if (digits > 53 || !(v == v))
+      {
+        return false;
+      }
+
+      constexpr unsigned long long powers_of_10[] =
+      {
+        1ULL                , 10ULL               , 100ULL              , 1000ULL             ,
+        10000ULL            , 100000ULL           , 1000000ULL          , 10000000ULL         ,
+        100000000ULL        , 1000000000ULL       , 10000000000ULL      , 100000000000ULL     ,
+        1000000000000ULL    , 10000000000000ULL   , 100000000000000ULL  , 1000000000000000ULL ,
+      };
+
+      constexpr auto  limit     = static_cast<T> (1ULL << (digits > 53 ? 53 : digits));
+      auto const      negative  = std::signbit (v);
+      auto const      magnitude = negative ? -v : v;
+
+      for (auto k = 0; k <= decimals && k < 16; ++k)
+      {
+        auto const power  = static_cast<T> (powers_of_10[k]);
+        auto const scaled = magnitude * power;
+
+        if (!(scaled < limit))
+        {
+          return false;
+        }
+
+        auto const r = static_cast<unsigned long long> (scaled);
+
+        if (static_cast<T> (r) == scaled && static_cast<T> (r) / power == magnitude)
+        {
+          if (negative)
+          {
+            put ('-');
+          }
+
+          *this << r / powers_of_10[k];
+
+          if (k > 0)
+          {
+            auto fraction = r % powers_of_10[k];
+            auto p        = reserve (static_cast<std::size_t> (k + 1));
+
+            p[0] = '.';
+            for (auto iter = k; iter > 0; --iter)
+            {
+              p[iter]   = static_cast<char> ('0' + fraction % 10);
+              fraction  /= 10;
+            }
+
+            commit (static_cast<std::size_t> (k + 1));
+          }
+
+          return true;
+        }
+      }
+
+      return false;
+    }
+
+    static int format (char * p, std::size_t capacity, int precision, double v) noexcept
+    {
+      return std::snprintf (p, capacity, "%.*g", precision, v);
+    }
+
+    static int format (char * p, std::size_t capacity, int precision, long double v) noexcept
+    {
+      return std::snprintf (p, capacity, "%.*Lg", precision, v);
+    }
+
+    static double parse (char const * p, double) noexcept
+    {
+      return std::strtod (p, nullptr);
+    }
+
+    static long double parse (char const * p, long double) noexcept
+    {
+      return std::strtold (p, nullptr);
+    }
+
+    detail::aligned_buffer  buffer;
+    std::size_t             used  ;
+  };
+
+  // --------------------------------------------------------------------------
+
+  struct async_read_options
+  {
+    // The size of each block pushed
+    std::size_t block_size  = detail::default_read_buffer_size;
+    // The number of blocks read ahead of the pipeline
+    std::size_t queue_depth = 4;
+    // Uses io_uring where available, otherwise a read-ahead thread is used
+    bool        io_uring    = true;
+  };
+
+  // --------------------------------------------------------------------------
+
+  struct file_sink_options
+  {
+    // The sink writes whenever this many bytes are buffered
+    std::size_t buffer_size = detail::default_write_buffer_size;
+    // Writes with O_DIRECT (bypassing the page cache) where supported
+    bool        direct      = false;
+    // Flushes the file data to the device before the sink returns
+    bool        sync        = false;
+  };
+
+  // --------------------------------------------------------------------------
+
+  struct csv_options
+  {
+    char                      delimiter   = ','   ;
+    char                      quote       = '"'   ;
+    bool                      has_header  = false ;
+    // The file column to read for each requested column, columns not listed
+    //  are skipped without conversion. Empty means the leading columns
+    std::vector<std::size_t>  columns     ;
+    std::size_t               buffer_size = detail::default_read_buffer_size;
+  };
+
+  // --------------------------------------------------------------------------
+  // Sources
+  // --------------------------------------------------------------------------
+
+  // Creates a source of the lines in a file, file is either a path or an
+  //  open file descriptor (read from its current position and not closed)
+  //  Lines are split on '\n' which isn't included, no per-line allocation
+  //  is done as each line is pushed as a text_view into the read buffer
+  auto from_lines = [] (auto && file, std::size_t buffer_size = detail::default_read_buffer_size)
+  {
+    return detail::adapt_source_function<text_view, detail::plan<detail::from_lines_step>> (
+      [spec = detail::make_file_spec (std::forward<decltype (file)> (file)), buffer_size] (auto && sink)
+      {
+        detail::read_blocks (spec, buffer_size, [&sink] (char const * begin, char const * end, bool eof, std::size_t & consumed)
+        {
+          auto line = begin;
+
+          auto const result = detail::scan_bytes (begin, end, '\n', '\n', '\n', [&line, &sink] (char const * newline)
+          {
+            auto const v = text_view (line, static_cast<std::size_t> (newline - line));
+            line = newline + 1;
+            return sink (v);
+          });
+
+          if (result && eof && line != end)
+          {
+            sink (text_view (line, static_cast<std::size_t> (end - line)));
+            line = end;
+          }
+
+          consumed = static_cast<std::size_t> (line - begin);
+
+          return result;
+        });
+      });
+  };
+
+  // --------------------------------------------------------------------------
+
+  // Creates a source of the content of a file as text_view blocks in file
+  //  order while the next blocks are read asynchronously. Regular files are
+  //  read with io_uring on Linux, otherwise (or if io_uring isn't permitted)
+  //  a read-ahead thread is used. A block is valid until the sink returns
+  auto from_file_blocks = [] (auto && file, async_read_options options = async_read_options ())
+  {
+    options.block_size  = options.block_size  > 0 ? options.block_size  : detail::default_read_buffer_size;
+    options.queue_depth = options.queue_depth > 0 ? options.queue_depth : 1;
+
+    return detail::adapt_source_function<text_view, detail::plan<detail::from_file_blocks_step>> (
+      [spec = detail::make_file_spec (std::forward<decltype (file)> (file)), options] (auto && sink)
+      {
+        auto process = [&sink] (char const * begin, char const * end)
+        {
+          detail::trace_scope scope ("from_file_blocks.block");
+
+          return sink (text_view (begin, static_cast<std::size_t> (end - begin)));
+        };
+
+#if CPP_STREAMS__IO_URING
+        if (options.io_uring && detail::io_uring_read_blocks (spec, options.block_size, options.queue_depth, process))
+        {
+          return;
+        }
+#endif
+
+        detail::read_ahead_blocks (spec, options.block_size, options.queue_depth, process);
+      });
+  };
+
+  // --------------------------------------------------------------------------
+
+  // Creates a source of TRecord from a delimited text file, each record is
+  //  brace-initialized from the requested columns parsed as TColumns...
+  //  Supported column types are integers, floating points, std::string and
+  //  text_view. Empty lines are skipped, empty and missing fields are
+  //  value-initialized and invalid numbers throw std::invalid_argument
+  template<typename TRecord, typename... TColumns, typename TFile>
+  auto from_csv_as (TFile && file, csv_options options = csv_options ())
+  {
+    constexpr auto column_count = sizeof... (TColumns);
+
+    if (options.columns.empty ())
+    {
+      for (auto iter = 0U; iter < column_count; ++iter)
+      {
+        options.columns.push_back (iter);
+      }
+    }
+    else if (options.columns.size () != column_count)
+    {
+      throw std::invalid_argument ("cpp_streams: csv_options.columns must list one file column per requested column");
+    }
+
+    return detail::adapt_source_function<TRecord, detail::plan<detail::from_csv_step>> (
+      [spec = detail::make_file_spec (std::forward<TFile> (file)), options = std::move (options)] (auto && sink)
+      {
+        // slot_of[file column] is the requested column it's parsed into or -1
+        std::vector<int> slot_of;
+        for (auto iter = 0U; iter < column_count; ++iter)
+        {
+          auto const column = options.columns[iter];
+          if (column >= slot_of.size ())
+          {
+            slot_of.resize (column + 1, -1);
+          }
+          slot_of[column] = static_cast<int> (iter);
+        }
+
+        detail::csv_field fields[column_count > 0 ? column_count : 1];
+
+        auto const delimiter  = options.delimiter ;
+        auto const quote      = options.quote     ;
+        auto skip_record      = options.has_header;
+
+        detail::read_blocks (spec, options.buffer_size, [&] (char const * begin, char const * end, bool eof, std::size_t & consumed)
+        {
+          auto        record    = begin ;
+          auto        field     = begin ;
+          std::size_t column    = 0     ;
+          std::size_t quotes    = 0     ;
+          auto        quoted    = false ;
+          auto        in_quotes = false ;
+
+          auto end_field = [&] (char const * field_end)
+          {
+            if (column < slot_of.size () && slot_of[column] >= 0)
+            {
+              fields[slot_of[column]] = detail::make_csv_field (field, field_end, quote, quoted, quotes);
+            }
+
+            ++column;
+            field     = field_end + 1;
+            quotes    = 0;
+            quoted    = false;
+          };
+
+          auto end_record = [&] (char const * record_end)
+          {
+            auto result   = true;
+            auto trimmed  = record_end != field && record_end[-1] == '\r' ? record_end - 1 : record_end;
+
+            if (trimmed != record)
+            {
+              end_field (trimmed);
+
+              if (skip_record)
+              {
+                skip_record = false;
+              }
+              else
+              {
+                result = sink (detail::make_csv_record<TRecord, TColumns...> (fields, std::index_sequence_for<TColumns...> ()));
+              }
+
+              for (auto && f : fields)
+              {
+                f = detail::csv_field ();
+              }
+            }
+
+            record    = record_end == end ? end : record_end + 1;
+            field     = record;
+            column    = 0;
+            quotes    = 0;
+            quoted    = false;
+            in_quotes = false;
+
+            return result;
+          };
+
+          auto const result = detail::scan_bytes (begin, end, delimiter, '\n', quote, [&] (char const * p)
+          {
+            auto const c = *p;
+
+            if (c == quote)
+            {
+              // Quotes are only special in fields that start with a quote
+              if (p == field)
+              {
+                quoted    = true;
+                in_quotes = true;
+                ++quotes;
+              }
+              else if (quoted)
+              {
+                in_quotes = !in_quotes;
+                ++quotes;
+              }
+              return true;
+            }
+            else if (in_quotes)
+            {
+              return true;
+            }
+            else if (c == delimiter)
+            {
+              end_field (p);
+              return true;
+            }
+            else
+            {
+              return end_record (p);
+            }
+          });
+
+          if (result && eof && record != end)
+          {
+            end_record (end);
+          }
+
+          consumed = static_cast<std::size_t> (record - begin);
+
+          return result;
+        });
+      });
+  }
+
+  // --------------------------------------------------------------------------
+
+  // Creates a source of std::tuple<TColumns...> from a delimited text file
+  template<typename... TColumns, typename TFile>
+  auto from_csv (TFile && file, csv_options options = csv_options ())
+  {
+    return from_csv_as<std::tuple<TColumns...>, TColumns...> (std::forward<TFile> (file), std::move (options));
+  }
+
+  // --------------------------------------------------------------------------
+  // Serializers
+  // --------------------------------------------------------------------------
+
+  // Serializes a value as text followed by '\n'
+  auto format_line = [] (output_buffer & out, auto && v)
+  {
+    out << std::forward<decltype (v)> (v) << '\n';
+  };
+
+  // --------------------------------------------------------------------------
+
+  // Serializes a trivially copyable value as its bytes
+  auto format_binary = [] (output_buffer & out, auto && v)
+  {
+    out.write_bytes (v);
+  };
+
+  // --------------------------------------------------------------------------
+  // Sinks
+  // --------------------------------------------------------------------------
+
+  // Writes the elements to a file using serializer (output_buffer &, v)
+  //  The output is coalesced into buffer_size writes
+  //  Returns the number of bytes written
+  auto to_file = [] (auto && path, auto && serializer, file_sink_options options = file_sink_options ())
+  {
+    using serializer_type = decltype (serializer);
+
+    return
+      [path = std::string (path), serializer = std::forward<serializer_type> (serializer), options] (auto && source)
+      {
+        CPP_STREAMS__CHECK_SOURCE (source);
+
+        detail::trace_scope scope ("to_file");
+
+        detail::output_file file (path, options.direct);
+
+        auto const alignment = file.direct ? detail::direct_io_alignment : detail::buffer_alignment;
+
+        output_buffer out (options.buffer_size + alignment, alignment);
+        std::size_t   written = 0;
+
+        auto flush = [&file, &out, &written] (bool final)
+        {
+          auto size = out.size ();
+
+          if (file.direct)
+          {
+            // Unbuffered writes must be a multiple of the block size
+            size -= size % detail::direct_io_alignment;
+          }
+
+          detail::trace_scope scope ("to_file.write");
+
+          file.write (out.data (), size);
+          out.consume (size);
+          written += size;
+
+          if (final && out.size () > 0)
+          {
+            file.disable_direct ();
+            file.write (out.data (), out.size ());
+            written += out.size ();
+            out.consume (out.size ());
+          }
+        };
+
+        source.source_function (
+          [&flush, &out, &serializer, buffer_size = options.buffer_size] (auto && v)
+          {
+            serializer (out, std::forward<decltype (v)> (v));
+            if (out.size () >= buffer_size)
+            {
+              flush (false);
+            }
+            return true;
+          });
+
+        flush (true);
+
+        if (options.sync)
+        {
+          file.sync ();
+        }
+
+        return written;
+      };
+  };
+
+  // --------------------------------------------------------------------------
+
+  // Writes the elements to a std::ostream using formatter (output_buffer &, v)
+  //  The output is coalesced into buffer_size calls to stream.write
+  //  Returns the number of bytes written, throws std::system_error like
+  //  to_file if the stream fails
+  //  The sink keeps a reference to stream so stream must be an lvalue
+  auto to_ostream = [] (auto && stream, auto && formatter, std::size_t buffer_size = detail::default_write_buffer_size)
+  {
+    using stream_type     = decltype (stream)     ;
+    using formatter_type  = decltype (formatter)  ;
+
+    static_assert (std::is_lvalue_reference<stream_type>::value, "stream must be an lvalue, the sink keeps a reference to it");
+
+    return
+      [stream = &stream, formatter = std::forward<formatter_type> (formatter), buffer_size] (auto && source)
+      {
+        CPP_STREAMS__CHECK_SOURCE (source);
+
+        detail::trace_scope scope ("to_ostream");
+
+        output_buffer out (buffer_size + detail::buffer_alignment);
+        std::size_t   written = 0;
+
+        auto flush = [stream, &out, &written] ()
+        {
+          stream->write (out.data (), static_cast<std::streamsize> (out.size ()));
+          if (stream->fail ())
+          {
+            detail::throw_stream_error ("cpp_streams: failed to write stream");
+          }
+          written += out.size ();
+          out.consume (out.size ());
+        };
+
+        source.source_function (
+          [&flush, &out, &formatter, buffer_size] (auto && v)
+          {
+            formatter (out, std::forward<decltype (v)> (v));
+            if (out.size () >= buffer_size)
+            {
+              flush ();
+            }
+            return true;
+          });
+
+        flush ();
+
+        return written;
+      };
+  };
+
+  // --------------------------------------------------------------------------
+
+}
+
+// ----------------------------------------------------------------------------
+#endif // CPP_STREAMS_IO__INCLUDE_GUARD
+// ----------------------------------------------------------------------------
@@ -0,0 +1,334 @@
+// ----------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef CPP_STREAMS_RANGE__INCLUDE_GUARD
+# define CPP_STREAMS_RANGE__INCLUDE_GUARD
+// ----------------------------------------------------------------------------
+# include "cpp_streams.hpp"
+// ----------------------------------------------------------------------------
+# include <atomic>
+# include <condition_variable>
+# include <cstddef>
+# include <exception>
+# include <iterator>
+# include <memory>
+# include <mutex>
+# include <thread>
+# include <utility>
+# include <vector>
+// ----------------------------------------------------------------------------
+// Pulling values from sources
+//  to_range returns an input range over the values of a source so it can be
+//  consumed by range-for or std:: algorithms without a to_vector first:
+//
+//    auto values = from_range (0, 10000000) >> map (f) >> to_range;
+//    auto found  = std::find_if (values.begin (), values.end (), g);
+//
+//  Sources push their values so the push loop can't be suspended between
+//  values (a coroutine can't yield from within the sink called by the
+//  source). The source instead runs on a producer thread, one OS thread per
+//  range, that fills batches of values at most one batch ahead of the
+//  consumer. Up to three batches are held at a time: the one being consumed,
+//  the ready one and the one the producer has filled while it waits.
+//
+//  The values are copied or moved into the batches, the source must stay
+//  valid while the range is used. Exceptions thrown by the source are
+//  rethrown when the range reaches them. Destroying the range stops the
+//  source at the next value it passes on, the destructor waits for that
+//  value. A source that passes on no more values (for instance a filter
+//  rejecting every remaining value of an endless source) blocks it
+// ----------------------------------------------------------------------------
+
+namespace cpp_streams
+{
+
+  // --------------------------------------------------------------------------
+
+  namespace detail
+  {
+    // Values passed on to the consumer at a time
+    constexpr std::size_t range_batch_size = 1024;
+
+    // ------------------------------------------------------------------------
+
+    template<typename TValueType>
+    struct range_state
+    {
+      std::mutex              mutex     ;
+      std::condition_variable changed   ;
+      std::vector<TValueType> ready     ;
+      std::exception_ptr      error     ;
+      bool                    has_ready = false;
+      bool                    done      = false;
+      // Checked by the producer for every value without locking
+      std::atomic<bool>       stopped   {false};
+    };
+
+    // Runs on the producer thread
+    template<typename TValueType, typename TSource>
+    void produce_range (TSource const & source, range_state<TValueType> & state)
+    {
+      std::vector<TValueType> filling;
+      filling.reserve (range_batch_size);
+
+      // Waits for the consumer to take the ready batch, returns false when
+      //  the range is destroyed
+      auto pass_on = [&filling, &state] ()
+      {
+        std::unique_lock<std::mutex> lock (state.mutex);
+        state.changed.wait (lock, [&state] () { return !state.has_ready || state.stopped; });
+
+        if (state.stopped)
+        {
+          return false;
+        }
+
+        // The consumer passes back the batch it's done with so the buffers
+        //  are reused
+        std::swap (state.ready, filling);
+        state.has_ready = true;
+        state.changed.notify_one ();
+
+        filling.clear ();
+        return true;
+      };
+
+      try
+      {
+        source.source_function (
+          [&filling, &pass_on, &state] (auto && v)
+          {
+            if (state.stopped.load (std::memory_order_relaxed))
+            {
+              return false;
+            }
+
+            filling.push_back (std::forward<decltype (v)> (v));
+            return filling.size () < range_batch_size || pass_on ();
+          });
+
+        if (!filling.empty ())
+        {
+          pass_on ();
+        }
+      }
+      catch (...)
+      {
+        std::lock_guard<std::mutex> lock (state.mutex);
+        state.error = std::current_exception ();
+      }
+
+      std::lock_guard<std::mutex> lock (state.mutex);
+      state.done = true;
+      state.changed.notify_one ();
+    }
+  }
+
+  // --------------------------------------------------------------------------
+
+  // A single pass input range over the values of a source, see to_range
+  template<typename TValueType>
+  class source_range
+  {
+  public:
+    class iterator
+    {
+    public:
+      using iterator_category = std::input_iterator_tag ;
+      using value_type        = TValueType              ;
+      using difference_type   = std::ptrdiff_t          ;
+      using pointer           = TValueType *            ;
+      using reference         = TValueType &            ;
+
+      // Holds the value of it++ as the range has moved past it
+      class postfix_value
+      {
+      public:
+        explicit postfix_value (TValueType && value)
+          : value (std::move (value))
+        {
+        }
+
+        TValueType & operator* () noexcept
+        {
+          return value;
+        }
+
+      private:
+        TValueType value;
+      };
+
+      iterator () noexcept
+        : range (nullptr)
+      {
+      }
+
+      explicit iterator (source_range * range) noexcept
+        : range (range)
+      {
+      }
+
+      reference operator* () const noexcept
+      {
+        return range->current[range->index];
+      }
+
+      pointer operator-> () const noexcept
+      {
+        return &range->current[range->index];
+      }
+
+      iterator & operator++ ()
+      {
+        if (!range->next ())
+        {
+          range = nullptr;
+        }
+        return *this;
+      }
+
+      postfix_value operator++ (int)
+      {
+        postfix_value result (std::move (**this));
+        ++*this;
+        return result;
+      }
+
+      bool operator== (iterator const & o) const noexcept
+      {
+        return range == o.range;
+      }
+
+      bool operator!= (iterator const & o) const noexcept
+      {
+        return range != o.range;
+      }
+
+    private:
+      source_range * range;
+    };
+
+    template<typename TSource>
+    explicit source_range (TSource && source)
+      : state   (std::make_shared<detail::range_state<TValueType>> ())
+      , index   (0)
+      , begun   (false)
+    {
+      producer = std::thread (
+        [state = state, source = std::forward<TSource> (source)] ()
+        {
+          detail::produce_range (source, *state);
+        });
+    }
+
+    source_range (source_range &&)                    = default;
+
+    source_range (source_range const &)               = delete;
+    source_range & operator= (source_range const &)   = delete;
+    source_range & operator= (source_range &&)        = delete;
+
+    ~source_range () noexcept
+    {
+      if (producer.joinable ())
+      {
+        {
+          std::lock_guard<std::mutex> lock (state->mutex);
+          state->stopped = true;
+        }
+        state->changed.notify_one ();
+        producer.join ();
+      }
+    }
+
+    // Single pass, begin () after the first value is consumed doesn't
+    //  restart the source
+    iterator begin ()
+    {
+      if (!begun)
+      {
+        begun = true;
+        if (!take_batch ())
+        {
+          return end ();
+        }
+      }
+
+      return index < current.size () ? iterator (this) : end ();
+    }
+
+    iterator end () noexcept
+    {
+      return iterator ();
+    }
+
+  private:
+    bool next ()
+    {
+      return ++index < current.size () || take_batch ();
+    }
+
+    // Waits for the producer, returns false after the last value
+    bool take_batch ()
+    {
+      std::unique_lock<std::mutex> lock (state->mutex);
+      state->changed.wait (lock, [this] () { return state->has_ready || state->done; });
+
+      if (state->has_ready)
+      {
+        current.clear ();
+        std::swap (current, state->ready);
+        state->has_ready  = false;
+        index             = 0;
+        state->changed.notify_one ();
+        return true;
+      }
+
+      current.clear ();
+      index = 0;
+
+      if (state->error)
+      {
+        std::rethrow_exception (state->error);
+      }
+
+      return false;
+    }
+
+    std::shared_ptr<detail::range_state<TValueType>>  state     ;
+    std::vector<TValueType>                           current   ;
+    std::size_t                                       index     ;
+    bool                                              begun     ;
+    std::thread                                       producer  ;
+  };
+
+  // --------------------------------------------------------------------------
+
+  auto to_range =
+    [] (auto && source)
+    {
+      CPP_STREAMS__CHECK_SOURCE (source);
+
+      using source_type = decltype (source);
+      using value_type  = detail::get_stripped_source_value_type_t<source_type>;
+
+      return source_range<value_type> (std::forward<source_type> (source));
+    };
+
+  // --------------------------------------------------------------------------
+
+}
+// ----------------------------------------------------------------------------
+#endif // CPP_STREAMS_RANGE__INCLUDE_GUARD
+// ----------------------------------------------------------------------------
@@ -0,0 +1,283 @@
+// ----------------------------------------------------------------------------
+// Copyright 2015 Mårten Rånge
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// ----------------------------------------------------------------------------
+#ifndef CPP_STREAMS_TRACE__INCLUDE_GUARD
+# define CPP_STREAMS_TRACE__INCLUDE_GUARD
+// ----------------------------------------------------------------------------
+# include <atomic>
+# include <chrono>
+# include <cstdint>
+# include <memory>
+# include <mutex>
+# include <ostream>
+# include <vector>
+// ----------------------------------------------------------------------------
+// Pipeline tracing
+//  Built with CPP_STREAMS__TRACE defined (for all translation units) sinks,
+//  the buffering, sorting and emitting phases of sort and reverse and the
+//  blocks of from_file_blocks and from_columnar_file are recorded as
+//  complete events with their thread. write_trace_json writes them in the
+//  Chrome trace event format loaded by chrome://tracing and Perfetto.
+//
+//  Every thread appends to its own fixed size buffer without locking, only
+//  the first event of a thread takes a lock to register the buffer. When a
+//  buffer is full further events of that thread are dropped and counted.
+//  Event names must be string literals (or otherwise outlive the trace).
+//  Without CPP_STREAMS__TRACE nothing is recorded
+// ----------------------------------------------------------------------------
+// The number of events each thread can record
+# ifndef CPP_STREAMS__TRACE_EVENTS_PER_THREAD
+#   define CPP_STREAMS__TRACE_EVENTS_PER_THREAD 65536
+# endif
+// ----------------------------------------------------------------------------
+
+namespace cpp_streams
+{
+
+  // --------------------------------------------------------------------------
+
+  namespace detail
+  {
+
+    // ------------------------------------------------------------------------
+
+    using trace_clock = std::chrono::steady_clock;
+
+    struct trace_event
+    {
+      char const *  name        ;
+      std::uint64_t begin_ns    ;
+      std::uint64_t duration_ns ;
+    };
+
+    // Written by a single thread, read by any
+    class trace_buffer
+    {
+    public:
+      trace_buffer (std::uint32_t thread_id, std::size_t capacity)
+        : thread_id (thread_id)
+        , events    (capacity)
+        , count     (0)
+        , dropped   (0)
+      {
+      }
+
+      trace_buffer (trace_buffer const &)             = delete;
+      trace_buffer & operator= (trace_buffer const &) = delete;
+
+      void push (trace_event const & e) noexcept
+      {
+        auto const n = count.load (std::memory_order_relaxed);
+        if (n < events.size ())
+        {
+          events[n] = e;
+          // Publishes the event to readers
+          count.store (n + 1, std::memory_order_release);
+        }
+        else
+        {
+          dropped.fetch_add (1, std::memory_order_relaxed);
+        }
+      }
+
+      std::size_t size () const noexcept
+      {
+        return count.load (std::memory_order_acquire);
+      }
+
+      trace_event const & operator[] (std::size_t index) const noexcept
+      {
+        return events[index];
+      }
+
+      std::size_t dropped_events () const noexcept
+      {
+        return dropped.load (std::memory_order_relaxed);
+      }
+
+      void clear () noexcept
+      {
+        count.store (0, std::memory_order_release);
+        dropped.store (0, std::memory_order_relaxed);
+      }
+
+      std::uint32_t const       thread_id ;
+
+    private:
+      std::vector<trace_event>  events    ;
+      std::atomic<std::size_t>  count     ;
+      std::atomic<std::size_t>  dropped   ;
+    };
+
+    class trace_registry
+    {
+    public:
+      static trace_registry & instance ()
+      {
+        static trace_registry registry;
+        return registry;
+      }
+
+      // The buffer of the calling thread, kept by the registry after the
+      //  thread exits so its events can still be written
+      trace_buffer & local ()
+      {
+        thread_local std::shared_ptr<trace_buffer> buffer = add_buffer ();
+        return *buffer;
+      }
+
+      std::uint64_t now_ns () const noexcept
+      {
+        return static_cast<std::uint64_t> (std::chrono::duration_cast<std::chrono::nanoseconds> (trace_clock::now () - epoch).count ());
+      }
+
+      std::vector<std::shared_ptr<trace_buffer>> buffers () const
+      {
+        std::lock_guard<std::mutex> lock (mutex);
+        return all_buffers;
+      }
+
+    private:
+      trace_registry ()
+        : epoch (trace_clock::now ())
+      {
+      }
+
+      std::shared_ptr<trace_buffer> add_buffer ()
+      {
+        std::lock_guard<std::mutex> lock (mutex);
+        auto buffer = std::make_shared<trace_buffer> (
+            static_cast<std::uint32_t> (all_buffers.size () + 1)
+          , static_cast<std::size_t> (CPP_STREAMS__TRACE_EVENTS_PER_THREAD)
+          );
+        all_buffers.push_back (buffer);
+        return buffer;
+      }
+
+      trace_clock::time_point                     epoch       ;
+      mutable std::mutex                          mutex       ;
+      std::vector<std::shared_ptr<trace_buffer>>  all_buffers ;
+    };
+
+    // ------------------------------------------------------------------------
+
+#ifdef CPP_STREAMS__TRACE
+    // Records the lifetime of the scope as an event on the current thread
+    class trace_scope
+    {
+    public:
+      explicit trace_scope (char const * name) noexcept
+        : name  (name)
+        , begin (trace_registry::instance ().now_ns ())
+      {
+      }
+
+      trace_scope (trace_scope const &)             = delete;
+      trace_scope & operator= (trace_scope const &) = delete;
+
+      ~trace_scope () noexcept
+      {
+        try
+        {
+          auto & registry = trace_registry::instance ();
+          auto const end  = registry.now_ns ();
+          registry.local ().push (trace_event {name, begin, end - begin});
+        }
+        catch (...)
+        {
+          // Tracing is best effort
+        }
+      }
+
+    private:
+      char const *  name  ;
+      std::uint64_t begin ;
+    };
+#endif
+
+    // ------------------------------------------------------------------------
+
+  }
+
+  // --------------------------------------------------------------------------
+
+  // The number of events dropped because a thread's buffer was full
+  inline std::size_t trace_dropped_events ()
+  {
+    std::size_t result = 0;
+    for (auto && buffer : detail::trace_registry::instance ().buffers ())
+    {
+      result += buffer->dropped_events ();
+    }
+    return result;
+  }
+
+  // Forgets all recorded events, must not be called while pipelines run
+  inline void reset_trace ()
+  {
+    for (auto && buffer : detail::trace_registry::instance ().buffers ())
+    {
+      buffer->clear ();
+    }
+  }
+
+  // Writes the recorded events in the Chrome trace event format
+  template<typename TChar, typename TTraits>
+  void write_trace_json (std::basic_ostream<TChar, TTraits> & stream)
+  {
+    auto const buffers = detail::trace_registry::instance ().buffers ();
+
+    // Timestamps and durations are in microseconds
+    auto const write_us = [&stream] (std::uint64_t ns)
+    {
+      stream << ns / 1000U << '.' << static_cast<char> ('0' + ns / 100U % 10U) << static_cast<char> ('0' + ns / 10U % 10U) << static_cast<char> ('0' + ns % 10U);
+    };
+
+    stream << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+
+    auto first = true;
+    for (auto && buffer : buffers)
+    {
+      stream
+        << (first ? "\n" : ",\n")
+        << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": "
+        << buffer->thread_id
+        << ", \"args\": {\"name\": \"cpp_streams "
+        << buffer->thread_id
+        << "\"}}"
+        ;
+      first = false;
+
+      auto const size = buffer->size ();
+      for (auto iter = 0U; iter < size; ++iter)
+      {
+        auto const & e = (*buffer)[iter];
+        stream << ",\n{\"name\": \"" << e.name << "\", \"cat\": \"cpp_streams\", \"ph\": \"X\", \"ts\": ";
+        write_us (e.begin_ns);
+        stream << ", \"dur\": ";
+        write_us (e.duration_ns);
+        stream << ", \"pid\": 1, \"tid\": " << buffer->thread_id << "}";
+      }
+    }
+
+    stream << "\n]}\n";
+  }
+
+  // --------------------------------------------------------------------------
+
+}
+// ----------------------------------------------------------------------------
+#endif // CPP_STREAMS_TRACE__INCLUDE_GUARD
+// ----------------------------------------------------------------------------
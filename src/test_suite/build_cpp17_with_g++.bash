@@ -0,0 +1 @@
+g++ -g -O2 -Wall -pedantic --std=c++17 -pthread test_suite.cpp -o cppstreams_cpp17_g++.out && ./cppstreams_cpp17_g++.out
@@ -0,0 +1 @@
+g++ -g -O2 -Wall -pedantic --std=c++20 -pthread test_suite.cpp -o cppstreams_cpp20_g++.out && ./cppstreams_cpp20_g++.out
@@ -0,0 +1 @@
+g++ -g -O2 -Wall -pedantic --std=c++1y -pthread -DCPP_STREAMS__INSTRUMENT -DCPP_STREAMS__TRACE test_suite.cpp -o cppstreams_instrumented_g++.out && ./cppstreams_instrumented_g++.out
@@ -1 +1 @@
-clang++ -g -O2 -Wall -pedantic --std=c++1y test_suite.cpp -o cppstreams_clang++.out && ./cppstreams_clang++.out
+clang++ -g -O2 -Wall -pedantic --std=c++1y -pthread test_suite.cpp -o cppstreams_clang++.out && ./cppstreams_clang++.out
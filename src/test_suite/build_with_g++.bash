@@ -1 +1 @@
-g++ -g -O2 -Wall -pedantic --std=c++1y test_suite.cpp -o cppstreams_g++.out && ./cppstreams_g++.out
+g++ -g -O2 -Wall -pedantic --std=c++1y -pthread test_suite.cpp -o cppstreams_g++.out && ./cppstreams_g++.out
@@ -17,15 +17,33 @@
 # define CPP_STREAMS__FUNCTIONAL_TESTS__INCLUDE_GUARD
 // ----------------------------------------------------------------------------
 # include "../cpp_streams/cpp_streams.hpp"
+# include "../cpp_streams/cpp_streams_any.hpp"
+# include "../cpp_streams/cpp_streams_arena.hpp"
+# include "../cpp_streams/cpp_streams_columnar.hpp"
+# include "../cpp_streams/cpp_streams_explain.hpp"
+# include "../cpp_streams/cpp_streams_generator.hpp"
+# include "../cpp_streams/cpp_streams_io.hpp"
+# include "../cpp_streams/cpp_streams_range.hpp"
 
-# include <chrono>
 # include <cstdint>
+# include <cstdio>
+# include <cstring>
 # include <algorithm>
+# include <array>
+# include <fstream>
 # include <iostream>
 # include <iterator>
+# include <limits>
+# include <memory>
+# include <set>
 # include <sstream>
 # include <string>
+# include <system_error>
+# include <thread>
 # include <tuple>
+# if __cplusplus >= 201703L
+#   include <optional>
+# endif
 // ----------------------------------------------------------------------------
 # define CPP_STREAMS__TEST()                  test_prelude (__FILE__, __LINE__, __FUNCTION__)
 # define CPP_STREAMS__ERROR(msg)              test_error (__FILE__, __LINE__, __FUNCTION__, msg)
@@ -41,12 +59,9 @@
 // ----------------------------------------------------------------------------
 namespace functional_tests
 {
+  // An aggregate, C++20 doesn't allow user declared constructors in aggregates
   struct user
   {
-    CPP_STREAMS__BODY (user);
-
-    user () = default;
-
     bool operator == (user const & o) const
     {
       return
@@ -69,14 +84,118 @@ namespace functional_tests
     }
   };
 
-  template<typename TOne, typename TTwo>
-  std::ostream & operator << (std::ostream & s, std::tuple<TOne, TTwo> const & v)
+  // Counts the copies and moves of all instances
+  struct copy_counter
+  {
+    static std::size_t copies;
+    static std::size_t moves ;
+
+    explicit copy_counter (int value = 0) noexcept
+      : value (value)
+    {
+    }
+
+    copy_counter (copy_counter const & o) noexcept
+      : value (o.value)
+    {
+      ++copies;
+    }
+
+    copy_counter (copy_counter && o) noexcept
+      : value (o.value)
+    {
+      ++moves;
+    }
+
+    copy_counter & operator= (copy_counter const & o) noexcept
+    {
+      value = o.value;
+      ++copies;
+      return *this;
+    }
+
+    copy_counter & operator= (copy_counter && o) noexcept
+    {
+      value = o.value;
+      ++moves;
+      return *this;
+    }
+
+    static void reset () noexcept
+    {
+      copies  = 0;
+      moves   = 0;
+    }
+
+    int value;
+  };
+
+  std::size_t copy_counter::copies  = 0;
+  std::size_t copy_counter::moves   = 0;
+
+#ifdef CPP_STREAMS__INSTRUMENT
+  std::set<std::string> & recorded_owners ()
+  {
+    static std::set<std::string> owners;
+    return owners;
+  }
+
+  // Records the operator owning each allocation
+  template<typename TValueType>
+  struct owner_recording_allocator
+  {
+    using value_type = TValueType;
+
+    owner_recording_allocator () noexcept = default;
+
+    template<typename TOther>
+    owner_recording_allocator (owner_recording_allocator<TOther> const &) noexcept
+    {
+    }
+
+    TValueType * allocate (std::size_t n)
+    {
+      auto const owner = cpp_streams::allocation_owner ();
+      recorded_owners ().insert (owner ? owner : "");
+      return std::allocator<TValueType> ().allocate (n);
+    }
+
+    void deallocate (TValueType * p, std::size_t n) noexcept
+    {
+      std::allocator<TValueType> ().deallocate (p, n);
+    }
+
+    template<typename TOther>
+    bool operator == (owner_recording_allocator<TOther> const &) const noexcept
+    {
+      return true;
+    }
+
+    template<typename TOther>
+    bool operator != (owner_recording_allocator<TOther> const &) const noexcept
+    {
+      return false;
+    }
+  };
+#endif
+
+  template<typename TTuple, std::size_t... Indices>
+  void print_tuple (std::ostream & s, TTuple const & v, std::index_sequence<Indices...>)
+  {
+    int ignore[] = {0, ((s << (Indices == 0 ? "" : ", ") << std::get<Indices> (v)), 0)...};
+    (void)ignore;
+  }
+
+  template<typename... TValues>
+  std::ostream & operator << (std::ostream & s, std::tuple<TValues...> const & v)
   {
     s
       << "{"
-      << std::get<0> (v)
-      << ", "
-      << std::get<1> (v)
+      ;
+
+    print_tuple (s, v, std::index_sequence_for<TValues...> ());
+
+    s
       << "}"
       ;
 
@@ -286,6 +405,62 @@ namespace functional_tests
     return sum;
   }
 
+#ifdef __cpp_impl_coroutine
+  cpp_streams::generator<int> count_to (int n)
+  {
+    for (auto iter = 1; iter <= n; ++iter)
+    {
+      co_yield iter;
+    }
+  }
+
+  cpp_streams::generator<int> count_to (std::allocator_arg_t, cpp_streams::arena_allocator<char>, int n)
+  {
+    for (auto iter = 1; iter <= n; ++iter)
+    {
+      co_yield iter;
+    }
+  }
+
+  cpp_streams::generator<std::string> throw_after_first ()
+  {
+    co_yield "first";
+    throw std::invalid_argument ("second");
+  }
+#endif
+
+  // Writes content to a temporary file that is removed when going out of scope
+  struct temporary_file
+  {
+    temporary_file (char const * path, std::string const & content)
+      : path (path)
+    {
+      std::ofstream stream (path, std::ios::binary);
+      stream.write (content.data (), static_cast<std::streamsize> (content.size ()));
+    }
+
+    temporary_file (temporary_file const &)             = delete;
+    temporary_file & operator= (temporary_file const &) = delete;
+
+    ~temporary_file ()
+    {
+      std::remove (path);
+    }
+
+    char const * path;
+  };
+
+  std::string read_file (char const * path)
+  {
+    std::ifstream stream (path, std::ios::binary);
+    return std::string (std::istreambuf_iterator<char> (stream), std::istreambuf_iterator<char> ());
+  }
+
+  auto map_text_to_string = [] (cpp_streams::text_view v)
+  {
+    return v.to_string ();
+  };
+
   void test_prelude (char const * /*file_name*/, int /*line_no*/, char const * function_name)
   {
     std::cout
@@ -443,830 +618,1176 @@ namespace functional_tests
 
   }
 
-  void test__to_all ()
+  void test__from_lines ()
   {
     CPP_STREAMS__TEST ();
 
     using namespace cpp_streams;
 
     {
-      bool expected = false;
-      bool actual   = from (empty_users) >> to_all (map_true);
-      CPP_STREAMS__EQUAL (expected, actual);
-    }
+      temporary_file file ("cpp_streams__from_lines.tmp", "");
 
-    {
-      bool expected = false;
-      bool actual   = from (some_users) >> to_all (map_false);
+      std::vector<std::string> expected {};
+      std::vector<std::string> actual   =
+            from_lines (file.path)
+        >>  map (map_text_to_string)
+        >>  to_vector
+        ;
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
+    // A buffer size of 8 forces lines to straddle and outgrow the read buffer
+    for (auto buffer_size : {8_sz, detail::default_read_buffer_size})
     {
-      bool expected = true;
-      bool actual   = from (some_users) >> to_all (map_true);
+      temporary_file file ("cpp_streams__from_lines.tmp", "Bill Gates\n\nSteve Jobs, a long line\r\nlast line");
+
+      std::vector<std::string> expected {"Bill Gates", "", "Steve Jobs, a long line\r", "last line"};
+      std::vector<std::string> actual   =
+            from_lines (file.path, buffer_size)
+        >>  map (map_text_to_string)
+        >>  to_vector
+        ;
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
     {
-      bool expected = true;
-      bool actual   = from (some_ints) >> to_all ([] (auto && v) {return v > 0;});
+      std::string content;
+      for (auto iter = 0; iter < 10000; ++iter)
+      {
+        content += std::to_string (iter);
+        content += '\n';
+      }
+
+      temporary_file file ("cpp_streams__from_lines.tmp", content);
+
+      std::size_t expected  = 10000;
+      std::size_t actual    = from_lines (std::string (file.path), 4096) >> to_length;
       CPP_STREAMS__EQUAL (expected, actual);
+
+      std::vector<std::string> expected_first {"0", "1", "2"};
+      std::vector<std::string> actual_first   =
+            from_lines (file.path, 4096)
+        >>  take (3)
+        >>  map (map_text_to_string)
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected_first, actual_first);
     }
 
   }
 
-  void test__to_any ()
+  void test__from_file_blocks ()
   {
     CPP_STREAMS__TEST ();
 
     using namespace cpp_streams;
 
+    auto join = [] (std::vector<std::string> const & vs)
     {
-      bool expected = false;
-      bool actual   = from (empty_users) >> to_any (map_true);
-      CPP_STREAMS__EQUAL (expected, actual);
-    }
+      std::string result;
+      for (auto && v : vs)
+      {
+        result += v;
+      }
+      return result;
+    };
 
+    std::string content;
+    for (auto iter = 0; iter < 10000; ++iter)
     {
-      bool expected = false;
-      bool actual   = from (some_users) >> to_any (map_false);
-      CPP_STREAMS__EQUAL (expected, actual);
+      content += static_cast<char> ('a' + iter % 26);
     }
 
+    // Both with io_uring (where available) and the read-ahead thread
+    for (auto io_uring : {true, false})
     {
-      bool expected = true;
-      bool actual   = from (some_users) >> to_any (map_true);
-      CPP_STREAMS__EQUAL (expected, actual);
-    }
+      async_read_options options;
+      options.block_size  = 1000;
+      options.queue_depth = 3;
+      options.io_uring    = io_uring;
 
-    {
-      bool expected = true;
-      bool actual   = from (some_ints) >> to_any ([] (auto && v) {return v > 8;});
-      CPP_STREAMS__EQUAL (expected, actual);
-    }
+      {
+        temporary_file file ("cpp_streams__from_file_blocks.tmp", "");
 
-  }
+        std::size_t expected  = 0;
+        std::size_t actual    = from_file_blocks (file.path, options) >> to_length;
+        CPP_STREAMS__EQUAL (expected, actual);
+      }
 
-  void test__to_first_or_default ()
-  {
-    CPP_STREAMS__TEST ();
+      {
+        temporary_file file ("cpp_streams__from_file_blocks.tmp", content);
 
-    using namespace cpp_streams;
+        std::vector<std::string> blocks =
+              from_file_blocks (file.path, options)
+          >>  map (map_text_to_string)
+          >>  to_vector
+          ;
 
-    {
-      user expected = empty_user;
-      user actual   = from (empty_users) >> to_first_or_default;
-      CPP_STREAMS__EQUAL (expected, actual);
+        std::string expected  = content;
+        std::string actual    = join (blocks);
+        CPP_STREAMS__EQUAL (expected, actual);
+        CPP_STREAMS__EQUAL (10_sz, blocks.size ());
+
+        std::string expected_first  = content.substr (0, 2500);
+        std::string actual_first    = join (
+              from_file_blocks (file.path, options)
+          >>  take (3)
+          >>  map (map_text_to_string)
+          >>  to_vector
+          ).substr (0, 2500);
+        CPP_STREAMS__EQUAL (expected_first, actual_first);
+      }
     }
 
-    {
-      int expected  = some_ints.front ();
-      int actual    = from (some_ints) >> to_first_or_default;
-      CPP_STREAMS__EQUAL (expected, actual);
-    }
   }
 
-  void test__to_last_or_default ()
+  struct csv_user
   {
-    CPP_STREAMS__TEST ();
-
-    using namespace cpp_streams;
+    std::uint64_t id        ;
+    std::string   last_name ;
+    double        score     ;
 
+    bool operator == (csv_user const & o) const
     {
-      user expected   = empty_user;
-      user actual     = from (empty_users) >> to_last_or_default;
-      CPP_STREAMS__EQUAL (expected, actual);
+      return id == o.id && last_name == o.last_name && score == o.score;
     }
+  };
 
-    {
-      int expected    = some_ints.back ();
-      int actual      = from (some_ints) >> to_last_or_default;
-      CPP_STREAMS__EQUAL (expected, actual);
-    }
+  std::ostream & operator << (std::ostream & s, csv_user const & v)
+  {
+    return s << "{csv_user, id:" << v.id << ", last_name:'" << v.last_name << "', score:" << v.score << "}";
   }
 
-  void test__to_length ()
+  void test__from_csv ()
   {
     CPP_STREAMS__TEST ();
 
     using namespace cpp_streams;
 
+    using row_type = std::tuple<std::uint64_t, std::string, std::string, double>;
+
+    auto const content =
+      "id,first_name,last_name,score\r\n"
+      "1001,Bill,Gates,0.5\r\n"
+      "\r\n"
+      "1002,\"Melinda, \"\"Mel\"\"\",Gates,-1.25e2\r\n"
+      "1003,Steve,\"Jobs\",\r\n"
+      "1004,Tim"
+      ;
+
+    csv_options options;
+    options.has_header = true;
+
+    // A buffer size of 8 forces records to straddle and outgrow the read buffer
+    for (auto buffer_size : {8_sz, detail::default_read_buffer_size})
     {
-      std::size_t expected  = 0;
-      std::size_t actual    = from (empty_ints) >> to_length;
+      temporary_file file ("cpp_streams__from_csv.tmp", content);
+
+      options.buffer_size = buffer_size;
+
+      std::vector<row_type> expected
+      {
+        row_type {1001, "Bill"              , "Gates" , 0.5     },
+        row_type {1002, "Melinda, \"Mel\"", "Gates" , -125.0  },
+        row_type {1003, "Steve"             , "Jobs"  , 0.0     },
+        row_type {1004, "Tim"               , ""      , 0.0     },
+      };
+      std::vector<row_type> actual =
+            from_csv<std::uint64_t, std::string, std::string, double> (file.path, options)
+        >>  to_vector
+        ;
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
     {
-      std::size_t expected  = some_users.size ();
-      std::size_t actual    = from (some_users) >> to_length;
+      temporary_file file ("cpp_streams__from_csv.tmp", content);
+
+      options.buffer_size = detail::default_read_buffer_size;
+      options.columns     = {0, 2, 3};
+
+      std::vector<csv_user> expected
+      {
+        {1001, "Gates"  , 0.5     },
+        {1002, "Gates"  , -125.0  },
+        {1003, "Jobs"   , 0.0     },
+        {1004, ""       , 0.0     },
+      };
+      std::vector<csv_user> actual =
+            from_csv_as<csv_user, std::uint64_t, std::string, double> (file.path, options)
+        >>  to_vector
+        ;
       CPP_STREAMS__EQUAL (expected, actual);
     }
-  }
 
-// TODO: Fix to_map for VS2015 RC
-  void test__to_map ()
-  {
-#ifndef _MSC_VER
-    CPP_STREAMS__TEST ();
+    {
+      temporary_file file ("cpp_streams__from_csv.tmp", "3\t0.1\tx\n-7\t1e-300\ty\n");
 
-    using namespace cpp_streams;
+      csv_options tsv_options;
+      tsv_options.delimiter = '\t';
+      tsv_options.columns   = {1, 0};
+
+      std::vector<std::tuple<double, int>> expected {std::make_tuple (0.1, 3), std::make_tuple (1e-300, -7)};
+      std::vector<std::tuple<double, int>> actual   =
+            from_csv<double, int> (file.path, tsv_options)
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
 
-    auto apply_map = [] (auto && key_selector, auto && vs)
     {
-      using value_type        = detail::strip_type_t<decltype (vs.front ())>      ;
-      using key_selector_type = decltype (key_selector)                           ;
-      using selected_key_type = std::result_of_t<key_selector_type (value_type)>  ;
-      using key_type          = detail::strip_type_t<selected_key_type>           ;
-      using map_type          = std::map<key_type, value_type>                    ;
-      using item_type         = typename map_type::value_type                     ;
-      map_type result;
+      // float and long double are rounded once, as by strtof and strtold
+      char const * const texts[] = {"1.0000000596046448", "0.1", "16777217", "3.4028235e38", "-1e-10", "123.456"};
 
-      for (auto && v : vs)
+      std::string content;
+      std::vector<std::tuple<float, long double>> expected;
+      for (auto text : texts)
       {
-        auto key = key_selector (v);
-        result.insert (item_type (std::move (key), std::forward<decltype (v)> (v)));
+        content += text;
+        content += ',';
+        content += text;
+        content += '\n';
+        expected.push_back (std::make_tuple (std::strtof (text, nullptr), std::strtold (text, nullptr)));
       }
 
-      return result;
-    };
-
+      temporary_file file ("cpp_streams__from_csv.tmp", content);
 
-    {
-      std::map<int, int> expected           = apply_map (identity, empty_ints);
-      std::map<int, int> actual             = from (empty_ints) >> to_map (identity);
+      std::vector<std::tuple<float, long double>> actual =
+            from_csv<float, long double> (file.path)
+        >>  to_vector
+        ;
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
     {
-      std::map<int, int> expected           = apply_map (identity, some_ints);
-      std::map<int, int> actual             = from (some_ints) >> to_map (identity);
-      CPP_STREAMS__EQUAL (expected, actual);
-    }
+      temporary_file file ("cpp_streams__from_csv.tmp", "1\nx\n");
 
-    {
-      std::map<std::uint64_t, user> expected= apply_map (map_id, some_users);
-      std::map<std::uint64_t, user> actual  = from (some_users) >> to_map (map_id);
+      bool expected = true;
+      bool actual   = false;
+      try
+      {
+        from_csv<int> (file.path) >> to_vector;
+      }
+      catch (std::invalid_argument const &)
+      {
+        actual = true;
+      }
       CPP_STREAMS__EQUAL (expected, actual);
     }
-#endif
+
   }
 
-  void test__to_max ()
+  void test__from_columnar_file ()
   {
     CPP_STREAMS__TEST ();
 
     using namespace cpp_streams;
 
-    {
-      int expected  = -1;
-      int actual    = from (empty_ints) >> to_max (-1);
-      CPP_STREAMS__EQUAL (expected, actual);
-    }
+    auto const path = "cpp_streams__from_columnar_file.tmp";
+
+    auto schema = columnar_schema ()
+      .add<int>           ("id"     )
+      .add<std::int64_t>  ("sorted" )
+      .add<double>        ("score"  )
+      .add<std::string>   ("kind"   )
+      .add<std::string>   ("name"   )
+      ;
+
+    using row = std::tuple<int, std::int64_t, double, std::string, std::string>;
 
+    // Covers frame of reference (id), delta (sorted), dictionary (kind) and
+    //  plain (name) encodings over several row groups
+    std::vector<row> rows;
+    for (auto iter = 0; iter < 2500; ++iter)
     {
-      std::uint64_t expected  = 1003;
-      std::uint64_t actual    = from (some_users) >> map (map_id) >> to_max (0U);
-      CPP_STREAMS__EQUAL (expected, actual);
+      rows.push_back (row (
+          iter % 7 - 3
+        , 1000000000000LL + iter * 3LL
+        , iter * 0.25
+        , iter % 3 == 0 ? "a" : "bb"
+        , "name" + std::to_string (iter)
+        ));
     }
 
     {
-      int expected  = 9;
-      int actual    = from (some_ints) >> to_max (0);
+      temporary_file file (path, "");
+
+      std::vector<row> no_rows;
+
+      std::size_t written = from (no_rows) >> to_columnar_file (file.path, schema);
+      CPP_STREAMS__EQUAL (0_sz, written);
+
+      std::size_t expected  = 0;
+      std::size_t actual    = from_columnar_file<int> (file.path, {"id"}) >> to_length;
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
     {
-      int expected  = 10;
-      int actual    = from (some_ints) >> to_max (10);
+      temporary_file file (path, "");
+
+      std::size_t written = from (rows) >> to_columnar_file (file.path, schema, 1000);
+      CPP_STREAMS__EQUAL (rows.size (), written);
+
+      {
+        std::vector<row> expected = rows;
+        std::vector<row> actual   =
+              from_columnar_file<int, std::int64_t, double, std::string, std::string> (file.path, {"id", "sorted", "score", "kind", "name"})
+          >>  to_vector
+          ;
+        CPP_STREAMS__EQUAL (expected, actual);
+      }
+
+      {
+        std::vector<std::tuple<std::string, int>> expected =
+              from (rows)
+          >>  take (4)
+          >>  map ([] (row const & v) { return std::make_tuple (std::get<4> (v), std::get<0> (v)); })
+          >>  to_vector
+          ;
+        std::vector<std::tuple<std::string, int>> actual   =
+              from_columnar_file<text_view, int> (file.path, {"name", "id"})
+          >>  take (4)
+          >>  map ([] (std::tuple<text_view, int> const & v) { return std::make_tuple (std::get<0> (v).to_string (), std::get<1> (v)); })
+          >>  to_vector
+          ;
+        CPP_STREAMS__EQUAL (expected, actual);
+      }
+
+      {
+        // Only the second row group overlaps, rows are filtered exactly
+        auto predicate = [] (row const & v) { return std::get<1> (v) >= 1000000003300LL && std::get<1> (v) <= 1000000003600LL && std::get<2> (v) >= 287.5; };
+
+        std::vector<row> expected = from (rows) >> filter (predicate) >> to_vector;
+        std::vector<row> actual   =
+              from_columnar_file<int, std::int64_t, double, std::string, std::string> (
+                  file.path
+                , {"id", "sorted", "score", "kind", "name"}
+                , {column_between ("sorted", 1000000003300LL, 1000000003600LL), column_between ("score", 287.5, 1e9)}
+                )
+          >>  to_vector
+          ;
+        CPP_STREAMS__EQUAL (expected, actual);
+        CPP_STREAMS__EQUAL (51_sz, actual.size ());
+      }
+
+      {
+        // The row groups outside the range and the columns not requested
+        //  aren't read
+        columnar_read_statistics all_columns;
+        columnar_read_statistics one_column ;
+        columnar_read_statistics one_group  ;
+
+        from_columnar_file<int, std::int64_t, double, std::string, std::string> (
+            file.path
+          , {"id", "sorted", "score", "kind", "name"}
+          , {}
+          , &all_columns
+          ) >> to_length;
+        from_columnar_file<std::int64_t> (file.path, {"sorted"}, {}, &one_column) >> to_length;
+
+        auto source = from_columnar_file<std::int64_t> (
+            file.path
+          , {"sorted"}
+          , {column_between ("sorted", 1000000003300LL, 1000000003600LL)}
+          , &one_group
+          );
+        CPP_STREAMS__EQUAL (101_sz, source >> to_length);
+
+        CPP_STREAMS__EQUAL (std::uint64_t (3) , all_columns.row_groups);
+        CPP_STREAMS__EQUAL (std::uint64_t (0) , all_columns.row_groups_skipped);
+        CPP_STREAMS__EQUAL (std::uint64_t (15), all_columns.chunks_read);
+        CPP_STREAMS__EQUAL (std::uint64_t (3) , one_column.chunks_read);
+        CPP_STREAMS__EQUAL (true, one_column.chunk_bytes_read < all_columns.chunk_bytes_read);
+        CPP_STREAMS__EQUAL (std::uint64_t (3) , one_group.row_groups);
+        CPP_STREAMS__EQUAL (std::uint64_t (2) , one_group.row_groups_skipped);
+        CPP_STREAMS__EQUAL (std::uint64_t (1) , one_group.chunks_read);
+        CPP_STREAMS__EQUAL (true, one_group.chunk_bytes_read < one_column.chunk_bytes_read);
+
+        // Every run adds to the statistics
+        source >> to_length;
+        CPP_STREAMS__EQUAL (std::uint64_t (6) , one_group.row_groups);
+        CPP_STREAMS__EQUAL (std::uint64_t (2) , one_group.chunks_read);
+      }
+
+      {
+        // Integer columns are read as narrower types only when the values
+        //  fit, real columns only as double
+        std::vector<std::int8_t> expected = from (rows) >> map ([] (row const & v) { return static_cast<std::int8_t> (std::get<0> (v)); }) >> to_vector;
+        std::vector<std::int8_t> actual   = from_columnar_file<std::int8_t> (file.path, {"id"}) >> map ([] (std::tuple<std::int8_t> const & v) { return std::get<0> (v); }) >> to_vector;
+        CPP_STREAMS__EQUAL (expected, actual);
+
+        auto rejects = [] (auto && read)
+        {
+          try
+          {
+            read ();
+          }
+          catch (std::invalid_argument const &)
+          {
+            return true;
+          }
+          return false;
+        };
+
+        CPP_STREAMS__EQUAL (true, rejects ([&file] { return from_columnar_file<int> (file.path, {"sorted"}) >> to_length; }));
+        CPP_STREAMS__EQUAL (true, rejects ([&file] { return from_columnar_file<std::uint32_t> (file.path, {"id"}) >> to_length; }));
+        CPP_STREAMS__EQUAL (true, rejects ([&file] { return from_columnar_file<float> (file.path, {"score"}) >> to_length; }));
+      }
+
+      {
+        double expected = from (rows) >> filter ([] (row const & v) { return std::get<0> (v) == 3; }) >> map ([] (row const & v) { return std::get<2> (v); }) >> to_sum;
+        double actual   = from_columnar_file<double> (file.path, {"score"}, {column_between ("id", 3, 3)}) >> map ([] (std::tuple<double> const & v) { return std::get<0> (v); }) >> to_sum;
+        CPP_STREAMS__EQUAL (expected, actual);
+      }
+
+      {
+        bool expected = true;
+        bool actual   = false;
+        try
+        {
+          from_columnar_file<double> (file.path, {"id"}) >> to_length;
+        }
+        catch (std::invalid_argument const &)
+        {
+          actual = true;
+        }
+        CPP_STREAMS__EQUAL (expected, actual);
+      }
+    }
+
+    {
+      // Unsigned 64 bit values above 2^63 keep their order in the chunk
+      //  min/max and ranges
+      temporary_file file (path, "");
+
+      using unsigned_row = std::tuple<std::uint64_t>;
+
+      auto const high = std::uint64_t (1) << 63;
+
+      std::vector<unsigned_row> unsigned_rows;
+      for (auto iter = 0U; iter < 3000U; ++iter)
+      {
+        unsigned_rows.push_back (unsigned_row (iter < 1000U ? iter : high + iter));
+      }
+
+      from (unsigned_rows) >> to_columnar_file (file.path, columnar_schema ().add<std::uint64_t> ("id"), 1000);
+
+      auto count_between = [&file] (std::uint64_t min, std::uint64_t max)
+      {
+        return from_columnar_file<std::uint64_t> (file.path, {"id"}, {column_between ("id", min, max)}) >> to_length;
+      };
+
+      std::vector<unsigned_row> expected = unsigned_rows;
+      std::vector<unsigned_row> actual   = from_columnar_file<std::uint64_t> (file.path, {"id"}) >> to_vector;
+      CPP_STREAMS__EQUAL (expected, actual);
+
+      CPP_STREAMS__EQUAL (3000_sz , count_between (0, std::numeric_limits<std::uint64_t>::max ()));
+      CPP_STREAMS__EQUAL (2000_sz , count_between (high, std::numeric_limits<std::uint64_t>::max ()));
+      CPP_STREAMS__EQUAL (1000_sz , count_between (0, high - 1));
+      CPP_STREAMS__EQUAL (11_sz   , count_between (high + 2500, high + 2510));
+
+      // A signed range over an unsigned column
+      std::size_t signed_range = from_columnar_file<std::uint64_t> (file.path, {"id"}, {column_between ("id", -5, 9)}) >> to_length;
+      CPP_STREAMS__EQUAL (10_sz, signed_range);
+    }
+
+    {
+      temporary_file file (path, "");
+
+      bool expected = true;
+      bool actual   = false;
+      try
+      {
+        from (some_ints) >> map ([] (int v) { return std::make_tuple (v); }) >> to_columnar_file (file.path, schema);
+      }
+      catch (std::invalid_argument const &)
+      {
+        actual = true;
+      }
       CPP_STREAMS__EQUAL (expected, actual);
     }
+
   }
 
-  void test__to_min ()
+  void test__to_all ()
   {
     CPP_STREAMS__TEST ();
 
     using namespace cpp_streams;
 
     {
-      int expected  = 100;
-      int actual    = from (empty_ints) >> to_min (100);
+      bool expected = false;
+      bool actual   = from (empty_users) >> to_all (map_true);
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
     {
-      std::uint64_t expected  = 1001;
-      std::uint64_t actual    = from (some_users) >> map (map_id) >> to_min (10000U);
+      bool expected = false;
+      bool actual   = from (some_users) >> to_all (map_false);
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
     {
-      int expected  = 1;
-      int actual    = from (some_ints) >> to_min (100);
+      bool expected = true;
+      bool actual   = from (some_users) >> to_all (map_true);
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
     {
-      int expected  = 0;
-      int actual    = from (some_ints) >> to_min (0);
+      bool expected = true;
+      bool actual   = from (some_ints) >> to_all ([] (auto && v) {return v > 0;});
       CPP_STREAMS__EQUAL (expected, actual);
     }
+
   }
 
-  void test__to_set ()
+  void test__to_any ()
   {
     CPP_STREAMS__TEST ();
 
     using namespace cpp_streams;
 
-    auto apply_set = [] (auto && vs)
     {
-      using value_type = detail::strip_type_t<decltype (vs.front ())>;
-      std::set<value_type> result;
-
-      for (auto && v : vs)
-      {
-        result.insert (std::forward<decltype (v)> (v));
-      }
-
-      return result;
-    };
-
+      bool expected = false;
+      bool actual   = from (empty_users) >> to_any (map_true);
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
 
     {
-      std::set<int> expected  = apply_set (empty_ints);
-      std::set<int> actual    = from (empty_ints) >> to_set;
+      bool expected = false;
+      bool actual   = from (some_users) >> to_any (map_false);
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
     {
-      std::set<int> expected  = apply_set (some_ints);
-      std::set<int> actual    = from (some_ints) >> to_set;
+      bool expected = true;
+      bool actual   = from (some_users) >> to_any (map_true);
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
     {
-      std::set<user> expected = apply_set (some_users);
-      std::set<user> actual   = from (some_users) >> to_set;
+      bool expected = true;
+      bool actual   = from (some_ints) >> to_any ([] (auto && v) {return v > 8;});
       CPP_STREAMS__EQUAL (expected, actual);
     }
+
   }
 
-  void test__to_sum ()
+  void test__to_first_or_default ()
   {
     CPP_STREAMS__TEST ();
 
     using namespace cpp_streams;
 
     {
-      int expected  = 0;
-      int actual    = from (empty_ints) >> to_sum;
+      user expected = empty_user;
+      user actual   = from (empty_users) >> to_first_or_default;
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
     {
-      int expected  = compute_sum (some_ints, identity);
-      int actual    = from (some_ints) >> to_sum;
+      int expected  = some_ints.front ();
+      int actual    = from (some_ints) >> to_first_or_default;
       CPP_STREAMS__EQUAL (expected, actual);
     }
   }
 
-  void test__to_vector ()
+  void test__to_last_or_default ()
   {
     CPP_STREAMS__TEST ();
 
     using namespace cpp_streams;
 
     {
-      std::vector<int> expected = empty_ints;
-      std::vector<int> actual   = from (empty_ints) >> to_vector;
+      user expected   = empty_user;
+      user actual     = from (empty_users) >> to_last_or_default;
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
     {
-      std::vector<user> expected  = some_users;
-      std::vector<user> actual    = from (some_users) >> to_vector;
+      int expected    = some_ints.back ();
+      int actual      = from (some_ints) >> to_last_or_default;
       CPP_STREAMS__EQUAL (expected, actual);
     }
   }
 
-  void test__to_iter ()
+  void test__to_length ()
   {
     CPP_STREAMS__TEST ();
 
     using namespace cpp_streams;
 
     {
-      int expected  = 0;
-      int actual    = 0;
-          from (empty_ints)
-      >>  to_iter ([&actual] (int v) { actual += v; return true; })
-      ;
+      std::size_t expected  = 0;
+      std::size_t actual    = from (empty_ints) >> to_length;
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
     {
-      std::uint64_t expected  = 0;
-      std::uint64_t actual    = 0;
-          from (empty_users)
-      >>  to_iter ([&actual] (user const & v) { actual += v.id; return false; })
-      ;
+      std::size_t expected  = some_users.size ();
+      std::size_t actual    = from (some_users) >> to_length;
       CPP_STREAMS__EQUAL (expected, actual);
     }
+  }
+
+// TODO: Fix to_map for VS2015 RC
+  void test__to_map ()
+  {
+#ifndef _MSC_VER
+    CPP_STREAMS__TEST ();
+
+    using namespace cpp_streams;
 
+    auto apply_map = [] (auto && key_selector, auto && vs)
     {
-      int expected  = compute_sum (some_ints, identity);
-      int actual    = 0;
-          from (some_ints)
-      >>  to_iter ([&actual] (int v) { actual += v; return true; })
-      ;
+      using value_type        = detail::strip_type_t<decltype (vs.front ())>      ;
+      using key_selector_type = decltype (key_selector)                           ;
+      using selected_key_type = std::result_of_t<key_selector_type (value_type)>  ;
+      using key_type          = detail::strip_type_t<selected_key_type>           ;
+      using map_type          = std::map<key_type, value_type>                    ;
+      using item_type         = typename map_type::value_type                     ;
+      map_type result;
+
+      for (auto && v : vs)
+      {
+        auto key = key_selector (v);
+        result.insert (item_type (std::move (key), std::forward<decltype (v)> (v)));
+      }
+
+      return result;
+    };
+
+
+    {
+      std::map<int, int> expected           = apply_map (identity, empty_ints);
+      std::map<int, int> actual             = from (empty_ints) >> to_map (identity);
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
     {
-      std::uint64_t expected  = some_users.front ().id;
-      std::uint64_t actual    = 0;
-          from (some_users)
-      >>  to_iter ([&actual] (user const & v) { actual += v.id; return false; })
-      ;
+      std::map<int, int> expected           = apply_map (identity, some_ints);
+      std::map<int, int> actual             = from (some_ints) >> to_map (identity);
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
+    {
+      std::map<std::uint64_t, user> expected= apply_map (map_id, some_users);
+      std::map<std::uint64_t, user> actual  = from (some_users) >> to_map (map_id);
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+#endif
   }
 
-  void test__to_fold ()
+  void test__to_max ()
   {
     CPP_STREAMS__TEST ();
 
     using namespace cpp_streams;
 
-    auto fold_int   = [] (int s, int v) { return s + v; };
-    auto fold_user  = [] (std::uint64_t s, user const & v) { return s + v.id; };
-
     {
-      int expected  = 0;
-      int actual    =
-            from (empty_ints)
-        >>  to_fold (0, fold_int)
-      ;
+      int expected  = -1;
+      int actual    = from (empty_ints) >> to_max (-1);
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
     {
-      int expected  = compute_sum (some_ints, identity);
-      int actual    =
-            from (some_ints)
-        >>  to_fold (0, fold_int)
-      ;
+      std::uint64_t expected  = 1003;
+      std::uint64_t actual    = from (some_users) >> map (map_id) >> to_max (0U);
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
     {
-      std::uint64_t expected  = compute_sum (some_users, map_id);
-      std::uint64_t actual    =
-            from (some_users)
-        >>  to_fold (0ULL, fold_user)
-      ;
+      int expected  = 9;
+      int actual    = from (some_ints) >> to_max (0);
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
+    {
+      int expected  = 10;
+      int actual    = from (some_ints) >> to_max (10);
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
   }
 
-  void test__append ()
+  void test__to_min ()
   {
     CPP_STREAMS__TEST ();
 
     using namespace cpp_streams;
 
     {
-      std::vector<int> expected {};
-      std::vector<int> actual   =
-            from (empty_ints)
-        >>  append (from (empty_ints))
-        >>  to_vector
-        ;
+      int expected  = 100;
+      int actual    = from (empty_ints) >> to_min (100);
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
     {
-      std::vector<user> expected = some_users;
-      std::vector<user> actual   =
-            from (some_users)
-        >>  append (from (empty_users))
-        >>  to_vector
-        ;
+      std::uint64_t expected  = 1001;
+      std::uint64_t actual    = from (some_users) >> map (map_id) >> to_min (10000U);
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
     {
-      std::vector<int> expected = some_ints;
-      std::vector<int> actual   =
-            from (empty_ints)
-        >>  append (from (some_ints))
-        >>  to_vector
-        ;
-      CPP_STREAMS__EQUAL (expected, actual);
+      int expected  = 1;
+      int actual    = from (some_ints) >> to_min (100);
+      CPP_STREAMS__EQUAL (expected, actual);
     }
 
     {
-      auto double_users = some_users;
-      double_users.reserve (double_users.size () * 2);
-      std::copy (
-          some_users.begin ()
-        , some_users.end ()
-        , std::back_inserter (double_users)
-        );
-      std::vector<user> expected = double_users;
-      std::vector<user> actual   =
-            from (some_users)
-        >>  append (from (some_users))
-        >>  to_vector
-        ;
+      int expected  = 0;
+      int actual    = from (some_ints) >> to_min (0);
       CPP_STREAMS__EQUAL (expected, actual);
     }
-
   }
 
-  void test__collect ()
+  void test__to_set ()
   {
     CPP_STREAMS__TEST ();
 
     using namespace cpp_streams;
 
-    auto collect_simple   = [] (user const & u) { return from (u.lottery_numbers); };
-    auto collect_advanced = [] (user const & u) { return from (u.lottery_numbers) >> map (map_tostring); };
+    auto apply_set = [] (auto && vs)
+    {
+      using value_type = detail::strip_type_t<decltype (vs.front ())>;
+      std::set<value_type> result;
+
+      for (auto && v : vs)
+      {
+        result.insert (std::forward<decltype (v)> (v));
+      }
+
+      return result;
+    };
+
 
     {
-      std::vector<int>  expected  {};
-      std::vector<int>  actual    =
-            from (empty_users)
-        >>  collect (collect_simple)
-        >>  to_vector
-        ;
+      std::set<int> expected  = apply_set (empty_ints);
+      std::set<int> actual    = from (empty_ints) >> to_set;
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
     {
-      std::vector<int>  expected  = some_users[0].lottery_numbers;
-      std::vector<int>  actual    =
-            from_singleton (some_users[0])
-        >>  collect (collect_simple)
-        >>  to_vector
-        ;
+      std::set<int> expected  = apply_set (some_ints);
+      std::set<int> actual    = from (some_ints) >> to_set;
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
     {
-      std::vector<std::string>  expected  =
-            from (some_users[0].lottery_numbers)
-        >>  map (map_tostring)
-        >> to_vector
-        ;
-      std::vector<std::string>  actual    =
-            from_singleton (some_users[0])
-        >>  collect (collect_advanced)
-        >>  to_vector
-        ;
+      std::set<user> expected = apply_set (some_users);
+      std::set<user> actual   = from (some_users) >> to_set;
       CPP_STREAMS__EQUAL (expected, actual);
     }
+  }
 
-    // These tests fails in VS2015 RC
-#ifndef _MSC_VER
-    auto apply_collect = [] (auto && collect, auto && vs)
-    {
-      using source_type = detail::strip_type_t<decltype (collect (vs.front ()))>;
-      using value_type  = detail::strip_type_t<typename source_type::value_type>;
-      std::vector<value_type> result;
-      for (auto && v : vs)
-      {
-            collect (std::forward<decltype(v)> (v))
-        >>  to_iter ([&] (auto && iv)
-            {
-              result.push_back (std::forward<decltype(iv)> (iv));
-              return true;
-            })
-        ;
-      }
-      return result;
-    };
+  void test__to_sum ()
+  {
+    CPP_STREAMS__TEST ();
+
+    using namespace cpp_streams;
 
     {
-      std::vector<int>  expected  = apply_collect (collect_simple, some_users);
-      std::vector<int>  actual    =
-            from (some_users)
-        >>  collect (collect_simple)
-        >>  to_vector
-        ;
+      int expected  = 0;
+      int actual    = from (empty_ints) >> to_sum;
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
     {
-      std::vector<std::string>  expected  = apply_collect (collect_advanced, some_users);
-      std::vector<std::string>  actual    =
-            from (some_users)
-        >>  collect (collect_advanced)
-        >>  to_vector
-        ;
+      int expected  = compute_sum (some_ints, identity);
+      int actual    = from (some_ints) >> to_sum;
       CPP_STREAMS__EQUAL (expected, actual);
     }
-#endif
-
   }
 
-  void test__filter ()
+  void test__to_vector ()
   {
     CPP_STREAMS__TEST ();
 
     using namespace cpp_streams;
 
-    auto filter_int   = [] (int v) { return v % 2 == 0; };
-    auto filter_user  = [] (user const & v) { return v.last_name == "Gates"; };
-
-    auto apply_filter = [] (auto && filter, auto && vs)
     {
-      using value_type = detail::strip_type_t<decltype (vs.front ())>;
-      std::vector<value_type> result;
-      result.reserve (vs.size ());
-      std::copy_if (
-          vs.begin ()
-        , vs.end ()
-        , std::back_inserter (result)
-        , filter
-        );
-      return result;
-    };
+      std::vector<int> expected = empty_ints;
+      std::vector<int> actual   = from (empty_ints) >> to_vector;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
 
     {
-      std::vector<int> expected {};
-      std::vector<int> actual   =
-            from (empty_ints)
-        >>  filter (filter_int)
-        >>  to_vector
-        ;
+      std::vector<user> expected  = some_users;
+      std::vector<user> actual    = from (some_users) >> to_vector;
       CPP_STREAMS__EQUAL (expected, actual);
     }
+  }
+
+  void test__to_vector_into ()
+  {
+    CPP_STREAMS__TEST ();
+
+    using namespace cpp_streams;
 
     {
-      std::vector<int> expected = apply_filter (filter_int, some_ints);
-      std::vector<int> actual   =
-            from (some_ints)
-        >>  filter (filter_int)
-        >>  to_vector
-        ;
+      std::vector<int> expected = some_ints;
+      std::vector<int> actual {1, 2, 3};
+      auto & result = from (some_ints) >> to_vector_into (actual);
       CPP_STREAMS__EQUAL (expected, actual);
+      CPP_STREAMS__EQUAL (&actual, &result);
     }
 
     {
-      std::vector<user> expected  = apply_filter (filter_user, some_users);
-      std::vector<user> actual    =
-            from (some_users)
-        >>  filter (filter_user)
-        >>  to_vector
-        ;
+      std::vector<int> expected = empty_ints;
+      std::vector<int> actual {1, 2, 3};
+      from (empty_ints) >> to_vector_into (actual);
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
+    {
+      // The capacity is kept between runs
+      std::vector<user> expected = some_users;
+      std::vector<user> actual;
+      from (some_users) >> to_vector_into (actual);
+      auto const data = actual.data ();
+      from (some_users) >> to_vector_into (actual);
+      CPP_STREAMS__EQUAL (expected, actual);
+      CPP_STREAMS__EQUAL (data, actual.data ());
+    }
   }
 
-  void test__map ()
+  void test__using_allocator ()
   {
+#ifndef _MSC_VER
     CPP_STREAMS__TEST ();
 
     using namespace cpp_streams;
 
-    auto map_int   = map_tostring ;
-    auto map_user  = map_id       ;
+    auto sorter_int = [] (int l, int r) { return l < r; };
 
-    auto apply_map = [] (auto && map, auto && vs)
-    {
-      using value_type = detail::strip_type_t<decltype (map (vs.front ()))>;
-      std::vector<value_type> result;
-      result.reserve (vs.size ());
-      std::transform (
-          vs.begin ()
-        , vs.end ()
-        , std::back_inserter (result)
-        , map
-        );
-      return result;
-    };
+    std::vector<int> sorted   = some_ints;
+    std::sort (sorted.begin (), sorted.end (), sorter_int);
+    std::vector<int> reversed (some_ints.rbegin (), some_ints.rend ());
 
     {
-      std::vector<std::string> expected {};
-      std::vector<std::string> actual   =
-            from (empty_ints)
-        >>  map (map_int)
-        >>  to_vector
+      std::vector<int> expected = sorted;
+      std::vector<int> actual   =
+            from (some_ints)
+        >>  sort_using (sorter_int, std::allocator<int> ())
+        >>  to_vector_using (std::allocator<int> ())
         ;
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
     {
-      std::vector<std::string> expected = apply_map (map_int, some_ints);
-      std::vector<std::string> actual   =
+      monotonic_arena arena;
+
+      auto actual =
             from (some_ints)
-        >>  map (map_int)
-        >>  to_vector
+        >>  reverse_using (arena_allocator<int> (arena))
+        >>  to_vector_using (arena_allocator<int> (arena))
         ;
-      CPP_STREAMS__EQUAL (expected, actual);
+      CPP_STREAMS__EQUAL (reversed, std::vector<int> (actual.begin (), actual.end ()));
+      CPP_STREAMS__EQUAL (true, arena.allocated_bytes () > 0U);
     }
 
     {
-      std::vector<std::uint64_t> expected = apply_map (map_user, some_users);
-      std::vector<std::uint64_t> actual   =
-            from (some_users)
-        >>  map (map_user)
-        >>  to_vector
+      monotonic_arena arena;
+
+      auto set =
+            from (some_ints)
+        >>  sort_by_using ([] (int v) { return -v; }, arena_allocator<int> (arena))
+        >>  to_set_using (arena_allocator<int> (arena))
         ;
-      CPP_STREAMS__EQUAL (expected, actual);
+      std::set<int> expected (some_ints.begin (), some_ints.end ());
+      CPP_STREAMS__EQUAL (expected, std::set<int> (set.begin (), set.end ()));
+
+      auto map = from (some_users) >> to_map_using ([] (user const & u) { return u.id; }, arena_allocator<char> (arena));
+      CPP_STREAMS__EQUAL (some_users.size (), map.size ());
+      CPP_STREAMS__EQUAL (some_users.front ().first_name, map[some_users.front ().id].first_name);
     }
 
+    {
+      // A pipeline run within an initial buffer doesn't allocate blocks
+      alignas (std::max_align_t) char buffer[4096];
+      monotonic_arena arena (buffer, sizeof buffer);
+
+      auto actual =
+            from (some_ints)
+        >>  sort_using (sorter_int, arena_allocator<int> (arena))
+        >>  to_vector_using (arena_allocator<int> (arena))
+        ;
+      CPP_STREAMS__EQUAL (sorted, std::vector<int> (actual.begin (), actual.end ()));
+
+      auto const data = reinterpret_cast<char const *> (actual.data ());
+      CPP_STREAMS__EQUAL (true, data >= buffer && data < buffer + sizeof buffer);
+
+      // Large allocations continue in blocks, release starts over
+      auto const large = arena.allocate (3 * sizeof buffer, alignof (std::max_align_t));
+      CPP_STREAMS__EQUAL (true, large != nullptr);
+      arena.release ();
+      CPP_STREAMS__EQUAL (0U, arena.allocated_bytes ());
+      CPP_STREAMS__EQUAL (static_cast<void *> (buffer), arena.allocate (1, 1));
+    }
+#endif
   }
 
-  void test__mapi ()
+  void test__to_file ()
   {
     CPP_STREAMS__TEST ();
 
     using namespace cpp_streams;
 
-    auto mapi_int   = [] (std::size_t idx, int v)
-    {
-      return std::make_tuple (idx, std::to_string (v));
-    };
-    auto mapi_user  = [] (std::size_t idx, user const & v)
+    auto const path = "cpp_streams__to_file.tmp";
+
     {
-      return std::make_tuple (idx, v.id);
-    };
+      temporary_file file (path, "");
+
+      std::string expected  {};
+      std::size_t written   = from (empty_ints) >> to_file (file.path, format_line);
+      std::string actual    = read_file (file.path);
+      CPP_STREAMS__EQUAL (expected, actual);
+      CPP_STREAMS__EQUAL (0_sz, written);
+    }
 
-    auto apply_mapi = [] (auto && mapi, auto && vs)
     {
-      using value_type = detail::strip_type_t<decltype (mapi (0U, vs.front ()))>;
-      std::vector<value_type> result;
-      result.reserve (vs.size ());
-      std::size_t idx = 0;
-      for (auto && v : vs)
+      temporary_file file (path, "");
+
+      auto format_user = [] (output_buffer & out, user const & v)
       {
-        result.push_back (mapi (idx++, std::forward<decltype(v)> (v)));
-      }
-      return result;
-    };
+        out << v.id << ',' << v.first_name << ',' << v.last_name << '\n';
+      };
 
-    {
-      std::vector<std::tuple<std::size_t, std::string>> expected {};
-      std::vector<std::tuple<std::size_t, std::string>> actual   =
-            from (empty_ints)
-        >>  mapi (mapi_int)
-        >>  to_vector
-        ;
+      std::string expected  = "1001,Bill,Gates\n1002,Melinda,Gates\n1003,Steve,Jobs\n";
+      std::size_t written   = from (some_users) >> to_file (file.path, format_user);
+      std::string actual    = read_file (file.path);
       CPP_STREAMS__EQUAL (expected, actual);
+      CPP_STREAMS__EQUAL (expected.size (), written);
     }
 
     {
-      std::vector<std::tuple<std::size_t, std::string>> expected = apply_mapi (mapi_int, some_ints);
-      std::vector<std::tuple<std::size_t, std::string>> actual   =
-            from (some_ints)
-        >>  mapi (mapi_int)
-        >>  to_vector
-        ;
+      temporary_file file (path, "");
+
+      // A tiny buffer forces many flushes, direct and sync exercise the
+      //  unbuffered path (or its fallback where O_DIRECT isn't supported)
+      file_sink_options options;
+      options.buffer_size = 8;
+      options.direct      = true;
+      options.sync        = true;
+
+      std::string expected;
+      for (auto iter = 0; iter < 3000; ++iter)
+      {
+        expected += std::to_string (iter);
+        expected += '\n';
+      }
+      std::size_t written   = from_range (0, 3000) >> to_file (file.path, format_line, options);
+      std::string actual    = read_file (file.path);
       CPP_STREAMS__EQUAL (expected, actual);
+      CPP_STREAMS__EQUAL (expected.size (), written);
     }
 
     {
-      std::vector<std::tuple<std::size_t, std::uint64_t>> expected = apply_mapi (mapi_user, some_users);
-      std::vector<std::tuple<std::size_t, std::uint64_t>> actual   =
-            from (some_users)
-        >>  mapi (mapi_user)
-        >>  to_vector
-        ;
+      temporary_file file (path, "");
+
+      std::vector<double> expected  {0.0, -1.5, 1e300, 0.1};
+      from (expected) >> to_file (file.path, format_binary);
+      auto const content = read_file (file.path);
+      std::vector<double> actual (content.size () / sizeof (double));
+      std::memcpy (actual.data (), content.data (), actual.size () * sizeof (double));
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
   }
 
-// TODO: Fix reverse for VS2015 RC
-  void test__reverse ()
+  void test__to_ostream ()
   {
-#ifndef _MSC_VER
     CPP_STREAMS__TEST ();
 
     using namespace cpp_streams;
 
-    auto apply_reverse = [] (auto && vs)
     {
-      using value_type = detail::strip_type_t<decltype (vs.front ())>;
-      std::vector<value_type> result;
-      result.reserve (vs.size ());
-      std::reverse_copy (
-          vs.begin ()
-        , vs.end ()
-        , std::back_inserter (result)
-        );
-      return result;
-    };
+      std::ostringstream stream;
 
-    {
-      std::vector<int> expected {};
-      std::vector<int> actual   =
-            from (empty_ints)
-        >>  reverse
-        >>  to_vector
-        ;
+      std::string expected  {};
+      std::size_t written   = from (empty_ints) >> to_ostream (stream, format_line);
+      std::string actual    = stream.str ();
       CPP_STREAMS__EQUAL (expected, actual);
+      CPP_STREAMS__EQUAL (0_sz, written);
     }
 
     {
-      std::vector<int> expected = apply_reverse (some_ints);
-      std::vector<int> actual   =
-            from (some_ints)
-        >>  reverse
-        >>  to_vector
-        ;
+      std::ostringstream stream;
+
+      auto format_values = [] (output_buffer & out, int v)
+      {
+        out << v << ' ' << -v << ' ' << v * 0.5 << ' ' << static_cast<float> (v) / 3 << ' ' << std::string ("s") << '\n';
+      };
+
+      std::string expected  = "3 -3 1.5 1 s\n0 0 0 0 s\n-7 7 -3.5 -2.33333325 s\n";
+      std::vector<int> ints {3, 0, -7};
+      std::size_t written   = from (ints) >> to_ostream (stream, format_values, 4);
+      std::string actual    = stream.str ();
       CPP_STREAMS__EQUAL (expected, actual);
+      CPP_STREAMS__EQUAL (expected.size (), written);
     }
 
     {
-      std::vector<user> expected = apply_reverse (some_users);
-      std::vector<user> actual   =
-            from (some_users)
-        >>  reverse
-        >>  to_vector
-        ;
+      std::ostringstream stream;
+
+      auto format_values = [] (output_buffer & out, auto && v)
+      {
+        out << v << ' ';
+      };
+
+      std::string expected  = "-9223372036854775808 18446744073709551615 0.1 1e+300 0.30000000000000004 ";
+      auto const values = std::make_tuple (
+          std::numeric_limits<long long>::min ()
+        , std::numeric_limits<unsigned long long>::max ()
+        , 0.1
+        , 1e300
+        , 0.1 + 0.2
+        );
+      from_singleton (std::get<0> (values)) >> to_ostream (stream, format_values);
+      from_singleton (std::get<1> (values)) >> to_ostream (stream, format_values);
+      from_singleton (std::get<2> (values)) >> to_ostream (stream, format_values);
+      from_singleton (std::get<3> (values)) >> to_ostream (stream, format_values);
+      from_singleton (std::get<4> (values)) >> to_ostream (stream, format_values);
+      std::string actual    = stream.str ();
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
-#endif
+    {
+      // A bad stream is reported rather than counted as written
+      std::ostringstream stream;
+      stream.setstate (std::ios_base::badbit);
+
+      auto thrown = false;
+      try
+      {
+        from (some_ints) >> to_ostream (stream, format_line);
+      }
+      catch (std::system_error const &)
+      {
+        thrown = true;
+      }
+      CPP_STREAMS__EQUAL (true, thrown);
+    }
+
+    {
+      // A stream failing part way through the output
+      struct failing_buffer : std::streambuf
+      {
+        int_type overflow (int_type) override
+        {
+          return traits_type::eof ();
+        }
+      };
+
+      failing_buffer  buffer;
+      std::ostream    stream (&buffer);
+
+      auto thrown = false;
+      try
+      {
+        from (some_ints) >> to_ostream (stream, format_line, 4);
+      }
+      catch (std::system_error const &)
+      {
+        thrown = true;
+      }
+      CPP_STREAMS__EQUAL (true, thrown);
+      CPP_STREAMS__EQUAL (true, stream.bad ());
+    }
+
   }
 
-  void test__skip ()
+  void test__to_iter ()
   {
     CPP_STREAMS__TEST ();
 
     using namespace cpp_streams;
 
     {
-      std::vector<int>  expected = {};
-      std::vector<int>  actual   =
-            from (some_ints)
-        >>  skip (10000)
-        >>  to_vector
-        ;
+      int expected  = 0;
+      int actual    = 0;
+          from (empty_ints)
+      >>  to_iter ([&actual] (int v) { actual += v; return true; })
+      ;
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
     {
-      std::vector<int>  expected {};
-      std::vector<int>  actual   =
-            from (empty_ints)
-        >>  skip (0)
-        >>  to_vector
-        ;
+      std::uint64_t expected  = 0;
+      std::uint64_t actual    = 0;
+          from (empty_users)
+      >>  to_iter ([&actual] (user const & v) { actual += v.id; return false; })
+      ;
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
     {
-      std::vector<user> expected = some_users;
-      std::vector<user> actual   =
-            from (some_users)
-        >>  skip (0)
-        >>  to_vector
-        ;
+      int expected  = compute_sum (some_ints, identity);
+      int actual    = 0;
+          from (some_ints)
+      >>  to_iter ([&actual] (int v) { actual += v; return true; })
+      ;
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
     {
-      std::vector<int>  expected = {9, 2, 6, 5, 3, 5, 8, 9, 7, 9};
-      std::vector<int>  actual   =
-            from (some_ints)
-        >>  skip (5)
-        >>  to_vector
-        ;
+      std::uint64_t expected  = some_users.front ().id;
+      std::uint64_t actual    = 0;
+          from (some_users)
+      >>  to_iter ([&actual] (user const & v) { actual += v.id; return false; })
+      ;
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
   }
 
-  void test__skip_while ()
+  void test__to_fold ()
   {
     CPP_STREAMS__TEST ();
 
     using namespace cpp_streams;
 
+    auto fold_int   = [] (int s, int v) { return s + v; };
+    auto fold_user  = [] (std::uint64_t s, user const & v) { return s + v.id; };
+
     {
-      std::vector<int>  expected = {};
-      std::vector<int>  actual   =
+      int expected  = 0;
+      int actual    =
+            from (empty_ints)
+        >>  to_fold (0, fold_int)
+      ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+    {
+      int expected  = compute_sum (some_ints, identity);
+      int actual    =
             from (some_ints)
-        >>  skip_while (map_true)
-        >>  to_vector
-        ;
+        >>  to_fold (0, fold_int)
+      ;
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
     {
-      std::vector<int>  expected {};
-      std::vector<int>  actual   =
+      std::uint64_t expected  = compute_sum (some_users, map_id);
+      std::uint64_t actual    =
+            from (some_users)
+        >>  to_fold (0ULL, fold_user)
+      ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+  }
+
+  void test__append ()
+  {
+    CPP_STREAMS__TEST ();
+
+    using namespace cpp_streams;
+
+    {
+      std::vector<int> expected {};
+      std::vector<int> actual   =
             from (empty_ints)
-        >>  skip_while ([] (auto &&) { return false; })
+        >>  append (from (empty_ints))
         >>  to_vector
         ;
       CPP_STREAMS__EQUAL (expected, actual);
@@ -1276,17 +1797,34 @@ namespace functional_tests
       std::vector<user> expected = some_users;
       std::vector<user> actual   =
             from (some_users)
-        >>  skip_while ([] (auto &&) { return false; })
+        >>  append (from (empty_users))
         >>  to_vector
         ;
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
     {
-      std::vector<int>  expected = {9, 2, 6, 5, 3, 5, 8, 9, 7, 9};
-      std::vector<int>  actual   =
-            from (some_ints)
-        >>  skip_while ([] (auto && v) { return v < 9; })
+      std::vector<int> expected = some_ints;
+      std::vector<int> actual   =
+            from (empty_ints)
+        >>  append (from (some_ints))
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+    {
+      auto double_users = some_users;
+      double_users.reserve (double_users.size () * 2);
+      std::copy (
+          some_users.begin ()
+        , some_users.end ()
+        , std::back_inserter (double_users)
+        );
+      std::vector<user> expected = double_users;
+      std::vector<user> actual   =
+            from (some_users)
+        >>  append (from (some_users))
         >>  to_vector
         ;
       CPP_STREAMS__EQUAL (expected, actual);
@@ -1294,237 +1832,1812 @@ namespace functional_tests
 
   }
 
-// TODO: Fix sort for VS2015 RC
-  void test__sort ()
+  void test__collect ()
   {
-#ifndef _MSC_VER
     CPP_STREAMS__TEST ();
 
     using namespace cpp_streams;
 
-    auto apply_sort = [] (auto && sorter, auto && vs)
-    {
-      using value_type = detail::strip_type_t<decltype (vs.front ())>;
-      std::vector<value_type> result = std::forward<decltype (vs)> (vs);
-      std::sort (
-          result.begin ()
-        , result.end ()
-        , sorter
-        );
-      return result;
-    };
-
-    auto sorter_int   = [] (auto && l, auto && r) { return l < r; };
-    auto sorter_user  = [] (user const & l, user const & r) { return l.id < r.id; };
+    auto collect_simple   = [] (user const & u) { return from (u.lottery_numbers); };
+    auto collect_advanced = [] (user const & u) { return from (u.lottery_numbers) >> map (map_tostring); };
 
     {
-      std::vector<int> expected {};
-      std::vector<int> actual   =
-            from (empty_ints)
-        >>  sort (sorter_int)
+      std::vector<int>  expected  {};
+      std::vector<int>  actual    =
+            from (empty_users)
+        >>  collect (collect_simple)
         >>  to_vector
         ;
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
     {
-      std::vector<int> expected = apply_sort (sorter_int, some_ints);
-      std::vector<int> actual   =
-            from (some_ints)
-        >>  sort (sorter_int)
+      std::vector<int>  expected  = some_users[0].lottery_numbers;
+      std::vector<int>  actual    =
+            from_singleton (some_users[0])
+        >>  collect (collect_simple)
         >>  to_vector
         ;
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
     {
-      std::vector<user> expected = apply_sort (sorter_user, some_users);
-      std::vector<user> actual   =
-            from (some_users)
-        >>  sort (sorter_user)
+      std::vector<std::string>  expected  =
+            from (some_users[0].lottery_numbers)
+        >>  map (map_tostring)
+        >> to_vector
+        ;
+      std::vector<std::string>  actual    =
+            from_singleton (some_users[0])
+        >>  collect (collect_advanced)
         >>  to_vector
         ;
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
+    // These tests fails in VS2015 RC
+#ifndef _MSC_VER
+    auto apply_collect = [] (auto && collect, auto && vs)
+    {
+      using source_type = detail::strip_type_t<decltype (collect (vs.front ()))>;
+      using value_type  = detail::strip_type_t<typename source_type::value_type>;
+      std::vector<value_type> result;
+      for (auto && v : vs)
+      {
+            collect (std::forward<decltype(v)> (v))
+        >>  to_iter ([&] (auto && iv)
+            {
+              result.push_back (std::forward<decltype(iv)> (iv));
+              return true;
+            })
+        ;
+      }
+      return result;
+    };
+
+    {
+      std::vector<int>  expected  = apply_collect (collect_simple, some_users);
+      std::vector<int>  actual    =
+            from (some_users)
+        >>  collect (collect_simple)
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+    {
+      std::vector<std::string>  expected  = apply_collect (collect_advanced, some_users);
+      std::vector<std::string>  actual    =
+            from (some_users)
+        >>  collect (collect_advanced)
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+#endif
+
+  }
+
+  void test__filter ()
+  {
+    CPP_STREAMS__TEST ();
+
+    using namespace cpp_streams;
+
+    auto filter_int   = [] (int v) { return v % 2 == 0; };
+    auto filter_user  = [] (user const & v) { return v.last_name == "Gates"; };
+
+    auto apply_filter = [] (auto && filter, auto && vs)
+    {
+      using value_type = detail::strip_type_t<decltype (vs.front ())>;
+      std::vector<value_type> result;
+      result.reserve (vs.size ());
+      std::copy_if (
+          vs.begin ()
+        , vs.end ()
+        , std::back_inserter (result)
+        , filter
+        );
+      return result;
+    };
+
+    {
+      std::vector<int> expected {};
+      std::vector<int> actual   =
+            from (empty_ints)
+        >>  filter (filter_int)
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+    {
+      std::vector<int> expected = apply_filter (filter_int, some_ints);
+      std::vector<int> actual   =
+            from (some_ints)
+        >>  filter (filter_int)
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+    {
+      std::vector<user> expected  = apply_filter (filter_user, some_users);
+      std::vector<user> actual    =
+            from (some_users)
+        >>  filter (filter_user)
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+  }
+
+  void test__map ()
+  {
+    CPP_STREAMS__TEST ();
+
+    using namespace cpp_streams;
+
+    auto map_int   = map_tostring ;
+    auto map_user  = map_id       ;
+
+    auto apply_map = [] (auto && map, auto && vs)
+    {
+      using value_type = detail::strip_type_t<decltype (map (vs.front ()))>;
+      std::vector<value_type> result;
+      result.reserve (vs.size ());
+      std::transform (
+          vs.begin ()
+        , vs.end ()
+        , std::back_inserter (result)
+        , map
+        );
+      return result;
+    };
+
+    {
+      std::vector<std::string> expected {};
+      std::vector<std::string> actual   =
+            from (empty_ints)
+        >>  map (map_int)
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+    {
+      std::vector<std::string> expected = apply_map (map_int, some_ints);
+      std::vector<std::string> actual   =
+            from (some_ints)
+        >>  map (map_int)
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+    {
+      std::vector<std::uint64_t> expected = apply_map (map_user, some_users);
+      std::vector<std::uint64_t> actual   =
+            from (some_users)
+        >>  map (map_user)
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+  }
+
+  void test__mapi ()
+  {
+    CPP_STREAMS__TEST ();
+
+    using namespace cpp_streams;
+
+    auto mapi_int   = [] (std::size_t idx, int v)
+    {
+      return std::make_tuple (idx, std::to_string (v));
+    };
+    auto mapi_user  = [] (std::size_t idx, user const & v)
+    {
+      return std::make_tuple (idx, v.id);
+    };
+
+    auto apply_mapi = [] (auto && mapi, auto && vs)
+    {
+      using value_type = detail::strip_type_t<decltype (mapi (0U, vs.front ()))>;
+      std::vector<value_type> result;
+      result.reserve (vs.size ());
+      std::size_t idx = 0;
+      for (auto && v : vs)
+      {
+        result.push_back (mapi (idx++, std::forward<decltype(v)> (v)));
+      }
+      return result;
+    };
+
+    {
+      std::vector<std::tuple<std::size_t, std::string>> expected {};
+      std::vector<std::tuple<std::size_t, std::string>> actual   =
+            from (empty_ints)
+        >>  mapi (mapi_int)
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+    {
+      std::vector<std::tuple<std::size_t, std::string>> expected = apply_mapi (mapi_int, some_ints);
+      std::vector<std::tuple<std::size_t, std::string>> actual   =
+            from (some_ints)
+        >>  mapi (mapi_int)
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+    {
+      std::vector<std::tuple<std::size_t, std::uint64_t>> expected = apply_mapi (mapi_user, some_users);
+      std::vector<std::tuple<std::size_t, std::uint64_t>> actual   =
+            from (some_users)
+        >>  mapi (mapi_user)
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+  }
+
+// TODO: Fix reverse for VS2015 RC
+  void test__probe ()
+  {
+    CPP_STREAMS__TEST ();
+
+    using namespace cpp_streams;
+
+    auto filter_int = [] (int v) { return v % 2 == 0; };
+
+#ifdef CPP_STREAMS__INSTRUMENT
+    reset_instrumentation ();
+#endif
+
+    {
+      std::vector<int> expected {};
+      std::vector<int> actual   =
+            from (empty_ints)
+        >>  probe ("test__probe.empty")
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+    {
+      std::vector<int> expected {4, 2};
+      std::vector<int> actual   =
+            from (some_ints)
+        >>  probe ("test__probe.source")
+        >>  filter (filter_int)
+        >>  probe ("test__probe.filtered")
+        >>  take (2)
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+#ifdef CPP_STREAMS__INSTRUMENT
+    {
+      auto const stages = instrumentation_snapshot ();
+      auto find_stage   = [&stages] (std::string const & name)
+      {
+        auto const found = std::find_if (
+            stages.begin ()
+          , stages.end ()
+          , [&name] (stage_statistics const & s) { return s.name == name; }
+          );
+        return found != stages.end () ? *found : stage_statistics ();
+      };
+
+      // The third even element (6) is the eighth element, take stops on it
+      auto const empty    = find_stage ("test__probe.empty");
+      auto const source   = find_stage ("test__probe.source");
+      auto const filtered = find_stage ("test__probe.filtered");
+      auto const filter   = find_stage ("filter");
+      auto const take     = find_stage ("take");
+
+      CPP_STREAMS__EQUAL (std::uint64_t (1), empty.runs);
+      CPP_STREAMS__EQUAL (std::uint64_t (0), empty.elements_in);
+      CPP_STREAMS__EQUAL (std::uint64_t (1), source.runs);
+      CPP_STREAMS__EQUAL (std::uint64_t (8), source.elements_in);
+      CPP_STREAMS__EQUAL (std::uint64_t (8), source.elements_out);
+      CPP_STREAMS__EQUAL (std::uint64_t (1), source.stops);
+      CPP_STREAMS__EQUAL (std::uint64_t (8), filter.elements_in);
+      CPP_STREAMS__EQUAL (std::uint64_t (3), filter.elements_out);
+      CPP_STREAMS__EQUAL (0.375, filter.selectivity ());
+      CPP_STREAMS__EQUAL (std::uint64_t (1), filter.stops);
+      CPP_STREAMS__EQUAL (std::uint64_t (3), filtered.elements_out);
+      CPP_STREAMS__EQUAL (std::uint64_t (1), filtered.stops);
+      CPP_STREAMS__EQUAL (std::uint64_t (3), take.elements_in);
+      CPP_STREAMS__EQUAL (std::uint64_t (2), take.elements_out);
+      CPP_STREAMS__EQUAL (std::uint64_t (0), take.stops);
+
+      std::ostringstream json;
+      write_instrumentation_json (json);
+      CPP_STREAMS__EQUAL (true, json.str ().find ("\"name\": \"test__probe.filtered\", \"runs\": 1, \"elements_in\": 3") != std::string::npos);
+
+      std::ostringstream csv;
+      write_instrumentation_csv (csv);
+      CPP_STREAMS__EQUAL (true, csv.str ().find ("\n\"filter\",1,8,3,0.375,1,") != std::string::npos);
+    }
+
+    {
+      // Every stage of a pipeline has an entry of its own, running the
+      //  pipeline again adds to the same entries
+      reset_instrumentation ();
+
+      auto run = []
+      {
+        return
+              from (some_ints)
+          >>  filter ([] (int v) { return v > 1; })
+          >>  map ([] (int v) { return v * 3; })
+          >>  filter ([] (int v) { return v % 2 == 0; })
+          >>  to_vector
+          ;
+      };
+
+      CPP_STREAMS__EQUAL ((std::vector<int> {12, 6, 18, 24}), run ());
+      run ();
+
+      std::vector<stage_statistics> filters;
+      for (auto && s : instrumentation_snapshot ())
+      {
+        if (s.name == "filter")
+        {
+          filters.push_back (s);
+        }
+      }
+
+      CPP_STREAMS__EQUAL (std::size_t (2), filters.size ());
+      if (filters.size () == 2)
+      {
+        auto const & first  = filters[0].elements_in > filters[1].elements_in ? filters[0] : filters[1];
+        auto const & second = filters[0].elements_in > filters[1].elements_in ? filters[1] : filters[0];
+
+        CPP_STREAMS__EQUAL (true, first.stage != second.stage);
+        CPP_STREAMS__EQUAL (std::uint64_t (2), first.runs);
+        CPP_STREAMS__EQUAL (std::uint64_t (30), first.elements_in);
+        CPP_STREAMS__EQUAL (std::uint64_t (26), first.elements_out);
+        CPP_STREAMS__EQUAL (std::uint64_t (2), second.runs);
+        CPP_STREAMS__EQUAL (std::uint64_t (26), second.elements_in);
+        CPP_STREAMS__EQUAL (std::uint64_t (8), second.elements_out);
+      }
+    }
+
+    {
+      // The buffering operators own the allocations they make
+      auto sorter_int = [] (int l, int r) { return l < r; };
+      auto allocator  = owner_recording_allocator<int> ();
+
+      recorded_owners ().clear ();
+      from (some_ints) >> sort_using (sorter_int, allocator) >> to_vector_using (allocator);
+      CPP_STREAMS__EQUAL ((std::set<std::string> {"sort", "to_vector"}), recorded_owners ());
+
+      recorded_owners ().clear ();
+      from (some_ints) >> reverse_using (allocator) >> to_set_using (allocator);
+      CPP_STREAMS__EQUAL ((std::set<std::string> {"reverse", "to_set"}), recorded_owners ());
+
+      recorded_owners ().clear ();
+      from (some_ints) >> to_map_using ([] (int v) { return v; }, allocator);
+      CPP_STREAMS__EQUAL ((std::set<std::string> {"to_map"}), recorded_owners ());
+      CPP_STREAMS__EQUAL (true, allocation_owner () == nullptr);
+    }
+#endif
+  }
+
+  void test__reverse ()
+  {
+#ifndef _MSC_VER
+    CPP_STREAMS__TEST ();
+
+    using namespace cpp_streams;
+
+    auto apply_reverse = [] (auto && vs)
+    {
+      using value_type = detail::strip_type_t<decltype (vs.front ())>;
+      std::vector<value_type> result;
+      result.reserve (vs.size ());
+      std::reverse_copy (
+          vs.begin ()
+        , vs.end ()
+        , std::back_inserter (result)
+        );
+      return result;
+    };
+
+    {
+      std::vector<int> expected {};
+      std::vector<int> actual   =
+            from (empty_ints)
+        >>  reverse
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+    {
+      std::vector<int> expected = apply_reverse (some_ints);
+      std::vector<int> actual   =
+            from (some_ints)
+        >>  reverse
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+    {
+      std::vector<user> expected = apply_reverse (some_users);
+      std::vector<user> actual   =
+            from (some_users)
+        >>  reverse
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+    {
+      // A prepared source reuses its buffer between runs
+      auto prepared = from (some_ints) >> reverse;
+
+      std::vector<int> expected = apply_reverse (some_ints);
+      std::vector<int> first    = prepared >> to_vector;
+      std::vector<int> second   = prepared >> to_vector;
+      CPP_STREAMS__EQUAL (expected, first);
+      CPP_STREAMS__EQUAL (expected, second);
+
+      auto copy = prepared;
+      std::vector<int> copied   = copy >> to_vector;
+      CPP_STREAMS__EQUAL (expected, copied);
+    }
+
+    {
+      // A nested run of the same source finds the buffer busy
+      auto prepared = from (some_ints) >> reverse;
+
+      std::vector<int> expected = apply_reverse (some_ints);
+      std::vector<int> inner;
+      std::vector<int> outer    =
+            prepared
+        >>  map ([&prepared, &inner] (int v) { inner = prepared >> to_vector; return v; })
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, outer);
+      CPP_STREAMS__EQUAL (expected, inner);
+    }
+
+#endif
+  }
+
+  void test__skip ()
+  {
+    CPP_STREAMS__TEST ();
+
+    using namespace cpp_streams;
+
+    {
+      std::vector<int>  expected = {};
+      std::vector<int>  actual   =
+            from (some_ints)
+        >>  skip (10000)
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+    {
+      std::vector<int>  expected {};
+      std::vector<int>  actual   =
+            from (empty_ints)
+        >>  skip (0)
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+    {
+      std::vector<user> expected = some_users;
+      std::vector<user> actual   =
+            from (some_users)
+        >>  skip (0)
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+    {
+      std::vector<int>  expected = {9, 2, 6, 5, 3, 5, 8, 9, 7, 9};
+      std::vector<int>  actual   =
+            from (some_ints)
+        >>  skip (5)
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+  }
+
+  void test__skip_while ()
+  {
+    CPP_STREAMS__TEST ();
+
+    using namespace cpp_streams;
+
+    {
+      std::vector<int>  expected = {};
+      std::vector<int>  actual   =
+            from (some_ints)
+        >>  skip_while (map_true)
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+    {
+      std::vector<int>  expected {};
+      std::vector<int>  actual   =
+            from (empty_ints)
+        >>  skip_while ([] (auto &&) { return false; })
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+    {
+      std::vector<user> expected = some_users;
+      std::vector<user> actual   =
+            from (some_users)
+        >>  skip_while ([] (auto &&) { return false; })
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+    {
+      std::vector<int>  expected = {9, 2, 6, 5, 3, 5, 8, 9, 7, 9};
+      std::vector<int>  actual   =
+            from (some_ints)
+        >>  skip_while ([] (auto && v) { return v < 9; })
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+  }
+
+// TODO: Fix sort for VS2015 RC
+  void test__sort ()
+  {
+#ifndef _MSC_VER
+    CPP_STREAMS__TEST ();
+
+    using namespace cpp_streams;
+
+    auto apply_sort = [] (auto && sorter, auto && vs)
+    {
+      using value_type = detail::strip_type_t<decltype (vs.front ())>;
+      std::vector<value_type> result = std::forward<decltype (vs)> (vs);
+      std::sort (
+          result.begin ()
+        , result.end ()
+        , sorter
+        );
+      return result;
+    };
+
+    auto sorter_int   = [] (auto && l, auto && r) { return l < r; };
+    auto sorter_user  = [] (user const & l, user const & r) { return l.id < r.id; };
+
+    {
+      std::vector<int> expected {};
+      std::vector<int> actual   =
+            from (empty_ints)
+        >>  sort (sorter_int)
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+    {
+      std::vector<int> expected = apply_sort (sorter_int, some_ints);
+      std::vector<int> actual   =
+            from (some_ints)
+        >>  sort (sorter_int)
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+    {
+      std::vector<user> expected = apply_sort (sorter_user, some_users);
+      std::vector<user> actual   =
+            from (some_users)
+        >>  sort (sorter_user)
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+    {
+      // A prepared source reuses its buffer between runs, also when a run
+      //  stops early
+      auto prepared = from (some_users) >> sort (sorter_user);
+
+      std::vector<user> expected = apply_sort (sorter_user, some_users);
+      std::vector<user> first    = prepared >> take (2) >> to_vector;
+      std::vector<user> second   = prepared >> to_vector;
+      CPP_STREAMS__EQUAL (2U, first.size ());
+      CPP_STREAMS__EQUAL (expected, second);
+    }
+
+#endif
+  }
+
+// TODO: Fix sort_by for VS2015 RC
+  void test__sort_by ()
+  {
+#ifndef _MSC_VER
+    CPP_STREAMS__TEST ();
+
+    using namespace cpp_streams;
+
+    auto apply_sort_by = [] (auto && selector, auto && vs)
+    {
+      using value_type = detail::strip_type_t<decltype (vs.front ())>;
+      std::vector<value_type> result = std::forward<decltype (vs)> (vs);
+      auto sorter = [selector] (auto && l, auto && r)
+        {
+          return selector (std::forward<decltype (l)> (l)) < selector (std::forward<decltype (r)> (r));
+        };
+      std::sort (
+          result.begin ()
+        , result.end ()
+        , sorter
+        );
+      return result;
+    };
+
+    auto selector_int   = identity;
+    auto selector_user  = map_id;
+
+    {
+      std::vector<int> expected {};
+      std::vector<int> actual   =
+            from (empty_ints)
+        >>  sort_by (selector_int)
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+    {
+      std::vector<int> expected = apply_sort_by (selector_int, some_ints);
+      std::vector<int> actual   =
+            from (some_ints)
+        >>  sort_by (selector_int)
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+    {
+      std::vector<user> expected = apply_sort_by (selector_user, some_users);
+      std::vector<user> actual   =
+            from (some_users)
+        >>  sort_by (selector_user)
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+#endif
+  }
+
+  void test__take ()
+  {
+    CPP_STREAMS__TEST ();
+
+    using namespace cpp_streams;
+
+    {
+      std::vector<int>  expected = {};
+      std::vector<int>  actual   =
+            from (some_ints)
+        >>  take (0)
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+    {
+      std::vector<int>  expected {};
+      std::vector<int>  actual   =
+            from (empty_ints)
+        >>  take (0)
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+    {
+      std::vector<user> expected = some_users;
+      std::vector<user> actual   =
+            from (some_users)
+        >>  take (10000)
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+    {
+      std::vector<int>  expected = {3,1,4,1};
+      std::vector<int>  actual   =
+            from (some_ints)
+        >>  take (4)
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+  }
+
+  void test__take_while ()
+  {
+    CPP_STREAMS__TEST ();
+
+    using namespace cpp_streams;
+
+    {
+      std::vector<int>  expected = {};
+      std::vector<int>  actual   =
+            from (some_ints)
+        >>  take_while ([] (auto &&) { return false; })
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+    {
+      std::vector<int>  expected {};
+      std::vector<int>  actual   =
+            from (empty_ints)
+        >>  take_while (map_false)
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+    {
+      std::vector<user> expected = some_users;
+      std::vector<user> actual   =
+            from (some_users)
+        >>  take_while (map_true)
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+    {
+      std::vector<int>  expected = {3,1,4,1};
+      std::vector<int>  actual   =
+            from (some_ints)
+        >>  take_while ([] (auto && v) { return v < 5; })
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+  }
+
+  void test__example ()
+  {
+    CPP_STREAMS__TEST ();
+
+    // Smoke tests the example on the homepage
+
+    using namespace cpp_streams;
+
+    std::vector<int> ints {3,1,4,1,5,9,2,6,5,4};
+
+    // Produce a sum of even ints (+1)
+    auto sum =
+          from (ints)
+      >>  filter ([] (auto && v) {return v % 2 == 0;})  // Keep only even numbers
+      >>  map ([] (auto && v) {return v + 1;})          // +1
+      >>  to_sum                                        // Compute sum
+      ;
+
+    std::cout << "SUM: " << sum << std::endl;
+  }
+
+  void test__trace ()
+  {
+    CPP_STREAMS__TEST ();
+
+    using namespace cpp_streams;
+
+    auto sort_int = [] (int l, int r) { return l < r; };
+
+    std::vector<int> expected = some_ints;
+    std::sort (expected.begin (), expected.end (), sort_int);
+
+#ifdef CPP_STREAMS__TRACE
+    reset_trace ();
+#endif
+
+    {
+      std::vector<int> actual =
+            from (some_ints)
+        >>  sort (sort_int)
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+    {
+      int actual = 0;
+      std::thread worker ([&actual] ()
+      {
+        actual = from (some_ints) >> reverse >> to_sum;
+      });
+      worker.join ();
+      CPP_STREAMS__EQUAL (77, actual);
+    }
+
+#ifdef CPP_STREAMS__TRACE
+    {
+      std::ostringstream stream;
+      write_trace_json (stream);
+      auto const json = stream.str ();
+
+      auto contains = [&json] (char const * text)
+      {
+        return json.find (text) != std::string::npos;
+      };
+
+      CPP_STREAMS__EQUAL (true, contains ("{\"displayTimeUnit\": \"ns\", \"traceEvents\": ["));
+      CPP_STREAMS__EQUAL (true, contains ("{\"name\": \"sort.buffer\", \"cat\": \"cpp_streams\", \"ph\": \"X\", \"ts\": "));
+      CPP_STREAMS__EQUAL (true, contains ("\"name\": \"sort.sort\""));
+      CPP_STREAMS__EQUAL (true, contains ("\"name\": \"sort.emit\""));
+      CPP_STREAMS__EQUAL (true, contains ("\"name\": \"to_vector\""));
+      CPP_STREAMS__EQUAL (true, contains ("\"name\": \"reverse.buffer\""));
+      CPP_STREAMS__EQUAL (true, contains ("\"name\": \"to_sum\""));
+      CPP_STREAMS__EQUAL (true, contains ("\"name\": \"thread_name\", \"ph\": \"M\""));
+      CPP_STREAMS__EQUAL (std::size_t (0), trace_dropped_events ());
+
+      // The worker thread records into a buffer of its own
+      auto const sort_event     = json.find ("\"name\": \"sort.buffer\"");
+      auto const reverse_event  = json.find ("\"name\": \"reverse.buffer\"");
+      auto const sort_tid       = json.substr (json.find ("\"tid\": ", sort_event), 12);
+      auto const reverse_tid    = json.substr (json.find ("\"tid\": ", reverse_event), 12);
+      CPP_STREAMS__EQUAL (true, sort_tid != reverse_tid);
+    }
+#endif
+  }
+
+  void test__move_only ()
+  {
+#ifndef _MSC_VER
+    CPP_STREAMS__TEST ();
+
+    using namespace cpp_streams;
+
+    using ptr = std::unique_ptr<int>;
+
+    auto make_ptrs = [] ()
+    {
+      std::vector<ptr> result;
+      for (auto && v : some_ints)
+      {
+        result.push_back (std::make_unique<int> (v));
+      }
+      return result;
+    };
+
+    auto values = [] (std::vector<ptr> const & ps)
+    {
+      std::vector<int> result;
+      for (auto && p : ps)
+      {
+        result.push_back (p ? *p : -1);
+      }
+      return result;
+    };
+
+    {
+      std::vector<int> expected;
+      for (auto && v : some_ints)
+      {
+        if (v % 2 != 0)
+        {
+          expected.push_back (v * 2);
+        }
+      }
+      std::sort (expected.begin (), expected.end ());
+      std::reverse (expected.begin (), expected.end ());
+
+      auto ps = make_ptrs ();
+      std::vector<ptr> actual =
+            from (std::move (ps))
+        >>  filter ([] (ptr const & p) { return *p % 2 != 0; })
+        >>  map ([] (ptr && p) { *p *= 2; return std::move (p); })
+        >>  sort ([] (ptr const & l, ptr const & r) { return *l < *r; })
+        >>  reverse
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (expected, values (actual));
+    }
+
+    {
+      auto ps = make_ptrs ();
+      ptr actual = from (std::move (ps)) >> to_first_or_default;
+      CPP_STREAMS__EQUAL (some_ints.front (), *actual);
+      // The source owns the container moved into it
+      CPP_STREAMS__EQUAL (true, ps.empty ());
+    }
+
+    {
+      auto ps = make_ptrs ();
+      ptr actual = from (std::move (ps)) >> to_last_or_default;
+      CPP_STREAMS__EQUAL (some_ints.back (), *actual);
+    }
+
+    {
+      std::vector<ptr> empty;
+      ptr actual = from (std::move (empty)) >> to_first_or_default;
+      CPP_STREAMS__EQUAL (true, actual == nullptr);
+    }
+
+    {
+      auto ps = make_ptrs ();
+      std::vector<ptr> actual;
+      from (std::move (ps)) >> to_iter ([&actual] (ptr && p) { actual.push_back (std::move (p)); return true; });
+      CPP_STREAMS__EQUAL (some_ints, values (actual));
+    }
+#endif
+  }
+
+  void test__copies ()
+  {
+#ifndef _MSC_VER
+    CPP_STREAMS__TEST ();
+
+    using namespace cpp_streams;
+
+    auto make_counters = [] ()
+    {
+      std::vector<copy_counter> result;
+      result.reserve (some_ints.size ());
+      for (auto && v : some_ints)
+      {
+        result.emplace_back (v);
+      }
+      return result;
+    };
+
+    {
+      auto cs = make_counters ();
+      copy_counter::reset ();
+
+      std::vector<copy_counter> actual =
+            from (std::move (cs))
+        >>  filter ([] (copy_counter const & c) { return c.value > 2; })
+        >>  map ([] (copy_counter && c) { return std::move (c); })
+        >>  sort ([] (copy_counter const & l, copy_counter const & r) { return l.value < r.value; })
+        >>  reverse
+        >>  take (5)
+        >>  to_vector
+        ;
+      CPP_STREAMS__EQUAL (5U, actual.size ());
+      CPP_STREAMS__EQUAL (0U, copy_counter::copies);
+      CPP_STREAMS__EQUAL (true, copy_counter::moves > 0U);
+    }
+
+    {
+      auto cs = make_counters ();
+      copy_counter::reset ();
+
+      copy_counter first  = from (std::move (cs)) >> to_first_or_default;
+      CPP_STREAMS__EQUAL (some_ints.front (), first.value);
+      CPP_STREAMS__EQUAL (0U, copy_counter::copies);
+
+      cs = make_counters ();
+      copy_counter::reset ();
+
+      copy_counter last   = from (std::move (cs)) >> to_last_or_default;
+      CPP_STREAMS__EQUAL (some_ints.back (), last.value);
+      CPP_STREAMS__EQUAL (0U, copy_counter::copies);
+    }
+
+    {
+      // Elements of lvalue containers are copied as before
+      auto const cs = make_counters ();
+      copy_counter::reset ();
+
+      std::vector<copy_counter> actual = from (cs) >> to_vector;
+      CPP_STREAMS__EQUAL (cs.size (), copy_counter::copies);
+    }
+#endif
+  }
+
+  void test__from_rvalue ()
+  {
+#ifndef _MSC_VER
+    CPP_STREAMS__TEST ();
+
+    using namespace cpp_streams;
+
+    auto make_counters = [] ()
+    {
+      std::vector<copy_counter> result;
+      result.reserve (some_ints.size ());
+      for (auto && v : some_ints)
+      {
+        result.emplace_back (v);
+      }
+      return result;
+    };
+
+    {
+      // The temporary vector is owned by the source, it doesn't dangle
+      auto source = from (std::vector<int> (some_ints)) >> filter ([] (int v) { return v % 2 == 0; });
+
+      std::vector<int> expected;
+      for (auto && v : some_ints)
+      {
+        if (v % 2 == 0)
+        {
+          expected.push_back (v);
+        }
+      }
+
+      auto actual = source >> to_vector;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+    {
+      copy_counter::reset ();
+
+      // Copies of the source share the container
+      auto source = from (make_counters ());
+      auto copy   = source;
+      CPP_STREAMS__EQUAL (0U, copy_counter::copies);
+
+      std::vector<copy_counter> from_copy = copy >> to_vector;
+      CPP_STREAMS__EQUAL (some_ints.size (), from_copy.size ());
+    }
+
+    {
+      // Every run of the source and its copies sees all the elements
+      auto source = from (std::vector<std::string> {"alpha", "beta"});
+      auto copy   = source;
+
+      std::vector<std::string> expected {"alpha", "beta"};
+      std::vector<std::string> first  = source  >> to_vector;
+      std::vector<std::string> second = copy    >> to_vector;
+      std::vector<std::string> third  = source  >> to_vector;
+      CPP_STREAMS__EQUAL (expected, first);
+      CPP_STREAMS__EQUAL (expected, second);
+      CPP_STREAMS__EQUAL (expected, third);
+    }
+
+    // Runs source twice, returns the first result and whether the second
+    //  run threw
+    auto run_twice = [] (auto & source)
+    {
+      auto first  = source >> to_vector;
+      auto thrown = false;
+      try
+      {
+        source >> to_length;
+      }
+      catch (std::logic_error const &)
+      {
+        thrown = true;
+      }
+      return std::make_pair (std::move (first), thrown);
+    };
+
+    {
+      // The only owner moves the elements out, a second run throws rather
+      //  than pass on moved from elements
+      auto source = from (std::vector<std::string> {"alpha", "beta"});
+      auto actual = run_twice (source);
+
+      std::vector<std::string> expected {"alpha", "beta"};
+      CPP_STREAMS__EQUAL (expected, actual.first);
+      CPP_STREAMS__EQUAL (true, actual.second);
+
+      auto copy   = source;
+      auto thrown = false;
+      try
+      {
+        copy >> to_length;
+      }
+      catch (std::logic_error const &)
+      {
+        thrown = true;
+      }
+      CPP_STREAMS__EQUAL (true, thrown);
+    }
+
+    {
+      // A source of move-only elements can't be copied, its run moves the
+      //  elements out
+      std::vector<std::unique_ptr<int>> ps;
+      ps.push_back (std::make_unique<int> (1));
+      ps.push_back (std::make_unique<int> (2));
+
+      auto source = from (std::move (ps));
+      static_assert (!std::is_copy_constructible<decltype (source)>::value, "Source of move-only elements must not be copyable");
+
+      auto actual = run_twice (source);
+      CPP_STREAMS__EQUAL (2U, actual.first.size ());
+      CPP_STREAMS__EQUAL (2, *actual.first[1]);
+      CPP_STREAMS__EQUAL (true, actual.second);
+    }
+#endif
+  }
+
+  void test__functor_copies ()
+  {
+    CPP_STREAMS__TEST ();
+
+    using namespace cpp_streams;
+
+    {
+      copy_counter::reset ();
+
+      // Functors and sources are moved into the pipeline when composed
+      auto expected = 0;
+      for (auto && v : some_ints)
+      {
+        expected += v + 1;
+      }
+      expected += some_ints.back () + 1;
+
+      auto actual =
+            from (some_ints)
+        >>  skip_while  ([c = copy_counter (0)] (int v) { return v < c.value; })
+        >>  take_while  ([c = copy_counter (100)] (int v) { return v < c.value; })
+        >>  filter      ([c = copy_counter (0)] (int v) { return v > c.value; })
+        >>  map         ([c = copy_counter (1)] (int v) { return v + c.value; })
+        >>  mapi        ([c = copy_counter (0)] (std::size_t, int v) { return v + c.value; })
+        >>  collect     ([c = copy_counter (0)] (int v) { return from_singleton (v + c.value); })
+        >>  append      (from_singleton (some_ints.back ()) >> map ([c = copy_counter (1)] (int v) { return v + c.value; }))
+        >>  to_fold     (0, [c = copy_counter (0)] (int s, int v) { return s + v + c.value; })
+        ;
+
+      CPP_STREAMS__EQUAL (expected, actual);
+      CPP_STREAMS__EQUAL (0U, copy_counter::copies);
+      CPP_STREAMS__EQUAL (true, copy_counter::moves > 0U);
+    }
+
+    {
+      copy_counter::reset ();
+
+      // A named pipe is copied into every pipeline it's used in
+      auto f = filter ([c = copy_counter (2)] (int v) { return v > c.value; });
+
+      auto first  = from (some_ints) >> f >> to_vector;
+      auto second = from (some_ints) >> f >> to_vector;
+      CPP_STREAMS__EQUAL (first, second);
+      CPP_STREAMS__EQUAL (2U, copy_counter::copies);
+    }
+
+    {
+      copy_counter::reset ();
+
+      // The formatters of the io sinks are moved too
+      std::ostringstream stream;
+      from (some_ints) >> to_ostream (stream, [c = copy_counter (0)] (output_buffer & out, int v) { out << v + c.value << '\n'; });
+
+      temporary_file file ("cpp_streams__functor_copies.tmp", "");
+      from (some_ints) >> to_file (file.path, [c = copy_counter (0)] (output_buffer & out, int v) { out << v + c.value << '\n'; });
+
+      CPP_STREAMS__EQUAL (stream.str (), read_file (file.path));
+      CPP_STREAMS__EQUAL (0U, copy_counter::copies);
+    }
+  }
+
+  void test__any_source ()
+  {
+    CPP_STREAMS__TEST ();
+
+    using namespace cpp_streams;
+
+    std::vector<int> even_ints;
+    for (auto && v : some_ints)
+    {
+      if (v % 2 == 0)
+      {
+        even_ints.push_back (v);
+      }
+    }
+
+    // any_source can be returned from non-template functions
+    auto create_even = [] () -> any_source<int>
+    {
+      return from (some_ints) >> filter ([] (int v) { return v % 2 == 0; });
+    };
+
+    {
+      auto actual = create_even () >> to_vector;
+      CPP_STREAMS__EQUAL (even_ints, actual);
+    }
+
+    {
+      auto actual = create_even () >> map ([] (int v) { return v + 1; }) >> to_sum;
+
+      auto expected = 0;
+      for (auto && v : even_ints)
+      {
+        expected += v + 1;
+      }
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+
+    {
+      // Large sources are allocated on the heap, copies are independent
+      std::array<int, 32> big {{1}};
+      any_source<int> source = from (some_ints) >> filter ([big] (int v) { return v > big.front (); });
+      auto copy = source;
+      source = create_even ();
+
+      CPP_STREAMS__EQUAL (even_ints, source >> to_vector);
+      CPP_STREAMS__EQUAL (static_cast<std::size_t> (std::count_if (some_ints.begin (), some_ints.end (), [] (int v) { return v > 1; })), (copy >> to_vector).size ());
+    }
+
+    {
+      // A moved from large source is empty, copies of it too
+      std::array<int, 32> big {{1}};
+      any_source<int> source = from (some_ints) >> filter ([big] (int v) { return v > big.front (); });
+      auto moved  = std::move (source);
+      auto copy   = source;
+
+      CPP_STREAMS__EQUAL (0U, (source >> to_vector).size ());
+      CPP_STREAMS__EQUAL (0U, (copy >> to_vector).size ());
+      CPP_STREAMS__EQUAL (static_cast<std::size_t> (std::count_if (some_ints.begin (), some_ints.end (), [] (int v) { return v > 1; })), (moved >> to_vector).size ());
+    }
+
+    {
+      std::vector<any_source<int>> sources;
+      sources.push_back (create_even ());
+      sources.push_back (from (some_ints));
+      sources.push_back (from_empty<int> ());
+
+      CPP_STREAMS__EQUAL (even_ints, sources[0] >> to_vector);
+      CPP_STREAMS__EQUAL (some_ints, sources[1] >> to_vector);
+      CPP_STREAMS__EQUAL (0U, (sources[2] >> to_vector).size ());
+    }
+
+    {
+      // Stops at the end of the batch
+      any_source<int> source = from_repeat (1, 100000U);
+      CPP_STREAMS__EQUAL (3, source >> take (3) >> to_sum);
+    }
+
+    {
+      // The values batched when the erased source throws are destroyed
+      auto value  = std::make_shared<int> (1);
+      auto passed = std::make_shared<int> (0);
+
+      any_source<std::shared_ptr<int>> source =
+            from_repeat (value, 10U)
+        >>  map ([passed] (std::shared_ptr<int> const & v)
+            {
+              if (++*passed == 3)
+              {
+                throw std::runtime_error ("test__any_source");
+              }
+              return v;
+            })
+        ;
+      auto const owners = value.use_count ();
+
+      auto thrown = false;
+      try
+      {
+        source >> to_vector;
+      }
+      catch (std::runtime_error const &)
+      {
+        thrown = true;
+      }
+      CPP_STREAMS__EQUAL (true, thrown);
+      CPP_STREAMS__EQUAL (owners, value.use_count ());
+    }
+
+#ifndef _MSC_VER
+    {
+      // Move-only values, any_source needs a copyable source
+      any_source<std::unique_ptr<int>> source = from (some_ints) >> map ([] (int v) { return std::make_unique<int> (v); });
+      auto actual = source >> map ([] (std::unique_ptr<int> && p) { return *p; }) >> to_vector;
+      CPP_STREAMS__EQUAL (some_ints, actual);
+    }
+#endif
+  }
+
+  void test__fusion ()
+  {
+    CPP_STREAMS__TEST ();
+
+    using namespace cpp_streams;
+
+    auto is_odd   = [] (int v) { return v % 2 != 0; };
+    auto is_small = [] (int v) { return v < 5; };
+
+    {
+      std::vector<int> expected;
+      for (auto && v : some_ints)
+      {
+        if (is_odd (v) && is_small (v))
+        {
+          expected.push_back (v * 2 + 1);
+        }
+      }
+
+      auto source =
+            from (some_ints)
+        >>  filter (is_odd)
+        >>  filter (is_small)
+        >>  map ([] (int v) { return v * 2; })
+        >>  map ([] (int v) { return v + 1; })
+        ;
+
+      // Adjacent filters and maps are merged into one stage each
+      using filtered_type = decltype (source.source_function.source);
+      static_assert (
+          detail::has_source_function<filtered_type, detail::filter_function>::value
+        , "filter >> filter >> map >> map should fuse into filter >> map"
+        );
+      static_assert (
+          !detail::has_source_function<decltype (source.source_function.source.source_function.source), detail::filter_function>::value
+        , "filter >> filter should fuse into a single filter"
+        );
+
+      CPP_STREAMS__EQUAL (expected, source >> to_vector);
+    }
+
+    {
+      // map (f) >> take (n) calls f n times, map (f) >> to_length never
+      auto calls  = 0;
+      auto mapper = [&calls] (int v) { ++calls; return v; };
+
+      auto taken = from (some_ints) >> map (mapper) >> take (3) >> to_vector;
+      CPP_STREAMS__EQUAL (3U, taken.size ());
+      CPP_STREAMS__EQUAL (3, calls);
+
+      calls = 0;
+      auto length = from (some_ints) >> map (mapper) >> to_length;
+      CPP_STREAMS__EQUAL (some_ints.size (), length);
+      CPP_STREAMS__EQUAL (0, calls);
+    }
+
+#ifndef _MSC_VER
+    {
+      // sort (s) >> to_first_or_default is a scan for the smallest element
+      auto less     = [] (int l, int r) { return l < r; };
+      auto greater  = [] (int l, int r) { return l > r; };
+
+      CPP_STREAMS__EQUAL (*std::min_element (some_ints.begin (), some_ints.end ()), from (some_ints) >> sort (less) >> to_first_or_default);
+      CPP_STREAMS__EQUAL (*std::max_element (some_ints.begin (), some_ints.end ()), from (some_ints) >> sort (greater) >> to_first_or_default);
+      CPP_STREAMS__EQUAL (0, from (empty_ints) >> sort (less) >> to_first_or_default);
+    }
+
+    {
+      // Neither default constructible nor assignable, the smallest element
+      //  is constructed in place
+      struct no_default
+      {
+        explicit no_default (int value)
+          : value (value)
+        {
+        }
+
+        no_default (no_default const &)             = default;
+        no_default (no_default &&)                  = default;
+        no_default & operator= (no_default const &) = delete;
+        no_default & operator= (no_default &&)      = delete;
+
+        int value;
+      };
+
+      auto less     = [] (no_default const & l, no_default const & r) { return l.value < r.value; };
+      auto first    = from (some_ints) >> map ([] (int v) { return no_default (v); }) >> sort (less) >> to_first_or_default;
+      CPP_STREAMS__EQUAL (*std::min_element (some_ints.begin (), some_ints.end ()), first.value);
+
+      auto thrown = false;
+      try
+      {
+        from (empty_ints) >> map ([] (int v) { return no_default (v); }) >> sort (less) >> to_first_or_default;
+      }
+      catch (std::out_of_range const &)
+      {
+        thrown = true;
+      }
+      CPP_STREAMS__EQUAL (true, thrown);
+
+      std::vector<std::unique_ptr<int>> ps;
+      for (auto && v : some_ints)
+      {
+        ps.push_back (std::make_unique<int> (v));
+      }
+
+      auto smallest = from (std::move (ps)) >> sort ([] (std::unique_ptr<int> const & l, std::unique_ptr<int> const & r) { return *l < *r; }) >> to_first_or_default;
+      CPP_STREAMS__EQUAL (*std::min_element (some_ints.begin (), some_ints.end ()), *smallest);
+    }
 #endif
   }
 
-// TODO: Fix sort_by for VS2015 RC
-  void test__sort_by ()
+  void test__explain ()
   {
-#ifndef _MSC_VER
     CPP_STREAMS__TEST ();
 
     using namespace cpp_streams;
 
-    auto apply_sort_by = [] (auto && selector, auto && vs)
-    {
-      using value_type = detail::strip_type_t<decltype (vs.front ())>;
-      std::vector<value_type> result = std::forward<decltype (vs)> (vs);
-      auto sorter = [selector] (auto && l, auto && r)
-        {
-          return selector (std::forward<decltype (l)> (l)) < selector (std::forward<decltype (r)> (r));
-        };
-      std::sort (
-          result.begin ()
-        , result.end ()
-        , sorter
-        );
-      return result;
-    };
-
-    auto selector_int   = identity;
-    auto selector_user  = map_id;
+    auto is_odd = [] (int v) { return v % 2 != 0; };
 
     {
-      std::vector<int> expected {};
-      std::vector<int> actual   =
-            from (empty_ints)
-        >>  sort_by (selector_int)
-        >>  to_vector
+      auto source =
+            from (some_ints)
+        >>  filter (is_odd)
+        >>  filter (is_odd)
+        >>  map ([] (int v) { return v * 2; })
+        >>  take (3)
+        >>  append (from_singleton (1))
         ;
-      CPP_STREAMS__EQUAL (expected, actual);
+
+      // map (f) >> take (n) runs as take (n) >> map (f)
+      using expected_plan = detail::plan<
+          detail::from_step
+        , detail::fused_filter_step
+        , detail::take_step
+        , detail::map_step
+        , detail::append_step
+        >;
+      static_assert (std::is_same<expected_plan, decltype (source)::plan_type>::value, "Unexpected plan");
+
+      std::string expected =
+        "#  operator        buffers  stops early  elements  strategy\n"
+        "1  from            no       no           exact     sequential\n"
+        "2  filter (fused)  no       no           bounded   sequential\n"
+        "3  take            no       yes          bounded   sequential\n"
+        "4  map             no       no           bounded   sequential\n"
+        "5  append          no       no           unknown   sequential\n"
+        ;
+      CPP_STREAMS__EQUAL (expected, explain (source));
     }
 
+#ifndef _MSC_VER
     {
-      std::vector<int> expected = apply_sort_by (selector_int, some_ints);
-      std::vector<int> actual   =
-            from (some_ints)
-        >>  sort_by (selector_int)
-        >>  to_vector
+      auto source = from_repeat (1, 3) >> sort ([] (int l, int r) { return l < r; }) >> reverse;
+
+      std::string expected =
+        "#  operator     buffers  stops early  elements  strategy\n"
+        "1  from_repeat  no       no           exact     sequential\n"
+        "2  sort         yes      no           exact     sequential\n"
+        "3  reverse      yes      no           exact     sequential\n"
         ;
-      CPP_STREAMS__EQUAL (expected, actual);
+      CPP_STREAMS__EQUAL (expected, explain (source));
     }
+#endif
 
     {
-      std::vector<user> expected = apply_sort_by (selector_user, some_users);
-      std::vector<user> actual   =
-            from (some_users)
-        >>  sort_by (selector_user)
-        >>  to_vector
+      any_source<int> source = from (some_ints) >> filter (is_odd);
+
+      std::string expected =
+        "#  operator    buffers  stops early  elements  strategy\n"
+        "1  any_source  no       no           unknown   batched type erasure\n"
         ;
-      CPP_STREAMS__EQUAL (expected, actual);
+      CPP_STREAMS__EQUAL (expected, explain (source));
     }
+  }
 
+  void test__constexpr ()
+  {
+    CPP_STREAMS__TEST ();
+
+    // Instrumented and traced pipes have side effects so aren't constexpr
+#if __cpp_constexpr >= 201603 && !defined (CPP_STREAMS__INSTRUMENT) && !defined (CPP_STREAMS__TRACE)
+    using namespace cpp_streams;
+
+    static constexpr std::array<int, 5> ints {{1, 2, 3, 4, 5}};
+
+    constexpr auto is_odd = [] (int v) { return v % 2 != 0; };
+    constexpr auto twice  = [] (int v) { return v * 2; };
+
+    static_assert (
+          (   from (ints)
+          >>  filter (is_odd)
+          >>  map (twice)
+          >>  take (2)
+          >>  to_sum
+          )
+      ==  8
+      , "Unexpected sum"
+      );
+
+    static_assert ((from (ints) >> skip (2) >> to_length) == 3, "Unexpected length");
+    static_assert ((from (ints) >> map (twice) >> to_length) == 5, "Unexpected length");
+    static_assert ((from_range (0, 10) >> to_sum) == 45, "Unexpected sum");
+    static_assert ((from_singleton (7) >> to_sum) == 7, "Unexpected sum");
+    static_assert ((from_repeat (3, 4) >> to_fold (1, [] (int s, int v) { return s * v; })) == 81, "Unexpected fold");
+
+    // Lookup tables can be built at compile time
+    constexpr auto squares = [] ()
+    {
+      std::array<int, 4> result {};
+      std::size_t index = 0;
+      from_range (0, 4) >> map ([] (int v) { return v * v; }) >> to_iter ([&] (int v) { result[index++] = v; return true; });
+      return result;
+    } ();
+
+    static_assert (squares[3] == 9, "Unexpected square");
+
+    std::vector<int> expected {0, 1, 4, 9};
+    std::vector<int> actual = from (squares) >> to_vector;
+    CPP_STREAMS__EQUAL (expected, actual);
 #endif
   }
 
-  void test__take ()
+  void test__to_range ()
   {
     CPP_STREAMS__TEST ();
 
     using namespace cpp_streams;
 
     {
-      std::vector<int>  expected = {};
-      std::vector<int>  actual   =
-            from (some_ints)
-        >>  take (0)
-        >>  to_vector
-        ;
+      std::vector<int> expected = from (some_ints) >> map ([] (int v) { return v * 2; }) >> to_vector;
+      std::vector<int> actual;
+      for (int v : from (some_ints) >> map ([] (int v) { return v * 2; }) >> to_range)
+      {
+        actual.push_back (v);
+      }
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
     {
-      std::vector<int>  expected {};
-      std::vector<int>  actual   =
-            from (empty_ints)
-        >>  take (0)
-        >>  to_vector
-        ;
-      CPP_STREAMS__EQUAL (expected, actual);
+      auto range = from (empty_ints) >> to_range;
+      CPP_STREAMS__EQUAL (true, range.begin () == range.end ());
     }
 
     {
-      std::vector<user> expected = some_users;
-      std::vector<user> actual   =
-            from (some_users)
-        >>  take (10000)
-        >>  to_vector
-        ;
+      // Spans several batches
+      int expected  = from_range (0, 100000) >> filter ([] (int v) { return v % 3 == 0; }) >> to_length;
+      auto range    = from_range (0, 100000) >> to_range;
+      int actual    = static_cast<int> (std::count_if (range.begin (), range.end (), [] (int v) { return v % 3 == 0; }));
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
     {
-      std::vector<int>  expected = {3,1,4,1};
-      std::vector<int>  actual   =
-            from (some_ints)
-        >>  take (4)
-        >>  to_vector
-        ;
-      CPP_STREAMS__EQUAL (expected, actual);
+      // Destroying the range stops the source
+      int produced = 0;
+      {
+        auto range = from_range (0, 100000000) >> map ([&produced] (int v) { ++produced; return v; }) >> to_range;
+        auto found = std::find_if (range.begin (), range.end (), [] (int v) { return v == 10; });
+        CPP_STREAMS__EQUAL (10, *found);
+      }
+      CPP_STREAMS__EQUAL (true, produced < 10000);
+    }
+
+    {
+      // A destroyed range stops the source at its next value, not its next
+      //  batch, the two first batches pass quickly then the filter rejects
+      //  almost every value of an endless source
+      auto const first_batches  = 2 * static_cast<long long> (detail::range_batch_size);
+      auto produced             = 0LL;
+      {
+        auto range =
+              from_range (0LL, std::numeric_limits<long long>::max ())
+          >>  filter ([first_batches] (long long v) { return v < first_batches || v % 10000000 == 0; })
+          >>  map ([&produced] (long long v) { ++produced; return v; })
+          >>  to_range
+          ;
+        // Reading into the second batch leaves the producer filling the third
+        auto iter = range.begin ();
+        std::advance (iter, detail::range_batch_size);
+        CPP_STREAMS__EQUAL (first_batches / 2, *iter);
+      }
+      CPP_STREAMS__EQUAL (true, produced <= first_batches + 1);
+    }
+
+    {
+      auto range  = from (some_ints) >> map ([] (int v) { return std::make_unique<int> (v); }) >> to_range;
+      auto iter   = range.begin ();
+      std::unique_ptr<int> first = std::move (*iter++);
+      CPP_STREAMS__EQUAL (3, *first);
+      CPP_STREAMS__EQUAL (1, **iter);
     }
 
+    {
+      bool expected = true;
+      bool actual   = false;
+      try
+      {
+        auto range = from (some_ints) >> map ([] (int v) { if (v == 9) throw std::invalid_argument ("v"); return v; }) >> to_range;
+        for (int v : range)
+        {
+          CPP_STREAMS__EQUAL (true, v != 9);
+        }
+      }
+      catch (std::invalid_argument const &)
+      {
+        actual = true;
+      }
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
   }
 
-  void test__take_while ()
+  void test__from_unfold ()
   {
     CPP_STREAMS__TEST ();
 
     using namespace cpp_streams;
 
+    using fibonacci = std::tuple<int, int>;
+
+    auto next_fibonacci = [] (fibonacci & state)
     {
-      std::vector<int>  expected = {};
-      std::vector<int>  actual   =
-            from (some_ints)
-        >>  take_while ([] (auto &&) { return false; })
+      state = std::make_tuple (std::get<1> (state), std::get<0> (state) + std::get<1> (state));
+      return std::get<0> (state) < 100;
+    };
+
+    {
+      std::vector<int> expected {1, 1, 2, 3, 5, 8, 13, 21, 34, 55, 89};
+      std::vector<int> actual =
+            from_unfold (std::make_tuple (0, 1), next_fibonacci)
+        >>  map ([] (fibonacci const & state) { return std::get<0> (state); })
         >>  to_vector
         ;
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
     {
-      std::vector<int>  expected {};
-      std::vector<int>  actual   =
-            from (empty_ints)
-        >>  take_while (map_false)
-        >>  to_vector
-        ;
+      // Each run starts over from the initial state
+      auto source = from_unfold (0, [] (int & s) { return ++s <= 3; });
+
+      std::vector<int> expected {1, 2, 3};
+      std::vector<int> first  = source >> to_vector;
+      std::vector<int> second = source >> to_vector;
+      CPP_STREAMS__EQUAL (expected, first);
+      CPP_STREAMS__EQUAL (expected, second);
+    }
+
+    {
+      std::size_t expected  = 0;
+      std::size_t actual    = from_unfold (0, [] (int &) { return false; }) >> to_length;
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
     {
-      std::vector<user> expected = some_users;
-      std::vector<user> actual   =
-            from (some_users)
-        >>  take_while (map_true)
-        >>  to_vector
-        ;
+      // Unbounded
+      int expected  = 55;
+      int actual    = from_unfold (0, [] (int & s) { ++s; return true; }) >> take (10) >> to_sum;
       CPP_STREAMS__EQUAL (expected, actual);
     }
 
     {
-      std::vector<int>  expected = {3,1,4,1};
-      std::vector<int>  actual   =
-            from (some_ints)
-        >>  take_while ([] (auto && v) { return v < 5; })
-        >>  to_vector
-        ;
+      // The values are separate from the state, here pages of a paginated
+      //  API where the state is the cursor and the value a page
+      struct cursor
+      {
+        int                       next  ;
+        std::vector<std::string>  page  ;
+      };
+
+      auto next_page = [] (cursor & c) -> std::vector<std::string> const *
+      {
+        if (c.next >= 3)
+        {
+          return nullptr;
+        }
+
+        c.page.clear ();
+        for (auto iter = 0; iter < 2; ++iter)
+        {
+          c.page.push_back (std::to_string (c.next * 2 + iter));
+        }
+        ++c.next;
+        return &c.page;
+      };
+
+      auto source = from_unfold (cursor {0, {}}, next_page);
+
+      std::vector<std::size_t> expected_sizes {2, 2, 2};
+      std::vector<std::size_t> actual_sizes   = source >> map ([] (std::vector<std::string> const & p) { return p.size (); }) >> to_vector;
+      CPP_STREAMS__EQUAL (expected_sizes, actual_sizes);
+
+      std::string expected  = "012345";
+      std::string actual    = source >> to_fold (std::string (), [] (std::string s, std::vector<std::string> const & p) { return s + p[0] + p[1]; });
       CPP_STREAMS__EQUAL (expected, actual);
+
+      std::size_t empty     = from_unfold (cursor {3, {}}, next_page) >> to_length;
+      CPP_STREAMS__EQUAL (0_sz, empty);
     }
 
+#ifdef __cpp_lib_optional
+    {
+      // The value is moved out of the optional
+      auto source = from_unfold (0, [] (int & s) -> std::optional<std::unique_ptr<int>>
+        {
+          if (++s > 3)
+          {
+            return std::nullopt;
+          }
+          return std::make_unique<int> (s * 10);
+        });
+
+      std::vector<int> expected {10, 20, 30};
+      std::vector<int> actual   = source >> map ([] (std::unique_ptr<int> && p) { return *p; }) >> to_vector;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
+#endif
   }
 
-  void test__example ()
+  void test__from_generator ()
   {
     CPP_STREAMS__TEST ();
 
-    // Smoke tests the example on the homepage
-
+#ifdef __cpp_impl_coroutine
     using namespace cpp_streams;
 
-    std::vector<int> ints {3,1,4,1,5,9,2,6,5,4};
+    {
+      std::vector<int> expected {1, 2, 3, 4, 5};
+      std::vector<int> actual = from_generator (count_to (5)) >> to_vector;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
 
-    // Produce a sum of even ints (+1)
-    auto sum =
-          from (ints)
-      >>  filter ([] (auto && v) {return v % 2 == 0;})  // Keep only even numbers
-      >>  map ([] (auto && v) {return v + 1;})          // +1
-      >>  to_sum                                        // Compute sum
-      ;
+    {
+      int expected  = 6;
+      int actual    = from_generator (count_to (1000000)) >> take (3) >> to_sum;
+      CPP_STREAMS__EQUAL (expected, actual);
+    }
 
-    std::cout << "SUM: " << sum << std::endl;
+    {
+      // A generator runs once
+      auto source = from_generator (count_to (3));
+
+      std::size_t first   = source >> to_length;
+      std::size_t second  = source >> to_length;
+      CPP_STREAMS__EQUAL (std::size_t (3), first);
+      CPP_STREAMS__EQUAL (std::size_t (0), second);
+    }
+
+    {
+      monotonic_arena arena;
+
+      int expected  = 10;
+      int actual    = from_generator (count_to (std::allocator_arg, arena_allocator<char> (arena), 4)) >> to_sum;
+      CPP_STREAMS__EQUAL (expected, actual);
+      CPP_STREAMS__EQUAL (true, arena.allocated_bytes () > 0);
+    }
+
+    {
+      std::vector<std::string> expected {"first"};
+      std::vector<std::string> actual;
+
+      bool thrown = false;
+      try
+      {
+        from_generator (throw_after_first ()) >> to_iter ([&actual] (std::string const & v) { actual.push_back (v); return true; });
+      }
+      catch (std::invalid_argument const &)
+      {
+        thrown = true;
+      }
+      CPP_STREAMS__EQUAL (expected, actual);
+      CPP_STREAMS__EQUAL (true, thrown);
+    }
+#endif
   }
 
   void test__mutating_source ()
@@ -1600,12 +3713,17 @@ namespace functional_tests
     test__from_repeat         ();
     test__from_singleton      ();
     test__from_empty          ();
+    test__from_lines          ();
+    test__from_csv            ();
+    test__from_file_blocks    ();
+    test__from_columnar_file  ();
 
     test__append              ();
     test__collect             ();
     test__filter              ();
     test__map                 ();
     test__mapi                ();
+    test__probe               ();
     test__reverse             ();
     test__skip                ();
     test__skip_while          ();
@@ -1625,9 +3743,25 @@ namespace functional_tests
     test__to_set              ();
     test__to_sum              ();
     test__to_vector           ();
+    test__to_vector_into      ();
+    test__using_allocator     ();
     test__to_iter             ();
+    test__to_file             ();
+    test__to_ostream          ();
     test__to_fold             ();
 
+    test__move_only           ();
+    test__copies              ();
+    test__from_rvalue         ();
+    test__functor_copies      ();
+    test__any_source          ();
+    test__fusion              ();
+    test__explain             ();
+    test__constexpr           ();
+    test__to_range            ();
+    test__from_unfold         ();
+    test__from_generator      ();
+    test__trace               ();
     test__mutating_source     ();
 
     // test__example             ();
@@ -1652,96 +3786,6 @@ namespace functional_tests
     }
   }
 
-  template<typename TPredicate>
-  auto time_it (std::size_t count, TPredicate && predicate)
-  {
-    auto then = std::chrono::high_resolution_clock::now ();
-
-    for (auto iter = 0U; iter < count; ++iter)
-    {
-      predicate ();
-    }
-
-    auto now = std::chrono::high_resolution_clock::now ();
-
-    auto diff = now - then;
-
-    return std::chrono::duration_cast<std::chrono::milliseconds> (diff);
-  }
-
-  auto create_vector (int inner)
-  {
-    std::vector<int> ints;
-    ints.reserve (inner);
-
-    for (auto iter = 0; iter < inner; ++iter)
-    {
-      ints.push_back (iter);
-    }
-
-    return ints;
-  }
-
-  void performance__simple_pipe_line (int outer, int inner)
-  {
-    CPP_STREAMS__TEST ();
-
-    using namespace cpp_streams;
-
-    auto ints = create_vector (inner);
-
-    {
-      auto cs_func = [] (auto && vs)
-      {
-        return
-              from (vs)
-          >>  filter ([] (auto && v) {return v % 2 == 0;})
-          >>  map ([] (auto && v) {return v + 1;})
-          >>  to_sum
-          ;
-      };
-
-      std::cout << "cs_sum: " << cs_func (ints) << std::endl;
-
-      auto cs_time = time_it (outer, [&] () { cs_func (ints); });
-
-      std::cout << "cs_time: " << cs_time.count () << " ms" << std::endl;
-    }
-
-    {
-      auto classic_func = [] (auto && vs)
-      {
-        auto sum = 0;
-
-        for (auto && v : vs)
-        {
-          if (v % 2 == 0)
-          {
-            sum += (v + 1);
-          }
-        }
-
-        return sum;
-      };
-
-      std::cout << "classic_sum: " << classic_func (ints) << std::endl;
-
-      auto classic_time = time_it (outer, [&] () { classic_func (ints); });
-
-      std::cout << "classic_time: " << classic_time.count () << " ms" << std::endl;
-    }
-  }
-
-  void run_performance_tests ()
-  {
-    std::cout
-      << "Running performance tests..."
-      << std::endl
-      ;
-
-    performance__simple_pipe_line     (100000, 10000);
-  }
-
 }
 // ----------------------------------------------------------------------------
 #endif // CPP_STREAMS__FUNCTIONAL_TESTS__INCLUDE_GUARD